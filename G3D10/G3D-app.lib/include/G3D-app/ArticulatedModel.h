@@ -99,6 +99,27 @@ public:
 
     static void clearCache();
 
+    /** \brief Enables the persistent on-disk cache of loaded models, which is disabled by default.
+
+        After loading a cachable Specification, create() stores the
+        final parts, geometry, meshes, material specifications, and
+        animations in \a directory. Later loads of the same
+        Specification, in this process or another, read that file
+        instead of parsing the source and rerunning preprocess and
+        cleanGeometry(). Entries are keyed by the contents of the
+        source file and by the Specification, and an entry is ignored
+        if the source or an OBJ material library has changed since it
+        was written. Other files that the source references, such as
+        glTF buffers, are not tracked.
+
+        Models with materials that were created from Texture objects
+        instead of a UniversalMaterial::Specification are never stored.
+
+        Set before loading begins. The empty string disables the cache. */
+    static void setPersistentCacheDirectory(const String& directory);
+
+    static String persistentCacheDirectory();
+
     /** Parameters for cleanGeometry(). Note that HAIR format models are never cleaned on load, as an optimization, because 
         they are always generated cleanly. */
     class CleanGeometrySettings {
@@ -646,7 +667,20 @@ Example:
             /** Index of a Face in a temporary array*/
             typedef int                         Index;
             typedef SmallArray<Index, 7>        IndexArray;
-            typedef Table<Point3, IndexArray>   AdjacentFaceTable;
+
+            /** The faces adjacent to each position. Corner 3 * f + v is vertex v of face f. 
+                Corners with identical positions form a group, listed in increasing order. */
+            class AdjacentFaceTable {
+            public:
+                /** Corners sorted by group */
+                Array<int>                      cornerArray;
+
+                /** The group of each corner */
+                Array<int>                      groupOfCorner;
+
+                /** The corners of group g are cornerArray[groupStart[g]] through cornerArray[groupStart[g + 1] - 1] */
+                Array<int>                      groupStart;
+            };
 
             Vertex                              vertex[3];
 
@@ -1227,6 +1261,17 @@ protected:
 
     static shared_ptr<ArticulatedModel> loadArticulatedModel(const Specification& specification, const String& n);
 
+    /** Name of the persistent cache entry for \a specification, or the empty string
+        if the cache is disabled or the source file cannot be read */
+    static String persistentCacheFilename(const Specification& specification);
+
+    /** Called from load(). Returns false, leaving this model empty, if
+        \a filename does not exist or is out of date. */
+    bool loadFromPersistentCache(const String& filename);
+
+    /** Called from load(). Does nothing if the model cannot be stored. */
+    void saveToPersistentCache(const String& filename) const;
+
     
     /** \brief Execute the program.  Called from load() */
     void preprocess(const Array<Instruction>& program);
@@ -1373,6 +1418,16 @@ public:
     */
     static shared_ptr<ArticulatedModel> create(const Specification& s, const String& name = "");
 
+    /** True if create() may be invoked for \a specification on a thread other than
+        the OpenGL thread. False for the importers (e.g., BSP and ASSIMP formats) that
+        create OpenGL resources while loading.
+
+        create() itself is threadsafe, and concurrent calls for the same
+        Specification load the model only once.
+
+        \sa Scene::LoadOptions::concurrentModelLoading */
+    static bool canLoadConcurrently(const Specification& specification);
+
     /** \copydoc create */
     static lazy_ptr<Model> lazyCreate(const Specification& s, const String& name = "");
 
@@ -88,6 +88,8 @@ public:
             a table of texture and settings */
         Specification(const Any& any);
 
+        Any toAny() const;
+
         bool operator==(const Specification& other) const;
 
         bool operator!=(const Specification& other) const {
@@ -16,6 +16,7 @@
 #include "G3D-app/TriTree.h"
 #include "G3D-app/TriTreeBase.h"
 #include "G3D-app/NativeTriTree.h"
+#include "G3D-app/InstancedTriTree.h"
 #include "G3D-app/EmbreeTriTree.h"
 #include "G3D-app/OptiXTriTree.h"
 #include "G3D-app/VulkanTriTree.h"
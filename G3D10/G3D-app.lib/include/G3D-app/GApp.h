@@ -12,6 +12,8 @@
 
 #include "G3D-base/platform.h"
 #include "G3D-base/Stopwatch.h"
+#include "G3D-base/TaskGraph.h"
+#include "G3D-base/FrameArenaMemoryManager.h"
 #include "G3D-base/G3DString.h"
 #include "G3D-base/CoordinateFrame.h"
 #include "G3D-base/NetworkDevice.h"
@@ -82,6 +84,11 @@ class XRWidget;
  onWait runs before onGraphics because the beginning of onGraphics causes the CPU to block, waiting for the GPU
  to complete the previous frame.
 
+ When setFrameTaskGraphEnabled(true) is set, the phases are scheduled through a TaskGraph:
+ the application's onNetwork and onAI run on the TBB worker pool concurrently with onSimulation,
+ and applications may add their own jobs and dependencies in GApp::onBuildFrameTaskGraph.
+ See GApp::FramePhaseTasks.
+
  When you override a method, invoke the GApp version of that method to ensure that Widget%s still work
  properly.  This allows you to control whether your per-app operations occur before or after the Widget ones.
 
@@ -473,6 +480,20 @@ protected:
     Stopwatch                       m_simulationWatch;
     Stopwatch                       m_waitWatch;
 
+    /** \copydoc setFrameTaskGraphEnabled */
+    bool                            m_frameTaskGraphEnabled;
+
+    /** Rebuilt for every simulation step by oneFrame() when m_frameTaskGraphEnabled is true */
+    TaskGraph                       m_frameTaskGraph;
+
+    /** True while m_frameTaskGraph runs. The WidgetManager's onNetwork and onAI then run in
+        FramePhaseTasks::widgets on the main thread, so GApp::onNetwork() and GApp::onAI()
+        do nothing when invoked from application overrides on worker threads. */
+    bool                            m_frameTaskGraphRunning;
+
+    /** \copydoc frameArena */
+    shared_ptr<FrameArenaMemoryManager> m_frameArena;
+
     /** The original settings */
     Settings                        m_settings;
 
@@ -1025,8 +1046,40 @@ protected:
 
     virtual void sampleGazeTrackerData();
 
+    /** Runs one simulation step of oneFrame() through m_frameTaskGraph.
+        Also poses if \a pose is true. */
+    void runFrameTaskGraph(RealTime timeStep, bool pose);
+
+    /** Helpers for oneFrame() that are shared by the sequential and task graph paths.
+        Each performs its own Stopwatch and Profiler timing. */
+    void simulateOneStep(RealTime timeStep);
+    void poseOneFrame();
+
 public:
 
+    /** TaskIDs of the built-in phases within the TaskGraph passed to
+        onBuildFrameTaskGraph(). The default dependencies are:
+
+        - userInput, widgets, and simulation run in that order on the main thread
+        - widgets runs the WidgetManager's onNetwork and onAI, which are not threadsafe
+        - network (GApp::onNetwork) runs on any thread after widgets
+        - ai (GApp::onAI) runs on any thread after network, concurrently with simulation
+        - pose runs on the main thread after simulation, network, ai, and all tasks
+          added by the application
+
+        Phases that do not occur in this step are -1. pose only occurs in the
+        last simulation step of each m_renderPeriod.
+     */
+    class FramePhaseTasks {
+    public:
+        TaskGraph::TaskID   userInput   = -1;
+        TaskGraph::TaskID   widgets     = -1;
+        TaskGraph::TaskID   network     = -1;
+        TaskGraph::TaskID   ai          = -1;
+        TaskGraph::TaskID   simulation  = -1;
+        TaskGraph::TaskID   pose        = -1;
+    };
+
     /**
        Installs a module.  Actual insertion may be delayed until the next frame.
     */
@@ -1149,6 +1202,28 @@ public:
         return m_lowerFrameRateInBackground;
     }
 
+    /** If true, oneFrame() schedules the per-frame phases through a TaskGraph
+        instead of invoking them one after another. onNetwork() and onAI() then run on
+        worker threads concurrently with onSimulation(), so enable this only if their
+        overrides are threadsafe with respect to simulation, and further jobs may be
+        added in onBuildFrameTaskGraph(). See FramePhaseTasks for the dependencies.
+
+        Default is false. \sa onBuildFrameTaskGraph */
+    virtual void setFrameTaskGraphEnabled(bool e) {
+        m_frameTaskGraphEnabled = e;
+    }
+
+    bool frameTaskGraphEnabled() const {
+        return m_frameTaskGraphEnabled;
+    }
+
+    /** Allocator for transient data that is rebuilt every frame. Recycled at the top of
+        each oneFrame(); allocations remain valid through the following frame. While this
+        GApp is current, it is also FrameArenaMemoryManager::current(). */
+    const shared_ptr<FrameArenaMemoryManager>& frameArena() const {
+        return m_frameArena;
+    }
+
 protected:
 
     /** Change the size of the underlying Film. Called by GApp::GApp() and GApp::onEvent(). This is not an event handler.  If you want
@@ -1257,6 +1332,9 @@ protected:
     /**
        For a networked app, override this to implement your network
        message polling.
+
+       When frameTaskGraphEnabled(), this runs on a worker thread and the
+       WidgetManager's network processing has already run on the main thread.
     */
     virtual void onNetwork();
 
@@ -1280,9 +1358,23 @@ protected:
        Update any state you need to here.  This is a good place for
        AI code, for example.  Called after onNetwork and onUserInput,
        before onSimulation.
+
+       When frameTaskGraphEnabled(), this runs on a worker thread concurrently
+       with onSimulation, and the WidgetManager's AI has already run on the
+       main thread.
     */
     virtual void onAI();
 
+    /**
+       Invoked once per simulation step when frameTaskGraphEnabled() is true,
+       after the built-in phases have been added to \a graph. Add application
+       jobs with TaskGraph::add and order them relative to the phases with
+       TaskGraph::addDependency. Any tasks added here complete before onPose().
+
+       The default implementation does nothing.
+    */
+    virtual void onBuildFrameTaskGraph(TaskGraph& graph, const FramePhaseTasks& phase) {}
+
 
     /**
        It is recommended to override onUserInput() instead of this method.
@@ -0,0 +1,254 @@
+/**
+  \file G3D-app.lib/include/G3D-app/InstancedTriTree.h
+
+  G3D Innovation Engine http://casual-effects.com/g3d
+  Copyright 2000-2019, Morgan McGuire
+  All rights reserved
+  Available under the BSD License
+*/
+#pragma once
+
+#include <functional>
+#include "G3D-base/platform.h"
+#include "G3D-base/AABox.h"
+#include "G3D-base/CoordinateFrame.h"
+#include "G3D-base/FlatTable.h"
+#include "G3D-app/TriTreeBase.h"
+
+namespace G3D {
+
+class Model;
+class UniversalSurface;
+
+/**
+ \brief Two-level TriTree for scenes of rigidly moving Entitys.
+
+ Each distinct piece of UniversalSurface geometry (CPU vertex array,
+ index array, and material) is built once, in object space, into a
+ bottom-level TriTree that is cached across calls to setContents().
+ A small top-level BVH over the posed instances of that geometry is
+ all that has to be updated when Entitys move: it is refit in place,
+ and only rebuilt when refitting has degraded it or the set of
+ instances changed.
+
+ triArray() and vertexArray() still expose the flattened, world-space
+ scene so that sample() and the Surfel overloads of intersectRays()
+ work unmodified. Moving an instance re-transforms only that instance's
+ vertices.
+
+ Surfaces that are not UniversalSurfaces are flattened into one
+ world-space bottom-level tree that is rebuilt only when one of them
+ reports a change.
+
+ Scene::tritree() wraps the CPU TriTree implementations in this class.
+
+ \sa TriTree::create, NativeTriTree, OptiXTriTree
+*/
+class InstancedTriTree : public TriTreeBase {
+public:
+    using TriTree::intersectRay;
+    using TriTree::intersectRays;
+
+    /** Creates an empty bottom-level tree */
+    typedef std::function<shared_ptr<TriTree>()> BottomLevelFactory;
+
+    class Stats {
+    public:
+        /** Posed instances in the top-level tree */
+        int             numInstances = 0;
+
+        /** Cached bottom-level trees */
+        int             numGeometries = 0;
+
+        /** Nodes in the top-level tree */
+        int             numTopLevelNodes = 0;
+
+        /** Bottom-level trees built since creation */
+        int             numBottomLevelBuilds = 0;
+
+        /** Calls to setContents() that only refit the top level */
+        int             numRefits = 0;
+
+        /** Calls to setContents() that rebuilt the top level */
+        int             numRebuilds = 0;
+    };
+
+protected:
+
+    /** Identifies the object-space geometry of a UniversalSurface */
+    class GeometryKey {
+    public:
+        const CPUVertexArray*           vertexArray = nullptr;
+        const Array<int>*               index       = nullptr;
+        const Material*                 material    = nullptr;
+        bool                            twoSided    = false;
+
+        static size_t hashCode(const GeometryKey& key) {
+            return HashTrait<const void*>::hashCode(key.vertexArray) ^
+                (HashTrait<const void*>::hashCode(key.index) * 31) ^
+                (HashTrait<const void*>::hashCode(key.material) * 131) ^
+                size_t(key.twoSided);
+        }
+
+        static bool equals(const GeometryKey& a, const GeometryKey& b) {
+            return (a.vertexArray == b.vertexArray) && (a.index == b.index) &&
+                (a.material == b.material) && (a.twoSided == b.twoSided);
+        }
+    };
+
+    /** An object-space bottom-level tree */
+    class Geometry {
+    public:
+        shared_ptr<TriTree>             tree;
+
+        /** Object-space bounds of tree->vertexArray() */
+        AABox                           bounds;
+
+        /** The cached key pointers are only valid while this is alive */
+        weak_ptr<Model>                 model;
+
+        /** Set when used by the current call to setContents(), for garbage collection */
+        bool                            live = false;
+    };
+
+    class Instance {
+    public:
+        shared_ptr<Geometry>            geometry;
+
+        /** Assigned as the Tri::data() of this instance's triangles in m_triArray */
+        shared_ptr<Surface>             surface;
+
+        /** UniversalSurface::rigidBodyID, or 0 for the flattened non-UniversalSurfaces */
+        uint64                          id = 0;
+
+        /** Object to world */
+        CFrame                          frame;
+
+        /** World-space bounds */
+        AABox                           bounds;
+
+        /** Offset of this instance's triangles in m_triArray */
+        int                             firstTri = 0;
+
+        /** Offset of this instance's vertices in m_vertexArray */
+        int                             firstVertex = 0;
+    };
+
+    /** Top-level BVH node, stored in depth-first order so that the first child
+        of an internal node immediately follows it and refitting can proceed
+        from the back of the array. */
+    class Node {
+    public:
+        AABox                           bounds;
+
+        /** Internal: index of the second child. Leaf: first index into m_leafInstance. */
+        int                             index = 0;
+
+        /** Number of instances for a leaf, 0 for an internal node */
+        int                             count = 0;
+
+        bool isLeaf() const {
+            return count > 0;
+        }
+    };
+
+    enum { MAX_INSTANCES_PER_LEAF = 2 };
+
+    /** Rebuild instead of refit once the total top-level node area grows by this factor */
+    static constexpr float REBUILD_AREA_RATIO = 2.0f;
+
+    BottomLevelFactory                  m_createBottomLevel;
+
+    FlatTable<GeometryKey, shared_ptr<Geometry>, GeometryKey, GeometryKey> m_geometryCache;
+
+    /** World-space tree of the non-UniversalSurfaces, if any. Not in m_geometryCache. */
+    shared_ptr<Geometry>                m_looseGeometry;
+
+    /** Surfaces that m_looseGeometry was built from */
+    Array<shared_ptr<Surface>>          m_looseSurfaceArray;
+
+    /** In the order of their triangles in m_triArray */
+    Array<Instance>                     m_instance;
+
+    Array<Node>                         m_node;
+
+    /** Indices into m_instance, grouped by leaf */
+    Array<int>                          m_leafInstance;
+
+    /** Sum of the areas of m_node when the top level was last built */
+    float                               m_builtArea = 0.0f;
+
+    Stats                               m_stats;
+
+    InstancedTriTree(const BottomLevelFactory& createBottomLevel);
+
+    /** Returns the cached bottom-level tree for the surface, building it if needed */
+    shared_ptr<Geometry> geometry(const shared_ptr<UniversalSurface>& surface, ImageStorage newStorage);
+
+    shared_ptr<Geometry> createLooseGeometry(const Array<shared_ptr<Surface>>& surfaceArray, ImageStorage newStorage);
+
+    /** Rewrite m_triArray and m_vertexArray from m_instance */
+    void flatten();
+
+    /** Re-transform the world-space vertices and bounds of instance \a i */
+    void updateInstance(int i);
+
+    void buildTopLevel();
+
+    int buildTopLevel(int begin, int end);
+
+    /** Recompute node bounds bottom-up. Returns the total node area. */
+    float refitTopLevel();
+
+    /** Invokes \a visit(instanceIndex) for every instance whose bounds overlap \a box */
+    void forEachInstance(const AABox& box, const std::function<void(int)>& visit) const;
+
+public:
+
+    /** \param createBottomLevel Creates the per-geometry trees. Defaults to TriTree::create(false),
+        i.e., the fastest CPU implementation. */
+    static shared_ptr<InstancedTriTree> create(const BottomLevelFactory& createBottomLevel = nullptr);
+
+    virtual const String& className() const override { static const String n = "InstancedTriTree"; return n; }
+
+    Stats stats() const {
+        Stats s = m_stats;
+        s.numInstances     = m_instance.size();
+        s.numGeometries    = int(m_geometryCache.size());
+        s.numTopLevelNodes = m_node.size();
+        return s;
+    }
+
+    /** Also discards the cached bottom-level trees */
+    virtual void clear() override;
+
+    /** Treats m_triArray and m_vertexArray as a single world-space instance */
+    virtual void rebuild() override;
+
+    /** Reuses cached bottom-level trees and refits the top level when only
+        the CFrames of the surfaces have changed since the previous call. */
+    virtual void setContents
+        (const Array<shared_ptr<Surface>>&  surfaceArray,
+         ImageStorage                       newStorage = ImageStorage::COPY_TO_CPU) override;
+
+    using TriTreeBase::setContents;
+
+    virtual bool intersectRay
+        (const Ray&                         ray,
+         Hit&                               hit,
+         IntersectRayOptions                options         = IntersectRayOptions(0)) const override;
+
+    using TriTreeBase::intersectBox;
+    using TriTreeBase::intersectSphere;
+
+    /** Queries the bottom-level tree of each instance whose bounds overlap \a box */
+    virtual void intersectBox
+        (const AABox&                       box,
+         Array<int>&                        triIndex) const override;
+
+    virtual void intersectSphere
+        (const Sphere&                      sphere,
+         Array<int>&                        triIndex) const override;
+};
+
+} // G3D
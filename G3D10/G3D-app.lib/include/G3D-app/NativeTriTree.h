@@ -16,6 +16,8 @@
 #include "G3D-base/SmallArray.h"
 #include "G3D-base/Triangle.h"
 #include "G3D-base/PrecomputedRay.h"
+#include "G3D-base/Crypto.h"
+#include "G3D-base/MemoryMappedFile.h"
 #include "G3D-app/TriTreeBase.h"
 #include "G3D-app/Component.h"
 
@@ -69,7 +71,39 @@ public:
             Theory indicates that this gives the highest performance
             for ray intersection, although that may not be the case
             for specific scenes and rays.*/
-        SAH};
+        SAH,
+
+        /** Approximates SAH by only considering Settings::numBins
+            evenly spaced planes per node. Each node costs \f$O(n)\f$ to
+            split, and large nodes are binned and partitioned in
+            parallel. Recommended for scenes with millions of
+            triangles. */
+        BINNED_SAH};
+
+    /** Node format that rebuild() produces and that the intersection methods traverse */
+    enum Layout {
+        /** Binary bounding interval hierarchy whose internal nodes may
+            also hold triangles that span the splitting plane. Builds
+            quickly, and supports draw(). */
+        BIH,
+
+        /** Flattened bounding volume hierarchy with four children per
+            node. Each step of a ray traversal tests all four child boxes
+            with one SSE instruction, and leaf triangles are tested four
+            at a time. */
+        BVH4,
+
+        /** As BVH4, with eight children per node. Produces a shallower
+            tree; better for large scenes with incoherent rays. */
+        BVH8,
+
+        /** The BVH8 tree stored in a fraction of the memory, for scenes
+            whose tree would not otherwise fit. Child bounds are quantized
+            to 8 bits relative to their parent, and leaves hold 16-byte
+            triangle records that refer to the CPUVertexArray. Finds the
+            same hits as BVH8 more slowly, and always traces rays
+            individually. \sa CompressedBVH, Stats::bytesPerTri */
+        COMPRESSED_BVH8};
 
     class Settings {
     public:
@@ -109,11 +143,33 @@ public:
             the fast method.*/
         int                accurateSAHCountThreshold;
 
+        /** The BVH layouts always split with a binned SAH, and ignore
+            algorithm, maxAreaFraction, and accurateSAHCountThreshold. */
+        Layout             layout;
+
+        /** Number of candidate splitting planes per node for BINNED_SAH
+            and the BVH layouts. Clamped to [2, 64]. */
+        int                numBins;
+
+        /** Maximum number of threads that rebuild() uses. 0 uses every
+            TBB worker thread; 1 builds serially on the calling thread. */
+        int                numThreads;
+
+        /** If not empty, rebuild() first tries to load a BVH layout from
+            the file named by contentHash() in this directory, and saves
+            the tree there after building it. Processes that share the
+            directory then share one copy of each tree in memory.
+            Ignored for the BIH layout. \sa NativeTriTree::load */
+        String             cacheDirectory;
+
         inline Settings() : 
             algorithm(MEAN_EXTENT), 
             maxAreaFraction(1.0f / 11.0f), 
             valuesPerLeaf(4),
-            accurateSAHCountThreshold(125) {}
+            accurateSAHCountThreshold(125),
+            layout(BIH),
+            numBins(32),
+            numThreads(0) {}
     };
 
     static const char* algorithmName(SplitAlgorithm s);
@@ -140,12 +196,56 @@ public:
         /** Max tris per node of any node */
         int largestNode;
 
+        /** Memory used by the nodes and by the triangle lists or records in their leaves */
+        size_t treeBytes;
+
+        /** Memory used by the Tri array and CPUVertexArray, which every layout also needs */
+        size_t sceneBytes;
+
+        /** treeBytes per input triangle */
+        float treeBytesPerTri;
+
+        /** (treeBytes + sceneBytes) per input triangle */
+        float bytesPerTri;
+
         Stats() : numLeaves(0), numTris(0), numNodes(0), shallowestLeaf(100000),
                   shallowestNodeOverMin(100000), averageValuesPerLeaf(0), 
-                  depth(0), largestNode(0) {}
+                  depth(0), largestNode(0), treeBytes(0), sceneBytes(0),
+                  treeBytesPerTri(0), bytesPerTri(0) {}
     };
 
 private:
+
+    enum {
+        /** Upper bound on Settings::numBins */
+        MAX_BINS = 64,
+
+        /** Subtrees over at least this many triangles are binned,
+            partitioned, and built with TBB tasks */
+        PARALLEL_BUILD_THRESHOLD = 16 * 1024,
+
+        /** Consecutive rays that intersectRays() groups for packet
+            traversal under COHERENT_RAY_HINT. A multiple of four. */
+        PACKET_SIZE = 16
+    };
+
+    /** Folds \a body over [begin, end) starting from \a identity, splitting
+        the range across TBB tasks if it is at least PARALLEL_BUILD_THRESHOLD
+        long and combining their results with \a join.
+
+        \param body <code>T body(int begin, int end, T accumulator)</code>
+        \param join <code>T join(const T& a, const T& b)</code> */
+    template<class T, class Body, class Join>
+    static T parallelReduce(int begin, int end, const T& identity, const Body& body, const Join& join) {
+        if (end - begin < PARALLEL_BUILD_THRESHOLD) {
+            return body(begin, end, identity);
+        } else {
+            return tbb::parallel_reduce(tbb::blocked_range<int>(begin, end, PARALLEL_BUILD_THRESHOLD / 4), identity,
+                [&body](const tbb::blocked_range<int>& r, const T& accumulator) { return body(r.begin(), r.end(), accumulator); },
+                join);
+        }
+    }
+
     /** A convex polygon formed by repeatedly clipping a Tri with axis-aligned planes */
     class Poly {
     private:
@@ -226,6 +326,7 @@ private:
          Array<Poly>&  highArray,
          Array<Poly>&  largeSpanArray) const;
 
+        /** Runs in parallel for large arrays */
         static AABox computeBounds(const Array<Poly>& array);
 
         inline void getBounds(AABox& b) const {
@@ -342,6 +443,8 @@ private:
 
         float chooseSAHSplitLocationFast(Array<Poly>& source, Vector3::Axis axis, const Settings& settings);
 
+        float chooseBinnedSAHSplitLocation(const Array<Poly>& source, Vector3::Axis axis, const Settings& settings);
+
         /** The SAHCost of tracing against just this array. */
         static float SAHCost(int size, float area, float containingArea);
 
@@ -350,11 +453,26 @@ private:
 
           Surface area heuristic: Trace time ~= boxIntersectTime +
           triIntersectTime * num * polyArea / boxArea
-                      
+
+          \param lowArray, highArray, spanArray Scratch space, so that
+          concurrent builds do not share state
         */
         static float SAHCost(Vector3::Axis axis, float offset,
                              const Array<Poly>& original, float containingArea, 
-                             const Settings& settings);
+                             const Settings& settings,
+                             Array<Poly>& lowArray, Array<Poly>& highArray, Array<Poly>& spanArray);
+
+        /** Invokes Poly::split on every element of \a original,
+            in parallel for large arrays. Output order is the same as
+            for a serial loop. */
+        static void partition
+           (const Array<Poly>&   original,
+            Vector3::Axis        axis,
+            float                offset,
+            float                minSpanArea,
+            Array<Poly>&         lowArray,
+            Array<Poly>&         highArray,
+            Array<Poly>&         spanArray);
 
         /** Called from intersect to determine which child the ray hits first.
 
@@ -408,6 +526,9 @@ private:
 
     public:
 
+        /** Builds the subtree for \a originals. Large subtrees build
+            their two children as concurrent TBB tasks if
+            mm->isThreadsafe(). */
         Node(Array<Poly>& originals, const Settings& settings, 
              const shared_ptr<MemoryManager>& mm);
 
@@ -417,14 +538,13 @@ private:
 
         void draw(RenderDevice* rd, const CPUVertexArray& vertexArray, int level, bool showBoxes, int minNodeSize) const;
 
-        /** Append all contained triangles that intersect this to triArray. Assumes that this node 
-            does intersect the box. 
+        /** Append the index relative to \a triBase of every contained triangle that intersects the box to triIndex. 
 
-            \param alreadyAdded Since nodes do not have unique ownership of triangles, this set is needed
-            to avoid adding duplicates to the triArray.
+            Nodes do not have unique ownership of triangles, so the same index may be appended
+            more than once. NativeTriTree::removeDuplicates() cleans up the result.
           */  
-        void intersectBox(const AABox& box, const CPUVertexArray& vertexArray, Array<Tri>& triArray, Set<Tri*>& alreadyAdded) const;
-        void intersectSphere(const Sphere& sphere, const CPUVertexArray& vertexArray, Array<Tri>& triArray, Set<Tri*>& alreadyAdded) const;
+        void intersectBox(const AABox& box, const CPUVertexArray& vertexArray, const Tri* triBase, Array<int>& triIndex) const;
+        void intersectSphere(const Sphere& sphere, const CPUVertexArray& vertexArray, const Tri* triBase, Array<int>& triIndex) const;
 
         void print(const String& indent) const;
 
@@ -438,11 +558,324 @@ private:
          IntersectRayOptions                options) const;
     };
 
+    /** \brief Flattened bounding volume hierarchy with \a N = 4 or 8 children per node,
+        used when Settings::layout is BVH4 or BVH8.
+
+        Each node stores the bounds of its children in structure-of-arrays
+        form, so one SSE comparison tests a ray against four of them.
+        Children that are leaves are not nodes; the parent refers directly
+        to a run of TriBlocks. Each block holds four triangles in the
+        precomputed form that the ray-triangle test consumes, so leaf
+        tests also run four at a time and never dereference the Tri or
+        CPUVertexArray until a candidate hit is found.
+
+        Unlike the BIH, every triangle appears in exactly one leaf. */
+    class CompressedBVH;
+
+    template<int N>
+    class WideBVH {
+        friend class CompressedBVH;
+        friend class NativeTriTree;
+    public:
+
+        class Node {
+        public:
+            float           lowX[N],  lowY[N],  lowZ[N];
+            float           highX[N], highY[N], highZ[N];
+
+            /** Index of the child Node, or of the child's first TriBlock
+                if numBlocks[i] > 0. Unused slots are -1 and have bounds at infinity. */
+            int32           child[N];
+
+            /** Number of TriBlocks in a leaf child. Zero for internal children. */
+            int32           numBlocks[N];
+        };
+
+        /** Four triangles, stored as the values that the Moller-Trumbore test needs */
+        class TriBlock {
+        public:
+            float           v0X[4], v0Y[4], v0Z[4];
+            float           e1X[4], e1Y[4], e1Z[4];
+            float           e2X[4], e2Y[4], e2Z[4];
+
+            /** Unnormalized face normal, e1 x e2 */
+            float           nX[4],  nY[4],  nZ[4];
+
+            /** A ray is backfacing if n.dot(direction) >= backfaceThreshold.
+                +inf for two-sided triangles. */
+            float           backfaceThreshold[4];
+
+            /** Index into m_triArray, or -1 for unused lanes */
+            int32           triIndex[4];
+        };
+
+    private:
+
+        /** Triangle reference used only during build() */
+        class BuildPrim {
+        public:
+            Point3          low;
+            Point3          high;
+            int             triIndex;
+
+            Point3 center() const {
+                return (low + high) * 0.5f;
+            }
+        };
+
+        /** Written by build() */
+        Array<Node>         m_nodeArray;
+        Array<TriBlock>     m_blockArray;
+
+        /** m_node[0] is the root. Points into m_nodeArray, or into m_file after NativeTriTree::load() */
+        const Node*         m_node;
+        const TriBlock*     m_block;
+        int                 m_numNodes;
+        int                 m_numBlocks;
+
+        /** Keeps the mapping alive while m_node and m_block point into it */
+        shared_ptr<MemoryMappedFile> m_file;
+
+        /** Depth of the deepest leaf, where the root's children are at 1 */
+        int                 m_depth;
+
+        /** Points m_node and m_block at the arrays and releases m_file */
+        void useArrays();
+
+        /** Reorders prim[begin:end] about a binned SAH plane, or about the
+            median if \a median is true, and returns the index of the first
+            element of the upper half */
+        int split(Array<BuildPrim>& prim, int begin, int end, bool median, int numBins) const;
+
+        /** Large subtrees are built concurrently into separate WideBVHs and then appended to this one.
+
+            \param valuesPerLeaf A multiple of four */
+        void buildNode(int nodeIndex, Array<BuildPrim>& prim, int begin, int end, int depth, int valuesPerLeaf, int numBins,
+                       const Array<Tri>& triArray, const CPUVertexArray& vertexArray);
+
+        /** Copies the nodes and blocks of \a subtree onto the end of this
+            tree and returns the new index of its root */
+        int append(const WideBVH& subtree);
+
+        /** Returns the index of the first block */
+        int buildLeaf(const Array<BuildPrim>& prim, int begin, int end,
+                      const Array<Tri>& triArray, const CPUVertexArray& vertexArray);
+
+        /** Scalar traversal of the subtree rooted at \a child, which is a
+            leaf if \a numBlocks > 0. Shrinks \a maxDistance on each hit. */
+        bool intersectSubtree
+           (int                             child,
+            int                             numBlocks,
+            const PrecomputedRay&           ray,
+            float&                          maxDistance,
+            Hit&                            hit,
+            IntersectRayOptions             options,
+            const Array<Tri>&               triArray,
+            const CPUVertexArray&           vertexArray) const;
+
+        bool intersectLeaf
+           (int                             firstBlock,
+            int                             numBlocks,
+            const PrecomputedRay&           ray,
+            float&                          maxDistance,
+            Hit&                            hit,
+            IntersectRayOptions             options,
+            const Array<Tri>&               triArray,
+            const CPUVertexArray&           vertexArray) const;
+
+        Triangle triangle(const TriBlock& block, int lane) const;
+
+    public:
+
+        WideBVH() : m_node(nullptr), m_block(nullptr), m_numNodes(0), m_numBlocks(0), m_depth(0) {}
+
+        void build(const Array<Tri>& triArray, const CPUVertexArray& vertexArray, const Settings& settings);
+
+        bool intersectRay
+           (const PrecomputedRay&           ray,
+            Hit&                            hit,
+            IntersectRayOptions             options,
+            const Array<Tri>&               triArray,
+            const CPUVertexArray&           vertexArray) const;
+
+        /** Traces ray[index[i]] into hit[index[i]] for i < count <= PACKET_SIZE
+            with a shared traversal stack, testing each child box against
+            four rays at a time. Rays that are alone in a subtree finish it
+            with the scalar traversal. Each hit must be initialized to Hit(). */
+        void intersectPacket
+           (const PrecomputedRay*           ray,
+            const int*                      index,
+            int                             count,
+            Hit*                            hit,
+            IntersectRayOptions             options,
+            const Array<Tri>&               triArray,
+            const CPUVertexArray&           vertexArray) const;
+
+        /** Appends the index of every triangle that intersects \a box */
+        void intersectBox(const AABox& box, Array<int>& triIndex) const;
+
+        void intersectSphere(const Sphere& sphere, Array<int>& triIndex) const;
+
+        void getStats(Stats& s, int valuesPerNode) const;
+    };
+
+    /** \brief Compact form of WideBVH<8>, used when Settings::layout is COMPRESSED_BVH8.
+
+        Each node stores its own bounds as the origin and power-of-two
+        spacing of a 255-cell grid along each axis, and the bounds of its
+        children as 8-bit grid coordinates rounded outward, so that the
+        decoded boxes always contain the originals. The internal children
+        of a node are consecutive Nodes and the triangles of its leaf
+        children are consecutive CompactTris, so a node needs only one
+        index for each. A node is 80 bytes instead of the 256 of a
+        WideBVH<8>::Node, and a triangle 16 bytes instead of the 56 of a
+        TriBlock lane.
+
+        Leaf triangles are expanded into a TriBlock on the stack during
+        traversal, so hits are the same as those of the WideBVH<8> that
+        build() converted.
+
+        @cite Ylitie, Karras, and Laine, Efficient Incoherent Ray Traversal on GPUs Through Compressed Wide BVHs, HPG 2017 */
+    class CompressedBVH {
+        friend class NativeTriTree;
+    public:
+        enum { N = 8 };
+
+        class Node {
+        public:
+            /** Low corner of the grid, which is the decoded bounds of this node in its parent */
+            float           originX, originY, originZ;
+
+            /** The grid spacing along each axis is 2^exponent */
+            int8            exponentX, exponentY, exponentZ;
+
+            /** Bit c is set if child c is an internal node */
+            uint8           internalMask;
+
+            /** Index of the Node of the first internal child */
+            int32           firstChild;
+
+            /** Index of the first CompactTri of the first leaf child */
+            int32           firstTri;
+
+            /** Number of CompactTris in each leaf child. Zero for internal and unused children. */
+            uint8           numTris[N];
+
+            uint8           lowX[N],  lowY[N],  lowZ[N];
+            uint8           highX[N], highY[N], highZ[N];
+        };
+
+        class CompactTri {
+        public:
+            enum { CULL_BACKFACE = 0x80000000u };
+
+            /** Indices into CPUVertexArray::vertex */
+            uint32          vertex[3];
+
+            /** Index into m_triArray in the low 31 bits, and CULL_BACKFACE
+                in the high bit for one-sided triangles */
+            uint32          triIndex;
+        };
+
+    private:
+
+        /** Written by build() */
+        Array<Node>         m_nodeArray;
+        Array<CompactTri>   m_compactTriArray;
+
+        /** m_node[0] is the root. Points into m_nodeArray, or into m_file after NativeTriTree::load() */
+        const Node*         m_node;
+        const CompactTri*   m_tri;
+        int                 m_numNodes;
+        int                 m_numTris;
+
+        /** Keeps the mapping alive while m_node and m_tri point into it */
+        shared_ptr<MemoryMappedFile> m_file;
+
+        /** Bounds of the root */
+        AABox               m_bounds;
+
+        int                 m_depth;
+
+        /** Points m_node and m_tri at the arrays and releases m_file */
+        void useArrays();
+
+        /** Encodes \a wideNode of \a bvh into m_node[nodeIndex], whose decoded bounds are \a bounds,
+            and then recursively encodes its internal children */
+        void encode(const WideBVH<N>& bvh, int wideNode, int nodeIndex, const AABox& bounds, const Array<Tri>& triArray);
+
+        /** Bounds of the children of \a node, with unused slots at infinity */
+        static void decode(const Node& node, float lowX[N], float lowY[N], float lowZ[N], float highX[N], float highY[N], float highZ[N]);
+
+        Triangle triangle(const CompactTri& tri, const CPUVertexArray& vertexArray) const;
+
+        /** \param first Index of the first CompactTri */
+        bool intersectLeaf
+           (int                             first,
+            int                             numTris,
+            const PrecomputedRay&           ray,
+            float&                          maxDistance,
+            Hit&                            hit,
+            IntersectRayOptions             options,
+            const Array<Tri>&               triArray,
+            const CPUVertexArray&           vertexArray) const;
+
+    public:
+
+        CompressedBVH() : m_node(nullptr), m_tri(nullptr), m_numNodes(0), m_numTris(0), m_depth(0) {}
+
+        /** Converts \a bvh, which is no longer needed afterward. Its leaves must have at most 255 triangles. */
+        void build(const WideBVH<N>& bvh, const Array<Tri>& triArray);
+
+        bool intersectRay
+           (const PrecomputedRay&           ray,
+            Hit&                            hit,
+            IntersectRayOptions             options,
+            const Array<Tri>&               triArray,
+            const CPUVertexArray&           vertexArray) const;
+
+        /** Appends the index of every triangle that intersects \a box */
+        void intersectBox(const AABox& box, const CPUVertexArray& vertexArray, Array<int>& triIndex) const;
+
+        void intersectSphere(const Sphere& sphere, const CPUVertexArray& vertexArray, Array<int>& triIndex) const;
+
+        void getStats(Stats& s, int valuesPerNode) const;
+    };
+
+    Settings                    m_settings;
+
     /** Memory manager used to allocate Nodes and Tri arrays. */
     shared_ptr<MemoryManager>   m_memoryManager;
 
-    /** Allocated with m_memoryManager */
+    /** Allocated with m_memoryManager. nullptr unless m_settings.layout == BIH */
     Node*                m_root;
+
+    /** nullptr unless m_settings.layout == BVH4 */
+    shared_ptr<WideBVH<4>>      m_bvh4;
+
+    /** nullptr unless m_settings.layout == BVH8 */
+    shared_ptr<WideBVH<8>>      m_bvh8;
+
+    /** nullptr unless m_settings.layout == COMPRESSED_BVH8 */
+    shared_ptr<CompressedBVH>   m_compressedBVH8;
+
+    /** Packet traversal for intersectRays(). Requires m_bvh4 or m_bvh8. */
+    void intersectPackets(const PrecomputedRay* ray, int numRays, Hit* results, IntersectRayOptions options) const;
+
+    /** Traces ray[begin..end), at most PACKET_SIZE rays, as packets split by direction octant */
+    void intersectPacketTile(const PrecomputedRay* ray, int begin, int end, Hit* results, IntersectRayOptions options) const;
+
+    /** Sorts triIndex[start..] and removes repeated indices */
+    static void removeDuplicates(Array<int>& triIndex, int start);
+
+    /** Releases the tree of every layout */
+    void freeTree();
+
+    /** \param key contentHash(), which must be current */
+    bool save(const String& filename, const MD5Hash& key) const;
+
+    /** \param key contentHash(), which must be current */
+    bool load(const String& filename, const MD5Hash& key);
     
 public:
 
@@ -458,15 +891,58 @@ public:
 
     virtual void clear() override;
 
+    const Settings& settings() const {
+        return m_settings;
+    }
+
+    /** Takes effect at the next rebuild() or setContents() */
+    void setSettings(const Settings& s) {
+        m_settings = s;
+    }
+
     /** Walk the entire tree, computing statistics */
     Stats stats(int valuesPerNode) const;
         
+    using TriTreeBase::intersectSphere;
+    using TriTreeBase::intersectBox;
+
     virtual void intersectSphere
         (const Sphere&                      sphere,
-         Array<Tri>&                        triArray) const override;
+         Array<int>&                        triIndex) const override;
 
     virtual void rebuild() override;
 
+    /** Hash of the triangles, vertex positions, and the Settings that
+        affect the tree, computed in parallel. Two trees with the same
+        contentHash() build identical BVH layouts. */
+    MD5Hash contentHash() const;
+
+    /** \brief Writes the tree built by the last rebuild() to \a filename.
+
+        The file holds the nodes and leaf records exactly as they are laid
+        out in memory, so that load() can use them in place. It does not
+        contain the triangles or vertices, which the loading tree must
+        already have from setContents().
+
+        The file is written under a temporary name and then renamed, so
+        processes that have \a filename mapped are unaffected.
+
+        \return false for the BIH layout, which is not stored contiguously,
+        or if the file cannot be written. */
+    bool save(const String& filename) const;
+
+    /** \brief Replaces the tree with the one in a file written by save(),
+        instead of calling rebuild().
+
+        The nodes and leaf records are memory-mapped rather than read, so
+        loading costs little more than contentHash() and every process
+        that loads the same file shares its pages.
+
+        \return false, leaving the tree unchanged, if the file does not
+        exist or was saved with a different layout, format, or
+        contentHash(). */
+    bool load(const String& filename);
+
     virtual bool intersectRay
         (const Ray&                         ray, 
          Hit&                               hit,
@@ -474,18 +950,28 @@ public:
 
     virtual void intersectBox
         (const AABox&                       box,
-         Array<Tri>&                        results) const override;
+         Array<int>&                        triIndex) const override;
     
     virtual void intersectRays
        (const Array<Ray>&                   rays,
         Array<Hit>&                         results,
         IntersectRayOptions                 options         = IntersectRayOptions(0)) const override;
 
+    /** With COHERENT_RAY_HINT and a BVH layout, traces runs of
+        PACKET_SIZE consecutive rays as packets, split by direction
+        octant. Primary rays in scanline order are coherent within such
+        a run. Otherwise traces each ray independently. */
     void intersectRays
        (const Array<PrecomputedRay>&        rays,
         Array<Hit>&                         results,
         IntersectRayOptions                 options         = IntersectRayOptions(0)) const;
 
+    /** Uses packets under the same conditions as the other overloads */
+    virtual void intersectRays
+       (const Array<Ray>&                   rays,
+        HitBuffer&                          results,
+        IntersectRayOptions                 options         = IntersectRayOptions(0)) const override;
+
     shared_ptr<Surfel> intersectRay
        (const PrecomputedRay&               ray, 
         IntersectRayOptions                 options,
@@ -498,7 +984,7 @@ public:
          IntersectRayOptions                options         = IntersectRayOptions(0)) const;
 
     /** Render the tree for debugging and visualization purposes. 
-        Inefficent.
+        Inefficent. Only supported for the BIH layout.
 
         \param level Show the nodes at or above this level of the tree, where 0 = root
 
@@ -100,8 +100,15 @@ protected:
             Initialized based on the number of rays per pixel. */
         Array<Color3>                           modulation;
 
-        /** Surfels hit by primary and indirect rays (may be nullptr if each missed) */
-        Array<shared_ptr<Surfel>>               surfel;
+        /** Intersections of ray, reused on every bounce */
+        TriTree::HitBuffer                      hit;
+
+        /** Owns the Surfels, which are resampled in place on every bounce */
+        TriTree::SurfelPool                     surfelPool;
+
+        /** Surfels hit by primary and indirect rays (may be nullptr if each missed).
+            Owned by surfelPool and only valid until the next bounce. */
+        Array<const Surfel*>                    surfel;
 
         /** Scattered radiance due to the selected light (which may be an emissive surface), IF
             it is visible: (B_j * |w_j . n| * f) / p_j
@@ -213,7 +220,7 @@ protected:
         */
     void addEmissive
        (const Array<Ray>&                       rayFromEye,
-        const Array<shared_ptr<Surfel>>&        surfelBuffer, 
+        const Array<const Surfel*>&             surfelBuffer, 
         const Array<bool>&                      impulseRay,
         const Array<Color3>&                    modulationBuffer,
         Radiance3*                              outputBuffer,
@@ -223,7 +230,7 @@ protected:
 
     /** Choose what light surface to sample, storing the corresponding shadow ray and biradiance value */
     void computeDirectIllumination
-       (const Array<shared_ptr<Surfel>>&        surfelBuffer,
+       (const Array<const Surfel*>&             surfelBuffer,
         const Array<shared_ptr<Light>>&         lightArray,
         const Array<Ray>&                       rayBuffer,
         int                                     currentPathDepth,
@@ -242,7 +249,7 @@ protected:
         radianceImage using pixelCoordBuffer indices.
         */
     virtual void shade
-       (const Array<shared_ptr<Surfel>>&        surfelBuffer,
+       (const Array<const Surfel*>&             surfelBuffer,
         const Array<Ray>&                       rayFromEye,
         const Array<Ray>&                       rayFromLight,
         const Array<bool>&                      lightShadowedBuffer,
@@ -261,7 +268,7 @@ protected:
     const shared_ptr<Light>& importanceSampleLight
        (const Array<shared_ptr<Light>>&         lightArray,
         const Vector3&                          w_o,
-        const shared_ptr<Surfel>&               surfel,
+        const Surfel*                           surfel,
         int                                     sequenceIndex,
         int                                     rayIndex,
         int                                     raysPerPixel,
@@ -273,7 +280,7 @@ protected:
         the inverse probability density that the direction was taken. Those probabilities are computed across
         three color channels, so modulationBuffer can become "colored" by this. */
     virtual void scatterRays
-       (const Array<shared_ptr<Surfel>>&        surfelBuffer, 
+       (const Array<const Surfel*>&             surfelBuffer, 
         const Array<shared_ptr<Light>>&         indirectLightArray,
         int                                     currentPathDepth,
         int                                     rayIndex,
@@ -13,11 +13,13 @@
 #include "G3D-base/platform.h"
 #include "G3D-base/ReferenceCount.h"
 #include "G3D-base/Array.h"
+#include "G3D-base/FlatTable.h"
 #include "G3D-base/SmallArray.h"
 #include "G3D-base/lazy_ptr.h"
 #include "G3D-app/LightingEnvironment.h"
 #include "G3D-app/ArticulatedModel.h"
 #include "G3D-app/TriTree.h"
+#include <mutex>
 
 namespace G3D {
 
@@ -82,7 +84,21 @@ public:
         /** Remove VisibleEntitys for which canChange = false. Default = false */
         bool        stripDynamicVisibleEntitys;
 
-        LoadOptions() : stripStaticVisibleEntitys(false), stripDynamicVisibleEntitys(false) {}
+        /** Load the ArticulatedModels of the scene on worker threads before creating
+            any entities, instead of one at a time as the entities that use them are
+            created. OpenGL uploads of their textures are deferred to the calling
+            thread. Models that ArticulatedModel::canLoadConcurrently rejects, and all
+            other Model types, still load on the calling thread. Default = false
+
+            \sa ArticulatedModel::canLoadConcurrently */
+        bool        concurrentModelLoading;
+
+        /** If not null, called periodically on the calling thread while models load
+            concurrently. Arguments are a status message and the fraction (between 0 and 1)
+            of the models loaded. The callback may render, for example, a loading screen. */
+        std::function<void(const String&, float)> progressCallback;
+
+        LoadOptions() : stripStaticVisibleEntitys(false), stripDynamicVisibleEntitys(false), concurrentModelLoading(false) {}
     };
 
     /** \sa registerEntityType */
@@ -117,6 +133,33 @@ protected:
     /** When true, the m_entityArray needs to be re-sorted based on dependencies before iterating. */
     bool                                m_needEntitySort;
 
+    /** Cached results of dynamic_pointer_cast on each Entity, used by onSimulation to
+        track change times without casting every Entity every frame. */
+    enum EntityTypeTag : uint8 {OTHER_ENTITY_TAG, VISIBLE_ENTITY_TAG, LIGHT_ENTITY_TAG};
+
+    /** Parallel to m_entityArray. Rebuilt by sortEntitiesByDependency(). */
+    Array<uint8>                        m_entityTypeTag;
+
+    /** After sortEntitiesByDependency(), m_entityArray is grouped into dependency levels.
+        Entities <code>m_entityLevelStart[L] <= i < m_entityLevelStart[L + 1]</code> depend only
+        on entities in earlier levels, so each level may be simulated concurrently.
+        The last element is always m_entityArray.size(). */
+    Array<int>                          m_entityLevelStart;
+
+    /** \copydoc setSimulateEntitiesConcurrently */
+    bool                                m_simulateEntitiesConcurrently;
+
+    /** True while onSimulation is invoking Entity::onSimulation. insert() and remove()
+        of Entity%s are then deferred until every level has been simulated, because
+        m_entityArray, m_entityTypeTag, and m_entityLevelStart are being iterated. */
+    bool                                m_simulatingEntities;
+
+    /** Protects m_deferredEntityEditArray */
+    std::mutex                          m_deferredEntityEditMutex;
+
+    /** Entity%s to insert (true) or remove (false) after the current simulation, in request order */
+    Array<std::pair<shared_ptr<Entity>, bool>> m_deferredEntityEditArray;
+
     String                              m_name;
 
     /** The Any from which this scene was constructed. */
@@ -128,7 +171,7 @@ protected:
     LightingEnvironment                 m_localLightingEnvironment;
 
     /** All Entitys, including Cameras, Lights, and MarkerEntitys, by name */
-    Table<String, shared_ptr<Entity> >  m_entityTable;
+    FlatTable<String, shared_ptr<Entity> > m_entityTable;
 
     /** All Entitys, including Cameras, Lights, and MarkerEntitys */
     Array< shared_ptr<Entity> >         m_entityArray;
@@ -167,9 +210,22 @@ protected:
 
     const shared_ptr<Entity> _entity(const String& name) const;
      
-    /** If m_needEntitySort, sort Entitys to resolve dependencies and set m_needEntitySort = false. Called fromOnSimulation */
+    /** If m_needEntitySort, sort Entitys to resolve dependencies, group them into
+        m_entityLevelStart levels, rebuild m_entityTypeTag, and set m_needEntitySort = false. Called from onSimulation */
     void sortEntitiesByDependency();
 
+    /** Called by sortEntitiesByDependency() after m_entityArray is in dependency order */
+    void computeEntityLevels();
+
+    /** Called by onSimulation after the entities have been simulated. Performs the
+        insertions and removals that were requested during simulation. */
+    void applyDeferredEntityEdits();
+
+    /** Called by load() when LoadOptions::concurrentModelLoading is set. Resolves the
+        ArticulatedModels in \a modelAnys that can load off of the OpenGL thread on a
+        worker pool, reporting progress through LoadOptions::progressCallback. */
+    void loadModelsConcurrently(const Table<String, Any>& modelAnys, const LoadOptions& options);
+
 public:
 
     const VRSettings& vrSettings() const {
@@ -209,6 +265,9 @@ public:
 
         Assumes that no entity with the same name is present in the scene.
 
+        If invoked from an Entity's onSimulation, the insertion occurs when
+        every Entity has been simulated for the current step.
+
      \sa createEntity, remove */
     virtual shared_ptr<Entity> insert(const shared_ptr<Entity>& entity);
 
@@ -223,7 +282,9 @@ public:
         (i.e., entityArray())
 
         Note that removal occurs immediately, so be avoid invoking this
-        in the middle of iterating through entityArray().
+        in the middle of iterating through entityArray(). The exception is an
+        Entity's onSimulation, which may remove any Entity, including itself;
+        that removal occurs when every Entity has been simulated for the current step.
 
       \sa insert, createEntity */
     virtual void remove(const shared_ptr<Entity>& entity);
@@ -334,8 +395,23 @@ public:
 
     virtual void onPose(Array<shared_ptr<Surface> >& surfaceArray);
 
+    /** Invokes Entity::onSimulation on every Entity. Entities that have no
+        ordering constraints between them (see setOrder) are simulated concurrently
+        unless setSimulateEntitiesConcurrently(false) has been called. */
     virtual void onSimulation(SimTime deltaTime);
 
+    /** If true (the default), onSimulation runs Entity::onSimulation for independent
+        Entity%s on multiple threads. Disable this if an Entity subclass's onSimulation
+        mutates shared state other than by inserting or removing Entity%s, which
+        are deferred until simulation completes. */
+    void setSimulateEntitiesConcurrently(bool b) {
+        m_simulateEntitiesConcurrently = b;
+    }
+
+    bool simulateEntitiesConcurrently() const {
+        return m_simulateEntitiesConcurrently;
+    }
+
     const LightingEnvironment & lightingEnvironment() const {
         return m_localLightingEnvironment;
     }
@@ -76,6 +76,72 @@ public:
 
         Hit() : triIndex(NONE), u(0), v(0), distance(0), backface(false) {}
     };
+
+    /** Structure-of-arrays batch of Hit%s. Reusing one across calls to
+        intersectRays() avoids all allocation once it has grown to the
+        largest batch size. */
+    class HitBuffer {
+    public:
+        /** Hit::NONE if no hit */
+        Array<int>              triIndex;
+        Array<float>            u;
+        Array<float>            v;
+        Array<float>            distance;
+        Array<bool>             backface;
+
+        int size() const {
+            return triIndex.size();
+        }
+
+        /** Never shrinks the underlying storage */
+        void resize(int n) {
+            triIndex.resize(n, false);
+            u.resize(n, false);
+            v.resize(n, false);
+            distance.resize(n, false);
+            backface.resize(n, false);
+        }
+
+        void set(int i, const Hit& hit) {
+            triIndex[i] = hit.triIndex;
+            u[i]        = hit.u;
+            v[i]        = hit.v;
+            distance[i] = hit.distance;
+            backface[i] = hit.backface;
+        }
+
+        Hit operator[](int i) const {
+            Hit hit;
+            hit.triIndex = triIndex[i];
+            hit.u        = u[i];
+            hit.v        = v[i];
+            hit.distance = distance[i];
+            hit.backface = backface[i];
+            return hit;
+        }
+    };
+
+    /** Surfels for sample(const HitBuffer&, SurfelPool&, Array<const Surfel*>&), which
+        resamples the material of each hit into the Surfel left in the same slot by the
+        previous call. After the first call on a batch size, material sampling neither
+        allocates nor touches reference counts.
+
+        Surfels handed out by one call are overwritten by the next, so use one pool per
+        batch that must stay alive, e.g., per path tracing bounce. */
+    class SurfelPool {
+    protected:
+        friend class TriTree;
+
+        /** Never shrinks, so that the Surfels are reused */
+        Array<shared_ptr<Surfel>>   m_surfel;
+
+    public:
+
+        /** Releases the Surfels */
+        void clear() {
+            m_surfel.clear();
+        }
+    };
     
     virtual const String& className() const = 0;
 
@@ -273,23 +339,87 @@ public:
          Array<bool>&                       results,
          IntersectRayOptions                options         = IntersectRayOptions(0)) const = 0;
 
-    /** Returns all triangles that lie within the box. Default implementation
-        tests each triangle in turn (linear time). */
+    /** Batch ray casting into a reusable HitBuffer, which does not allocate once \a results
+        has grown to the size of \a rays. Use with sample(const HitBuffer&, SurfelPool&, Array<const Surfel*>&)
+        to avoid the per-ray shared_ptr<Surfel> of the Surfel overload.  */
+    virtual void intersectRays
+        (const Array<Ray>&                  rays,
+         HitBuffer&                         results,
+         IntersectRayOptions                options         = IntersectRayOptions(0)) const = 0;
+
+    /** Returns all triangles that lie within the box. Walks the
+        acceleration structure; see the Array<int> overload. */
     virtual void intersectBox
         (const AABox&                       box,
          Array<Tri>&                        results) const = 0;
 
     /** Returns all triangles that intersect or are contained within
         the sphere (technically, this is a ball intersection).
-
-        Default implementation calls intersectBox and then filters the results for the sphere.
      */
     virtual void intersectSphere
         (const Sphere&                      sphere,
          Array<Tri>&                        triArray) const = 0;
 
+    /** Appends to \a triIndex the index into triArray() of every triangle
+        that intersects the box, in no particular order. Cheaper than the
+        Array<Tri> overload because it does not copy the Tri%s. */
+    virtual void intersectBox
+        (const AABox&                       box,
+         Array<int>&                        triIndex) const = 0;
+
+    /** Appends to \a triIndex the index into triArray() of every triangle
+        that intersects or is contained within the sphere. */
+    virtual void intersectSphere
+        (const Sphere&                      sphere,
+         Array<int>&                        triIndex) const = 0;
+
+    /** Flat results of a batch of region queries. Reusing one across
+        calls avoids allocation once it has grown large enough. */
+    class OverlapBuffer {
+    public:
+        /** Indices into triArray(), grouped by query */
+        Array<int>              triIndex;
+
+        /** Query q overlaps triIndex[offset[q]] through triIndex[offset[q + 1] - 1].
+            One element longer than the number of queries. */
+        Array<int>              offset;
+
+        /** Number of queries */
+        int size() const {
+            return G3D::max(offset.size() - 1, 0);
+        }
+
+        /** Number of triangles that overlap query \a q */
+        int count(int q) const {
+            return offset[q + 1] - offset[q];
+        }
+
+        const int* begin(int q) const {
+            return triIndex.getCArray() + offset[q];
+        }
+
+        const int* end(int q) const {
+            return triIndex.getCArray() + offset[q + 1];
+        }
+    };
+
+    /** Runs intersectBox() for every box in parallel and stores the
+        results in a single flat buffer */
+    virtual void intersectBoxes
+        (const Array<AABox>&                boxArray,
+         OverlapBuffer&                     results) const = 0;
+
+    virtual void intersectSpheres
+        (const Array<Sphere>&               sphereArray,
+         OverlapBuffer&                     results) const = 0;
+
     void sample(const Hit& hit, shared_ptr<Surfel>& surfel) const;
 
+    /** Samples the material at every hit in parallel. Sets \a surfel[i] to the Surfel for
+        \a hits[i], or nullptr on a miss. The Surfels are owned by \a pool and remain valid
+        until the next call that uses it. */
+    void sample(const HitBuffer& hits, SurfelPool& pool, Array<const Surfel*>& surfel) const;
+
     /** Create an instance of whatever is the fastest implementation subclass for this machine.
         \param preferGPUData If true, use an implementation that is fast for ray buffers already on the GPU. */
     static shared_ptr<TriTree> create(bool preferGPUData = true, bool preferVulkan = false);
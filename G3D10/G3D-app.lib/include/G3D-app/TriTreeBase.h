@@ -9,8 +9,11 @@
 #pragma once
 
 #include <functional>
+#include <atomic>
+#include <mutex>
 #include "G3D-base/platform.h"
 #include "G3D-base/Vector3.h"
+#include "G3D-base/AABox.h"
 #include "G3D-base/Ray.h"
 #include "G3D-base/Array.h"
 #include "G3D-gfx/CPUVertexArray.h"
@@ -31,6 +34,71 @@ class GBuffer;
 class TriTreeBase : public TriTree {
 protected:
 
+    /** Binary AABB tree over the triangle indices of m_triArray, for the
+        region queries of subclasses whose acceleration structure cannot
+        answer them (e.g., Embree and the GPU trees). */
+    class QueryTree {
+    public:
+        /** Stored in depth-first order, so that the first child of an internal node immediately follows it */
+        class Node {
+        public:
+            AABox               bounds;
+
+            /** Internal: index of the second child. Leaf: first index into m_triIndex. */
+            int                 index = 0;
+
+            /** Number of triangles for a leaf, 0 for an internal node */
+            int                 count = 0;
+        };
+
+        enum { MAX_TRIS_PER_LEAF = 4 };
+
+        Array<Node>             m_node;
+
+        /** Non-degenerate triangles, grouped by leaf */
+        Array<int>              m_triIndex;
+
+        /** m_triArray.size() when this was built */
+        int                     m_numTris = -1;
+
+        void build(const Array<Tri>& triArray, const CPUVertexArray& vertexArray);
+
+        /** Invokes \a visit(triIndex) for every triangle in a leaf whose bounds overlap \a box */
+        template<class Visit>
+        void forEachCandidate(const AABox& box, Visit visit) const;
+
+        void intersectBox(const AABox& box, const Array<Tri>& triArray, const CPUVertexArray& vertexArray, Array<int>& triIndex) const;
+
+        void intersectSphere(const Sphere& sphere, const Array<Tri>& triArray, const CPUVertexArray& vertexArray, Array<int>& triIndex) const;
+    };
+
+    mutable QueryTree           m_queryTree;
+
+    /** m_lastBuildTime when m_queryTree was built. Written after m_queryTree, so that
+        queries only need m_queryTreeMutex when the tree is out of date. */
+    mutable std::atomic<RealTime> m_queryTreeBuildTime;
+
+    /** m_queryTree.m_numTris, published in the same way as m_queryTreeBuildTime */
+    mutable std::atomic<int>    m_queryTreeNumTris;
+
+    /** Protects lazy building of m_queryTree */
+    mutable std::mutex          m_queryTreeMutex;
+
+    /** Returns m_queryTree, rebuilding it first if the triangles have changed */
+    const QueryTree& queryTree() const;
+
+    /** intersectRays() traces smaller batches in the order given */
+    enum { MIN_SORTED_RAYS = 4096 };
+
+    /** The HitBuffer overload of intersectRays() frees its per-thread scratch
+        Array<Hit> after batches larger than this */
+    enum { MAX_RETAINED_HITS = 1 << 18 };
+
+    /** True if intersectRays() should trace \a numRays in sortRays() order */
+    static bool shouldSortRays(int numRays, IntersectRayOptions options) {
+        return (numRays >= MIN_SORTED_RAYS) && ((options & COHERENT_RAY_HINT) == 0);
+    }
+
     static void copyToCPU
        (const shared_ptr<GLPixelTransferBuffer>& rayOrigin,
         const shared_ptr<GLPixelTransferBuffer>& rayDirection,
@@ -43,9 +111,24 @@ protected:
         Array<float>&                            rayCoherenceBuffer);
 
 public:
+
+    TriTreeBase();
     
     virtual ~TriTreeBase();
 
+    /** \brief Computes an order in which to trace incoherent rays.
+
+        Bins the rays by direction octant and, within each octant, sorts
+        them by a Morton code of their origin (relative to the bounds of
+        all origins) and direction. Tracing neighboring rays of the result
+        together visits the same tree nodes and triangles, which greatly
+        improves the cache behavior of secondary rays.
+
+        rays[order[i]] is the ith ray to trace. intersectRays() does this
+        automatically for large batches without COHERENT_RAY_HINT and
+        scatters the results back to the original indices. */
+    static void sortRays(const Array<Ray>& rays, Array<int>& order);
+
     virtual void clear() override;
 
     virtual void setContents
@@ -108,6 +191,13 @@ public:
          Array<bool>&                             results,
          IntersectRayOptions                      options         = IntersectRayOptions(0)) const override;
 
+    /** Invokes the Array<Hit> overload on the calling thread and converts its results,
+        so that subclasses only need to batch that one */
+    virtual void intersectRays
+        (const Array<Ray>&                        rays,
+         HitBuffer&                               results,
+         IntersectRayOptions                      options         = IntersectRayOptions(0)) const override;
+
     virtual void intersectBox
         (const AABox&                             box,
          Array<Tri>&                              results) const override;
@@ -115,6 +205,24 @@ public:
     virtual void intersectSphere
         (const Sphere&                            sphere,
          Array<Tri>&                              triArray) const override;
+
+    /** Walks a lazily built QueryTree. Subclasses with their own tree override this. */
+    virtual void intersectBox
+        (const AABox&                             box,
+         Array<int>&                              triIndex) const override;
+
+    /** Walks a lazily built QueryTree. Subclasses with their own tree override this. */
+    virtual void intersectSphere
+        (const Sphere&                            sphere,
+         Array<int>&                              triIndex) const override;
+
+    virtual void intersectBoxes
+        (const Array<AABox>&                      boxArray,
+         OverlapBuffer&                           results) const override;
+
+    virtual void intersectSpheres
+        (const Array<Sphere>&                     sphereArray,
+         OverlapBuffer&                           results) const override;
 };
 
 } // G3D
@@ -226,8 +226,14 @@ Any component can be a Texture::Specification, Color3/Color4, or table of <code>
 
         bool operator==(const Specification& s) const;
 
+        /** Requires isSerializable() */
         Any toAny() const;
 
+        /** False if a texture or light map was supplied as a Texture
+            object instead of a Texture::Specification, since toAny()
+            cannot represent those */
+        bool isSerializable() const;
+
         bool operator!=(const Specification& s) const {
             return !((*this) == s);
         }
@@ -373,6 +379,9 @@ protected:
 
     String                      m_name;
 
+    /** The argument to create(), or nullptr if this was constructed from components */
+    shared_ptr<Specification>   m_specification;
+
     /** Scattering function */
     shared_ptr<UniversalBSDF>   m_bsdf;
 
@@ -431,6 +440,12 @@ public:
        return m_name;
     }
 
+    /** The Specification that this material was created from, or
+        nullptr if it was constructed directly from its components */
+    const shared_ptr<Specification>& specification() const {
+        return m_specification;
+    }
+
     /** The sampler used for all Texture%s */
     const Sampler& sampler() const {
         return m_sampler;
@@ -77,7 +77,8 @@ private:
     std::future<bool>  m_thread;
     std::atomic_bool   m_quitThread;
 
-    ThreadsafeQueue<shared_ptr<CPUPixelTransferBuffer>> m_frames;
+    /** Filled by the decode thread and drained by the thread that calls nextFrame() */
+    ThreadsafeQueue<shared_ptr<CPUPixelTransferBuffer>, SPSCQueue<shared_ptr<CPUPixelTransferBuffer>>> m_frames;
 
     // ffmpeg management
     AVFormatContext*    m_avFormatContext;
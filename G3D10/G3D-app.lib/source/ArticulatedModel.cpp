@@ -11,6 +11,8 @@
 #include "G3D-base/FileSystem.h"
 #include "G3D-base/Stopwatch.h"
 #include "G3D-app/GApp.h"
+#include <mutex>
+#include <future>
 
 namespace G3D {
 
@@ -31,11 +33,26 @@ String ArticulatedModel::resolveRelativeFilename(const String& filename, const S
 
 Table<ArticulatedModel::Specification, shared_ptr<ArticulatedModel> > s_cache;
 
+/** Models that are currently being loaded by some thread, so that concurrent
+    create() calls for the same Specification load it only once. */
+static Table<ArticulatedModel::Specification, std::shared_future<shared_ptr<ArticulatedModel> > > s_pending;
+
+/** Protects s_cache and s_pending. Held only for lookups and insertions, never while loading. */
+static std::mutex s_cacheMutex;
+
 void ArticulatedModel::clearCache() {
+    std::lock_guard<std::mutex> lock(s_cacheMutex);
     s_cache.clear();
 }
 
 
+bool ArticulatedModel::canLoadConcurrently(const Specification& specification) {
+    const String& ext = toLower(FilePath::ext(specification.filename));
+    // These importers create OpenGL resources directly
+    return ! ((ext == "bsp") || (ext == "dae") || (ext == "fbx") || (ext == "lwo") || (ext == "ase") || (ext == "glb") || (ext == "gltf"));
+}
+
+
 shared_ptr<ArticulatedModel> ArticulatedModel::loadArticulatedModel(const ArticulatedModel::Specification& specification, const String& n) {
     const shared_ptr<ArticulatedModel>& a = createShared<ArticulatedModel>();
 
@@ -65,11 +82,44 @@ lazy_ptr<Model> ArticulatedModel::lazyCreate(const ArticulatedModel::Specificati
 
 shared_ptr<ArticulatedModel> ArticulatedModel::create(const ArticulatedModel::Specification& specification, const String& n) {
     if (specification.cachable) {
-        bool created = false;
-        shared_ptr<ArticulatedModel>& a = s_cache.getCreate(specification, created);
-        if (created) {
+        std::promise<shared_ptr<ArticulatedModel>> promise;
+        std::shared_future<shared_ptr<ArticulatedModel>> pending;
+        {
+            std::lock_guard<std::mutex> lock(s_cacheMutex);
+            const shared_ptr<ArticulatedModel>* cached = s_cache.getPointer(specification);
+            if (notNull(cached)) {
+                return *cached;
+            }
+
+            bool created = false;
+            std::shared_future<shared_ptr<ArticulatedModel>>& p = s_pending.getCreate(specification, created);
+            if (created) {
+                p = promise.get_future().share();
+            } else {
+                pending = p;
+            }
+        }
+
+        if (pending.valid()) {
+            // Another thread is loading the same specification
+            return pending.get();
+        }
+
+        // Load without holding the lock so that other models can load concurrently
+        shared_ptr<ArticulatedModel> a;
+        try {
             a = loadArticulatedModel(specification, n);
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(s_cacheMutex);
+            s_pending.remove(specification);
+            promise.set_exception(std::current_exception());
+            throw;
         }
+
+        std::lock_guard<std::mutex> lock(s_cacheMutex);
+        s_cache.set(specification, a);
+        s_pending.remove(specification);
+        promise.set_value(a);
         return a;
     } else {
         return loadArticulatedModel(specification, n);
@@ -234,6 +284,12 @@ void ArticulatedModel::load(const Specification& specification) {
 
     timer.setEnabled(timeArticulatedModelLoad);
     m_sourceSpecification = specification;
+
+    const String& cacheFilename = specification.cachable ? persistentCacheFilename(specification) : "";
+    if (! cacheFilename.empty() && loadFromPersistentCache(cacheFilename)) {
+        timer.printElapsedTime("load from persistent cache");
+        return;
+    }
     
     const String& ext = toLower(FilePath::ext(specification.filename));
 
@@ -304,6 +360,11 @@ void ArticulatedModel::load(const Specification& specification) {
     computeBounds();
     
     timer.printElapsedTime("cleanGeometry");
+
+    if (! cacheFilename.empty()) {
+        saveToPersistentCache(cacheFilename);
+        timer.printElapsedTime("save to persistent cache");
+    }
 }
 
 
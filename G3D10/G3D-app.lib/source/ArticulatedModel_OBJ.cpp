@@ -284,7 +284,7 @@ void ArticulatedModel::loadOBJ(const Specification& specification) {
 
     ParseOBJ parseData;
     {
-        BinaryInput bi(specification.filename, G3D_LITTLE_ENDIAN);
+        BinaryInput bi(specification.filename, G3D_LITTLE_ENDIAN, MemoryMappedFile::SEQUENTIAL);
         timer.printElapsedTime(" open file");
         parseData.parse(bi, specification.objOptions);
 
@@ -26,7 +26,7 @@ void ArticulatedModel::loadPLY(const Specification& specification) {
     
     ParsePLY parseData;
     {
-        BinaryInput bi(specification.filename, G3D_LITTLE_ENDIAN);
+        BinaryInput bi(specification.filename, G3D_LITTLE_ENDIAN, MemoryMappedFile::SEQUENTIAL);
         parseData.parse(bi);
     }
 
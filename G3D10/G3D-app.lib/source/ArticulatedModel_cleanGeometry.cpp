@@ -7,7 +7,6 @@
   Available under the BSD License
 */
 #include "G3D-base/Stopwatch.h"
-#include "G3D-base/AreaMemoryManager.h"
 #include "G3D-app/ArticulatedModel.h"
 #include "G3D-base/FastPointHashGrid.h"
 
@@ -77,6 +76,87 @@ void ArticulatedModel::Geometry::getAffectedMeshes(const Array<Mesh*>& fullMeshA
 }
 
 
+/** Groups the items 0..n-1 that \a equal reports are identical. \a hashCode must agree with \a equal.
+    Groups are ordered by hash code, and the items within a group are in increasing order, so the 
+    result does not depend on how the work was scheduled.
+
+    \param order The items, sorted by group
+    \param groupStart The items of group g are order[groupStart[g]] through order[groupStart[g + 1] - 1]
+    \param groupOf The group of each item */
+template<class HashFn, class EqualFn>
+static void groupEqual(int n, const HashFn& hashCode, const EqualFn& equal, Array<int>& order, Array<int>& groupStart, Array<int>& groupOf) {
+    // (hash << 32) | item. Folding the hash code to 32 bits only adds collisions, which are resolved below.
+    Array<uint64> key;
+    key.resize(n);
+    runConcurrently(0, n, [&](int i) {
+        const uint64 h = uint64(hashCode(i));
+        key[i] = (uint64(uint32(h ^ (h >> 32))) << 32) | uint64(uint32(i));
+    });
+    tbb::parallel_sort(key.begin(), key.end());
+
+    order.resize(n);
+    runConcurrently(0, n, [&](int i) {
+        order[i] = int(key[i] & 0xFFFFFFFF);
+    });
+
+    // Runs of equal hash codes. Almost all runs contain a single group.
+    Array<int> runStart;
+    for (int i = 0; i < n; ++i) {
+        if ((i == 0) || ((key[i] >> 32) != (key[i - 1] >> 32))) {
+            runStart.append(i);
+        }
+    }
+    runStart.append(n);
+
+    // Split colliding runs into groups, keeping the items of each group in order
+    Array<bool> isGroupStart;
+    isGroupStart.resize(n);
+    runConcurrently(0, runStart.size() - 1, [&](int r) {
+        const int start = runStart[r];
+        const int end   = runStart[r + 1];
+        isGroupStart[start] = true;
+
+        bool allEqual = true;
+        for (int i = start + 1; i < end; ++i) {
+            isGroupStart[i] = false;
+            allEqual = allEqual && equal(order[start], order[i]);
+        }
+
+        if (! allEqual) {
+            // Greedily assign each item to the first group with an equal representative
+            typedef std::pair<int, int> GroupedItem;
+            Array<GroupedItem> groupedItem;
+            Array<int> representative;
+            for (int i = start; i < end; ++i) {
+                int g = 0;
+                while ((g < representative.size()) && ! equal(representative[g], order[i])) {
+                    ++g;
+                }
+                if (g == representative.size()) {
+                    representative.append(order[i]);
+                }
+                groupedItem.append(GroupedItem(g, order[i]));
+            }
+            std::sort(groupedItem.begin(), groupedItem.end());
+            for (int i = 0; i < groupedItem.size(); ++i) {
+                order[start + i] = groupedItem[i].second;
+                isGroupStart[start + i] = (i == 0) || (groupedItem[i].first != groupedItem[i - 1].first);
+            }
+        }
+    });
+
+    groupStart.fastClear();
+    groupOf.resize(n);
+    for (int i = 0; i < n; ++i) {
+        if (isGroupStart[i]) {
+            groupStart.append(i);
+        }
+        groupOf[order[i]] = groupStart.size() - 1;
+    }
+    groupStart.append(n);
+}
+
+
 static void generateFaceArray(Array<ArticulatedModel::Geometry::Face>& faceArray, const Array<ArticulatedModel::Mesh*>& affectedMeshes, const CPUVertexArray& cpuVertexArray) {
     int triangleCount = 0;
     for (int i = 0; i < affectedMeshes.size(); ++i) {
@@ -368,7 +448,6 @@ void ArticulatedModel::Geometry::cleanGeometry(const CleanGeometrySettings& sett
         // each vertex's normal independently if needed.
         Array<Face> faceArray;
         Face::AdjacentFaceTable adjacentFaceTable;
-        adjacentFaceTable.clearAndSetMemoryManager(AreaMemoryManager::create());
 
         buildFaceArray(faceArray, adjacentFaceTable, affectedMeshes);
         timer.printElapsedTime("  buildFaceArray");
@@ -523,22 +602,34 @@ void ArticulatedModel::Geometry::computeMissingTangents(const Array<Mesh*> affec
     // Compute all tangents, but only extract those that we need at the bottom.
 
     // See http://www.terathon.com/code/tangent.html for a derivation of the following code
-    Array<Vector3>  tangent1;
-    Array<Vector3>  tangent2;
-    tangent1.resize(cpuVertexArray.size());
-    tangent2.resize(cpuVertexArray.size());
-    Vector3* tan1 = tangent1.getCArray();
-    Vector3* tan2 = tangent2.getCArray();
     CPUVertexArray::Vertex* vertexArray = cpuVertexArray.vertex.getCArray();
-    debugAssertM(tan1[0].x == 0, "This implementation assumes that new Vector3 values are initialized to zero.");
 
-    // For each face
+    // The first triangle of each mesh, counting across all affected meshes
+    Array<int> meshTriangleStart;
+    meshTriangleStart.append(0);
     for (int m = 0; m < affectedMeshes.size(); ++m) {
-        const Mesh* mesh = affectedMeshes[m];        
-        const Array<int>& cpuIndexArray = mesh->cpuIndexArray;
-        const int* indexArray = cpuIndexArray.getCArray();
+        meshTriangleStart.append(meshTriangleStart.last() + affectedMeshes[m]->cpuIndexArray.size() / 3);
+    }
+    const int numTriangles = meshTriangleStart.last();
 
-        for (int i = 0; i < cpuIndexArray.size(); i += 3) {
+    // Directions of increasing s and t on each triangle
+    Array<Vector3> triangleSdir;
+    Array<Vector3> triangleTdir;
+    triangleSdir.resize(numTriangles);
+    triangleTdir.resize(numTriangles);
+
+    // (vertex << 32) | corner, where corner 3 * t + v is vertex v of triangle t. 
+    // Sorting these lets each vertex sum its triangles' contributions without
+    // contention, in the same order as a serial loop over the triangles.
+    Array<uint64> vertexCorner;
+    vertexCorner.resize(numTriangles * 3);
+
+    for (int m = 0; m < affectedMeshes.size(); ++m) {
+        const int* indexArray = affectedMeshes[m]->cpuIndexArray.getCArray();
+        const int  firstTriangle = meshTriangleStart[m];
+
+        runConcurrently(0, meshTriangleStart[m + 1] - firstTriangle, [&](int t) {
+            const int i  = 3 * t;
             const int i0 = indexArray[i];
             const int i1 = indexArray[i + 1];
             const int i2 = indexArray[i + 2];
@@ -571,34 +662,51 @@ void ArticulatedModel::Geometry::computeMissingTangents(const Array<Mesh*> affec
         
             const float r = 1.0f / (s0 * t1 - s1 * t0);
             
-            const Vector3 sdir
+            const int triangle = firstTriangle + t;
+            triangleSdir[triangle] = Vector3
                 ((t1 * x0 - t0 * x1) * r, 
                  (t1 * y0 - t0 * y1) * r,
                  (t1 * z0 - t0 * z1) * r);
 
-            const Vector3 tdir
+            triangleTdir[triangle] = Vector3
                 ((s0 * x1 - s1 * x0) * r, 
                  (s0 * y1 - s1 * y0) * r,
                  (s0 * z1 - s1 * z0) * r);
-        
-            tan1[i0] += sdir;
-            tan1[i1] += sdir;
-            tan1[i2] += sdir;
-        
-            tan2[i0] += tdir;
-            tan2[i1] += tdir;
-            tan2[i2] += tdir;        
-        } // For each triangle
+
+            const int corner = 3 * triangle;
+            vertexCorner[corner]     = (uint64(i0) << 32) | uint64(corner);
+            vertexCorner[corner + 1] = (uint64(i1) << 32) | uint64(corner + 1);
+            vertexCorner[corner + 2] = (uint64(i2) << 32) | uint64(corner + 2);
+        }); // For each triangle
     } // For each mesh
 
-    for (int v = 0; v < cpuVertexArray.size(); ++v) {
+    tbb::parallel_sort(vertexCorner.begin(), vertexCorner.end());
+
+    // The corners of vertex v are vertexCorner[vertexStart[v]] through vertexCorner[vertexStart[v + 1] - 1]
+    const int numVertices = cpuVertexArray.size();
+    Array<int> vertexStart;
+    vertexStart.resize(numVertices + 1);
+    runConcurrently(0, vertexCorner.size() + 1, [&](int c) {
+        const int previous = (c == 0) ? -1 : int(vertexCorner[c - 1] >> 32);
+        const int current  = (c == vertexCorner.size()) ? numVertices : int(vertexCorner[c] >> 32);
+        for (int v = previous + 1; v <= current; ++v) {
+            vertexStart[v] = c;
+        }
+    });
+
+    runConcurrently(0, numVertices, [&](int v) {
         CPUVertexArray::Vertex& vertex = vertexArray[v];
 
         if (isNaN(vertex.tangent.x)) {
+            Vector3 t1, t2;
+            for (int c = vertexStart[v]; c < vertexStart[v + 1]; ++c) {
+                const int triangle = int(vertexCorner[c] & 0xFFFFFFFF) / 3;
+                t1 += triangleSdir[triangle];
+                t2 += triangleTdir[triangle];
+            }
+
             // This tangent needs to be overriden
             const Vector3& n = vertex.normal;
-            const Vector3& t1 = tan1[v];
-            const Vector3& t2 = tan2[v];
         
             // Gram-Schmidt orthogonalize
             const Vector3& T = (t1 - n * n.dot(t1)).directionOrZero();
@@ -619,10 +727,11 @@ void ArticulatedModel::Geometry::computeMissingTangents(const Array<Mesh*> affec
             // Calculate handedness
             vertex.tangent.w = (n.cross(t1).dot(t2) < 0.0f) ? 1.0f : -1.0f;
         } // if this must be updated
-    } // for each vertex
+    }); // for each vertex
     
  }
 
+
  
 void ArticulatedModel::Geometry::mergeVertices(const Array<Face>& faceArray, float maxNormalWeldAngle, const Array<Mesh*> affectedMeshes) {
     // Clear all mesh index arrays
@@ -639,84 +748,105 @@ void ArticulatedModel::Geometry::mergeVertices(const Array<Face>& faceArray, flo
     cpuVertexArray.boneIndices.fastClear();
     cpuVertexArray.boneWeights.fastClear();
 
-    Stopwatch timer;
-    timer.setEnabled(false);
-
-    // Track the location of vertices in cpuVertexArray by their exact texcoord and position.
-    // The vertices in the list may have differing normals.
-    typedef int VertexIndex;
-    typedef SmallArray<VertexIndex, 4> VertexIndexList;
-    Table<Face::Vertex, VertexIndexList, Face::AMFaceVertexHash, Face::AMFaceVertexHash> vertexIndexTable;
-
-    // Almost all of the time in this method is spent deallocating the table at
-    // the end, so use an AreaMemoryManager to directly dump the allocated memory
-    // without freeing individual objects.
-    vertexIndexTable.clearAndSetMemoryManager(AreaMemoryManager::create());
-
-    // Conservative estimate of the size (overallocation here is bad for large models on low RAM systems (such as San Miguel on a standard 8GB RAM computer)
-    vertexIndexTable.setSizeHint(faceArray.size() / 6); 
+    // Group corners whose vertices have exactly matching positions and texture coordinates.
+    // The vertices in a group may have differing normals. Corner 3 * f + v is vertex v of face f.
+    const int numCorners = faceArray.size() * 3;
+    const auto& cornerVertex = [&](int c) -> const Face::Vertex& {
+        return faceArray[c / 3].vertex[c % 3];
+    };
+    Array<int> cornerArray;
+    Array<int> groupStart;
+    Array<int> groupOfCorner;
+    groupEqual(numCorners, 
+        [&](int c) { return Face::AMFaceVertexHash::hashCode(cornerVertex(c)); },
+        [&](int a, int b) { return Face::AMFaceVertexHash::equals(cornerVertex(a), cornerVertex(b)); },
+        cornerArray, groupStart, groupOfCorner);
 
     const float normalClosenessThreshold = cos(maxNormalWeldAngle);
 
-    // Iterate over all faces
-    int longestListLength = 0;
-    for (int f = 0; f < faceArray.size(); ++f) {
-        const Face& face = faceArray[f];
-        Mesh* mesh = face.mesh;
-        int vertexIndex[3];
-        for (int v = 0; v < 3; ++v) {
-            const Face::Vertex& vertex = face.vertex[v];
-
-            // Find the location of this vertex in cpuVertexArray...or add it.
-            // The texture coordinates and vertices must exactly match.
-            // The normals may be slightly off, since the order of computation can affect them
-            // even if we wanted no normal welding.
-            VertexIndexList& list = vertexIndexTable.getCreate(vertex);
-
-            int index = -1;
-            for (int i = 0; i < list.size(); ++i) {
-                int j = list[i];
-                // See if the normals are close (we know that the texcoords and positions match exactly)
-                const Vector3& otherNormal = cpuVertexArray.vertex[j].normal;
-                if ((otherNormal.dot(vertex.normal) >= normalClosenessThreshold) 
-                    || otherNormal.isZero() || vertex.normal.isZero()) { 
+    // Within each group, visit the corners in order and reuse the first earlier vertex 
+    // whose normal is close. The normals may be slightly off even if we wanted no normal
+    // welding, since the order of computation can affect them. This matches processing
+    // all faces serially, regardless of the order in which groups are processed.
+    Array<int> leaderOfCorner;
+    leaderOfCorner.resize(numCorners);
+    runConcurrently(0, groupStart.size() - 1, [&](int g) {
+        SmallArray<int, 4> leaderList;
+        for (int i = groupStart[g]; i < groupStart[g + 1]; ++i) {
+            const int c = cornerArray[i];
+            const Vector3& normal = cornerVertex(c).normal;
+
+            int leader = -1;
+            for (int j = 0; (j < leaderList.size()) && (leader == -1); ++j) {
+                const Vector3& otherNormal = cornerVertex(leaderList[j]).normal;
+                if ((otherNormal.dot(normal) >= normalClosenessThreshold) 
+                    || otherNormal.isZero() || normal.isZero()) { 
                     // Reuse this vertex
-                    index = j;
-                    break;
+                    leader = leaderList[j];
                 }
             }
 
-            if (index == -1) {
-                // This must be a new vertex, so add it
-                index = cpuVertexArray.size();
-                cpuVertexArray.vertex.append(vertex);
-                if (cpuVertexArray.hasTexCoord1) {
-                    cpuVertexArray.texCoord1.append(vertex.texCoord1);
-                }
-                if (cpuVertexArray.hasVertexColors) {
-                    cpuVertexArray.vertexColors.append(vertex.vertexColor);
-                }
-                if (cpuVertexArray.hasBones) {
-                    cpuVertexArray.boneIndices.append(vertex.boneIndices);
-                    cpuVertexArray.boneWeights.append(vertex.boneWeights);
-                }
-                list.append(index);
-                longestListLength = max(longestListLength, list.size());
+            if (leader == -1) {
+                // This must be a new vertex
+                leader = c;
+                leaderList.append(c);
             }
+            leaderOfCorner[c] = leader;
+        }
+    });
 
-            // Add this vertex index to the mesh
-            vertexIndex[v] = index;
+    // Number the new vertices in the order that their first corners appear
+    Array<int> vertexIndexOfCorner;
+    vertexIndexOfCorner.resize(numCorners);
+    int numVertices = 0;
+    for (int c = 0; c < numCorners; ++c) {
+        if (leaderOfCorner[c] == c) {
+            vertexIndexOfCorner[c] = numVertices;
+            ++numVertices;
         }
+    }
+
+    cpuVertexArray.vertex.resize(numVertices);
+    if (cpuVertexArray.hasTexCoord1) {
+        cpuVertexArray.texCoord1.resize(numVertices);
+    }
+    if (cpuVertexArray.hasVertexColors) {
+        cpuVertexArray.vertexColors.resize(numVertices);
+    }
+    if (cpuVertexArray.hasBones) {
+        cpuVertexArray.boneIndices.resize(numVertices);
+        cpuVertexArray.boneWeights.resize(numVertices);
+    }
 
-        // Add only non-degenerate triangles
+    runConcurrently(0, numCorners, [&](int c) {
+        const int leader = leaderOfCorner[c];
+        if (leader == c) {
+            const Face::Vertex& vertex = cornerVertex(c);
+            const int index = vertexIndexOfCorner[c];
+            cpuVertexArray.vertex[index] = vertex;
+            if (cpuVertexArray.hasTexCoord1) {
+                cpuVertexArray.texCoord1[index] = vertex.texCoord1;
+            }
+            if (cpuVertexArray.hasVertexColors) {
+                cpuVertexArray.vertexColors[index] = vertex.vertexColor;
+            }
+            if (cpuVertexArray.hasBones) {
+                cpuVertexArray.boneIndices[index] = vertex.boneIndices;
+                cpuVertexArray.boneWeights[index] = vertex.boneWeights;
+            }
+        } else {
+            // Leaders precede the corners that reuse them
+            vertexIndexOfCorner[c] = vertexIndexOfCorner[leader];
+        }
+    });
+
+    // Add only non-degenerate triangles to the meshes
+    for (int f = 0; f < faceArray.size(); ++f) {
+        const int* vertexIndex = vertexIndexOfCorner.getCArray() + 3 * f;
         if ((vertexIndex[0] != vertexIndex[1]) && (vertexIndex[1] != vertexIndex[2]) && (vertexIndex[2] != vertexIndex[0])) {
-            mesh->cpuIndexArray.append(vertexIndex[0], vertexIndex[1], vertexIndex[2]);
+            faceArray[f].mesh->cpuIndexArray.append(vertexIndex[0], vertexIndex[1], vertexIndex[2]);
         }
     }
-
-   // debugPrintf("average bucket size = %f\n", vertexIndexTable.debugGetAverageBucketSize());
-   // debugPrintf("deepest bucket size = %d\n", vertexIndexTable.debugGetDeepestBucketSize());
-   // debugPrintf("longestListLength = %d\n", longestListLength);
 }
 
 
@@ -727,8 +857,8 @@ void ArticulatedModel::Geometry::computeMissingVertexNormals
 
     const float smoothThreshold = cos(maximumSmoothAngle);
 
-    // Compute vertex normals as needed
-    for (int f = 0; f < faceArray.size(); ++f) {
+    // Compute vertex normals as needed. Each face only writes its own vertices.
+    runConcurrently(0, faceArray.size(), [&](int f) {
         Face& face = faceArray[f];
 
         for (int v = 0; v < 3; ++v) {
@@ -738,14 +868,17 @@ void ArticulatedModel::Geometry::computeMissingVertexNormals
             if (isNaN(vertex.normal.x)) {
                 // This normal needs to be computed
                 vertex.normal = Vector3::zero();
-                const Face::IndexArray& faceIndexArray = adjacentFaceTable.get(vertex.position);
+                // The adjacent faces, in increasing order
+                const int group = adjacentFaceTable.groupOfCorner[3 * f + v];
+                const int* adjacentCorner = adjacentFaceTable.cornerArray.getCArray() + adjacentFaceTable.groupStart[group];
+                const int numAdjacent = adjacentFaceTable.groupStart[group + 1] - adjacentFaceTable.groupStart[group];
 
                 // Did we arrive at this vertex by considering a denegerate face?
                 if (face.unitNormal.isZero()) {
                     // This face has no normal (presumably this is a degenerate face formed by three collinear points), 
                     // so just average adjacent ones directly.
-                    for (int i = 0; i < faceIndexArray.size(); ++i) {
-                        vertex.normal += faceArray[faceIndexArray[i]].normal;
+                    for (int i = 0; i < numAdjacent; ++i) {
+                        vertex.normal += faceArray[adjacentCorner[i] / 3].normal;
                     }
 
                     if (vertex.normal.isZero()) {
@@ -756,8 +889,8 @@ void ArticulatedModel::Geometry::computeMissingVertexNormals
                 } else {
                     // The face containing this vertex has a valid normal.  Consider all adjacent
                     // faces and the angles that they subtend around the vertex.
-                    for (int i = 0; i < faceIndexArray.size(); ++i) {
-                        const Face& adjacentFace = faceArray[faceIndexArray[i]];
+                    for (int i = 0; i < numAdjacent; ++i) {
+                        const Face& adjacentFace = faceArray[adjacentCorner[i] / 3];
                         const float cosAngle = face.unitNormal.dot(adjacentFace.unitNormal);
 
                         // Only process if within the cutoff angle
@@ -781,7 +914,7 @@ void ArticulatedModel::Geometry::computeMissingVertexNormals
                     "the adjacent face normals were probably corrupt"); 
             }
         }
-    }
+    });
 }
 
 
@@ -790,31 +923,26 @@ void ArticulatedModel::Geometry::buildFaceArray
     Face::AdjacentFaceTable& adjacentFaceTable, 
     const Array<Mesh*>&      affectedMeshes) {
 
-    faceArray.fastClear();
-
-    int triangleCount = 0;
-    for (int i = 0; i < affectedMeshes.size(); ++i) {
-        triangleCount += affectedMeshes[i]->triangleCount();
+    // The first face of each mesh
+    Array<int> meshFaceStart;
+    meshFaceStart.append(0);
+    for (int m = 0; m < affectedMeshes.size(); ++m) {
+        meshFaceStart.append(meshFaceStart.last() + affectedMeshes[m]->triangleCount());
     }
-    faceArray.reserve(triangleCount);
-    adjacentFaceTable.setSizeHint(triangleCount / 2); // low ball estimate
-
-    // Maps positions to the faces adjacent to that position.  The valence of the average vertex in a closed mesh is 6, so
-    // allocate slightly more indices so that we rarely need to allocate extra heap space.
+    faceArray.resize(meshFaceStart.last());
 
     for (int m = 0; m < affectedMeshes.size(); ++m) {
         Mesh* mesh = affectedMeshes[m];
         const Array<int>& indexArray = mesh->cpuIndexArray;
 
         // For every indexed triangle, create a Face
-        for (int i = 0; i < indexArray.size(); i += 3) {
-            const Face::Index faceIndex = faceArray.size();
-            Face& face = faceArray.next();
+        runConcurrently(0, meshFaceStart[m + 1] - meshFaceStart[m], [&](int t) {
+            Face& face = faceArray[meshFaceStart[m] + t];
             face.mesh = mesh;
 
-            // Copy each vertex, updating the adjacency table
+            // Copy each vertex
             for (int v = 0; v < 3; ++v) {
-                int index = indexArray[i + v];
+                int index = indexArray[3 * t + v];
                 face.vertex[v] = Face::Vertex(cpuVertexArray.vertex[index], index);
 
                 // Copy texCoord1s as well, if they exist
@@ -828,11 +956,7 @@ void ArticulatedModel::Geometry::buildFaceArray
                     face.vertex[v].boneWeights = cpuVertexArray.boneWeights[index];
                     face.vertex[v].boneIndices = cpuVertexArray.boneIndices[index];
                 }
-
-                // Record that this face is next to this vertex
-                adjacentFaceTable.getCreate(face.vertex[v].position).append(faceIndex);
             }
-            
 
             // Compute the non-unit and unit face normals
             face.normal = 
@@ -840,8 +964,17 @@ void ArticulatedModel::Geometry::buildFaceArray
                     face.vertex[2].position - face.vertex[0].position);
 
             face.unitNormal = face.normal.directionOrZero();
-        }
+        });
     }
+
+    // Record the faces next to each position
+    const auto& cornerPosition = [&](int c) -> const Point3& {
+        return faceArray[c / 3].vertex[c % 3].position;
+    };
+    groupEqual(faceArray.size() * 3,
+        [&](int c) { return cornerPosition(c).hashCode(); },
+        [&](int a, int b) { return cornerPosition(a) == cornerPosition(b); },
+        adjacentFaceTable.cornerArray, adjacentFaceTable.groupStart, adjacentFaceTable.groupOfCorner);
 }
 
 } // namespace G3D
@@ -0,0 +1,444 @@
+/**
+  \file G3D-app.lib/source/ArticulatedModel_persistentCache.cpp
+
+  Storing fully loaded ArticulatedModels on disk so that later loads
+  can skip parsing, preprocessing, and cleanGeometry.
+
+  G3D Innovation Engine http://casual-effects.com/g3d
+  Copyright 2000-2019, Morgan McGuire
+  All rights reserved
+  Available under the BSD License
+*/
+#include "G3D-app/ArticulatedModel.h"
+#include "G3D-base/BinaryInput.h"
+#include "G3D-base/BinaryOutput.h"
+#include "G3D-base/Crypto.h"
+#include "G3D-base/FileSystem.h"
+#include <mutex>
+
+namespace G3D {
+
+namespace {
+
+/** Increment whenever the format written by saveToPersistentCache() changes */
+const int32 CACHE_VERSION = 1;
+
+const char CACHE_MAGIC[8] = {'G', '3', 'D', 'A', 'M', 'O', 'D', 'L'};
+
+std::mutex  s_persistentCacheMutex;
+String      s_persistentCacheDirectory;
+
+/** Thrown while reading an entry that is inconsistent with its own contents */
+class CorruptEntry {};
+
+
+String toHex(const MD5Hash& hash) {
+    String s;
+    for (int i = 0; i < 16; ++i) {
+        s += format("%02x", hash[i]);
+    }
+    return s;
+}
+
+
+bool hashFile(const String& filename, MD5Hash& hash) {
+    if (! FileSystem::exists(filename)) {
+        return false;
+    }
+    BinaryInput b(filename, G3D_LITTLE_ENDIAN, MemoryMappedFile::SEQUENTIAL);
+    hash = Crypto::md5(b.getCArray(), size_t(b.size()));
+    return true;
+}
+
+
+/** Only for arrays of types with no pointers, whose bytes are written directly */
+template<class T>
+void writePODArray(BinaryOutput& b, const Array<T>& array) {
+    b.writeInt32(array.size());
+    if (array.size() > 0) {
+        b.writeBytes(array.getCArray(), sizeof(T) * array.size());
+    }
+}
+
+
+template<class T>
+void readPODArray(BinaryInput& b, Array<T>& array) {
+    const int32 n = b.readInt32();
+    if ((n < 0) || (int64(n) * int64(sizeof(T)) > b.size() - b.getPosition())) {
+        throw CorruptEntry();
+    }
+    array.resize(n);
+    if (n > 0) {
+        b.readBytes(array.getCArray(), sizeof(T) * n);
+    }
+}
+
+
+/** Reads an index written for an element of an array of size \a n, where -1 means none */
+int readIndex(BinaryInput& b, int n) {
+    const int32 i = b.readInt32();
+    if ((i < -1) || (i >= n)) {
+        throw CorruptEntry();
+    }
+    return i;
+}
+
+} // namespace
+
+
+void ArticulatedModel::setPersistentCacheDirectory(const String& directory) {
+    std::lock_guard<std::mutex> guard(s_persistentCacheMutex);
+    s_persistentCacheDirectory = directory;
+}
+
+
+String ArticulatedModel::persistentCacheDirectory() {
+    std::lock_guard<std::mutex> guard(s_persistentCacheMutex);
+    return s_persistentCacheDirectory;
+}
+
+
+String ArticulatedModel::persistentCacheFilename(const Specification& specification) {
+    const String& directory = persistentCacheDirectory();
+    MD5Hash sourceHash;
+    if (directory.empty() || ! hashFile(specification.filename, sourceHash)) {
+        return "";
+    }
+
+    TextOutput::Settings settings;
+    settings.wordWrap = TextOutput::Settings::WRAP_NONE;
+    const String& key =
+        format("%d %d %d ", CACHE_VERSION, int(sizeof(CPUVertexArray::Vertex)), int(specification.invertPrecomputedNormalYAxis)) +
+        toHex(sourceHash) + specification.toAny().unparse(settings);
+
+    return FilePath::concat(directory, toHex(Crypto::md5(key.c_str(), key.size())) + ".ArticulatedModel.cache");
+}
+
+
+void ArticulatedModel::saveToPersistentCache(const String& filename) const {
+    // Index the shared objects so that references can be written as integers
+    Table<const Part*, int> partIndex;
+    for (int p = 0; p < m_partArray.size(); ++p) {
+        partIndex.set(m_partArray[p], p);
+    }
+
+    Table<const Geometry*, int> geometryIndex;
+    for (int g = 0; g < m_geometryArray.size(); ++g) {
+        geometryIndex.set(m_geometryArray[g], g);
+    }
+
+    Table<const UniversalMaterial*, int> materialIndex;
+    Array<shared_ptr<UniversalMaterial>> materialArray;
+    for (const Mesh* mesh : m_meshArray) {
+        if (notNull(mesh->material) && ! materialIndex.containsKey(mesh->material.get())) {
+            const shared_ptr<UniversalMaterial::Specification>& specification = mesh->material->specification();
+            if (isNull(specification) || ! specification->isSerializable()) {
+                // The material could not be recreated
+                return;
+            }
+            materialIndex.set(mesh->material.get(), materialArray.size());
+            materialArray.append(mesh->material);
+        }
+    }
+
+    // Files other than the source whose contents determine the model
+    Array<String> dependencyArray;
+    for (const String& mtl : m_mtlArray) {
+        if (! mtl.empty()) {
+            dependencyArray.append(FilePath::concat(FilePath::parent(m_sourceSpecification.filename), mtl));
+        }
+    }
+
+    const String& directory = FilePath::parent(filename);
+    if (! directory.empty() && ! FileSystem::exists(directory, false)) {
+        FileSystem::createDirectory(directory);
+    }
+
+    // Write under another name so that no process ever reads a partial file
+    const String& temp = FileSystem::tempFilename(directory.empty() ? "." : directory);
+    bool ok = true;
+    try {
+        BinaryOutput b(temp, G3D_LITTLE_ENDIAN);
+        b.writeBytes(CACHE_MAGIC, sizeof(CACHE_MAGIC));
+        b.writeInt32(CACHE_VERSION);
+
+        // Length of the file, to detect truncation before parsing
+        b.writeInt64(0);
+
+        b.writeInt32(dependencyArray.size());
+        for (const String& dependency : dependencyArray) {
+            MD5Hash hash;
+            ok = ok && hashFile(dependency, hash);
+            b.writeString32(dependency);
+            hash.serialize(b);
+        }
+
+        b.writeInt32(m_nextID);
+
+        b.writeInt32(m_partArray.size());
+        for (const Part* part : m_partArray) {
+            b.writeString32(part->name);
+            b.writeInt32(part->uniqueID);
+            b.writeInt32(part->isRoot() ? -1 : partIndex[part->m_parent]);
+            part->cframe.serialize(b);
+            part->inverseBindPoseTransform.serialize(b);
+            b.writeInt32(part->m_children.size());
+            for (const Part* child : part->m_children) {
+                b.writeInt32(partIndex[child]);
+            }
+        }
+
+        b.writeInt32(m_rootArray.size());
+        for (const Part* part : m_rootArray) {
+            b.writeInt32(partIndex[part]);
+        }
+
+        b.writeInt32(m_boneArray.size());
+        for (const Part* part : m_boneArray) {
+            b.writeInt32(partIndex[part]);
+        }
+
+        b.writeInt32(m_geometryArray.size());
+        for (const Geometry* geometry : m_geometryArray) {
+            const CPUVertexArray& vertexArray = geometry->cpuVertexArray;
+            b.writeString32(geometry->name);
+            writePODArray(b, vertexArray.vertex);
+            writePODArray(b, vertexArray.texCoord1);
+            writePODArray(b, vertexArray.vertexColors);
+            writePODArray(b, vertexArray.boneIndices);
+            writePODArray(b, vertexArray.boneWeights);
+            writePODArray(b, vertexArray.prevPosition);
+            b.writeBool8(vertexArray.hasTexCoord0);
+            b.writeBool8(vertexArray.hasTexCoord1);
+            b.writeBool8(vertexArray.hasTangent);
+            b.writeBool8(vertexArray.hasBones);
+            b.writeBool8(vertexArray.hasVertexColors);
+            geometry->sphereBounds.serialize(b);
+            geometry->boxBounds.serialize(b);
+        }
+
+        b.writeInt32(materialArray.size());
+        for (const shared_ptr<UniversalMaterial>& material : materialArray) {
+            b.writeString32(material->name());
+            material->specification()->toAny().serialize(b);
+        }
+
+        b.writeInt32(m_meshArray.size());
+        for (const Mesh* mesh : m_meshArray) {
+            b.writeString32(mesh->name);
+            b.writeInt32(isNull(mesh->logicalPart) ? -1 : partIndex[mesh->logicalPart]);
+            b.writeInt32(isNull(mesh->geometry) ? -1 : geometryIndex[mesh->geometry]);
+            b.writeInt32(isNull(mesh->material) ? -1 : materialIndex[mesh->material.get()]);
+            mesh->primitive.serialize(b);
+            b.writeBool8(mesh->twoSided);
+            b.writeInt32(mesh->uniqueID);
+            mesh->sphereBounds.serialize(b);
+            mesh->boxBounds.serialize(b);
+            b.writeInt32(mesh->contributingJoints.size());
+            for (const Part* joint : mesh->contributingJoints) {
+                b.writeInt32(isNull(joint) ? -1 : partIndex[joint]);
+            }
+            writePODArray(b, mesh->cpuIndexArray);
+        }
+
+        b.writeInt32(m_animationTable.size());
+        for (Table<String, Animation>::Iterator it = m_animationTable.begin(); it.isValid(); ++it) {
+            b.writeString32(it->key);
+            b.writeFloat64(it->value.duration);
+            const PoseSpline::SplineTable& splineTable = it->value.poseSpline.partSpline;
+            b.writeInt32(splineTable.size());
+            for (PoseSpline::SplineTable::Iterator s = splineTable.begin(); s.isValid(); ++s) {
+                b.writeString32(s->key);
+                s->value.toAny().serialize(b);
+            }
+        }
+
+        b.writeInt32(m_mtlArray.size());
+        for (const String& mtl : m_mtlArray) {
+            b.writeString32(mtl);
+        }
+
+        const int64 length = b.length();
+        b.setPosition(sizeof(CACHE_MAGIC) + sizeof(int32));
+        b.writeInt64(length);
+        b.setPosition(length);
+
+        if (ok) {
+            b.commit();
+            ok = b.ok();
+        }
+    } catch (...) {
+        ok = false;
+    }
+
+    if (ok && (FileSystem::rename(temp, filename) != 0)) {
+        // Windows cannot rename over an existing file
+        FileSystem::removeFile(filename);
+        ok = (FileSystem::rename(temp, filename) == 0);
+    }
+
+    if (! ok && FileSystem::exists(temp, false)) {
+        FileSystem::removeFile(temp);
+    }
+}
+
+
+bool ArticulatedModel::loadFromPersistentCache(const String& filename) {
+    if ((System::machineEndian() != G3D_LITTLE_ENDIAN) || ! FileSystem::exists(filename, false)) {
+        return false;
+    }
+
+    BinaryInput b(filename, G3D_LITTLE_ENDIAN, MemoryMappedFile::SEQUENTIAL);
+    const int64 headerSize = sizeof(CACHE_MAGIC) + sizeof(int32) + sizeof(int64);
+    if (b.size() < headerSize) {
+        return false;
+    }
+
+    char magic[sizeof(CACHE_MAGIC)];
+    b.readBytes(magic, sizeof(magic));
+    if ((memcmp(magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) != 0) || (b.readInt32() != CACHE_VERSION) || (b.readInt64() != b.size())) {
+        return false;
+    }
+
+    try {
+        const int numDependencies = b.readInt32();
+        for (int d = 0; d < numDependencies; ++d) {
+            const String& dependency = b.readString32();
+            MD5Hash expected(b), actual;
+            if (! hashFile(dependency, actual) || (actual != expected)) {
+                return false;
+            }
+        }
+
+        m_nextID = b.readInt32();
+
+        const int numParts = b.readInt32();
+        if ((numParts < 0) || (numParts > b.size())) {
+            throw CorruptEntry();
+        }
+        for (int p = 0; p < numParts; ++p) {
+            m_partArray.append(new Part("", nullptr, 0));
+        }
+        for (Part* part : m_partArray) {
+            part->name     = b.readString32();
+            part->uniqueID = b.readInt32();
+            const int parent = readIndex(b, numParts);
+            part->m_parent = (parent == -1) ? nullptr : m_partArray[parent];
+            part->cframe.deserialize(b);
+            part->inverseBindPoseTransform.deserialize(b);
+            const int numChildren = b.readInt32();
+            for (int c = 0; c < numChildren; ++c) {
+                const int child = readIndex(b, numParts);
+                if (child == -1) {
+                    throw CorruptEntry();
+                }
+                part->m_children.append(m_partArray[child]);
+            }
+        }
+
+        for (Array<Part*>* array : {&m_rootArray, &m_boneArray}) {
+            const int n = b.readInt32();
+            for (int i = 0; i < n; ++i) {
+                const int p = readIndex(b, numParts);
+                if (p == -1) {
+                    throw CorruptEntry();
+                }
+                array->append(m_partArray[p]);
+            }
+        }
+
+        const int numGeometry = b.readInt32();
+        for (int g = 0; g < numGeometry; ++g) {
+            Geometry* geometry = addGeometry(b.readString32());
+            CPUVertexArray& vertexArray = geometry->cpuVertexArray;
+            readPODArray(b, vertexArray.vertex);
+            readPODArray(b, vertexArray.texCoord1);
+            readPODArray(b, vertexArray.vertexColors);
+            readPODArray(b, vertexArray.boneIndices);
+            readPODArray(b, vertexArray.boneWeights);
+            readPODArray(b, vertexArray.prevPosition);
+            vertexArray.hasTexCoord0    = b.readBool8();
+            vertexArray.hasTexCoord1    = b.readBool8();
+            vertexArray.hasTangent      = b.readBool8();
+            vertexArray.hasBones        = b.readBool8();
+            vertexArray.hasVertexColors = b.readBool8();
+            geometry->sphereBounds.deserialize(b);
+            geometry->boxBounds.deserialize(b);
+        }
+
+        Array<shared_ptr<UniversalMaterial>> materialArray;
+        materialArray.resize(b.readInt32());
+        for (shared_ptr<UniversalMaterial>& material : materialArray) {
+            const String& name = b.readString32();
+            Any any;
+            any.deserialize(b);
+            material = UniversalMaterial::create(name, UniversalMaterial::Specification(any));
+        }
+
+        const int numMeshes = b.readInt32();
+        for (int m = 0; m < numMeshes; ++m) {
+            const String& name = b.readString32();
+            const int part     = readIndex(b, numParts);
+            const int geometry = readIndex(b, m_geometryArray.size());
+            const int material = readIndex(b, materialArray.size());
+
+            // Construct directly instead of with addMesh() to preserve the ID
+            Mesh* mesh = new Mesh(name, (part == -1) ? nullptr : m_partArray[part], (geometry == -1) ? nullptr : m_geometryArray[geometry], 0);
+            m_meshArray.append(mesh);
+            mesh->material  = (material == -1) ? nullptr : materialArray[material];
+            mesh->primitive.deserialize(b);
+            mesh->twoSided  = b.readBool8();
+            mesh->uniqueID  = b.readInt32();
+            mesh->sphereBounds.deserialize(b);
+            mesh->boxBounds.deserialize(b);
+
+            mesh->contributingJoints.fastClear();
+            const int numJoints = b.readInt32();
+            for (int j = 0; j < numJoints; ++j) {
+                const int joint = readIndex(b, numParts);
+                mesh->contributingJoints.append((joint == -1) ? nullptr : m_partArray[joint]);
+            }
+            readPODArray(b, mesh->cpuIndexArray);
+        }
+
+        const int numAnimations = b.readInt32();
+        for (int a = 0; a < numAnimations; ++a) {
+            Animation& animation = m_animationTable.getCreate(b.readString32());
+            animation.duration = b.readFloat64();
+            const int numSplines = b.readInt32();
+            for (int s = 0; s < numSplines; ++s) {
+                const String& partName = b.readString32();
+                Any any;
+                any.deserialize(b);
+                animation.poseSpline.partSpline.set(partName, PhysicsFrameSpline(any));
+            }
+        }
+
+        m_mtlArray.resize(b.readInt32());
+        for (String& mtl : m_mtlArray) {
+            mtl = b.readString32();
+        }
+
+        if (b.getPosition() != b.size()) {
+            throw CorruptEntry();
+        }
+    } catch (...) {
+        // Leave the model empty for the regular loader
+        m_partArray.invokeDeleteOnAllElements();
+        m_meshArray.invokeDeleteOnAllElements();
+        m_geometryArray.invokeDeleteOnAllElements();
+        m_partArray.fastClear();
+        m_meshArray.fastClear();
+        m_geometryArray.fastClear();
+        m_rootArray.fastClear();
+        m_boneArray.fastClear();
+        m_animationTable.clear();
+        m_mtlArray.fastClear();
+        m_nextID = 1;
+        return false;
+    }
+
+    return true;
+}
+
+} // namespace G3D
@@ -38,6 +38,14 @@ BumpMap::Specification::Specification(const Any& any) {
 }
 
 
+Any BumpMap::Specification::toAny() const {
+    Any any(Any::TABLE, "BumpMap::Specification");
+    any["texture"]  = texture;
+    any["settings"] = settings;
+    return any;
+}
+
+
 BumpMap::BumpMap(const shared_ptr<MapComponent<Image4>>& normalBump, const Settings& settings) : 
     m_normalBump(normalBump), m_settings(settings) {
 }
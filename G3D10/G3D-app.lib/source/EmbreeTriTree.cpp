@@ -382,6 +382,13 @@ void EmbreeTriTree::intersectRays
     }
     context.userRayExt = (void*)&adapter;
 
+    // Embree only reorders rays within each rtcIntersect1M call, so sort the whole batch first
+    Array<int> order;
+    if (shouldSortRays(rays.size(), options)) {
+        sortRays(rays, order);
+    }
+    const int* index = (order.size() > 0) ? order.getCArray() : nullptr;
+
     // Using raw pointers instead of C++ arrays gave no performance increase for the code below
     static const size_t grainSize = 64;
     tbb::parallel_for(tbb::blocked_range<size_t>(0, rays.size(), grainSize), [&](const tbb::blocked_range<size_t>& r) {
@@ -396,24 +403,25 @@ void EmbreeTriTree::intersectRays
             const size_t numRays = min(BLOCK_SIZE, end - r);
 
             for (size_t i = 0; i < numRays; ++i) {
-                apiConvert(rays[r + i], rtcRays[i]);
+                apiConvert(rays[index ? index[r + i] : (r + i)], rtcRays[i]);
             }
 
             (occlusionOnly ? rtcOccluded1M : rtcIntersect1M)(m_scene, &context, rtcRays, numRays, sizeof(RTCRay));
 
             for (size_t i = 0; i < numRays; ++i) {
                 RTCRay& rtcRay = rtcRays[i];
+                Hit& result = results[index ? index[r + i] : (r + i)];
                 if (rtcRay.geomID != RTC_INVALID_GEOMETRY_ID) {
                     // Hit
                     if (occlusionOnly) {
-                        apiConvertOcclusion(rtcRay, results[r + i]);
+                        apiConvertOcclusion(rtcRay, result);
                     } else {
                         const int triIndex = ((rtcRay.geomID == m_alphaGeomID) ? m_alphaTriangleArray : m_opaqueTriangleArray)[rtcRay.primID].triIndex;
-                        apiConvert(rtcRay, triIndex, results[r + i]);
+                        apiConvert(rtcRay, triIndex, result);
                     }                   
                 } else {
                     // Miss
-                    results[r + i].triIndex = Hit::NONE;
+                    result.triIndex = Hit::NONE;
                 }
             } // for each ray
         } // for 
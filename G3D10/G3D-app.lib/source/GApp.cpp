@@ -109,6 +109,7 @@ GApp* GApp::current() {
 
 void GApp::setCurrent(GApp* gApp) {
     s_currentGApp = gApp;
+    FrameArenaMemoryManager::setCurrent(gApp ? gApp->m_frameArena : nullptr);
 }
 
 
@@ -445,6 +446,9 @@ GApp::GApp(const Settings& settings, OSWindow* window, RenderDevice* rd, bool cr
     m_lastDebugID(0),
     m_screenCapture(nullptr),
     m_submitToDisplayMode(SubmitToDisplayMode::MAXIMIZE_THROUGHPUT),
+    m_frameTaskGraphEnabled(false),
+    m_frameTaskGraphRunning(false),
+    m_frameArena(FrameArenaMemoryManager::create()),
     m_settings(settings),
     m_renderPeriod(1),
     m_endProgram(false),
@@ -1289,13 +1293,139 @@ void GApp::resize(int w, int h) {
 }
 
 
+void GApp::simulateOneStep(RealTime timeStep) {
+    m_simulationWatch.tick();
+    BEGIN_PROFILER_EVENT("Simulation");
+    {
+        RealTime rdt = timeStep;
+
+        SimTime sdt = m_simTimeStep;
+        if (sdt == MATCH_REAL_TIME_TARGET) {
+            sdt = m_wallClockTargetDuration;
+        } else if (sdt == REAL_TIME) {
+            sdt = float(timeStep);
+        }
+        sdt *= m_simTimeScale;
+
+        SimTime idt = m_wallClockTargetDuration;
+
+        onBeforeSimulation(rdt, sdt, idt);
+        onSimulation(rdt, sdt, idt);
+        onAfterSimulation(rdt, sdt, idt);
+
+        m_previousSimTimeStep = float(sdt);
+        m_previousRealTimeStep = float(rdt);
+        setRealTime(realTime() + rdt);
+        setSimTime(simTime() + sdt);
+    }
+    m_simulationWatch.tock();
+    END_PROFILER_EVENT();
+}
+
+
+void GApp::poseOneFrame() {
+    BEGIN_PROFILER_EVENT("Pose");
+    m_poseWatch.tick(); {
+        m_posed3D.fastClear();
+        m_posed2D.fastClear();
+        onPose(m_posed3D, m_posed2D);
+
+        // The debug camera is not in the scene, so we have
+        // to explicitly pose it. This actually does nothing, but
+        // it allows us to trigger the TAA code.
+        m_debugCamera->onPose(m_posed3D);
+    } m_poseWatch.tock();
+    END_PROFILER_EVENT();
+}
+
+
+void GApp::runFrameTaskGraph(RealTime timeStep, bool pose) {
+    typedef TaskGraph::Affinity Affinity;
+    m_frameTaskGraph.clear();
+    FramePhaseTasks phase;
+
+    phase.userInput = m_frameTaskGraph.add("GApp::onUserInput", [this]() {
+        m_userInputWatch.tick();
+        if (manageUserInput) {
+            processGEventQueue();
+        }
+        onAfterEvents();
+        onUserInput(userInput);
+        m_userInputWatch.tock();
+
+        if (notNull(m_gazeTracker)) {
+            BEGIN_PROFILER_EVENT("GApp::sampleGazeTrackerData");
+            sampleGazeTrackerData();
+            END_PROFILER_EVENT();
+        }
+    }, Affinity::CALLING_THREAD);
+
+    // The WidgetManager is not threadsafe, so its part of the default onNetwork and onAI
+    // stays on this thread and the application's part runs on the worker pool
+    phase.widgets = m_frameTaskGraph.add("WidgetManager::onNetwork/onAI", [this]() {
+        m_widgetManager->onNetwork();
+        m_widgetManager->onAI();
+    }, Affinity::CALLING_THREAD, { phase.userInput });
+
+    phase.network = m_frameTaskGraph.add("GApp::onNetwork", [this]() {
+        BEGIN_PROFILER_EVENT("GApp::onNetwork");
+        m_networkWatch.tick();
+        onNetwork();
+        m_networkWatch.tock();
+        END_PROFILER_EVENT();
+    }, Affinity::ANY_THREAD, { phase.widgets });
+
+    phase.ai = m_frameTaskGraph.add("GApp::onAI", [this]() {
+        m_logicWatch.tick();
+        BEGIN_PROFILER_EVENT("GApp::onAI");
+        onAI();
+        END_PROFILER_EVENT();
+        m_logicWatch.tock();
+    }, Affinity::ANY_THREAD, { phase.network });
+
+    phase.simulation = m_frameTaskGraph.add("GApp::onSimulation", [this, timeStep]() {
+        simulateOneStep(timeStep);
+    }, Affinity::CALLING_THREAD, { phase.widgets });
+
+    if (pose) {
+        phase.pose = m_frameTaskGraph.add("GApp::onPose", [this]() {
+            poseOneFrame();
+        }, Affinity::CALLING_THREAD, { phase.network, phase.ai, phase.simulation });
+    }
+
+    const int numBuiltInTasks = m_frameTaskGraph.size();
+    onBuildFrameTaskGraph(m_frameTaskGraph, phase);
+
+    if (pose) {
+        // Application jobs must finish before their results are posed
+        for (TaskGraph::TaskID t = numBuiltInTasks; t < m_frameTaskGraph.size(); ++t) {
+            m_frameTaskGraph.addDependency(t, phase.pose);
+        }
+    }
+
+    m_frameTaskGraphRunning = true;
+    m_frameTaskGraph.run();
+    m_frameTaskGraphRunning = false;
+}
+
+
 void GApp::oneFrame() {
-    for (int repeat = 0; repeat < max(1, m_renderPeriod); ++repeat) {
+    m_frameArena->beginFrame();
+
+    const int numSteps = max(1, m_renderPeriod);
+    bool posed = false;
+    for (int repeat = 0; repeat < numSteps; ++repeat) {
         Profiler::nextFrame();
         m_lastTime = m_now;
         m_now = System::time();
         RealTime timeStep = m_now - m_lastTime;
 
+        if (m_frameTaskGraphEnabled) {
+            posed = (repeat == numSteps - 1);
+            runFrameTaskGraph(timeStep, posed);
+            continue;
+        }
+
         // Logic
         m_logicWatch.tick();
         BEGIN_PROFILER_EVENT("GApp::onAI");
@@ -1326,47 +1456,13 @@ void GApp::oneFrame() {
         END_PROFILER_EVENT();
 
         // Simulation
-        m_simulationWatch.tick();
-        BEGIN_PROFILER_EVENT("Simulation");
-        {
-            RealTime rdt = timeStep;
-
-            SimTime sdt = m_simTimeStep;
-            if (sdt == MATCH_REAL_TIME_TARGET) {
-                sdt = m_wallClockTargetDuration;
-            } else if (sdt == REAL_TIME) {
-                sdt = float(timeStep);
-            }
-            sdt *= m_simTimeScale;
-
-            SimTime idt = m_wallClockTargetDuration;
-
-            onBeforeSimulation(rdt, sdt, idt);
-            onSimulation(rdt, sdt, idt);
-            onAfterSimulation(rdt, sdt, idt);
-
-            m_previousSimTimeStep = float(sdt);
-            m_previousRealTimeStep = float(rdt);
-            setRealTime(realTime() + rdt);
-            setSimTime(simTime() + sdt);
-        }
-        m_simulationWatch.tock();
-        END_PROFILER_EVENT();
+        simulateOneStep(timeStep);
     }
     
     // Pose
-    BEGIN_PROFILER_EVENT("Pose");
-    m_poseWatch.tick(); {
-        m_posed3D.fastClear();
-        m_posed2D.fastClear();
-        onPose(m_posed3D, m_posed2D);
-
-        // The debug camera is not in the scene, so we have
-        // to explicitly pose it. This actually does nothing, but
-        // it allows us to trigger the TAA code.
-        m_debugCamera->onPose(m_posed3D);
-    } m_poseWatch.tock();
-    END_PROFILER_EVENT();
+    if (! posed) {
+        poseOneFrame();
+    }
 
     // Wait
     // Note: we might end up spending all of our time inside of
@@ -1621,12 +1717,17 @@ void GApp::onPose(Array<shared_ptr<Surface> >& surface, Array<shared_ptr<Surface
 
 
 void GApp::onNetwork() {
-    m_widgetManager->onNetwork();
+    // Otherwise FramePhaseTasks::widgets already invoked it on the main thread
+    if (! m_frameTaskGraphRunning) {
+        m_widgetManager->onNetwork();
+    }
 }
 
 
 void GApp::onAI() {
-    m_widgetManager->onAI();
+    if (! m_frameTaskGraphRunning) {
+        m_widgetManager->onAI();
+    }
 }
 
 
@@ -0,0 +1,572 @@
+/**
+  \file G3D-app.lib/source/InstancedTriTree.cpp
+
+  G3D Innovation Engine http://casual-effects.com/g3d
+  Copyright 2000-2019, Morgan McGuire
+  All rights reserved
+  Available under the BSD License
+*/
+#include <algorithm>
+#include "G3D-base/Box.h"
+#include "G3D-base/Sphere.h"
+#include "G3D-base/CollisionDetection.h"
+#include "G3D-base/Triangle.h"
+#include "G3D-app/InstancedTriTree.h"
+#include "G3D-app/UniversalSurface.h"
+#include "G3D-app/UniversalMaterial.h"
+#include "G3D-app/Model.h"
+
+namespace G3D {
+
+/** Slab test. On success, \a tEntry is the distance at which the ray enters the box. */
+static bool rayIntersectsBox(const AABox& box, const Point3& origin, const Vector3& invDirection, float tMin, float tMax, float& tEntry) {
+    const Vector3 t0 = (box.low()  - origin) * invDirection;
+    const Vector3 t1 = (box.high() - origin) * invDirection;
+    tEntry = G3D::max(tMin, t0.min(t1).max());
+    return tEntry <= G3D::min(tMax, t0.max(t1).min());
+}
+
+
+InstancedTriTree::InstancedTriTree(const BottomLevelFactory& createBottomLevel) :
+    m_createBottomLevel(createBottomLevel) {
+
+    if (! m_createBottomLevel) {
+        m_createBottomLevel = [] { return TriTree::create(false); };
+    }
+}
+
+
+shared_ptr<InstancedTriTree> InstancedTriTree::create(const BottomLevelFactory& createBottomLevel) {
+    return createShared<InstancedTriTree>(createBottomLevel);
+}
+
+
+void InstancedTriTree::clear() {
+    TriTreeBase::clear();
+    m_geometryCache.clear();
+    m_looseGeometry = nullptr;
+    m_looseSurfaceArray.fastClear();
+    m_instance.fastClear();
+    m_node.fastClear();
+    m_leafInstance.fastClear();
+    m_builtArea = 0.0f;
+}
+
+
+shared_ptr<InstancedTriTree::Geometry> InstancedTriTree::geometry(const shared_ptr<UniversalSurface>& surface, ImageStorage newStorage) {
+    const UniversalSurface::CPUGeom& cpuGeom = surface->cpuGeom();
+    const shared_ptr<UniversalMaterial>& material = surface->material();
+
+    GeometryKey key;
+    key.vertexArray = cpuGeom.vertexArray;
+    key.index       = cpuGeom.index;
+    key.material    = material.get();
+    key.twoSided    = notNull(surface->gpuGeom()) && surface->gpuGeom()->twoSided;
+
+    shared_ptr<Geometry>& geometry = m_geometryCache.getCreate(key);
+
+    // The key is made of raw pointers, so it is only trustworthy while the Model that owns them is alive
+    if (isNull(geometry) || (geometry->model.lock() != surface->model())) {
+        geometry = std::make_shared<Geometry>();
+        geometry->model = surface->model();
+        geometry->tree  = m_createBottomLevel();
+
+        const CPUVertexArray& source = *cpuGeom.vertexArray;
+        const Array<int>&     index  = *cpuGeom.index;
+
+        CPUVertexArray& vertexArray = geometry->tree->vertexArray();
+        Array<Tri>&     triArray    = geometry->tree->triArray();
+        vertexArray.clear();
+        triArray.fastClear();
+        vertexArray.hasTexCoord0    = source.hasTexCoord0;
+        vertexArray.hasTexCoord1    = source.hasTexCoord1;
+        vertexArray.hasTangent      = source.hasTangent;
+        vertexArray.hasVertexColors = source.hasVertexColors;
+
+        // Compact to the vertices that this index array references, since
+        // several meshes usually share one CPUVertexArray
+        Array<int> remap;
+        remap.resize(source.size());
+        remap.setAll(-1);
+        for (int i = 0; i < index.size(); ++i) {
+            int& r = remap[index[i]];
+            if (r < 0) {
+                r = vertexArray.size();
+                const CPUVertexArray::Vertex& v = source.vertex[index[i]];
+                vertexArray.vertex.append(v);
+                geometry->bounds.merge(v.position);
+                if (source.hasTexCoord1) {
+                    vertexArray.texCoord1.append(source.texCoord1[index[i]]);
+                }
+                if (source.hasVertexColors) {
+                    vertexArray.vertexColors.append(source.vertexColors[index[i]]);
+                }
+            }
+        }
+
+        // The bottom level stores the material so that it can run alpha tests
+        // without holding on to a particular posed Surface
+        const bool hasPartialCoverage = notNull(material) && material->hasPartialCoverage();
+        triArray.reserve(index.size() / 3);
+        for (int i = 0; i < index.size(); i += 3) {
+            triArray.append(Tri(remap[index[i]], remap[index[i + 1]], remap[index[i + 2]],
+                                vertexArray, material, key.twoSided, hasPartialCoverage));
+        }
+        Tri::setStorage(triArray, newStorage);
+
+        geometry->tree->rebuild();
+        ++m_stats.numBottomLevelBuilds;
+    }
+
+    geometry->live = true;
+    return geometry;
+}
+
+
+shared_ptr<InstancedTriTree::Geometry> InstancedTriTree::createLooseGeometry(const Array<shared_ptr<Surface>>& surfaceArray, ImageStorage newStorage) {
+    const shared_ptr<Geometry>& geometry = std::make_shared<Geometry>();
+    geometry->tree = m_createBottomLevel();
+
+    CPUVertexArray& vertexArray = geometry->tree->vertexArray();
+    Array<Tri>&     triArray    = geometry->tree->triArray();
+    vertexArray.clear();
+    triArray.fastClear();
+    Surface::getTris(surfaceArray, vertexArray, triArray, false);
+
+    for (const CPUVertexArray::Vertex& v : vertexArray.vertex) {
+        geometry->bounds.merge(v.position);
+    }
+
+    geometry->tree->rebuild();
+    ++m_stats.numBottomLevelBuilds;
+    return geometry;
+}
+
+
+void InstancedTriTree::updateInstance(int i) {
+    Instance&             instance = m_instance[i];
+    const TriTree&        tree     = *instance.geometry->tree;
+    const CPUVertexArray& source   = tree.vertexArray();
+
+    CPUVertexArray::Vertex* dst = m_vertexArray.vertex.getCArray() + instance.firstVertex;
+    for (int v = 0; v < source.size(); ++v) {
+        dst[v] = source.vertex[v];
+        dst[v].transformBy(instance.frame);
+    }
+
+    if (notNull(instance.surface)) {
+        Tri* tri = m_triArray.getCArray() + instance.firstTri;
+        for (int t = 0; t < tree.size(); ++t) {
+            tri[t].setData(instance.surface);
+        }
+    }
+
+    instance.frame.toWorldSpace(instance.geometry->bounds).getBounds(instance.bounds);
+}
+
+
+void InstancedTriTree::flatten() {
+    m_triArray.fastClear();
+    m_vertexArray.clear();
+
+    for (Instance& instance : m_instance) {
+        const TriTree& tree = *instance.geometry->tree;
+        instance.firstTri    = m_triArray.size();
+        instance.firstVertex = m_vertexArray.size();
+
+        m_vertexArray.transformAndAppend(tree.vertexArray(), instance.frame);
+
+        m_triArray.resize(instance.firstTri + tree.size());
+        Tri* dst = m_triArray.getCArray() + instance.firstTri;
+        for (int t = 0; t < tree.size(); ++t) {
+            dst[t] = tree[t];
+            for (int k = 0; k < 3; ++k) {
+                dst[t].index[k] += instance.firstVertex;
+            }
+            if (notNull(instance.surface)) {
+                dst[t].setData(instance.surface);
+            }
+        }
+
+        instance.frame.toWorldSpace(instance.geometry->bounds).getBounds(instance.bounds);
+    }
+}
+
+
+void InstancedTriTree::setContents
+   (const Array<shared_ptr<Surface>>&  surfaceArray,
+    ImageStorage                       newStorage) {
+
+    m_sky = nullptr;
+
+    for (FlatTable<GeometryKey, shared_ptr<Geometry>, GeometryKey, GeometryKey>::Iterator it = m_geometryCache.begin(); it.isValid(); ++it) {
+        it->value->live = false;
+    }
+
+    Array<Instance> instanceArray;
+    Array<shared_ptr<Surface>> looseArray;
+    instanceArray.reserve(surfaceArray.size() + 1);
+
+    for (const shared_ptr<Surface>& surface : surfaceArray) {
+        const shared_ptr<UniversalSurface>& uniS = dynamic_pointer_cast<UniversalSurface>(surface);
+        if (isNull(uniS) || isNull(uniS->cpuGeom().index) || isNull(uniS->cpuGeom().vertexArray)) {
+            looseArray.append(surface);
+        } else if (uniS->cpuGeom().index->size() > 0) {
+            Instance& instance = instanceArray.next();
+            instance.geometry = geometry(uniS, newStorage);
+            instance.surface  = surface;
+            instance.id       = uniS->rigidBodyID();
+            uniS->getCoordinateFrame(instance.frame, false);
+        }
+    }
+
+    // Drop the bottom-level trees that nothing referenced this time
+    {
+        Array<GeometryKey> stale;
+        for (FlatTable<GeometryKey, shared_ptr<Geometry>, GeometryKey, GeometryKey>::Iterator it = m_geometryCache.begin(); it.isValid(); ++it) {
+            if (! it->value->live) {
+                stale.append(it->key);
+            }
+        }
+        for (const GeometryKey& key : stale) {
+            m_geometryCache.remove(key);
+        }
+    }
+
+    // The non-UniversalSurfaces have no object space to cache in, so they
+    // share one world-space tree that is rebuilt only when they change
+    bool looseChanged = (looseArray.size() != m_looseSurfaceArray.size());
+    for (int i = 0; (i < looseArray.size()) && ! looseChanged; ++i) {
+        looseChanged = (looseArray[i]->lastChangeTime() > m_lastBuildTime);
+    }
+    if (looseChanged) {
+        m_looseSurfaceArray = looseArray;
+        m_looseGeometry = looseArray.size() > 0 ? createLooseGeometry(looseArray, newStorage) : nullptr;
+    }
+    if (notNull(m_looseGeometry) && (m_looseGeometry->tree->size() > 0)) {
+        // Always last, so that it can be replaced without moving any other instance
+        instanceArray.next().geometry = m_looseGeometry;
+    }
+
+    // Same instances of the same geometry as last time?
+    bool sameInstances = (instanceArray.size() == m_instance.size());
+    for (int i = 0; (i < instanceArray.size()) && sameInstances; ++i) {
+        const Instance& a = instanceArray[i];
+        const Instance& b = m_instance[i];
+        sameInstances = (a.id == b.id) && ((a.geometry == b.geometry) || ((a.geometry == m_looseGeometry) && (b.id == 0) && isNull(b.surface)));
+    }
+
+    if (sameInstances) {
+        bool looseReplaced = false;
+        Array<int> changed;
+        for (int i = 0; i < instanceArray.size(); ++i) {
+            Instance& instance = m_instance[i];
+            if (instance.geometry != instanceArray[i].geometry) {
+                // Replace the loose instance, which is at the end of the flattened arrays
+                debugAssert(i == m_instance.size() - 1);
+                const TriTree& tree = *instanceArray[i].geometry->tree;
+                instance.geometry = instanceArray[i].geometry;
+
+                m_vertexArray.vertex.resize(instance.firstVertex);
+                m_vertexArray.texCoord1.resize(G3D::min(m_vertexArray.texCoord1.size(), instance.firstVertex));
+                m_vertexArray.vertexColors.resize(G3D::min(m_vertexArray.vertexColors.size(), instance.firstVertex));
+                m_vertexArray.transformAndAppend(tree.vertexArray(), instance.frame);
+
+                m_triArray.resize(instance.firstTri + tree.size());
+                for (int t = 0; t < tree.size(); ++t) {
+                    Tri& tri = m_triArray[instance.firstTri + t];
+                    tri = tree[t];
+                    for (int k = 0; k < 3; ++k) {
+                        tri.index[k] += instance.firstVertex;
+                    }
+                }
+                instance.bounds = instance.geometry->bounds;
+                looseReplaced = true;
+            } else if (instance.frame != instanceArray[i].frame) {
+                instance.frame   = instanceArray[i].frame;
+                instance.surface = instanceArray[i].surface;
+                changed.append(i);
+            }
+        }
+
+        if ((changed.size() > 0) || looseReplaced) {
+            runConcurrently(0, changed.size(), [&](int c) { updateInstance(changed[c]); });
+
+            if (refitTopLevel() > m_builtArea * REBUILD_AREA_RATIO) {
+                buildTopLevel();
+                ++m_stats.numRebuilds;
+            } else {
+                ++m_stats.numRefits;
+            }
+        }
+    } else {
+        m_instance.swap(instanceArray);
+        flatten();
+        buildTopLevel();
+        ++m_stats.numRebuilds;
+    }
+
+    Surface::setStorage(surfaceArray, newStorage);
+    m_lastBuildTime = System::time();
+}
+
+
+void InstancedTriTree::rebuild() {
+    m_geometryCache.clear();
+    m_looseSurfaceArray.fastClear();
+    m_instance.fastClear();
+    m_looseGeometry = nullptr;
+
+    if (m_triArray.size() > 0) {
+        // Already flat, so the whole scene is one world-space instance
+        const shared_ptr<Geometry>& geometry = std::make_shared<Geometry>();
+        geometry->tree = m_createBottomLevel();
+        geometry->tree->triArray() = m_triArray;
+        geometry->tree->vertexArray().copyFrom(m_vertexArray);
+        for (const CPUVertexArray::Vertex& v : m_vertexArray.vertex) {
+            geometry->bounds.merge(v.position);
+        }
+        geometry->tree->rebuild();
+        ++m_stats.numBottomLevelBuilds;
+
+        // Hit::triIndex refers to the bottom level's order
+        m_triArray = geometry->tree->triArray();
+
+        Instance& instance = m_instance.next();
+        instance.geometry = geometry;
+        instance.bounds   = geometry->bounds;
+    }
+
+    buildTopLevel();
+    ++m_stats.numRebuilds;
+    m_lastBuildTime = System::time();
+}
+
+
+void InstancedTriTree::buildTopLevel() {
+    m_node.fastClear();
+    m_leafInstance.resize(m_instance.size());
+    for (int i = 0; i < m_leafInstance.size(); ++i) {
+        m_leafInstance[i] = i;
+    }
+
+    m_builtArea = 0.0f;
+    if (m_instance.size() > 0) {
+        buildTopLevel(0, m_instance.size());
+        for (const Node& node : m_node) {
+            m_builtArea += node.bounds.area();
+        }
+    }
+}
+
+
+int InstancedTriTree::buildTopLevel(int begin, int end) {
+    const int n = m_node.size();
+    m_node.next();
+
+    AABox bounds, centerBounds;
+    for (int i = begin; i < end; ++i) {
+        const AABox& b = m_instance[m_leafInstance[i]].bounds;
+        bounds.merge(b);
+        centerBounds.merge(b.center());
+    }
+    m_node[n].bounds = bounds;
+
+    if ((end - begin <= MAX_INSTANCES_PER_LEAF) || (centerBounds.extent().max() == 0.0f)) {
+        m_node[n].index = begin;
+        m_node[n].count = end - begin;
+        return n;
+    }
+
+    // Median split along the longest axis of the instance centers
+    const int axis   = centerBounds.extent().primaryAxis();
+    const int median = (begin + end) / 2;
+    int* leaf = m_leafInstance.getCArray();
+    std::nth_element(leaf + begin, leaf + median, leaf + end, [&](int a, int b) {
+        return m_instance[a].bounds.center()[axis] < m_instance[b].bounds.center()[axis];
+    });
+
+    buildTopLevel(begin, median);
+    const int second = buildTopLevel(median, end);
+
+    // m_node may have been reallocated by the recursion
+    m_node[n].index = second;
+    m_node[n].count = 0;
+    return n;
+}
+
+
+float InstancedTriTree::refitTopLevel() {
+    float area = 0.0f;
+    // Children always follow their parent
+    for (int n = m_node.size() - 1; n >= 0; --n) {
+        Node& node = m_node[n];
+        if (node.isLeaf()) {
+            node.bounds = m_instance[m_leafInstance[node.index]].bounds;
+            for (int i = 1; i < node.count; ++i) {
+                node.bounds.merge(m_instance[m_leafInstance[node.index + i]].bounds);
+            }
+        } else {
+            node.bounds = m_node[n + 1].bounds;
+            node.bounds.merge(m_node[node.index].bounds);
+        }
+        area += node.bounds.area();
+    }
+    return area;
+}
+
+
+bool InstancedTriTree::intersectRay
+   (const Ray&                          ray,
+    Hit&                                hit,
+    IntersectRayOptions                 options) const {
+
+    hit.triIndex = Hit::NONE;
+    if (m_node.size() == 0) {
+        return false;
+    }
+
+    const Vector3 invDirection = Vector3::one() / ray.direction();
+    float maxDistance = ray.maxDistance();
+
+    // Node index and entry distance. The depth of a median-split tree is logarithmic.
+    class StackEntry {
+    public:
+        int     node;
+        float   tEntry;
+    } stack[64];
+    int top = 0;
+
+    float tEntry;
+    if (rayIntersectsBox(m_node[0].bounds, ray.origin(), invDirection, ray.minDistance(), maxDistance, tEntry)) {
+        stack[top++] = {0, tEntry};
+    }
+
+    while (top > 0) {
+        const StackEntry entry = stack[--top];
+        if (entry.tEntry > maxDistance) {
+            // A closer hit was found after this node was pushed
+            continue;
+        }
+
+        const Node& node = m_node[entry.node];
+        if (node.isLeaf()) {
+            for (int i = 0; i < node.count; ++i) {
+                const Instance& instance = m_instance[m_leafInstance[node.index + i]];
+
+                // Instances are rigid, so distances are the same in object space
+                const Ray objectRay = Ray::fromOriginAndDirection
+                    (instance.frame.pointToObjectSpace(ray.origin()),
+                     instance.frame.vectorToObjectSpace(ray.direction()),
+                     ray.minDistance(), maxDistance);
+
+                Hit objectHit;
+                if (instance.geometry->tree->intersectRay(objectRay, objectHit, options)) {
+                    hit = objectHit;
+                    // Occlusion tests do not report a triIndex, but the result must not be NONE
+                    hit.triIndex = G3D::max(objectHit.triIndex, 0) + instance.firstTri;
+                    if ((options & OCCLUSION_TEST_ONLY) != 0) {
+                        return true;
+                    }
+                    maxDistance = objectHit.distance;
+                }
+            }
+        } else {
+            const int   child[2] = { entry.node + 1, node.index };
+            float       t[2];
+            bool        visit[2];
+            for (int c = 0; c < 2; ++c) {
+                visit[c] = rayIntersectsBox(m_node[child[c]].bounds, ray.origin(), invDirection, ray.minDistance(), maxDistance, t[c]);
+            }
+
+            // Push the farther child first, so that the nearer one is visited first
+            const int nearer = (t[1] < t[0]) ? 1 : 0;
+            if (visit[1 - nearer]) {
+                stack[top++] = {child[1 - nearer], t[1 - nearer]};
+            }
+            if (visit[nearer]) {
+                stack[top++] = {child[nearer], t[nearer]};
+            }
+        }
+    }
+
+    return hit.triIndex != Hit::NONE;
+}
+
+
+void InstancedTriTree::forEachInstance(const AABox& box, const std::function<void(int)>& visit) const {
+    if (m_node.size() == 0) {
+        return;
+    }
+
+    int stack[64];
+    int top = 0;
+    stack[top++] = 0;
+    while (top > 0) {
+        const int n = stack[--top];
+        const Node& node = m_node[n];
+        if (! node.bounds.intersects(box)) {
+            continue;
+        }
+
+        if (node.isLeaf()) {
+            for (int i = 0; i < node.count; ++i) {
+                const int instanceIndex = m_leafInstance[node.index + i];
+                if (m_instance[instanceIndex].bounds.intersects(box)) {
+                    visit(instanceIndex);
+                }
+            }
+        } else {
+            stack[top++] = node.index;
+            stack[top++] = n + 1;
+        }
+    }
+}
+
+
+void InstancedTriTree::intersectBox
+   (const AABox&                        box,
+    Array<int>&                         triIndex) const {
+
+    Array<int> candidates;
+    forEachInstance(box, [&](int i) {
+        const Instance& instance = m_instance[i];
+
+        // The object-space query is conservative; test exactly against the world-space triangles
+        AABox objectBox;
+        instance.frame.toObjectSpace(box).getBounds(objectBox);
+        candidates.fastClear();
+        instance.geometry->tree->intersectBox(objectBox, candidates);
+
+        for (const int t : candidates) {
+            const Tri& tri = m_triArray[instance.firstTri + t];
+            if (CollisionDetection::fixedSolidBoxIntersectsFixedTriangle(box, Triangle(tri.position(m_vertexArray, 0),
+                                                                                       tri.position(m_vertexArray, 1),
+                                                                                       tri.position(m_vertexArray, 2)))) {
+                triIndex.append(instance.firstTri + t);
+            }
+        }
+    });
+}
+
+
+void InstancedTriTree::intersectSphere
+   (const Sphere&                       sphere,
+    Array<int>&                         triIndex) const {
+
+    AABox bounds;
+    sphere.getBounds(bounds);
+
+    forEachInstance(bounds, [&](int i) {
+        const Instance& instance = m_instance[i];
+
+        // Spheres are exact in object space
+        const int start = triIndex.size();
+        instance.geometry->tree->intersectSphere(instance.frame.toObjectSpace(sphere), triIndex);
+        for (int j = start; j < triIndex.size(); ++j) {
+            triIndex[j] += instance.firstTri;
+        }
+    });
+}
+
+} // G3D
@@ -10,6 +10,7 @@
 #include "G3D-base/AreaMemoryManager.h"
 #include "G3D-base/Intersect.h"
 #include "G3D-base/CollisionDetection.h"
+#include "G3D-base/FileSystem.h"
 #include "G3D-app/NativeTriTree.h"
 #include "G3D-gfx/RenderDevice.h"
 #include "G3D-app/Draw.h"
@@ -28,57 +29,135 @@ namespace G3D {
 #endif
 
 const char* NativeTriTree::algorithmName(SplitAlgorithm s) {
-    const char* n[] = {"Mean extent", "Median area", "Median count", "SAH"};
+    const char* n[] = {"Mean extent", "Median area", "Median count", "SAH", "Binned SAH"};
     return n[s];
 }
 
 
 void NativeTriTree::intersectSphere
    (const Sphere& sphere,
-    Array<Tri>&   triArray) const {
+    Array<int>&   triIndex) const {
     if (m_root) {
-        Set<Tri*> alreadyAdded;
-        m_root->intersectSphere(sphere, m_vertexArray, triArray, alreadyAdded);
+        const int start = triIndex.size();
+        m_root->intersectSphere(sphere, m_vertexArray, m_triArray.getCArray(), triIndex);
+        removeDuplicates(triIndex, start);
+    } else if (m_bvh4) {
+        m_bvh4->intersectSphere(sphere, triIndex);
+    } else if (m_bvh8) {
+        m_bvh8->intersectSphere(sphere, triIndex);
+    } else if (m_compressedBVH8) {
+        m_compressedBVH8->intersectSphere(sphere, m_vertexArray, triIndex);
     }
 }
 
 
 void NativeTriTree::intersectBox
    (const AABox&  box,
-    Array<Tri>&   triArray) const {
+    Array<int>&   triIndex) const {
     if (m_root) {
-        Set<Tri*> alreadyAdded;
-        m_root->intersectBox(box, m_vertexArray, triArray, alreadyAdded);
+        const int start = triIndex.size();
+        m_root->intersectBox(box, m_vertexArray, m_triArray.getCArray(), triIndex);
+        removeDuplicates(triIndex, start);
+    } else if (m_bvh4) {
+        m_bvh4->intersectBox(box, triIndex);
+    } else if (m_bvh8) {
+        m_bvh8->intersectBox(box, triIndex);
+    } else if (m_compressedBVH8) {
+        m_compressedBVH8->intersectBox(box, m_vertexArray, triIndex);
     }
 }
 
 
+void NativeTriTree::removeDuplicates(Array<int>& triIndex, int start) {
+    int* begin = triIndex.getCArray() + start;
+    int* end   = triIndex.getCArray() + triIndex.size();
+    std::sort(begin, end);
+    triIndex.resize(int(std::unique(begin, end) - triIndex.getCArray()), false);
+}
+
+
 void NativeTriTree::rebuild() {
-    if (m_root) {
-        m_root->destroy(m_memoryManager);
-        m_memoryManager->free(m_root);
-        m_root = nullptr;
-        m_memoryManager.reset();
-    }
+    freeTree();
 
-    Settings settings;
-    static const float epsilon = 0.000001f;
+    const Settings& settings = m_settings;
 
-    Array<Poly> source;
-    // Don't add 0 area triangles to source
-    for (int i = 0; i < m_triArray.size(); ++i) {
-        if (m_triArray[i].area() > epsilon) {
-            source.append(Poly(m_vertexArray, &m_triArray[i]));
+    const bool useCache = ! settings.cacheDirectory.empty() && (settings.layout != BIH);
+    MD5Hash key;
+    String cacheFilename;
+    if (useCache) {
+        key = contentHash();
+        for (int i = 0; i < 16; ++i) {
+            cacheFilename += format("%02x", key[i]);
+        }
+        cacheFilename = FilePath::concat(settings.cacheDirectory, cacheFilename + ".tritree");
+        if (load(cacheFilename, key)) {
+            return;
         }
     }
+
+    const auto build = [&] {
+        if (settings.layout == BVH4) {
+            m_bvh4 = std::make_shared<WideBVH<4>>();
+            m_bvh4->build(m_triArray, m_vertexArray, settings);
+            return;
+        } else if (settings.layout == BVH8) {
+            m_bvh8 = std::make_shared<WideBVH<8>>();
+            m_bvh8->build(m_triArray, m_vertexArray, settings);
+            return;
+        } else if (settings.layout == COMPRESSED_BVH8) {
+            // Leaf sizes must fit in CompressedBVH::Node::numTris
+            Settings wideSettings = settings;
+            wideSettings.valuesPerLeaf = min(settings.valuesPerLeaf, 252);
+            WideBVH<8> bvh;
+            bvh.build(m_triArray, m_vertexArray, wideSettings);
+            m_compressedBVH8 = std::make_shared<CompressedBVH>();
+            m_compressedBVH8->build(bvh, m_triArray);
+            return;
+        }
+
+        static const float epsilon = 0.000001f;
+
+        Array<Poly> source;
+        source.resize(m_triArray.size());
+        tbb::parallel_for(tbb::blocked_range<int>(0, m_triArray.size(), 4096), [&](const tbb::blocked_range<int>& r) {
+            for (int i = r.begin(); i < r.end(); ++i) {
+                source[i] = Poly(m_vertexArray, &m_triArray[i]);
+            }
+        });
+
+        // Don't add 0 area triangles to source
+        int numSources = 0;
+        for (int i = 0; i < source.size(); ++i) {
+            if (source[i].area() > epsilon) {
+                if (numSources < i) {
+                    source[numSources] = source[i];
+                }
+                ++numSources;
+            }
+        }
+        source.resize(numSources, false);
     
-    if (source.size() > 0) {
-        m_memoryManager = AreaMemoryManager::create();
-        m_root = new (m_memoryManager->alloc(sizeof(Node))) Node(source, settings, m_memoryManager);
+        if (source.size() > 0) {
+            // Only pay for locking if the children may be built concurrently
+            m_memoryManager = AreaMemoryManager::create(10 * 1024 * 1024, settings.numThreads != 1);
+            m_root = new (m_memoryManager->alloc(sizeof(Node))) Node(source, settings, m_memoryManager);
+        }
+    };
+
+    if (settings.numThreads > 0) {
+        // Limit the TBB algorithms and task groups within the build to this many threads
+        tbb::task_arena arena(settings.numThreads);
+        arena.execute(build);
+    } else {
+        build();
     }
 
     m_lastBuildTime = System::time();
 
+    if (useCache) {
+        save(cacheFilename, key);
+    }
+
     // alwaysAssertM(m_triArray.size() == m_triArray.capacity(), "Allocated too much memory for the Tri Array");
     // alwaysAssertM(m_vertexArray.vertex.size() == m_vertexArray.vertex.capacity(), "Allocated too much memory for the vertex array");
 }
@@ -165,9 +244,7 @@ void NativeTriTree::Node::split(Array<Poly>& original, const Settings& settings,
         // the triangle because otherwise it is being
         // multiplied at every split.
         const float maxArea = bounds.area() * settings.maxAreaFraction;
-        for (int j = 0; j < original.size(); ++j) {
-            original[j].split(axis, splitLocation, maxArea, lowArray, highArray, spanArray);
-        }
+        partition(original, axis, splitLocation, maxArea, lowArray, highArray, spanArray);
         
         if (badSplit(original.size(), lowArray.size(), highArray.size())) {
             if (i == 2) {
@@ -187,8 +264,19 @@ void NativeTriTree::Node::split(Array<Poly>& original, const Settings& settings,
                           format("Pointer is not a multiple of four bytes: %d", (int)(intptr_t)ptr));
             packedChildAxis = reinterpret_cast<uintptr_t>(ptr) | static_cast<uintptr_t>(axis);
 
-            new (ptr) Node(lowArray, settings, mm);
-            new (ptr + 1) Node(highArray, settings, mm);
+            const bool concurrent = mm->isThreadsafe() && (original.size() >= PARALLEL_BUILD_THRESHOLD);
+
+            // The caller has no further use for the originals, so release them before
+            // recursing. This bounds the peak memory of concurrent builds.
+            original.clear();
+
+            if (concurrent) {
+                tbb::parallel_invoke([&] { new (ptr) Node(lowArray, settings, mm); },
+                                     [&] { new (ptr + 1) Node(highArray, settings, mm); });
+            } else {
+                new (ptr) Node(lowArray, settings, mm);
+                new (ptr + 1) Node(highArray, settings, mm);
+            }
             return;
         }
     }
@@ -228,6 +316,9 @@ float NativeTriTree::Node::chooseSplitLocation(Array<Poly>& source, const Settin
         
     case SAH:
         return chooseSAHSplitLocation(source, axis, settings);
+
+    case BINNED_SAH:
+        return chooseBinnedSAHSplitLocation(source, axis, settings);
         
     default:
         alwaysAssertM(false, "Fell through switch");
@@ -373,11 +464,12 @@ float NativeTriTree::Node::chooseSAHSplitLocationAccurate(Array<Poly>& source, V
     positionSet.getMembers(position);
     positionSet.clear();
     
+    Array<Poly> lowArray, highArray, spanArray;
     int lowestCostIndex = 0;
     float lowestCost = (float)inf();
     //debugPrintf("\nChoosing split:\n");
     for (int i = 0; i < position.size(); ++i) {
-        float cost = SAHCost(axis, position[i], source, bounds.area(), settings);
+        float cost = SAHCost(axis, position[i], source, bounds.area(), settings, lowArray, highArray, spanArray);
         //debugPrintf("  pos = %f, cost = %f\n", position[i], cost);
         if (cost < lowestCost) {
             lowestCost = cost;
@@ -401,9 +493,15 @@ float NativeTriTree::Node::SAHCost(int size, float area, float containingArea) {
 }
 
 
-float NativeTriTree::Node::SAHCost(Vector3::Axis axis, float offset, const Array<Poly>& original, float containingArea, const Settings& settings) {
-    // TODO: pass these arrays in for thread-safing
-    static Array<Poly> lowArray, highArray, spanArray;
+float NativeTriTree::Node::SAHCost
+   (Vector3::Axis       axis,
+    float               offset,
+    const Array<Poly>&  original,
+    float               containingArea,
+    const Settings&     settings,
+    Array<Poly>&        lowArray,
+    Array<Poly>&        highArray,
+    Array<Poly>&        spanArray) {
     
     lowArray.fastClear();
     highArray.fastClear();
@@ -420,6 +518,175 @@ float NativeTriTree::Node::SAHCost(Vector3::Axis axis, float offset, const Array
 }
 
 
+float NativeTriTree::Node::chooseBinnedSAHSplitLocation(const Array<Poly>& source, Vector3::Axis axis, const Settings& settings) {
+    const int   numBins = iClamp(settings.numBins, 2, MAX_BINS);
+    const float base    = bounds.low()[axis];
+    const float extent  = bounds.extent()[axis];
+    if (extent <= 0.0f) {
+        // Every split along this axis is bad
+        return base;
+    }
+    const float binScale = numBins / extent;
+
+    // Plane b lies at the low edge of bin b. A poly is on the low side of
+    // it if the poly begins in a lower bin, and on the high side if it
+    // ends in bin b or above. Polys that span the plane count on both
+    // sides, because they will be clipped or stored at this node.
+    class Bins {
+    public:
+        /** Indexed by the bin containing each poly's low() */
+        int     beginCount[MAX_BINS];
+        Point3  beginLow[MAX_BINS];
+        Point3  beginHigh[MAX_BINS];
+
+        /** Indexed by the bin containing each poly's high() */
+        int     endCount[MAX_BINS];
+        Point3  endLow[MAX_BINS];
+        Point3  endHigh[MAX_BINS];
+
+        Bins(int numBins) {
+            for (int b = 0; b < numBins; ++b) {
+                beginCount[b] = endCount[b] = 0;
+                beginLow[b]   = endLow[b]   = Point3::inf();
+                beginHigh[b]  = endHigh[b]  = -Point3::inf();
+            }
+        }
+
+        Bins(const Bins& x, const Bins& y, int numBins) {
+            for (int b = 0; b < numBins; ++b) {
+                beginCount[b] = x.beginCount[b] + y.beginCount[b];
+                beginLow[b]   = x.beginLow[b].min(y.beginLow[b]);
+                beginHigh[b]  = x.beginHigh[b].max(y.beginHigh[b]);
+                endCount[b]   = x.endCount[b] + y.endCount[b];
+                endLow[b]     = x.endLow[b].min(y.endLow[b]);
+                endHigh[b]    = x.endHigh[b].max(y.endHigh[b]);
+            }
+        }
+    };
+
+    const Bins bins = parallelReduce(0, source.size(), Bins(numBins),
+        [&](int i0, int i1, Bins bins) {
+            for (int i = i0; i < i1; ++i) {
+                const Poly& poly = source[i];
+                const int b = iClamp(int((poly.low()[axis]  - base) * binScale), 0, numBins - 1);
+                const int e = iClamp(int((poly.high()[axis] - base) * binScale), 0, numBins - 1);
+                ++bins.beginCount[b];
+                bins.beginLow[b]  = bins.beginLow[b].min(poly.low());
+                bins.beginHigh[b] = bins.beginHigh[b].max(poly.high());
+                ++bins.endCount[e];
+                bins.endLow[e]    = bins.endLow[e].min(poly.low());
+                bins.endHigh[e]   = bins.endHigh[e].max(poly.high());
+            }
+            return bins;
+        },
+        [numBins](const Bins& x, const Bins& y) { return Bins(x, y, numBins); });
+
+    const float containingArea = bounds.area();
+
+    // Sweep from above for the high-side cost of each plane
+    float highCost[MAX_BINS];
+    {
+        int     n    = 0;
+        Vector3 low  = Vector3::inf();
+        Vector3 high = -Vector3::inf();
+        for (int b = numBins - 1; b > 0; --b) {
+            n   += bins.endCount[b];
+            low  = low.min(bins.endLow[b]);
+            high = high.max(bins.endHigh[b]);
+
+            Vector3 clippedLow = low;
+            clippedLow[axis] = max(low[axis], base + b / binScale);
+            highCost[b] = (n == 0) ? 0.0f : SAHCost(n, AABox(clippedLow.min(high), high).area(), containingArea);
+        }
+    }
+
+    // Sweep from below, tracking the best plane
+    float lowestCost         = finf();
+    float lowestCostPosition = bounds.center()[axis];
+    {
+        int     n    = 0;
+        Vector3 low  = Vector3::inf();
+        Vector3 high = -Vector3::inf();
+        for (int b = 1; b < numBins; ++b) {
+            n   += bins.beginCount[b - 1];
+            low  = low.min(bins.beginLow[b - 1]);
+            high = high.max(bins.beginHigh[b - 1]);
+
+            if ((n == 0) || (n == source.size())) {
+                // Everything is on one side
+                continue;
+            }
+
+            const float position = base + b / binScale;
+            Vector3 clippedHigh = high;
+            clippedHigh[axis] = min(high[axis], position);
+            const float cost = SAHCost(n, AABox(low, clippedHigh.max(low)).area(), containingArea) + highCost[b];
+            if (cost < lowestCost) {
+                lowestCost = cost;
+                lowestCostPosition = position;
+            }
+        }
+    }
+
+    return lowestCostPosition;
+}
+
+
+void NativeTriTree::Node::partition
+   (const Array<Poly>&   original,
+    Vector3::Axis        axis,
+    float                offset,
+    float                minSpanArea,
+    Array<Poly>&         lowArray,
+    Array<Poly>&         highArray,
+    Array<Poly>&         spanArray) {
+
+    if (original.size() < PARALLEL_BUILD_THRESHOLD) {
+        for (int j = 0; j < original.size(); ++j) {
+            original[j].split(axis, offset, minSpanArea, lowArray, highArray, spanArray);
+        }
+        return;
+    }
+
+    // Split fixed-size chunks concurrently, and then concatenate them in order
+    class Chunk {
+    public:
+        Array<Poly>     array[3];
+        int             offset[3];
+    };
+
+    const int chunkSize = PARALLEL_BUILD_THRESHOLD / 4;
+    Array<Chunk> chunk;
+    chunk.resize((original.size() + chunkSize - 1) / chunkSize);
+    tbb::parallel_for(0, chunk.size(), [&](int c) {
+        Chunk& k = chunk[c];
+        for (int j = c * chunkSize; j < min(original.size(), (c + 1) * chunkSize); ++j) {
+            original[j].split(axis, offset, minSpanArea, k.array[0], k.array[1], k.array[2]);
+        }
+    });
+
+    Array<Poly>* output[3] = {&lowArray, &highArray, &spanArray};
+    for (int i = 0; i < 3; ++i) {
+        int size = output[i]->size();
+        for (Chunk& k : chunk) {
+            k.offset[i] = size;
+            size += k.array[i].size();
+        }
+        output[i]->resize(size, false);
+    }
+
+    tbb::parallel_for(0, chunk.size(), [&](int c) {
+        const Chunk& k = chunk[c];
+        for (int i = 0; i < 3; ++i) {
+            Array<Poly>& out = *output[i];
+            for (int j = 0; j < k.array[i].size(); ++j) {
+                out[k.offset[i] + j] = k.array[i][j];
+            }
+        }
+    });
+}
+
+
 static bool rayTriangleIntersection
    (const PrecomputedRay&                         ray,
     float                              minDistance,
@@ -629,7 +896,7 @@ static void draw(RenderDevice* rd, const AABox& m_box, const Color4& color) {
 #endif
 
 
-void NativeTriTree::Node::intersectSphere(const Sphere& sphere, const CPUVertexArray& vertexArray, Array<Tri>& triArray, Set<Tri*>& alreadyAdded) const {
+void NativeTriTree::Node::intersectSphere(const Sphere& sphere, const CPUVertexArray& vertexArray, const Tri* triBase, Array<int>& triIndex) const {
     if (! bounds.intersects(sphere)) {
         return;
     }
@@ -637,13 +904,10 @@ void NativeTriTree::Node::intersectSphere(const Sphere& sphere, const CPUVertexA
     // Add the triangles at this node
     if (valueArray && valueArray->bounds.intersects(sphere)) {
         for (int v = 0; v < valueArray->size; ++v) {
-            Tri* tri = const_cast<Tri*>(valueArray->data[v]);
-            if (! alreadyAdded.contains(tri)) {
-                if ((tri->area() > 0) && CollisionDetection::fixedSolidSphereIntersectsFixedTriangle(sphere, Triangle(tri->position(vertexArray, 0), 
-                                                                                       tri->position(vertexArray, 1), tri->position(vertexArray, 2)))) {
-                    triArray.append(*tri);
-                    alreadyAdded.insert(tri);
-                }
+            const Tri* tri = valueArray->data[v];
+            if ((tri->area() > 0) && CollisionDetection::fixedSolidSphereIntersectsFixedTriangle(sphere, Triangle(tri->position(vertexArray, 0), 
+                                                                   tri->position(vertexArray, 1), tri->position(vertexArray, 2)))) {
+                triIndex.append(int(tri - triBase));
             }
         }
     }
@@ -651,13 +915,13 @@ void NativeTriTree::Node::intersectSphere(const Sphere& sphere, const CPUVertexA
     // Recurse into children
     if (! isLeaf()) {
         for (int c = 0; c < 2; ++c) {
-            child(c).intersectSphere(sphere, vertexArray, triArray, alreadyAdded);
+            child(c).intersectSphere(sphere, vertexArray, triBase, triIndex);
         }
     }
 }
 
 
-void NativeTriTree::Node::intersectBox(const AABox& box,  const CPUVertexArray& vertexArray, Array<Tri>& triArray, Set<Tri*>& alreadyAdded) const {
+void NativeTriTree::Node::intersectBox(const AABox& box, const CPUVertexArray& vertexArray, const Tri* triBase, Array<int>& triIndex) const {
     if (! bounds.intersects(box)) {
         return;
     }
@@ -665,13 +929,10 @@ void NativeTriTree::Node::intersectBox(const AABox& box,  const CPUVertexArray&
     // Add the triangles at this node
     if (valueArray && valueArray->bounds.intersects(box)) {
         for (int v = 0; v < valueArray->size; ++v) {
-            Tri* tri = const_cast<Tri*>(valueArray->data[v]);
-            if (! alreadyAdded.contains(tri)) {
-                if ((tri->area() > 0) && CollisionDetection::fixedSolidBoxIntersectsFixedTriangle(box, Triangle(tri->position(vertexArray, 0), 
-                                                                                 tri->position(vertexArray, 1), tri->position(vertexArray, 2)))) {
-                    triArray.append(*tri);
-                    alreadyAdded.insert(tri);
-                }
+            const Tri* tri = valueArray->data[v];
+            if ((tri->area() > 0) && CollisionDetection::fixedSolidBoxIntersectsFixedTriangle(box, Triangle(tri->position(vertexArray, 0), 
+                                                                   tri->position(vertexArray, 1), tri->position(vertexArray, 2)))) {
+                triIndex.append(int(tri - triBase));
             }
         }
     }
@@ -679,7 +940,7 @@ void NativeTriTree::Node::intersectBox(const AABox& box,  const CPUVertexArray&
     // Recurse into children
     if (! isLeaf()) {
         for (int c = 0; c < 2; ++c) {
-            child(c).intersectBox(box, vertexArray, triArray, alreadyAdded);
+            child(c).intersectBox(box, vertexArray, triBase, triIndex);
         }
     }
 }
@@ -755,6 +1016,7 @@ void NativeTriTree::Node::getStats(Stats& s, int level, int valuesPerNode) const
     ++s.numNodes;
     s.depth = max(s.depth, level);
     s.largestNode = max(s.largestNode, n);
+    s.treeBytes += sizeof(Node) + ((valueArray) ? sizeof(ValueArray) + n * sizeof(const Tri*) : 0);
     
     if (valueArray && (valueArray->size > valuesPerNode)) {
         s.shallowestNodeOverMin = min(s.shallowestNodeOverMin, level);
@@ -786,22 +1048,50 @@ NativeTriTree::Stats NativeTriTree::stats(int valuesPerNode) const {
     if (m_root) {
         m_root->getStats(s, 0, valuesPerNode);
         s.averageValuesPerLeaf /= s.numLeaves;
+    } else if (m_bvh4) {
+        m_bvh4->getStats(s, valuesPerNode);
+    } else if (m_bvh8) {
+        m_bvh8->getStats(s, valuesPerNode);
+    } else if (m_compressedBVH8) {
+        m_compressedBVH8->getStats(s, valuesPerNode);
     } else {
         s.shallowestLeaf = 0;
         s.shallowestNodeOverMin = 0;
     }
+
+    s.sceneBytes =
+        size_t(m_triArray.size())                   * sizeof(Tri) +
+        size_t(m_vertexArray.vertex.size())         * sizeof(CPUVertexArray::Vertex) +
+        size_t(m_vertexArray.texCoord1.size())      * sizeof(Point2unorm16) +
+        size_t(m_vertexArray.vertexColors.size())   * sizeof(Color4) +
+        size_t(m_vertexArray.boneIndices.size())    * sizeof(Vector4int32) +
+        size_t(m_vertexArray.boneWeights.size())    * sizeof(Vector4) +
+        size_t(m_vertexArray.prevPosition.size())   * sizeof(Point3);
+
+    if (m_triArray.size() > 0) {
+        s.treeBytesPerTri = float(s.treeBytes) / float(m_triArray.size());
+        s.bytesPerTri     = float(s.treeBytes + s.sceneBytes) / float(m_triArray.size());
+    }
     return s;
 }
 
 
 void NativeTriTree::clear() {
     TriTreeBase::clear();
+    freeTree();
+}
+
+
+void NativeTriTree::freeTree() {
     if (m_root) {
         m_root->destroy(m_memoryManager);
         m_memoryManager->free(m_root);
         m_root = nullptr;
         m_memoryManager.reset();
     }
+    m_bvh4.reset();
+    m_bvh8.reset();
+    m_compressedBVH8.reset();
 }
 
 
@@ -826,8 +1116,68 @@ bool NativeTriTree::intersectRay
     Hit&                               hit,
     IntersectRayOptions                options) const {
 
-    float maxDistance = ray.maxDistance();
-    return notNull(m_root) && m_root->intersectRay(*this, ray, maxDistance, hit, options);        
+    if (m_root) {
+        float maxDistance = ray.maxDistance();
+        return m_root->intersectRay(*this, ray, maxDistance, hit, options);
+    } else if (m_bvh4) {
+        return m_bvh4->intersectRay(ray, hit, options, m_triArray, m_vertexArray);
+    } else if (m_bvh8) {
+        return m_bvh8->intersectRay(ray, hit, options, m_triArray, m_vertexArray);
+    } else if (m_compressedBVH8) {
+        return m_compressedBVH8->intersectRay(ray, hit, options, m_triArray, m_vertexArray);
+    } else {
+        return false;
+    }
+}
+
+
+void NativeTriTree::intersectPackets(const PrecomputedRay* ray, int numRays, Hit* results, IntersectRayOptions options) const {
+    debugAssert(notNull(m_bvh4) || notNull(m_bvh8));
+    const int numTiles = (numRays + PACKET_SIZE - 1) / PACKET_SIZE;
+
+    runConcurrently(0, numTiles, [&](int tile) {
+        const int begin = tile * PACKET_SIZE;
+        intersectPacketTile(ray, begin, G3D::min(begin + PACKET_SIZE, numRays), results, options);
+    });
+}
+
+
+void NativeTriTree::intersectPacketTile(const PrecomputedRay* ray, int begin, int end, Hit* results, IntersectRayOptions options) const {
+    // Counting sort of the tile by direction octant, so that the
+    // rays in each packet agree on the near-to-far order of boxes
+    int octant[PACKET_SIZE];
+    int start[9] = {};
+    for (int i = begin; i < end; ++i) {
+        const Vector3& d = ray[i].direction();
+        octant[i - begin] = int(d.x < 0.0f) | (int(d.y < 0.0f) << 1) | (int(d.z < 0.0f) << 2);
+        ++start[octant[i - begin] + 1];
+    }
+    for (int o = 0; o < 8; ++o) {
+        start[o + 1] += start[o];
+    }
+
+    int index[PACKET_SIZE];
+    int next[8];
+    for (int o = 0; o < 8; ++o) {
+        next[o] = start[o];
+    }
+    for (int i = begin; i < end; ++i) {
+        index[next[octant[i - begin]]++] = i;
+        results[i] = Hit();
+    }
+
+    for (int o = 0; o < 8; ++o) {
+        const int count = start[o + 1] - start[o];
+        if (count == 1) {
+            intersectRay(ray[index[start[o]]], results[index[start[o]]], options);
+        } else if (count > 1) {
+            if (m_bvh4) {
+                m_bvh4->intersectPacket(ray, index + start[o], count, results, options, m_triArray, m_vertexArray);
+            } else {
+                m_bvh8->intersectPacket(ray, index + start[o], count, results, options, m_triArray, m_vertexArray);
+            }
+        }
+    }
 }
 
 
@@ -837,7 +1187,40 @@ void NativeTriTree::intersectRays
     IntersectRayOptions                 options) const {
 
     results.resize(rays.size());
-    runConcurrently(0, rays.size(), [&](int i) { intersectRay(rays[i], results[i], options); });
+    if (((options & COHERENT_RAY_HINT) != 0) && (m_bvh4 || m_bvh8)) {
+        intersectPackets(rays.getCArray(), rays.size(), results.getCArray(), options);
+    } else {
+        runConcurrently(0, rays.size(), [&](int i) { intersectRay(rays[i], results[i], options); });
+    }
+}
+
+
+void NativeTriTree::intersectRays
+   (const Array<Ray>&                   rays,
+    HitBuffer&                          results,
+    IntersectRayOptions                 options) const {
+
+    if (((options & COHERENT_RAY_HINT) == 0) || (isNull(m_bvh4) && isNull(m_bvh8))) {
+        TriTreeBase::intersectRays(rays, results, options);
+        return;
+    }
+
+    results.resize(rays.size());
+    const int numTiles = (rays.size() + PACKET_SIZE - 1) / PACKET_SIZE;
+    runConcurrently(0, numTiles, [&](int tile) {
+        const int begin = tile * PACKET_SIZE;
+        const int count = G3D::min(int(PACKET_SIZE), rays.size() - begin);
+
+        PrecomputedRay ray[PACKET_SIZE];
+        Hit hit[PACKET_SIZE];
+        for (int i = 0; i < count; ++i) {
+            ray[i] = rays[begin + i];
+        }
+        intersectPacketTile(ray, 0, count, hit, options);
+        for (int i = 0; i < count; ++i) {
+            results.set(begin + i, hit[i]);
+        }
+    });
 }
 
 
@@ -868,24 +1251,37 @@ void NativeTriTree::intersectRays
     conversionTimer.tick();
     results.resize(rays.size());
 
+    // Convert incoherent rays in sorted order, and scatter their results back
+    Array<int> order;
+    if (shouldSortRays(rays.size(), options)) {
+        sortRays(rays, order);
+    }
+
     Array<PrecomputedRay> prays;
     prays.resize(rays.size());
 
     PrecomputedRay* dst = prays.getCArray();
     const Ray*      src = rays.getCArray();
+    const int*      srcIndex = (order.size() > 0) ? order.getCArray() : nullptr;
     tbb::parallel_for(tbb::blocked_range<size_t>(0, rays.size(), 64), [&](const tbb::blocked_range<size_t>& r) {
         const size_t start = r.begin();
         const size_t end   = r.end();
         for (size_t i = start; i < end; ++i) {
             debugAssert(i < size_t(prays.size()));
-            dst[i] = src[i];
+            dst[i] = src[srcIndex ? srcIndex[i] : i];
         }
     });
 
     conversionTimer.tock();
     debugConversionOverheadTime = conversionTimer.elapsedTime();
 
-    runConcurrently(0, prays.size(), [&](int i) { intersectRay(prays[i], results[i], options); });
+    if (order.size() > 0) {
+        runConcurrently(0, prays.size(), [&](int i) { intersectRay(prays[i], results[order[i]], options); });
+    } else if (((options & COHERENT_RAY_HINT) != 0) && (m_bvh4 || m_bvh8)) {
+        intersectPackets(prays.getCArray(), prays.size(), results.getCArray(), options);
+    } else {
+        runConcurrently(0, prays.size(), [&](int i) { intersectRay(prays[i], results[i], options); });
+    }
 }
 
 #ifdef _MSC_VER
@@ -153,13 +153,17 @@ AABox NativeTriTree::Poly::computeBounds(const Array<Poly>& array) {
         return AABox(Vector3::zero());
     }
 
-    Vector3 L = array[0].m_low, H = array[0].m_high;
-    for (int i = 1; i < array.size(); ++i) {
-        L = L.min(array[i].m_low);
-        H = H.max(array[i].m_high);
-    }
-
-    return AABox(L, H);
+    const AABox& first = AABox(array[0].m_low, array[0].m_high);
+    return parallelReduce(1, array.size(), first,
+        [&array](int begin, int end, const AABox& box) {
+            Vector3 L = box.low(), H = box.high();
+            for (int i = begin; i < end; ++i) {
+                L = L.min(array[i].m_low);
+                H = H.max(array[i].m_high);
+            }
+            return AABox(L, H);
+        },
+        [](const AABox& a, const AABox& b) { return AABox(a.low().min(b.low()), a.high().max(b.high())); });
 }
 
 }
@@ -0,0 +1,1580 @@
+/**
+  \file G3D-app.lib/source/NativeTriTree_WideBVH.cpp
+
+  G3D Innovation Engine http://casual-effects.com/g3d
+  Copyright 2000-2019, Morgan McGuire
+  All rights reserved
+  Available under the BSD License
+*/
+
+#include "G3D-base/CollisionDetection.h"
+#include "G3D-base/Vector2int32.h"
+#include "G3D-app/NativeTriTree.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+#ifdef G3D_X86
+#   include <xmmintrin.h>
+#   include <emmintrin.h>
+#endif
+#ifdef _MSC_VER
+#   include <intrin.h>
+#endif
+
+namespace G3D {
+
+#ifdef _MSC_VER
+// Turn on fast floating-point optimizations
+#pragma float_control( push )
+#pragma fp_contract( on )
+#pragma fenv_access( off )
+#pragma float_control( except, off )
+#pragma float_control( precise, off )
+#endif
+
+namespace {
+
+// Four-wide float and comparison-mask types. The engine is not compiled
+// with AVX enabled, so BVH8 nodes are tested as two halves.
+#ifdef G3D_X86
+
+class mask4 {
+public:
+    __m128 m;
+    mask4(__m128 m) : m(m) {}
+
+    /** Bit i is set if lane i is true */
+    int bits() const { return _mm_movemask_ps(m); }
+};
+
+inline mask4 operator&(mask4 a, mask4 b) { return _mm_and_ps(a.m, b.m); }
+inline mask4 operator|(mask4 a, mask4 b) { return _mm_or_ps(a.m, b.m); }
+/** a & ~b */
+inline mask4 andNot(mask4 a, mask4 b) { return _mm_andnot_ps(b.m, a.m); }
+
+class float4 {
+public:
+    __m128 m;
+    float4() {}
+    float4(__m128 m) : m(m) {}
+    explicit float4(float f) : m(_mm_set1_ps(f)) {}
+    static float4 load(const float* p) { return _mm_loadu_ps(p); }
+    /** Converts four unsigned bytes */
+    static float4 load(const uint8* p) {
+        int32 bytes;
+        memcpy(&bytes, p, sizeof(bytes));
+        const __m128i zero = _mm_setzero_si128();
+        return _mm_cvtepi32_ps(_mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(bytes), zero), zero));
+    }
+    void store(float* p) const { _mm_storeu_ps(p, m); }
+};
+
+inline float4 operator+(float4 a, float4 b) { return _mm_add_ps(a.m, b.m); }
+inline float4 operator-(float4 a, float4 b) { return _mm_sub_ps(a.m, b.m); }
+inline float4 operator*(float4 a, float4 b) { return _mm_mul_ps(a.m, b.m); }
+inline float4 operator/(float4 a, float4 b) { return _mm_div_ps(a.m, b.m); }
+/** Returns b if either argument is NaN */
+inline float4 min(float4 a, float4 b) { return _mm_min_ps(a.m, b.m); }
+/** Returns b if either argument is NaN */
+inline float4 max(float4 a, float4 b) { return _mm_max_ps(a.m, b.m); }
+inline float4 abs(float4 a) { return _mm_andnot_ps(_mm_set1_ps(-0.0f), a.m); }
+inline mask4 operator<(float4 a, float4 b) { return _mm_cmplt_ps(a.m, b.m); }
+inline mask4 operator<=(float4 a, float4 b) { return _mm_cmple_ps(a.m, b.m); }
+inline mask4 operator>(float4 a, float4 b) { return _mm_cmpgt_ps(a.m, b.m); }
+inline mask4 operator>=(float4 a, float4 b) { return _mm_cmpge_ps(a.m, b.m); }
+/** Lanes of a where m is true, b elsewhere */
+inline float4 select(mask4 m, float4 a, float4 b) { return _mm_or_ps(_mm_and_ps(m.m, a.m), _mm_andnot_ps(m.m, b.m)); }
+
+#else
+
+class mask4 {
+public:
+    bool m[4];
+    int bits() const { return int(m[0]) | (int(m[1]) << 1) | (int(m[2]) << 2) | (int(m[3]) << 3); }
+};
+
+#define G3D_LANEWISE(T, expr) T r; for (int i = 0; i < 4; ++i) { r.m[i] = (expr); } return r
+
+inline mask4 operator&(mask4 a, mask4 b) { G3D_LANEWISE(mask4, a.m[i] && b.m[i]); }
+inline mask4 operator|(mask4 a, mask4 b) { G3D_LANEWISE(mask4, a.m[i] || b.m[i]); }
+inline mask4 andNot(mask4 a, mask4 b) { G3D_LANEWISE(mask4, a.m[i] && ! b.m[i]); }
+
+class float4 {
+public:
+    float m[4];
+    float4() {}
+    explicit float4(float f) { m[0] = m[1] = m[2] = m[3] = f; }
+    static float4 load(const float* p) { float4 r; for (int i = 0; i < 4; ++i) { r.m[i] = p[i]; } return r; }
+    static float4 load(const uint8* p) { float4 r; for (int i = 0; i < 4; ++i) { r.m[i] = float(p[i]); } return r; }
+    void store(float* p) const { for (int i = 0; i < 4; ++i) { p[i] = m[i]; } }
+};
+
+inline float4 operator+(float4 a, float4 b) { G3D_LANEWISE(float4, a.m[i] + b.m[i]); }
+inline float4 operator-(float4 a, float4 b) { G3D_LANEWISE(float4, a.m[i] - b.m[i]); }
+inline float4 operator*(float4 a, float4 b) { G3D_LANEWISE(float4, a.m[i] * b.m[i]); }
+inline float4 operator/(float4 a, float4 b) { G3D_LANEWISE(float4, a.m[i] / b.m[i]); }
+// Match the SSE behavior of returning b when either argument is NaN
+inline float4 min(float4 a, float4 b) { G3D_LANEWISE(float4, (a.m[i] < b.m[i]) ? a.m[i] : b.m[i]); }
+inline float4 max(float4 a, float4 b) { G3D_LANEWISE(float4, (a.m[i] > b.m[i]) ? a.m[i] : b.m[i]); }
+inline float4 abs(float4 a) { G3D_LANEWISE(float4, ::fabsf(a.m[i])); }
+inline mask4 operator<(float4 a, float4 b) { G3D_LANEWISE(mask4, a.m[i] < b.m[i]); }
+inline mask4 operator<=(float4 a, float4 b) { G3D_LANEWISE(mask4, a.m[i] <= b.m[i]); }
+inline mask4 operator>(float4 a, float4 b) { G3D_LANEWISE(mask4, a.m[i] > b.m[i]); }
+inline mask4 operator>=(float4 a, float4 b) { G3D_LANEWISE(mask4, a.m[i] >= b.m[i]); }
+inline float4 select(mask4 m, float4 a, float4 b) { G3D_LANEWISE(float4, m.m[i] ? a.m[i] : b.m[i]); }
+
+#undef G3D_LANEWISE
+
+#endif
+
+/** Tolerances shared with rayTriangleIntersection in NativeTriTree.cpp */
+const float EPS          = 1e-12f;
+const float conservative = 1e-8f;
+
+/** Split ranges with the SAH down to this depth and at the object median below it, which bounds the traversal stack */
+const int   MAX_SAH_DEPTH = 32;
+
+/** Index of the least significant set bit of a nonzero mask */
+inline int lowestBit(int bits) {
+    debugAssert(bits != 0);
+#   ifdef _MSC_VER
+        unsigned long i;
+        _BitScanForward(&i, (unsigned long)bits);
+        return int(i);
+#   else
+        return __builtin_ctz((unsigned int)bits);
+#   endif
+}
+
+/** Surface area of the box, or zero if it is empty */
+inline float area(const Vector3& low, const Vector3& high) {
+    const Vector3 e = (high - low).max(Vector3::zero());
+    return 2.0f * (e.x * e.y + e.y * e.z + e.z * e.x);
+}
+
+/** Moller-Trumbore test of \a ray against the four triangles of a
+    WideBVH<N>::TriBlock. Shrinks \a maxDistance on each hit. */
+template<class TriBlock>
+bool intersectBlock
+   (const TriBlock&                 block,
+    const PrecomputedRay&           ray,
+    float&                          maxDistance,
+    TriTree::Hit&                   hit,
+    TriTree::IntersectRayOptions    options,
+    const Array<Tri>&               triArray,
+    const CPUVertexArray&           vertexArray) {
+
+    const bool noBackfaceTest    = (options & TriTree::DO_NOT_CULL_BACKFACES) != 0;
+    const bool occlusionTestOnly = (options & TriTree::OCCLUSION_TEST_ONLY) != 0;
+    const bool alphaTest         = (options & TriTree::NO_PARTIAL_COVERAGE_TEST) == 0;
+    const float alphaThreshold   = ((options & TriTree::PARTIAL_COVERAGE_THRESHOLD_ZERO) != 0) ? 1.0f : 0.5f;
+
+    const float4 dX(ray.direction().x), dY(ray.direction().y), dZ(ray.direction().z);
+    const float4 oX(ray.origin().x),    oY(ray.origin().y),    oZ(ray.origin().z);
+    const float4 minDistance(ray.minDistance());
+    const float4 one(1.0f);
+    const float4 zero(0.0f);
+
+    const float4 e1X = float4::load(block.e1X), e1Y = float4::load(block.e1Y), e1Z = float4::load(block.e1Z);
+    const float4 e2X = float4::load(block.e2X), e2Y = float4::load(block.e2Y), e2Z = float4::load(block.e2Z);
+
+    // p = direction x e2
+    const float4 pX = dY * e2Z - dZ * e2Y;
+    const float4 pY = dZ * e2X - dX * e2Z;
+    const float4 pZ = dX * e2Y - dY * e2X;
+
+    // Negative if we are coming from the back
+    const float4 a = e1X * pX + e1Y * pY + e1Z * pZ;
+    const float4 f = one / a;
+    const float4 c = float4(conservative) * f;
+
+    const float4 sX = (oX - float4::load(block.v0X)) * f;
+    const float4 sY = (oY - float4::load(block.v0Y)) * f;
+    const float4 sZ = (oZ - float4::load(block.v0Z)) * f;
+    const float4 u  = sX * pX + sY * pY + sZ * pZ;
+
+    // q = s x e1
+    const float4 qX = sY * e1Z - sZ * e1Y;
+    const float4 qY = sZ * e1X - sX * e1Z;
+    const float4 qZ = sX * e1Y - sY * e1X;
+    const float4 v  = dX * qX + dY * qY + dZ * qZ;
+    const float4 t  = e2X * qX + e2Y * qY + e2Z * qZ;
+
+    const float4 negC = zero - c;
+    const float4 onePlusC = one + c;
+    mask4 accept =
+        (u >= negC) & (u <= onePlusC) &
+        (v >= negC) & ((u + v) <= onePlusC) &
+        (abs(a) >= float4(EPS)) &
+        (t > minDistance) & (t < float4(maxDistance));
+
+    if (! noBackfaceTest) {
+        const float4 nDotD = float4::load(block.nX) * dX + float4::load(block.nY) * dY + float4::load(block.nZ) * dZ;
+        accept = andNot(accept, nDotD >= float4::load(block.backfaceThreshold));
+    }
+
+    int bits = accept.bits();
+    if (bits == 0) {
+        return false;
+    }
+
+    float tLane[4], uLane[4], vLane[4], aLane[4];
+    t.store(tLane); u.store(uLane); v.store(vLane); a.store(aLane);
+
+    bool found = false;
+    for (; bits != 0; bits &= bits - 1) {
+        const int lane = (bits & 1) ? 0 : (bits & 2) ? 1 : (bits & 4) ? 2 : 3;
+
+        // An earlier lane may have moved maxDistance closer
+        if (tLane[lane] >= maxDistance) {
+            continue;
+        }
+
+        const int triIndex = block.triIndex[lane];
+        if (alphaTest && ! triArray[triIndex].intersectionAlphaTest(vertexArray, uLane[lane], vLane[lane], alphaThreshold)) {
+            continue;
+        }
+
+        hit.triIndex = triIndex;
+        hit.distance = tLane[lane];
+        hit.u        = uLane[lane];
+        hit.v        = vLane[lane];
+        hit.backface = (aLane[lane] < 0);
+        found        = true;
+
+        if (occlusionTestOnly) {
+            return true;
+        }
+        maxDistance = tLane[lane];
+    }
+
+    return found;
+}
+
+} // namespace
+
+
+template<int N>
+int NativeTriTree::WideBVH<N>::split(Array<BuildPrim>& prim, int begin, int end, bool median, int numBins) const {
+    debugAssert(end - begin >= 2);
+    debugAssert((numBins >= 2) && (numBins <= MAX_BINS));
+
+    class Bounds {
+    public:
+        Point3  low;
+        Point3  high;
+        Bounds() : low(Point3::inf()), high(-Point3::inf()) {}
+        Bounds(const Bounds& a, const Bounds& b) : low(a.low.min(b.low)), high(a.high.max(b.high)) {}
+    };
+
+    const Bounds centerBounds = parallelReduce(begin, end, Bounds(),
+        [&prim](int b, int e, Bounds bounds) {
+            for (int i = b; i < e; ++i) {
+                const Point3& c = prim[i].center();
+                bounds.low  = bounds.low.min(c);
+                bounds.high = bounds.high.max(c);
+            }
+            return bounds;
+        },
+        [](const Bounds& a, const Bounds& b) { return Bounds(a, b); });
+
+    const Vector3 extent = centerBounds.high - centerBounds.low;
+    const Vector3::Axis axis = extent.primaryAxis();
+    const int mid = (begin + end) / 2;
+
+    if (! median && (extent[axis] > 0.0f)) {
+        class Bins {
+        public:
+            int     count[MAX_BINS];
+            Point3  low[MAX_BINS];
+            Point3  high[MAX_BINS];
+
+            Bins(int numBins) {
+                for (int b = 0; b < numBins; ++b) {
+                    count[b] = 0;
+                    low[b]   = Point3::inf();
+                    high[b]  = -Point3::inf();
+                }
+            }
+
+            Bins(const Bins& x, const Bins& y, int numBins) {
+                for (int b = 0; b < numBins; ++b) {
+                    count[b] = x.count[b] + y.count[b];
+                    low[b]   = x.low[b].min(y.low[b]);
+                    high[b]  = x.high[b].max(y.high[b]);
+                }
+            }
+        };
+
+        const float binScale = numBins * (1.0f - 1e-5f) / extent[axis];
+        const float binBase  = centerBounds.low[axis];
+        const auto binOf = [=](const BuildPrim& p) {
+            return iClamp(int((p.center()[axis] - binBase) * binScale), 0, numBins - 1);
+        };
+
+        const Bins bins = parallelReduce(begin, end, Bins(numBins),
+            [&](int b, int e, Bins bins) {
+                for (int i = b; i < e; ++i) {
+                    const int k = binOf(prim[i]);
+                    ++bins.count[k];
+                    bins.low[k]  = bins.low[k].min(prim[i].low);
+                    bins.high[k] = bins.high[k].max(prim[i].high);
+                }
+                return bins;
+            },
+            [numBins](const Bins& x, const Bins& y) { return Bins(x, y, numBins); });
+
+        // Cost of everything above each candidate plane; plane b lies between bins b and b + 1
+        float aboveCost[MAX_BINS];
+        {
+            Point3 lo = Point3::inf(), hi = -Point3::inf();
+            int n = 0;
+            for (int b = numBins - 1; b > 0; --b) {
+                n += bins.count[b];
+                lo = lo.min(bins.low[b]);
+                hi = hi.max(bins.high[b]);
+                aboveCost[b - 1] = n * area(lo, hi);
+            }
+        }
+
+        float bestCost  = finf();
+        int   bestPlane = -1;
+        int   bestCount = 0;
+        {
+            Point3 lo = Point3::inf(), hi = -Point3::inf();
+            int n = 0;
+            for (int b = 0; b < numBins - 1; ++b) {
+                n += bins.count[b];
+                lo = lo.min(bins.low[b]);
+                hi = hi.max(bins.high[b]);
+                const float cost = n * area(lo, hi) + aboveCost[b];
+                if ((n > 0) && (n < end - begin) && (cost < bestCost)) {
+                    bestCost  = cost;
+                    bestPlane = b;
+                    bestCount = n;
+                }
+            }
+        }
+
+        if (bestPlane >= 0) {
+            const auto isLow = [&](const BuildPrim& p) { return binOf(p) <= bestPlane; };
+            if (end - begin < PARALLEL_BUILD_THRESHOLD) {
+                BuildPrim* first = prim.getCArray() + begin;
+                std::partition(first, prim.getCArray() + end, isLow);
+            } else {
+                // Stable parallel partition: count each chunk's low elements, then scatter
+                // into a copy at offsets given by the prefix sums
+                const int chunkSize = PARALLEL_BUILD_THRESHOLD / 4;
+                const int numChunks = (end - begin + chunkSize - 1) / chunkSize;
+                Array<int> lowOffset;
+                lowOffset.resize(numChunks);
+                tbb::parallel_for(0, numChunks, [&](int c) {
+                    int n = 0;
+                    for (int i = begin + c * chunkSize; i < min(end, begin + (c + 1) * chunkSize); ++i) {
+                        n += isLow(prim[i]) ? 1 : 0;
+                    }
+                    lowOffset[c] = n;
+                });
+
+                int numLow = 0;
+                for (int c = 0; c < numChunks; ++c) {
+                    const int n = lowOffset[c];
+                    lowOffset[c] = numLow;
+                    numLow += n;
+                }
+                debugAssert(numLow == bestCount);
+
+                Array<BuildPrim> sorted;
+                sorted.resize(end - begin);
+                tbb::parallel_for(0, numChunks, [&](int c) {
+                    int lowIndex  = lowOffset[c];
+                    int highIndex = numLow + (c * chunkSize - lowOffset[c]);
+                    for (int i = begin + c * chunkSize; i < min(end, begin + (c + 1) * chunkSize); ++i) {
+                        sorted[isLow(prim[i]) ? lowIndex++ : highIndex++] = prim[i];
+                    }
+                });
+                System::memcpy(prim.getCArray() + begin, sorted.getCArray(), sizeof(BuildPrim) * sorted.size());
+            }
+            return begin + bestCount;
+        }
+    }
+
+    // All centers coincide, or the tree is already deep: split at the object median
+    std::nth_element(prim.getCArray() + begin, prim.getCArray() + mid, prim.getCArray() + end,
+        [axis](const BuildPrim& a, const BuildPrim& b) { return a.center()[axis] < b.center()[axis]; });
+    return mid;
+}
+
+
+template<int N>
+int NativeTriTree::WideBVH<N>::buildLeaf
+   (const Array<BuildPrim>&     prim,
+    int                         begin,
+    int                         end,
+    const Array<Tri>&           triArray,
+    const CPUVertexArray&       vertexArray) {
+
+    const int firstBlock = m_blockArray.size();
+    for (int i = begin; i < end; i += 4) {
+        TriBlock& block = m_blockArray.next();
+        for (int lane = 0; lane < 4; ++lane) {
+            if (i + lane < end) {
+                const int  t   = prim[i + lane].triIndex;
+                const Tri& tri = triArray[t];
+                const Point3&  v0 = tri.position(vertexArray, 0);
+                const Vector3& e1 = tri.position(vertexArray, 1) - v0;
+                const Vector3& e2 = tri.position(vertexArray, 2) - v0;
+                const Vector3& n  = e1.cross(e2);
+
+                block.v0X[lane] = v0.x;  block.v0Y[lane] = v0.y;  block.v0Z[lane] = v0.z;
+                block.e1X[lane] = e1.x;  block.e1Y[lane] = e1.y;  block.e1Z[lane] = e1.z;
+                block.e2X[lane] = e2.x;  block.e2Y[lane] = e2.y;  block.e2Z[lane] = e2.z;
+                block.nX[lane]  = n.x;   block.nY[lane]  = n.y;   block.nZ[lane]  = n.z;
+                block.backfaceThreshold[lane] = (! tri.twoSided() && (tri.area() >= 0)) ? -EPS * 2.0f * tri.area() : finf();
+                block.triIndex[lane] = t;
+            } else {
+                // Degenerate; always fails the determinant test
+                block.v0X[lane] = block.v0Y[lane] = block.v0Z[lane] = 0.0f;
+                block.e1X[lane] = block.e1Y[lane] = block.e1Z[lane] = 0.0f;
+                block.e2X[lane] = block.e2Y[lane] = block.e2Z[lane] = 0.0f;
+                block.nX[lane]  = block.nY[lane]  = block.nZ[lane]  = 0.0f;
+                block.backfaceThreshold[lane] = finf();
+                block.triIndex[lane] = -1;
+            }
+        }
+    }
+    return firstBlock;
+}
+
+
+template<int N>
+void NativeTriTree::WideBVH<N>::buildNode
+   (int                         nodeIndex,
+    Array<BuildPrim>&           prim,
+    int                         begin,
+    int                         end,
+    int                         depth,
+    int                         valuesPerLeaf,
+    int                         numBins,
+    const Array<Tri>&           triArray,
+    const CPUVertexArray&       vertexArray) {
+
+    class Range {
+    public:
+        int     begin;
+        int     end;
+        Point3  low;
+        Point3  high;
+
+        Range() {}
+        Range(int b, int e) : begin(b), end(e), low(Point3::inf()), high(-Point3::inf()) {}
+        Range(const Range& x, const Range& y) : begin(x.begin), end(x.end), low(x.low.min(y.low)), high(x.high.max(y.high)) {}
+
+        Range(const Array<BuildPrim>& prim, int b, int e) {
+            *this = parallelReduce(b, e, Range(b, e),
+                [&prim](int i0, int i1, Range r) {
+                    for (int i = i0; i < i1; ++i) {
+                        r.low  = r.low.min(prim[i].low);
+                        r.high = r.high.max(prim[i].high);
+                    }
+                    return r;
+                },
+                [](const Range& x, const Range& y) { return Range(x, y); });
+        }
+    };
+
+    // Repeatedly split the child with the largest surface area until
+    // there are N children or none of them is worth splitting
+    Range range[N];
+    int numChildren = 1;
+    range[0] = Range(prim, begin, end);
+    while (numChildren < N) {
+        int   largest     = -1;
+        float largestArea = -1.0f;
+        for (int c = 0; c < numChildren; ++c) {
+            if ((range[c].end - range[c].begin > valuesPerLeaf) && (area(range[c].low, range[c].high) > largestArea)) {
+                largest     = c;
+                largestArea = area(range[c].low, range[c].high);
+            }
+        }
+
+        if (largest == -1) {
+            break;
+        }
+
+        const Range r = range[largest];
+        const int mid = split(prim, r.begin, r.end, depth > MAX_SAH_DEPTH, numBins);
+        range[largest]       = Range(prim, r.begin, mid);
+        range[numChildren++] = Range(prim, mid, r.end);
+    }
+
+    // Large subtrees are built concurrently, each into its own WideBVH
+    const bool concurrent = (end - begin >= PARALLEL_BUILD_THRESHOLD);
+
+    // Otherwise, internal children are allocated adjacent to each other
+    // before recursing, which keeps siblings together in memory
+    Node node;
+    int firstInternal = m_nodeArray.size();
+    for (int c = 0; c < N; ++c) {
+        if (c < numChildren) {
+            const Range& r = range[c];
+            node.lowX[c]  = r.low.x;  node.lowY[c]  = r.low.y;  node.lowZ[c]  = r.low.z;
+            node.highX[c] = r.high.x; node.highY[c] = r.high.y; node.highZ[c] = r.high.z;
+            if (r.end - r.begin <= valuesPerLeaf) {
+                node.child[c]     = buildLeaf(prim, r.begin, r.end, triArray, vertexArray);
+                node.numBlocks[c] = (r.end - r.begin + 3) / 4;
+                m_depth = max(m_depth, depth + 1);
+            } else {
+                // Assigned by append() for concurrent subtrees
+                node.child[c]     = concurrent ? -1 : m_nodeArray.size();
+                node.numBlocks[c] = 0;
+                if (! concurrent) {
+                    m_nodeArray.next();
+                }
+            }
+        } else {
+            // A box at infinity never passes the slab test. (An inverted
+            // box would, because the slab test orders each pair of planes.)
+            node.lowX[c]  = node.lowY[c]  = node.lowZ[c]  = finf();
+            node.highX[c] = node.highY[c] = node.highZ[c] = finf();
+            node.child[c]     = -1;
+            node.numBlocks[c] = 0;
+        }
+    }
+
+    if (concurrent) {
+        WideBVH subtree[N];
+        tbb::task_group group;
+        for (int c = 0; c < numChildren; ++c) {
+            if (node.numBlocks[c] == 0) {
+                group.run([&, c] {
+                    subtree[c].m_nodeArray.next();
+                    subtree[c].buildNode(0, prim, range[c].begin, range[c].end, depth + 1, valuesPerLeaf, numBins, triArray, vertexArray);
+                });
+            }
+        }
+        group.wait();
+
+        for (int c = 0; c < numChildren; ++c) {
+            if (node.numBlocks[c] == 0) {
+                node.child[c] = append(subtree[c]);
+            }
+        }
+    } else {
+        for (int c = 0; c < numChildren; ++c) {
+            if (node.numBlocks[c] == 0) {
+                debugAssert(node.child[c] == firstInternal);
+                buildNode(firstInternal, prim, range[c].begin, range[c].end, depth + 1, valuesPerLeaf, numBins, triArray, vertexArray);
+                ++firstInternal;
+            }
+        }
+    }
+
+    m_nodeArray[nodeIndex] = node;
+}
+
+
+template<int N>
+int NativeTriTree::WideBVH<N>::append(const WideBVH& subtree) {
+    const int nodeOffset  = m_nodeArray.size();
+    const int blockOffset = m_blockArray.size();
+
+    m_blockArray.append(subtree.m_blockArray);
+    m_nodeArray.append(subtree.m_nodeArray);
+    for (int i = nodeOffset; i < m_nodeArray.size(); ++i) {
+        Node& node = m_nodeArray[i];
+        for (int c = 0; c < N; ++c) {
+            if (node.child[c] >= 0) {
+                node.child[c] += (node.numBlocks[c] > 0) ? blockOffset : nodeOffset;
+            }
+        }
+    }
+
+    m_depth = max(m_depth, subtree.m_depth);
+    return nodeOffset;
+}
+
+
+template<int N>
+void NativeTriTree::WideBVH<N>::build(const Array<Tri>& triArray, const CPUVertexArray& vertexArray, const Settings& settings) {
+    m_nodeArray.fastClear();
+    m_blockArray.fastClear();
+    m_depth = 0;
+
+    // Don't add 0 area triangles, matching the BIH
+    static const float epsilon = 0.000001f;
+
+    Array<BuildPrim> prim;
+    prim.resize(triArray.size());
+    tbb::parallel_for(tbb::blocked_range<int>(0, triArray.size(), 4096), [&](const tbb::blocked_range<int>& r) {
+        for (int t = r.begin(); t < r.end(); ++t) {
+            const Tri& tri = triArray[t];
+            BuildPrim& p = prim[t];
+            const Point3& v0 = tri.position(vertexArray, 0);
+            const Point3& v1 = tri.position(vertexArray, 1);
+            const Point3& v2 = tri.position(vertexArray, 2);
+            p.low      = v0.min(v1).min(v2);
+            p.high     = v0.max(v1).max(v2);
+            p.triIndex = (tri.area() > epsilon) ? t : -1;
+        }
+    });
+
+    // Compact away the degenerate triangles
+    int numPrims = 0;
+    for (int t = 0; t < prim.size(); ++t) {
+        if (prim[t].triIndex >= 0) {
+            prim[numPrims++] = prim[t];
+        }
+    }
+    prim.resize(numPrims, false);
+
+    if (prim.size() == 0) {
+        useArrays();
+        return;
+    }
+
+    // Leaves are padded to whole blocks, so round the requested size up
+    const int valuesPerLeaf = max(4, (settings.valuesPerLeaf + 3) & ~3);
+    const int numBins = iClamp(settings.numBins, 2, MAX_BINS);
+
+    m_nodeArray.reserve(prim.size() / (valuesPerLeaf * (N - 1)) + 1);
+    m_blockArray.reserve(prim.size() / 3 + 1);
+    m_nodeArray.next();
+    buildNode(0, prim, 0, prim.size(), 0, valuesPerLeaf, numBins, triArray, vertexArray);
+    useArrays();
+}
+
+
+template<int N>
+void NativeTriTree::WideBVH<N>::useArrays() {
+    m_file.reset();
+    m_node      = m_nodeArray.getCArray();
+    m_numNodes  = m_nodeArray.size();
+    m_block     = m_blockArray.getCArray();
+    m_numBlocks = m_blockArray.size();
+}
+
+
+template<int N>
+bool NativeTriTree::WideBVH<N>::intersectLeaf
+   (int                             firstBlock,
+    int                             numBlocks,
+    const PrecomputedRay&           ray,
+    float&                          maxDistance,
+    Hit&                            hit,
+    IntersectRayOptions             options,
+    const Array<Tri>&               triArray,
+    const CPUVertexArray&           vertexArray) const {
+
+    bool found = false;
+    for (int b = firstBlock; b < firstBlock + numBlocks; ++b) {
+        if (intersectBlock(m_block[b], ray, maxDistance, hit, options, triArray, vertexArray)) {
+            found = true;
+            if ((options & OCCLUSION_TEST_ONLY) != 0) {
+                return true;
+            }
+        }
+    }
+
+    return found;
+}
+
+
+template<int N>
+bool NativeTriTree::WideBVH<N>::intersectRay
+   (const PrecomputedRay&           ray,
+    Hit&                            hit,
+    IntersectRayOptions             options,
+    const Array<Tri>&               triArray,
+    const CPUVertexArray&           vertexArray) const {
+
+    if (m_numNodes == 0) {
+        return false;
+    }
+
+    float maxDistance = ray.maxDistance();
+    return intersectSubtree(0, 0, ray, maxDistance, hit, options, triArray, vertexArray);
+}
+
+
+template<int N>
+bool NativeTriTree::WideBVH<N>::intersectSubtree
+   (int                             child,
+    int                             numBlocks,
+    const PrecomputedRay&           ray,
+    float&                          maxDistance,
+    Hit&                            hit,
+    IntersectRayOptions             options,
+    const Array<Tri>&               triArray,
+    const CPUVertexArray&           vertexArray) const {
+
+    class StackEntry {
+    public:
+        int32   child;
+        int32   numBlocks;
+        float   distance;
+    };
+
+    // Each level pushes at most N - 1 more entries than it pops
+    enum { STACK_SIZE = (MAX_SAH_DEPTH + 34) * (N - 1) + 1 };
+    StackEntry stack[STACK_SIZE];
+    debugAssert(m_depth < MAX_SAH_DEPTH + 34);
+
+    const float4 oX(ray.origin().x), oY(ray.origin().y), oZ(ray.origin().z);
+    const float4 iX(ray.invDirection().x), iY(ray.invDirection().y), iZ(ray.invDirection().z);
+    const float4 minDistance(ray.minDistance());
+
+    bool found = false;
+
+    int top = 0;
+    stack[top].child     = child;
+    stack[top].numBlocks = numBlocks;
+    stack[top].distance  = -finf();
+    ++top;
+
+    while (top > 0) {
+        const StackEntry entry = stack[--top];
+        if (entry.distance > maxDistance) {
+            // A closer hit was found after this entry was pushed
+            continue;
+        }
+
+        if (entry.numBlocks > 0) {
+            if (intersectLeaf(entry.child, entry.numBlocks, ray, maxDistance, hit, options, triArray, vertexArray)) {
+                found = true;
+                if ((options & OCCLUSION_TEST_ONLY) != 0) {
+                    return true;
+                }
+            }
+            continue;
+        }
+
+        // Slab test against all children. The argument order of min
+        // and max makes NaNs (from 0 * inf) leave the interval unchanged.
+        const Node& node = m_node[entry.child];
+        // Clamped so that unused slots, whose boxes are at infinity, miss rays of unbounded length
+        const float4 maxD(G3D::min(maxDistance, std::numeric_limits<float>::max()));
+        float entryDistance[N];
+        int   hitBits = 0;
+        for (int g = 0; g < N; g += 4) {
+            const float4 tx0 = (float4::load(node.lowX + g)  - oX) * iX;
+            const float4 tx1 = (float4::load(node.highX + g) - oX) * iX;
+            const float4 ty0 = (float4::load(node.lowY + g)  - oY) * iY;
+            const float4 ty1 = (float4::load(node.highY + g) - oY) * iY;
+            const float4 tz0 = (float4::load(node.lowZ + g)  - oZ) * iZ;
+            const float4 tz1 = (float4::load(node.highZ + g) - oZ) * iZ;
+
+            const float4 tNear = max(min(tz0, tz1), max(min(ty0, ty1), max(min(tx0, tx1), minDistance)));
+            const float4 tFar  = min(max(tz0, tz1), min(max(ty0, ty1), min(max(tx0, tx1), maxD)));
+
+            hitBits |= (tNear <= tFar).bits() << g;
+            tNear.store(entryDistance + g);
+        }
+
+        // Push the hit children from farthest to nearest, so that the nearest is traversed first
+        int   order[N];
+        int   numHit = 0;
+        for (int c = 0; c < N; ++c) {
+            if ((hitBits & (1 << c)) != 0) {
+                int i = numHit++;
+                while ((i > 0) && (entryDistance[order[i - 1]] < entryDistance[c])) {
+                    order[i] = order[i - 1];
+                    --i;
+                }
+                order[i] = c;
+            }
+        }
+
+        debugAssert(top + numHit <= STACK_SIZE);
+        for (int i = 0; i < numHit; ++i) {
+            const int c = order[i];
+            stack[top].child     = node.child[c];
+            stack[top].numBlocks = node.numBlocks[c];
+            stack[top].distance  = entryDistance[c];
+            ++top;
+        }
+    }
+
+    return found;
+}
+
+
+template<int N>
+void NativeTriTree::WideBVH<N>::intersectPacket
+   (const PrecomputedRay*           ray,
+    const int*                      index,
+    int                             count,
+    Hit*                            hit,
+    IntersectRayOptions             options,
+    const Array<Tri>&               triArray,
+    const CPUVertexArray&           vertexArray) const {
+
+    debugAssert((count > 0) && (count <= PACKET_SIZE));
+    if (m_numNodes == 0) {
+        return;
+    }
+
+    const bool occlusionTestOnly = (options & OCCLUSION_TEST_ONLY) != 0;
+
+    // Structure-of-arrays copy of the packet. Unused lanes have an empty
+    // [minDistance, maxDistance] interval, so they never hit a box.
+    enum { NUM_GROUPS = PACKET_SIZE / 4 };
+    float oX[PACKET_SIZE], oY[PACKET_SIZE], oZ[PACKET_SIZE];
+    float iX[PACKET_SIZE], iY[PACKET_SIZE], iZ[PACKET_SIZE];
+    float minDistance[PACKET_SIZE];
+
+    /** Clamped so that unused child slots, whose boxes are at infinity, miss rays of unbounded length */
+    float maxDistance[PACKET_SIZE];
+
+    for (int r = 0; r < PACKET_SIZE; ++r) {
+        if (r < count) {
+            const PrecomputedRay& R = ray[index[r]];
+            oX[r] = R.origin().x;       oY[r] = R.origin().y;       oZ[r] = R.origin().z;
+            iX[r] = R.invDirection().x; iY[r] = R.invDirection().y; iZ[r] = R.invDirection().z;
+            minDistance[r] = R.minDistance();
+            maxDistance[r] = G3D::min(R.maxDistance(), std::numeric_limits<float>::max());
+        } else {
+            oX[r] = oY[r] = oZ[r] = iX[r] = iY[r] = iZ[r] = 0.0f;
+            minDistance[r] = finf();
+            maxDistance[r] = -finf();
+        }
+    }
+
+    class StackEntry {
+    public:
+        int32   child;
+        int32   numBlocks;
+
+        /** Nearest entry distance of the rays in mask */
+        float   distance;
+
+        /** Bit r is set if ray r entered this child's box */
+        int32   mask;
+    };
+
+    enum { STACK_SIZE = (MAX_SAH_DEPTH + 34) * (N - 1) + 1 };
+    StackEntry stack[STACK_SIZE];
+
+    // Rays that have not finished an occlusion test
+    int active = (1 << count) - 1;
+
+    int top = 0;
+    stack[top].child     = 0;
+    stack[top].numBlocks = 0;
+    stack[top].distance  = -finf();
+    stack[top].mask      = active;
+    ++top;
+
+    while (top > 0) {
+        const StackEntry entry = stack[--top];
+        int mask = entry.mask & active;
+
+        // Drop rays that found a hit closer than the box
+        for (int bits = mask; bits != 0; bits &= bits - 1) {
+            const int r = lowestBit(bits);
+            if (entry.distance > maxDistance[r]) {
+                mask &= ~(1 << r);
+            }
+        }
+
+        if (mask == 0) {
+            continue;
+        }
+
+        if ((entry.numBlocks > 0) || ((mask & (mask - 1)) == 0)) {
+            // A leaf, or a subtree that only one ray reached: finish it per ray
+            for (int bits = mask; bits != 0; bits &= bits - 1) {
+                const int r = lowestBit(bits);
+                const bool found = (entry.numBlocks > 0) ?
+                    intersectLeaf(entry.child, entry.numBlocks, ray[index[r]], maxDistance[r], hit[index[r]], options, triArray, vertexArray) :
+                    intersectSubtree(entry.child, entry.numBlocks, ray[index[r]], maxDistance[r], hit[index[r]], options, triArray, vertexArray);
+                if (found && occlusionTestOnly) {
+                    active &= ~(1 << r);
+                }
+            }
+            continue;
+        }
+
+        // Test each child box against four rays at a time
+        const Node& node = m_node[entry.child];
+        int    childMask[N];
+        float4 childNear[N];
+        for (int c = 0; c < N; ++c) {
+            childMask[c] = 0;
+            childNear[c] = float4(finf());
+        }
+
+        for (int g = 0; g < NUM_GROUPS; ++g) {
+            const int groupMask = (mask >> (4 * g)) & 0xF;
+            if (groupMask == 0) {
+                continue;
+            }
+
+            const int offset = 4 * g;
+            const float4 gOX = float4::load(oX + offset), gOY = float4::load(oY + offset), gOZ = float4::load(oZ + offset);
+            const float4 gIX = float4::load(iX + offset), gIY = float4::load(iY + offset), gIZ = float4::load(iZ + offset);
+            const float4 gMin = float4::load(minDistance + offset);
+            const float4 gMax = float4::load(maxDistance + offset);
+
+            for (int c = 0; c < N; ++c) {
+                if (node.child[c] < 0) {
+                    continue;
+                }
+
+                // Same NaN-tolerant argument order as the scalar slab test
+                const float4 tx0 = (float4(node.lowX[c])  - gOX) * gIX;
+                const float4 tx1 = (float4(node.highX[c]) - gOX) * gIX;
+                const float4 ty0 = (float4(node.lowY[c])  - gOY) * gIY;
+                const float4 ty1 = (float4(node.highY[c]) - gOY) * gIY;
+                const float4 tz0 = (float4(node.lowZ[c])  - gOZ) * gIZ;
+                const float4 tz1 = (float4(node.highZ[c]) - gOZ) * gIZ;
+
+                const float4 tNear = max(min(tz0, tz1), max(min(ty0, ty1), max(min(tx0, tx1), gMin)));
+                const float4 tFar  = min(max(tz0, tz1), min(max(ty0, ty1), min(max(tx0, tx1), gMax)));
+
+                const mask4 hit = tNear <= tFar;
+                childMask[c] |= (hit.bits() & groupMask) << offset;
+                childNear[c]  = min(childNear[c], select(hit, tNear, float4(finf())));
+            }
+        }
+
+        // Push the hit children from farthest to nearest, so that the nearest is traversed first
+        int   order[N];
+        float childDistance[N];
+        int   numHit = 0;
+        for (int c = 0; c < N; ++c) {
+            if (childMask[c] != 0) {
+                float tLane[4];
+                childNear[c].store(tLane);
+                childDistance[c] = G3D::min(G3D::min(tLane[0], tLane[1]), G3D::min(tLane[2], tLane[3]));
+
+                int i = numHit++;
+                while ((i > 0) && (childDistance[order[i - 1]] < childDistance[c])) {
+                    order[i] = order[i - 1];
+                    --i;
+                }
+                order[i] = c;
+            }
+        }
+
+        debugAssert(top + numHit <= STACK_SIZE);
+        for (int i = 0; i < numHit; ++i) {
+            const int c = order[i];
+            stack[top].child     = node.child[c];
+            stack[top].numBlocks = node.numBlocks[c];
+            stack[top].distance  = childDistance[c];
+            stack[top].mask      = childMask[c];
+            ++top;
+        }
+    }
+}
+
+
+template<int N>
+Triangle NativeTriTree::WideBVH<N>::triangle(const TriBlock& block, int lane) const {
+    const Point3  v0(block.v0X[lane], block.v0Y[lane], block.v0Z[lane]);
+    const Vector3 e1(block.e1X[lane], block.e1Y[lane], block.e1Z[lane]);
+    const Vector3 e2(block.e2X[lane], block.e2Y[lane], block.e2Z[lane]);
+    return Triangle(v0, v0 + e1, v0 + e2);
+}
+
+
+template<int N>
+void NativeTriTree::WideBVH<N>::intersectBox(const AABox& box, Array<int>& triIndex) const {
+    if (m_numNodes == 0) {
+        return;
+    }
+
+    Array<int> stack;
+    stack.append(0);
+    while (stack.size() > 0) {
+        const Node& node = m_node[stack.pop()];
+        for (int c = 0; c < N; ++c) {
+            if ((node.child[c] < 0) ||
+                ! box.intersects(AABox(Point3(node.lowX[c], node.lowY[c], node.lowZ[c]), Point3(node.highX[c], node.highY[c], node.highZ[c])))) {
+                continue;
+            }
+
+            if (node.numBlocks[c] == 0) {
+                stack.append(node.child[c]);
+            } else {
+                for (int b = node.child[c]; b < node.child[c] + node.numBlocks[c]; ++b) {
+                    const TriBlock& block = m_block[b];
+                    for (int lane = 0; (lane < 4) && (block.triIndex[lane] >= 0); ++lane) {
+                        if (CollisionDetection::fixedSolidBoxIntersectsFixedTriangle(box, triangle(block, lane))) {
+                            triIndex.append(block.triIndex[lane]);
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+
+template<int N>
+void NativeTriTree::WideBVH<N>::intersectSphere(const Sphere& sphere, Array<int>& triIndex) const {
+    if (m_numNodes == 0) {
+        return;
+    }
+
+    Array<int> stack;
+    stack.append(0);
+    while (stack.size() > 0) {
+        const Node& node = m_node[stack.pop()];
+        for (int c = 0; c < N; ++c) {
+            if ((node.child[c] < 0) ||
+                ! AABox(Point3(node.lowX[c], node.lowY[c], node.lowZ[c]), Point3(node.highX[c], node.highY[c], node.highZ[c])).intersects(sphere)) {
+                continue;
+            }
+
+            if (node.numBlocks[c] == 0) {
+                stack.append(node.child[c]);
+            } else {
+                for (int b = node.child[c]; b < node.child[c] + node.numBlocks[c]; ++b) {
+                    const TriBlock& block = m_block[b];
+                    for (int lane = 0; (lane < 4) && (block.triIndex[lane] >= 0); ++lane) {
+                        if (CollisionDetection::fixedSolidSphereIntersectsFixedTriangle(sphere, triangle(block, lane))) {
+                            triIndex.append(block.triIndex[lane]);
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+
+template<int N>
+void NativeTriTree::WideBVH<N>::getStats(Stats& s, int valuesPerNode) const {
+    s.numNodes = m_numNodes;
+    s.depth    = m_depth;
+    s.shallowestLeaf = m_depth;
+
+    // (node, level) pairs
+    Array<Vector2int32> stack;
+    if (m_numNodes > 0) {
+        stack.append(Vector2int32(0, 0));
+    }
+    while (stack.size() > 0) {
+        const Vector2int32 entry = stack.pop();
+        const Node& node = m_node[entry.x];
+        for (int c = 0; c < N; ++c) {
+            if (node.child[c] < 0) {
+                continue;
+            } else if (node.numBlocks[c] == 0) {
+                stack.append(Vector2int32(node.child[c], entry.y + 1));
+            } else {
+                int n = 0;
+                for (int b = node.child[c]; b < node.child[c] + node.numBlocks[c]; ++b) {
+                    for (int lane = 0; lane < 4; ++lane) {
+                        n += (m_block[b].triIndex[lane] >= 0) ? 1 : 0;
+                    }
+                }
+                ++s.numLeaves;
+                ++s.numNodes;
+                s.numTris += n;
+                s.largestNode = max(s.largestNode, n);
+                s.shallowestLeaf = min(s.shallowestLeaf, entry.y + 1);
+                if (n > valuesPerNode) {
+                    s.shallowestNodeOverMin = min(s.shallowestNodeOverMin, entry.y + 1);
+                }
+            }
+        }
+    }
+
+    s.averageValuesPerLeaf = (s.numLeaves > 0) ? float(s.numTris) / s.numLeaves : 0.0f;
+    s.treeBytes = size_t(m_numNodes) * sizeof(Node) + size_t(m_numBlocks) * sizeof(TriBlock);
+}
+
+
+template class NativeTriTree::WideBVH<4>;
+template class NativeTriTree::WideBVH<8>;
+
+////////////////////////////////////////////////////////////////////////////////
+
+namespace {
+
+/** 2^e for e in [-126, 127] */
+inline float exp2i(int e) {
+    const uint32 bits = uint32(e + 127) << 23;
+    float f;
+    memcpy(&f, &bits, sizeof(float));
+    return f;
+}
+
+/** Chooses the exponent of the grid spacing for [low, high] and
+    the grid coordinates of the child interval [childLow, childHigh]
+    within it, rounding outward with the same arithmetic that decoding uses */
+class Quantizer {
+public:
+    float   origin;
+    int     exponent;
+    float   scale;
+
+    Quantizer(float low, float high) : origin(low), exponent(-126) {
+        const float extent = high - low;
+        if (extent > 0.0f) {
+            frexp(extent / 255.0f, &exponent);
+            exponent = iClamp(exponent, -126, 127);
+        }
+        scale = exp2i(exponent);
+
+        // Guard against roundoff in the division
+        while ((decode(255) < high) && (exponent < 127)) {
+            scale = exp2i(++exponent);
+        }
+    }
+
+    /** Matches CompressedBVH::decode() */
+    float decode(int q) const {
+        return origin + float(q) * scale;
+    }
+
+    uint8 low(float childLow) const {
+        int q = iClamp(int(floor((childLow - origin) / scale)), 0, 255);
+        while ((q > 0) && (decode(q) > childLow)) {
+            --q;
+        }
+        return uint8(q);
+    }
+
+    uint8 high(float childHigh) const {
+        int q = iClamp(int(ceil((childHigh - origin) / scale)), 0, 255);
+        while ((q < 255) && (decode(q) < childHigh)) {
+            ++q;
+        }
+        return uint8(q);
+    }
+};
+
+} // namespace
+
+
+void NativeTriTree::CompressedBVH::decode
+   (const Node& node,
+    float       lowX[N],
+    float       lowY[N],
+    float       lowZ[N],
+    float       highX[N],
+    float       highY[N],
+    float       highZ[N]) {
+
+    const float sX = exp2i(node.exponentX), sY = exp2i(node.exponentY), sZ = exp2i(node.exponentZ);
+    for (int c = 0; c < N; ++c) {
+        if ((node.numTris[c] > 0) || ((node.internalMask & (1 << c)) != 0)) {
+            lowX[c]  = node.originX + float(node.lowX[c])  * sX;
+            lowY[c]  = node.originY + float(node.lowY[c])  * sY;
+            lowZ[c]  = node.originZ + float(node.lowZ[c])  * sZ;
+            highX[c] = node.originX + float(node.highX[c]) * sX;
+            highY[c] = node.originY + float(node.highY[c]) * sY;
+            highZ[c] = node.originZ + float(node.highZ[c]) * sZ;
+        } else {
+            // A box at infinity never passes the slab test
+            lowX[c] = lowY[c] = lowZ[c] = highX[c] = highY[c] = highZ[c] = finf();
+        }
+    }
+}
+
+
+void NativeTriTree::CompressedBVH::encode
+   (const WideBVH<N>&   bvh,
+    int                 wideNode,
+    int                 nodeIndex,
+    const AABox&        bounds,
+    const Array<Tri>&   triArray) {
+
+    const WideBVH<N>::Node& src = bvh.m_node[wideNode];
+    const Quantizer qX(bounds.low().x, bounds.high().x);
+    const Quantizer qY(bounds.low().y, bounds.high().y);
+    const Quantizer qZ(bounds.low().z, bounds.high().z);
+
+    Node node;
+    node.originX   = qX.origin;   node.originY   = qY.origin;   node.originZ   = qZ.origin;
+    node.exponentX = int8(qX.exponent); node.exponentY = int8(qY.exponent); node.exponentZ = int8(qZ.exponent);
+    node.internalMask = 0;
+    node.firstTri     = m_compactTriArray.size();
+
+    int numInternal = 0;
+    for (int c = 0; c < N; ++c) {
+        node.numTris[c] = 0;
+        if (src.child[c] < 0) {
+            node.lowX[c]  = node.lowY[c]  = node.lowZ[c]  = 0;
+            node.highX[c] = node.highY[c] = node.highZ[c] = 0;
+            continue;
+        }
+
+        node.lowX[c]  = qX.low(src.lowX[c]);   node.lowY[c]  = qY.low(src.lowY[c]);   node.lowZ[c]  = qZ.low(src.lowZ[c]);
+        node.highX[c] = qX.high(src.highX[c]); node.highY[c] = qY.high(src.highY[c]); node.highZ[c] = qZ.high(src.highZ[c]);
+
+        if (src.numBlocks[c] == 0) {
+            node.internalMask |= uint8(1 << c);
+            ++numInternal;
+        } else {
+            int n = 0;
+            for (int b = src.child[c]; b < src.child[c] + src.numBlocks[c]; ++b) {
+                const WideBVH<N>::TriBlock& block = bvh.m_block[b];
+                for (int lane = 0; (lane < 4) && (block.triIndex[lane] >= 0); ++lane) {
+                    const int  t   = block.triIndex[lane];
+                    const Tri& tri = triArray[t];
+                    CompactTri& dst = m_compactTriArray.next();
+                    for (int k = 0; k < 3; ++k) {
+                        dst.vertex[k] = tri.index[k];
+                    }
+                    dst.triIndex = uint32(t) | ((! tri.twoSided() && (tri.area() >= 0)) ? uint32(CompactTri::CULL_BACKFACE) : 0u);
+                    ++n;
+                }
+            }
+            alwaysAssertM(n <= 255, "CompressedBVH leaves are limited to 255 triangles");
+            node.numTris[c] = uint8(n);
+        }
+    }
+
+    // Allocate the internal children adjacent to each other before recursing
+    node.firstChild = m_nodeArray.size();
+    m_nodeArray.resize(m_nodeArray.size() + numInternal);
+
+    float lowX[N], lowY[N], lowZ[N], highX[N], highY[N], highZ[N];
+    decode(node, lowX, lowY, lowZ, highX, highY, highZ);
+    m_nodeArray[nodeIndex] = node;
+
+    int child = node.firstChild;
+    for (int c = 0; c < N; ++c) {
+        if ((node.internalMask & (1 << c)) != 0) {
+            encode(bvh, src.child[c], child, AABox(Point3(lowX[c], lowY[c], lowZ[c]), Point3(highX[c], highY[c], highZ[c])), triArray);
+            ++child;
+        }
+    }
+}
+
+
+void NativeTriTree::CompressedBVH::build(const WideBVH<N>& bvh, const Array<Tri>& triArray) {
+    static_assert(sizeof(Node) == 80, "CompressedBVH::Node is not packed");
+    static_assert(sizeof(CompactTri) == 16, "CompressedBVH::CompactTri is not packed");
+
+    m_nodeArray.fastClear();
+    m_compactTriArray.fastClear();
+    m_depth  = bvh.m_depth;
+    m_bounds = AABox();
+
+    if (bvh.m_numNodes == 0) {
+        useArrays();
+        return;
+    }
+
+    const WideBVH<N>::Node& root = bvh.m_node[0];
+    for (int c = 0; c < N; ++c) {
+        if (root.child[c] >= 0) {
+            m_bounds.merge(AABox(Point3(root.lowX[c], root.lowY[c], root.lowZ[c]), Point3(root.highX[c], root.highY[c], root.highZ[c])));
+        }
+    }
+
+    m_nodeArray.reserve(bvh.m_numNodes);
+    m_compactTriArray.reserve(bvh.m_numBlocks * 4);
+    m_nodeArray.next();
+    encode(bvh, 0, 0, m_bounds, triArray);
+    m_nodeArray.trimToSize();
+    m_compactTriArray.trimToSize();
+    useArrays();
+}
+
+
+void NativeTriTree::CompressedBVH::useArrays() {
+    m_file.reset();
+    m_node      = m_nodeArray.getCArray();
+    m_numNodes  = m_nodeArray.size();
+    m_tri       = m_compactTriArray.getCArray();
+    m_numTris   = m_compactTriArray.size();
+}
+
+
+Triangle NativeTriTree::CompressedBVH::triangle(const CompactTri& tri, const CPUVertexArray& vertexArray) const {
+    return Triangle(vertexArray.vertex[tri.vertex[0]].position, vertexArray.vertex[tri.vertex[1]].position, vertexArray.vertex[tri.vertex[2]].position);
+}
+
+
+bool NativeTriTree::CompressedBVH::intersectLeaf
+   (int                             first,
+    int                             numTris,
+    const PrecomputedRay&           ray,
+    float&                          maxDistance,
+    Hit&                            hit,
+    IntersectRayOptions             options,
+    const Array<Tri>&               triArray,
+    const CPUVertexArray&           vertexArray) const {
+
+    bool found = false;
+    for (int i = first; i < first + numTris; i += 4) {
+        // Expand into the form that WideBVH<N>::buildLeaf() produces
+        WideBVH<N>::TriBlock block;
+        for (int lane = 0; lane < 4; ++lane) {
+            if (i + lane < first + numTris) {
+                const CompactTri& tri = m_tri[i + lane];
+                const Point3&  v0 = vertexArray.vertex[tri.vertex[0]].position;
+                const Vector3& e1 = vertexArray.vertex[tri.vertex[1]].position - v0;
+                const Vector3& e2 = vertexArray.vertex[tri.vertex[2]].position - v0;
+                const Vector3& n  = e1.cross(e2);
+
+                block.v0X[lane] = v0.x;  block.v0Y[lane] = v0.y;  block.v0Z[lane] = v0.z;
+                block.e1X[lane] = e1.x;  block.e1Y[lane] = e1.y;  block.e1Z[lane] = e1.z;
+                block.e2X[lane] = e2.x;  block.e2Y[lane] = e2.y;  block.e2Z[lane] = e2.z;
+                block.nX[lane]  = n.x;   block.nY[lane]  = n.y;   block.nZ[lane]  = n.z;
+                // n.length() is twice Tri::area()
+                block.backfaceThreshold[lane] = ((tri.triIndex & CompactTri::CULL_BACKFACE) != 0) ? -EPS * n.length() : finf();
+                block.triIndex[lane] = int32(tri.triIndex & ~uint32(CompactTri::CULL_BACKFACE));
+            } else {
+                block.v0X[lane] = block.v0Y[lane] = block.v0Z[lane] = 0.0f;
+                block.e1X[lane] = block.e1Y[lane] = block.e1Z[lane] = 0.0f;
+                block.e2X[lane] = block.e2Y[lane] = block.e2Z[lane] = 0.0f;
+                block.nX[lane]  = block.nY[lane]  = block.nZ[lane]  = 0.0f;
+                block.backfaceThreshold[lane] = finf();
+                block.triIndex[lane] = -1;
+            }
+        }
+
+        if (intersectBlock(block, ray, maxDistance, hit, options, triArray, vertexArray)) {
+            found = true;
+            if ((options & OCCLUSION_TEST_ONLY) != 0) {
+                return true;
+            }
+        }
+    }
+
+    return found;
+}
+
+
+bool NativeTriTree::CompressedBVH::intersectRay
+   (const PrecomputedRay&           ray,
+    Hit&                            hit,
+    IntersectRayOptions             options,
+    const Array<Tri>&               triArray,
+    const CPUVertexArray&           vertexArray) const {
+
+    if (m_numNodes == 0) {
+        return false;
+    }
+
+    class StackEntry {
+    public:
+        /** Node index, or first CompactTri index of a leaf */
+        int32   child;
+        int32   numTris;
+        float   distance;
+    };
+
+    // Each level pushes at most N - 1 more entries than it pops
+    enum { STACK_SIZE = (MAX_SAH_DEPTH + 34) * (N - 1) + 1 };
+    StackEntry stack[STACK_SIZE];
+    debugAssert(m_depth < MAX_SAH_DEPTH + 34);
+
+    const float4 oX(ray.origin().x), oY(ray.origin().y), oZ(ray.origin().z);
+    const float4 iX(ray.invDirection().x), iY(ray.invDirection().y), iZ(ray.invDirection().z);
+    const float4 minDistance(ray.minDistance());
+
+    float maxDistance = ray.maxDistance();
+    bool found = false;
+
+    int top = 0;
+    stack[top].child    = 0;
+    stack[top].numTris  = 0;
+    stack[top].distance = -finf();
+    ++top;
+
+    while (top > 0) {
+        const StackEntry entry = stack[--top];
+        if (entry.distance > maxDistance) {
+            // A closer hit was found after this entry was pushed
+            continue;
+        }
+
+        if (entry.numTris > 0) {
+            if (intersectLeaf(entry.child, entry.numTris, ray, maxDistance, hit, options, triArray, vertexArray)) {
+                found = true;
+                if ((options & OCCLUSION_TEST_ONLY) != 0) {
+                    return true;
+                }
+            }
+            continue;
+        }
+
+        // Decode the child boxes as in decode(), and apply the same slab test as WideBVH<N>::intersectSubtree()
+        const Node& node = m_node[entry.child];
+        const float4 originX(node.originX), originY(node.originY), originZ(node.originZ);
+        const float4 sX(exp2i(node.exponentX)), sY(exp2i(node.exponentY)), sZ(exp2i(node.exponentZ));
+        const float4 maxD(G3D::min(maxDistance, std::numeric_limits<float>::max()));
+        float entryDistance[N];
+        int   hitBits = 0;
+        for (int g = 0; g < N; g += 4) {
+            const float4 tx0 = (originX + float4::load(node.lowX + g)  * sX - oX) * iX;
+            const float4 tx1 = (originX + float4::load(node.highX + g) * sX - oX) * iX;
+            const float4 ty0 = (originY + float4::load(node.lowY + g)  * sY - oY) * iY;
+            const float4 ty1 = (originY + float4::load(node.highY + g) * sY - oY) * iY;
+            const float4 tz0 = (originZ + float4::load(node.lowZ + g)  * sZ - oZ) * iZ;
+            const float4 tz1 = (originZ + float4::load(node.highZ + g) * sZ - oZ) * iZ;
+
+            const float4 tNear = max(min(tz0, tz1), max(min(ty0, ty1), max(min(tx0, tx1), minDistance)));
+            const float4 tFar  = min(max(tz0, tz1), min(max(ty0, ty1), min(max(tx0, tx1), maxD)));
+
+            hitBits |= (tNear <= tFar).bits() << g;
+            tNear.store(entryDistance + g);
+        }
+
+        // Locate every child, and push the hit ones from farthest to nearest
+        int   childIndex[N];
+        int   nextChild = node.firstChild;
+        int   nextTri   = node.firstTri;
+        int   order[N];
+        int   numHit = 0;
+        for (int c = 0; c < N; ++c) {
+            if ((node.internalMask & (1 << c)) != 0) {
+                childIndex[c] = nextChild++;
+            } else if (node.numTris[c] > 0) {
+                childIndex[c] = nextTri;
+                nextTri += node.numTris[c];
+            } else {
+                // Unused slots have all-zero grid coordinates
+                continue;
+            }
+
+            if ((hitBits & (1 << c)) != 0) {
+                int i = numHit++;
+                while ((i > 0) && (entryDistance[order[i - 1]] < entryDistance[c])) {
+                    order[i] = order[i - 1];
+                    --i;
+                }
+                order[i] = c;
+            }
+        }
+
+        debugAssert(top + numHit <= STACK_SIZE);
+        for (int i = 0; i < numHit; ++i) {
+            const int c = order[i];
+            stack[top].child    = childIndex[c];
+            stack[top].numTris  = node.numTris[c];
+            stack[top].distance = entryDistance[c];
+            ++top;
+        }
+    }
+
+    return found;
+}
+
+
+void NativeTriTree::CompressedBVH::intersectBox(const AABox& box, const CPUVertexArray& vertexArray, Array<int>& triIndex) const {
+    if (m_numNodes == 0) {
+        return;
+    }
+
+    Array<int> stack;
+    stack.append(0);
+    while (stack.size() > 0) {
+        const Node& node = m_node[stack.pop()];
+        float lowX[N], lowY[N], lowZ[N], highX[N], highY[N], highZ[N];
+        decode(node, lowX, lowY, lowZ, highX, highY, highZ);
+
+        int nextChild = node.firstChild;
+        int nextTri   = node.firstTri;
+        for (int c = 0; c < N; ++c) {
+            const bool internal = (node.internalMask & (1 << c)) != 0;
+            const int  first    = internal ? nextChild++ : nextTri;
+            nextTri += node.numTris[c];
+            if (((! internal) && (node.numTris[c] == 0)) ||
+                ! box.intersects(AABox(Point3(lowX[c], lowY[c], lowZ[c]), Point3(highX[c], highY[c], highZ[c])))) {
+                continue;
+            }
+
+            if (internal) {
+                stack.append(first);
+            } else {
+                for (int t = first; t < first + node.numTris[c]; ++t) {
+                    if (CollisionDetection::fixedSolidBoxIntersectsFixedTriangle(box, triangle(m_tri[t], vertexArray))) {
+                        triIndex.append(int(m_tri[t].triIndex & ~uint32(CompactTri::CULL_BACKFACE)));
+                    }
+                }
+            }
+        }
+    }
+}
+
+
+void NativeTriTree::CompressedBVH::intersectSphere(const Sphere& sphere, const CPUVertexArray& vertexArray, Array<int>& triIndex) const {
+    if (m_numNodes == 0) {
+        return;
+    }
+
+    Array<int> stack;
+    stack.append(0);
+    while (stack.size() > 0) {
+        const Node& node = m_node[stack.pop()];
+        float lowX[N], lowY[N], lowZ[N], highX[N], highY[N], highZ[N];
+        decode(node, lowX, lowY, lowZ, highX, highY, highZ);
+
+        int nextChild = node.firstChild;
+        int nextTri   = node.firstTri;
+        for (int c = 0; c < N; ++c) {
+            const bool internal = (node.internalMask & (1 << c)) != 0;
+            const int  first    = internal ? nextChild++ : nextTri;
+            nextTri += node.numTris[c];
+            if (((! internal) && (node.numTris[c] == 0)) ||
+                ! AABox(Point3(lowX[c], lowY[c], lowZ[c]), Point3(highX[c], highY[c], highZ[c])).intersects(sphere)) {
+                continue;
+            }
+
+            if (internal) {
+                stack.append(first);
+            } else {
+                for (int t = first; t < first + node.numTris[c]; ++t) {
+                    if (CollisionDetection::fixedSolidSphereIntersectsFixedTriangle(sphere, triangle(m_tri[t], vertexArray))) {
+                        triIndex.append(int(m_tri[t].triIndex & ~uint32(CompactTri::CULL_BACKFACE)));
+                    }
+                }
+            }
+        }
+    }
+}
+
+
+void NativeTriTree::CompressedBVH::getStats(Stats& s, int valuesPerNode) const {
+    s.numNodes = m_numNodes;
+    s.depth    = m_depth;
+    s.shallowestLeaf = m_depth;
+
+    // (node, level) pairs
+    Array<Vector2int32> stack;
+    if (m_numNodes > 0) {
+        stack.append(Vector2int32(0, 0));
+    }
+    while (stack.size() > 0) {
+        const Vector2int32 entry = stack.pop();
+        const Node& node = m_node[entry.x];
+        int nextChild = node.firstChild;
+        for (int c = 0; c < N; ++c) {
+            if ((node.internalMask & (1 << c)) != 0) {
+                stack.append(Vector2int32(nextChild++, entry.y + 1));
+            } else if (node.numTris[c] > 0) {
+                const int n = node.numTris[c];
+                ++s.numLeaves;
+                ++s.numNodes;
+                s.numTris += n;
+                s.largestNode = max(s.largestNode, n);
+                s.shallowestLeaf = min(s.shallowestLeaf, entry.y + 1);
+                if (n > valuesPerNode) {
+                    s.shallowestNodeOverMin = min(s.shallowestNodeOverMin, entry.y + 1);
+                }
+            }
+        }
+    }
+
+    s.averageValuesPerLeaf = (s.numLeaves > 0) ? float(s.numTris) / s.numLeaves : 0.0f;
+    s.treeBytes = size_t(m_numNodes) * sizeof(Node) + size_t(m_numTris) * sizeof(CompactTri);
+}
+
+#ifdef _MSC_VER
+// Turn off fast floating-point optimizations
+#pragma float_control( pop )
+#endif
+
+} // namespace G3D
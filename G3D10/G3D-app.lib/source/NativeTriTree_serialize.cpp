@@ -0,0 +1,333 @@
+/**
+  \file G3D-app.lib/source/NativeTriTree_serialize.cpp
+
+  Saving and memory-mapping the BVH layouts of NativeTriTree.
+
+  G3D Innovation Engine http://casual-effects.com/g3d
+  Copyright 2000-2019, Morgan McGuire
+  All rights reserved
+  Available under the BSD License
+*/
+
+#include "G3D-base/BinaryOutput.h"
+#include "G3D-base/FileSystem.h"
+#include "G3D-app/NativeTriTree.h"
+#include <cstring>
+
+namespace G3D {
+
+namespace {
+
+/** Increment whenever the layout of a node or leaf record changes */
+const uint32 CACHE_VERSION = 1;
+
+const char CACHE_MAGIC[8] = {'G', '3', 'D', 'T', 'R', 'I', 'T', 'R'};
+
+/** Nodes and records are aligned to cache lines within the file, and so in memory */
+const uint64 SECTION_ALIGNMENT = 64;
+
+/** Number of triangles or vertices that contentHash() hashes per task */
+const int HASH_CHUNK_SIZE = 1 << 16;
+
+/** Start of a file written by NativeTriTree::save(), followed by the node and record sections */
+class CacheHeader {
+public:
+    char            magic[8];
+    uint32          version;
+    uint32          layout;
+    uint8           key[16];
+
+    /** sizeof(Node) and sizeof the leaf record, to reject files from
+        builds with a different memory layout */
+    uint32          nodeSize;
+    uint32          recordSize;
+
+    int32           numNodes;
+    int32           numRecords;
+    int32           depth;
+    int32           numTris;
+
+    /** Byte offsets from the start of the file */
+    uint64          nodeOffset;
+    uint64          recordOffset;
+
+    float           boundsLow[3];
+    float           boundsHigh[3];
+};
+
+
+uint64 alignSection(uint64 offset) {
+    return (offset + SECTION_ALIGNMENT - 1) & ~(SECTION_ALIGNMENT - 1);
+}
+
+
+/** Hashes the \a numElements values of \a get(i) as an array of \a T, HASH_CHUNK_SIZE
+    elements at a time in parallel, writing one hash per chunk to \a hash */
+template<class T, class Get>
+void hashChunks(int numElements, MD5Hash* hash, Get get) {
+    const int numChunks = (numElements + HASH_CHUNK_SIZE - 1) / HASH_CHUNK_SIZE;
+    tbb::parallel_for(0, numChunks, [&](int c) {
+        const int begin = c * HASH_CHUNK_SIZE;
+        const int end   = min(begin + HASH_CHUNK_SIZE, numElements);
+        Array<T> buffer;
+        buffer.resize(end - begin);
+        for (int i = begin; i < end; ++i) {
+            buffer[i - begin] = get(i);
+        }
+        hash[c] = Crypto::md5(buffer.getCArray(), sizeof(T) * buffer.size());
+    });
+}
+
+} // namespace
+
+
+MD5Hash NativeTriTree::contentHash() const {
+    class TriRecord {
+    public:
+        uint32  index[3];
+        uint32  twoSided;
+    };
+
+    const int numTris     = m_triArray.size();
+    const int numVertices = m_vertexArray.vertex.size();
+    const int numTriChunks    = (numTris + HASH_CHUNK_SIZE - 1) / HASH_CHUNK_SIZE;
+    const int numVertexChunks = (numVertices + HASH_CHUNK_SIZE - 1) / HASH_CHUNK_SIZE;
+
+    // Only the inputs that build() reads: positions, indices, and backface culling
+    Array<MD5Hash> hash;
+    hash.resize(numTriChunks + numVertexChunks);
+    hashChunks<TriRecord>(numTris, hash.getCArray(), [&](int i) {
+        const Tri& tri = m_triArray[i];
+        TriRecord r;
+        for (int v = 0; v < 3; ++v) {
+            r.index[v] = tri.index[v];
+        }
+        r.twoSided = tri.twoSided() ? 1 : 0;
+        return r;
+    });
+    hashChunks<Point3>(numVertices, hash.getCArray() + numTriChunks, [&](int i) {
+        return m_vertexArray.vertex[i].position;
+    });
+
+    const int32 settingsRecord[] = {int32(CACHE_VERSION), int32(m_settings.layout), m_settings.valuesPerLeaf, m_settings.numBins, numTris, numVertices};
+
+    Array<uint8> all;
+    all.resize(int(sizeof(MD5Hash) * hash.size() + sizeof(settingsRecord)));
+    if (hash.size() > 0) {
+        System::memcpy(all.getCArray(), hash.getCArray(), sizeof(MD5Hash) * hash.size());
+    }
+    System::memcpy(all.getCArray() + sizeof(MD5Hash) * hash.size(), settingsRecord, sizeof(settingsRecord));
+
+    return Crypto::md5(all.getCArray(), all.size());
+}
+
+
+bool NativeTriTree::save(const String& filename) const {
+    return save(filename, contentHash());
+}
+
+
+bool NativeTriTree::load(const String& filename) {
+    return load(filename, contentHash());
+}
+
+
+bool NativeTriTree::save(const String& filename, const MD5Hash& key) const {
+    CacheHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+    header.version = CACHE_VERSION;
+    header.numTris = m_triArray.size();
+    for (int i = 0; i < 16; ++i) {
+        header.key[i] = key[i];
+    }
+
+    const void* node   = nullptr;
+    const void* record = nullptr;
+    AABox bounds;
+    if (m_bvh4) {
+        header.layout     = BVH4;
+        header.nodeSize   = sizeof(WideBVH<4>::Node);
+        header.recordSize = sizeof(WideBVH<4>::TriBlock);
+        header.numNodes   = m_bvh4->m_numNodes;
+        header.numRecords = m_bvh4->m_numBlocks;
+        header.depth      = m_bvh4->m_depth;
+        node              = m_bvh4->m_node;
+        record            = m_bvh4->m_block;
+    } else if (m_bvh8) {
+        header.layout     = BVH8;
+        header.nodeSize   = sizeof(WideBVH<8>::Node);
+        header.recordSize = sizeof(WideBVH<8>::TriBlock);
+        header.numNodes   = m_bvh8->m_numNodes;
+        header.numRecords = m_bvh8->m_numBlocks;
+        header.depth      = m_bvh8->m_depth;
+        node              = m_bvh8->m_node;
+        record            = m_bvh8->m_block;
+    } else if (m_compressedBVH8) {
+        header.layout     = COMPRESSED_BVH8;
+        header.nodeSize   = sizeof(CompressedBVH::Node);
+        header.recordSize = sizeof(CompressedBVH::CompactTri);
+        header.numNodes   = m_compressedBVH8->m_numNodes;
+        header.numRecords = m_compressedBVH8->m_numTris;
+        header.depth      = m_compressedBVH8->m_depth;
+        node              = m_compressedBVH8->m_node;
+        record            = m_compressedBVH8->m_tri;
+        bounds            = m_compressedBVH8->m_bounds;
+    } else {
+        // The BIH is a pointer-based tree, and an empty tree has no layout
+        return false;
+    }
+
+    for (int a = 0; a < 3; ++a) {
+        header.boundsLow[a]  = bounds.low()[a];
+        header.boundsHigh[a] = bounds.high()[a];
+    }
+
+    const uint64 nodeBytes   = uint64(header.numNodes) * header.nodeSize;
+    const uint64 recordBytes = uint64(header.numRecords) * header.recordSize;
+    header.nodeOffset   = alignSection(sizeof(CacheHeader));
+    header.recordOffset = alignSection(header.nodeOffset + nodeBytes);
+
+    const String& directory = FilePath::parent(filename);
+    if (! directory.empty() && ! FileSystem::exists(directory, false)) {
+        FileSystem::createDirectory(directory);
+    }
+
+    // Write under another name so that no process ever maps a partial file
+    const String& temp = FileSystem::tempFilename(directory.empty() ? "." : directory);
+    bool ok = false;
+    try {
+        BinaryOutput b(temp, G3D_LITTLE_ENDIAN);
+        b.writeBytes(&header, sizeof(header));
+        while (uint64(b.position()) < header.nodeOffset) {
+            b.writeUInt8(0);
+        }
+        b.writeBytes(node, size_t(nodeBytes));
+        while (uint64(b.position()) < header.recordOffset) {
+            b.writeUInt8(0);
+        }
+        b.writeBytes(record, size_t(recordBytes));
+        b.commit();
+        ok = b.ok();
+    } catch (...) {
+        ok = false;
+    }
+
+    if (ok && (FileSystem::rename(temp, filename) != 0)) {
+        // Windows cannot rename over an existing file. Another process
+        // may have it mapped, so leave it if it cannot be removed.
+        FileSystem::removeFile(filename);
+        ok = (FileSystem::rename(temp, filename) == 0);
+    }
+
+    if (! ok && FileSystem::exists(temp, false)) {
+        FileSystem::removeFile(temp);
+    }
+
+    return ok;
+}
+
+
+bool NativeTriTree::load(const String& filename, const MD5Hash& key) {
+    if (System::machineEndian() != G3D_LITTLE_ENDIAN) {
+        return false;
+    }
+
+    const shared_ptr<MemoryMappedFile>& file = MemoryMappedFile::create(filename);
+    if (isNull(file) || (file->size() < sizeof(CacheHeader))) {
+        return false;
+    }
+
+    CacheHeader header;
+    std::memcpy(&header, file->data(), sizeof(header));
+
+    bool ok =
+        (std::memcmp(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) == 0) &&
+        (header.version == CACHE_VERSION) &&
+        (header.layout == uint32(m_settings.layout)) &&
+        (header.numTris == m_triArray.size()) &&
+        (header.numNodes >= 0) && (header.numRecords >= 0);
+
+    for (int i = 0; ok && (i < 16); ++i) {
+        ok = (header.key[i] == key[i]);
+    }
+
+    if (ok) {
+        uint32 nodeSize = 0, recordSize = 0;
+        switch (m_settings.layout) {
+        case BVH4:
+            nodeSize   = sizeof(WideBVH<4>::Node);
+            recordSize = sizeof(WideBVH<4>::TriBlock);
+            break;
+
+        case BVH8:
+            nodeSize   = sizeof(WideBVH<8>::Node);
+            recordSize = sizeof(WideBVH<8>::TriBlock);
+            break;
+
+        case COMPRESSED_BVH8:
+            nodeSize   = sizeof(CompressedBVH::Node);
+            recordSize = sizeof(CompressedBVH::CompactTri);
+            break;
+
+        default:
+            break;
+        }
+
+        ok = (nodeSize > 0) && (header.nodeSize == nodeSize) && (header.recordSize == recordSize) &&
+            (header.nodeOffset % SECTION_ALIGNMENT == 0) && (header.recordOffset % SECTION_ALIGNMENT == 0) &&
+            (header.nodeOffset + uint64(header.numNodes) * nodeSize <= file->size()) &&
+            (header.recordOffset + uint64(header.numRecords) * recordSize <= file->size());
+    }
+
+    if (! ok) {
+        return false;
+    }
+
+    freeTree();
+
+    const uint8* node   = (header.numNodes > 0)   ? file->data() + header.nodeOffset   : nullptr;
+    const uint8* record = (header.numRecords > 0) ? file->data() + header.recordOffset : nullptr;
+
+    // Traversal starts at the top of the tree on every ray, so fetch the nodes now
+    // and leave the leaves to be paged in as rays reach them
+    file->advise(MemoryMappedFile::WILL_NEED, size_t(header.nodeOffset), size_t(header.numNodes) * header.nodeSize);
+    file->advise(MemoryMappedFile::RANDOM, size_t(header.recordOffset), size_t(header.numRecords) * header.recordSize);
+
+    if (m_settings.layout == BVH4) {
+        m_bvh4 = std::make_shared<WideBVH<4>>();
+        m_bvh4->m_node      = reinterpret_cast<const WideBVH<4>::Node*>(node);
+        m_bvh4->m_block     = reinterpret_cast<const WideBVH<4>::TriBlock*>(record);
+        m_bvh4->m_numNodes  = header.numNodes;
+        m_bvh4->m_numBlocks = header.numRecords;
+        m_bvh4->m_depth     = header.depth;
+        m_bvh4->m_file      = file;
+    } else if (m_settings.layout == BVH8) {
+        m_bvh8 = std::make_shared<WideBVH<8>>();
+        m_bvh8->m_node      = reinterpret_cast<const WideBVH<8>::Node*>(node);
+        m_bvh8->m_block     = reinterpret_cast<const WideBVH<8>::TriBlock*>(record);
+        m_bvh8->m_numNodes  = header.numNodes;
+        m_bvh8->m_numBlocks = header.numRecords;
+        m_bvh8->m_depth     = header.depth;
+        m_bvh8->m_file      = file;
+    } else {
+        m_compressedBVH8 = std::make_shared<CompressedBVH>();
+        m_compressedBVH8->m_node     = reinterpret_cast<const CompressedBVH::Node*>(node);
+        m_compressedBVH8->m_tri      = reinterpret_cast<const CompressedBVH::CompactTri*>(record);
+        m_compressedBVH8->m_numNodes = header.numNodes;
+        m_compressedBVH8->m_numTris  = header.numRecords;
+        m_compressedBVH8->m_depth    = header.depth;
+        m_compressedBVH8->m_file     = file;
+
+        // An empty tree has empty (NaN) bounds
+        const Point3 low(header.boundsLow[0], header.boundsLow[1], header.boundsLow[2]);
+        if (! low.isNaN()) {
+            m_compressedBVH8->m_bounds = AABox(low, Point3(header.boundsHigh[0], header.boundsHigh[1], header.boundsHigh[2]));
+        }
+    }
+
+    m_lastBuildTime = System::time();
+    return true;
+}
+
+} // namespace G3D
@@ -151,7 +151,7 @@ void PathTracer::generateEyeRays
 
 void PathTracer::addEmissive
 (const Array<Ray>&                   rayFromEye,
- const Array<shared_ptr<Surfel>>&    surfelBuffer, 
+ const Array<const Surfel*>&         surfelBuffer, 
  const Array<bool>&                  impulseRay,
  const Array<Color3>&                modulationBuffer,
  Radiance3*                          outputBuffer,
@@ -160,7 +160,7 @@ void PathTracer::addEmissive
  const Array<PixelCoord>&            pixelCoordBuffer) const {
     
     runConcurrently(0, rayFromEye.length(), [&](int i) {
-        const Surfel* surfel = surfelBuffer[i].get();
+        const Surfel* surfel = surfelBuffer[i];
         const Vector3& w_o = -rayFromEye[i].direction();
         Radiance3 L_e = notNull(surfel) ? surfel->emittedRadiance(w_o) : skyRadiance(w_o);
         
@@ -211,7 +211,7 @@ Point3 PathTracer::sampleOneLight(const shared_ptr<Light>& light, const Point3&
 const shared_ptr<Light>& PathTracer::importanceSampleLight
 (const Array<shared_ptr<Light>>&             lightArray,
  const Vector3&                              w_o,
- const shared_ptr<Surfel>&                   surfel,
+ const Surfel*                               surfel,
  int                                         sequenceIndex,
  int                                         rayIndex,
  int                                         raysPerPixel,
@@ -337,7 +337,7 @@ const shared_ptr<Light>& PathTracer::importanceSampleLight
 
 
 void PathTracer::computeDirectIllumination
-(const Array<shared_ptr<Surfel>>&    surfelBuffer, 
+(const Array<const Surfel*>&         surfelBuffer, 
  const Array<shared_ptr<Light>>&     lightArray,
  const Array<Ray>&                   rayBuffer,
  int                                 currentPathDepth,
@@ -351,7 +351,7 @@ void PathTracer::computeDirectIllumination
     const float epsilon = 1e-3f;
 
     runConcurrently(0, surfelBuffer.size(), [&](int i) {
-        const shared_ptr<Surfel>& surfel = surfelBuffer[i];
+        const Surfel* surfel = surfelBuffer[i];
 
         debugAssert(notNull(surfel));
 
@@ -400,7 +400,7 @@ void PathTracer::computeDirectIllumination
 
 
 void PathTracer::shade
-(const Array<shared_ptr<Surfel>>&        surfelBuffer,
+(const Array<const Surfel*>&             surfelBuffer,
  const Array<Ray>&                       rayFromEye,
  const Array<Ray>&                       rayFromLight,
  const Array<bool>&                      lightShadowedBuffer,
@@ -421,13 +421,13 @@ void PathTracer::shade
 #           if 1 // Regular implementation
                const Radiance3& L = L_sd;
 #           elif 0 // Visualize lambertian term
-               const shared_ptr<Surfel>& surfel = surfelBuffer[i];
+               const Surfel* surfel = surfelBuffer[i];
                debugAssertM(notNull(surfel), "Null surfels should have been compacted before shading"); 
 
                const Vector3& w_i = -rayFromLight[i].direction();
                const Vector3& w_o = -rayFromEye[i].direction();
                const Vector3& n   = surfel->shadingNormal;
-               const shared_ptr<UniversalSurfel>& us = dynamic_pointer_cast<UniversalSurfel>(surfel);
+               const UniversalSurfel* us = dynamic_cast<const UniversalSurfel*>(surfel);
                const Radiance3& L = us->lambertianReflectivity / pif();
 #           elif 0 // Visualize hit points
                const Radiance3& L = Radiance3(surfel->position * 0.3f + Point3::one() * 0.5f));
@@ -451,7 +451,7 @@ void PathTracer::shade
 
 
 void PathTracer::scatterRays
-   (const Array<shared_ptr<Surfel>>&        surfelBuffer,
+   (const Array<const Surfel*>&             surfelBuffer,
     const Array<shared_ptr<Light>>&         indirectLightArray,
     int                                     currentPathDepth,
     int                                     rayIndex,
@@ -463,7 +463,7 @@ void PathTracer::scatterRays
     static const float epsilon = 1e-4f;
 
     runConcurrently(0, surfelBuffer.size(), [&](int i) {
-        const shared_ptr<Surfel>& surfel = surfelBuffer[i];
+        const Surfel* surfel = surfelBuffer[i];
         debugAssertM(notNull(surfel), "Null surfels should have been compacted before scattering");
 
         // Direction that the light went OUT, eventually towards the eye
@@ -489,7 +489,7 @@ void PathTracer::scatterRays
             // scatterPeteCone
             // scatterBlinnPhong
             // scatterHackedBlinnPhong
-            SimpleBSDF::scatter(dynamic_pointer_cast<UniversalSurfel>(surfel), w_o, Random::threadCommon(), w_i, weight);
+            SimpleBSDF::scatter(dynamic_cast<const UniversalSurfel*>(surfel), w_o, Random::threadCommon(), w_i, weight);
 #       endif
 
         if ((modulationBuffer[i].sum() < minModulation) || w_i.isNaN() || weight.isZero()) {
@@ -623,17 +623,19 @@ void PathTracer::traceBufferInternal
     
     const int numTraceIterations = m_options.maxScatteringEvents - (m_options.useEnvironmentMapForLastScatteringEvent ?  1 : 0);
 
-    int radianceImageWidth = radianceImage->width();
+    // traceBuffer() writes to output instead of an image
+    const int radianceImageWidth = notNull(radianceImage) ? radianceImage->width() : 0;
 
     for (int scatteringEvents = 0; (scatteringEvents < numTraceIterations) && (buffers.surfel.size() > 0); ++scatteringEvents) {
 
-        m_triTree->intersectRays(buffers.ray, buffers.surfel, (scatteringEvents == 0) ? TriTree::COHERENT_RAY_HINT : 0);
+        m_triTree->intersectRays(buffers.ray, buffers.hit, (scatteringEvents == 0) ? TriTree::COHERENT_RAY_HINT : 0);
+        m_triTree->sample(buffers.hit, buffers.surfelPool, buffers.surfel);
 
         if (notNull(distance) && (scatteringEvents == 0)) {
             // Write to the distance buffer.
             // On the first hit, outputCoordBuffer[i] == i, so no need for indirection on indices.
             runConcurrently(0, numRays, [&](int i) {
-                const shared_ptr<Surfel>& surfel = buffers.surfel[i];
+                const Surfel* surfel = buffers.surfel[i];
                 distance[i] = surfel ? (surfel->position - buffers.ray[i].origin()).length() : finf();
             });
         }
@@ -652,7 +654,8 @@ void PathTracer::traceBufferInternal
         // Direct lighting
         if (directLightArray.size() > 0) {
             computeDirectIllumination(buffers.surfel, directLightArray, buffers.ray, scatteringEvents, currentRayIndex, m_options, buffers.outputCoord, radianceImageWidth, buffers.direct, buffers.shadowRay);
-            m_triTree->intersectRays(buffers.shadowRay, buffers.lightShadowed, TriTree::COHERENT_RAY_HINT | TriTree::DO_NOT_CULL_BACKFACES | TriTree::OCCLUSION_TEST_ONLY);
+            // Shadow rays from secondary hits are incoherent and benefit from sorting
+            m_triTree->intersectRays(buffers.shadowRay, buffers.lightShadowed, ((scatteringEvents == 0) ? TriTree::COHERENT_RAY_HINT : 0) | TriTree::DO_NOT_CULL_BACKFACES | TriTree::OCCLUSION_TEST_ONLY);
             shade(buffers.surfel, buffers.ray, buffers.shadowRay, buffers.lightShadowed, buffers.direct, buffers.modulation, output, buffers.outputIndex, radianceImage, buffers.outputCoord);
         }
 
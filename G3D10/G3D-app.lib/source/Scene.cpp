@@ -29,6 +29,12 @@
 #include "G3D-app/FontModel.h"
 #include "G3D-app/VoxelModel.h"
 #include "G3D-app/SoundEntity.h"
+#include "G3D-app/NativeTriTree.h"
+#include "G3D-app/EmbreeTriTree.h"
+#include "G3D-app/InstancedTriTree.h"
+#include "G3D-base/Thread.h"
+#include <atomic>
+#include <thread>
 
 using namespace G3D::units;
 
@@ -45,22 +51,58 @@ bool Scene::contains(const shared_ptr<Camera>& c) const {
 void Scene::onSimulation(SimTime deltaTime) {
     sortEntitiesByDependency();
     m_time += isNaN(deltaTime) ? 0 : deltaTime;
-    for (int i = 0; i < m_entityArray.size(); ++i) {
-        const shared_ptr<Entity> entity = m_entityArray[i];
-        
-        entity->onSimulation(m_time, deltaTime);
 
-        const shared_ptr<Light>& light = dynamic_pointer_cast<Light>(entity);
-        if (light) {
-            m_lastLightChangeTime = max(m_lastLightChangeTime, entity->lastChangeTime());
-            if (light->visible()) {
-                m_lastVisibleChangeTime = max(m_lastVisibleChangeTime, entity->lastChangeTime());
-            }
-        } else if (dynamic_pointer_cast<VisibleEntity>(entity)) {
-            m_lastVisibleChangeTime = max(m_lastVisibleChangeTime, entity->lastChangeTime());
-        }
-        // Intentionally ignoring the case of other Entity subclasses
+    // Below this many entities in a level, the thread pool costs more than it saves
+    static const int MIN_CONCURRENT_LEVEL_SIZE = 64;
+
+    m_simulatingEntities = true;
+    for (int L = 0; L < m_entityLevelStart.size() - 1; ++L) {
+        const int start = m_entityLevelStart[L];
+        const int stop  = m_entityLevelStart[L + 1];
+        runConcurrently(start, stop, [&](int i) {
+            m_entityArray[i]->onSimulation(m_time, deltaTime);
+        }, ! m_simulateEntitiesConcurrently || (stop - start < MIN_CONCURRENT_LEVEL_SIZE));
     }
+    m_simulatingEntities = false;
+
+    if (m_deferredEntityEditArray.size() > 0) {
+        applyDeferredEntityEdits();
+        // Rebuild the levels and type tags for the new entity array
+        sortEntitiesByDependency();
+    }
+
+    // Reduce the change times over the cached type tags. Lights can be toggled
+    // visible during simulation, so that test cannot be cached.
+    typedef std::pair<RealTime, RealTime> LightAndVisibleTime;
+    const LightAndVisibleTime changeTime = tbb::parallel_reduce(tbb::blocked_range<int>(0, m_entityArray.size(), 1024),
+        LightAndVisibleTime(m_lastLightChangeTime, m_lastVisibleChangeTime),
+        [&](const tbb::blocked_range<int>& range, LightAndVisibleTime t) {
+            for (int i = range.begin(); i < range.end(); ++i) {
+                const Entity* entity = m_entityArray[i].get();
+                switch (m_entityTypeTag[i]) {
+                case LIGHT_ENTITY_TAG:
+                    t.first = max(t.first, entity->lastChangeTime());
+                    if (static_cast<const Light*>(entity)->visible()) {
+                        t.second = max(t.second, entity->lastChangeTime());
+                    }
+                    break;
+
+                case VISIBLE_ENTITY_TAG:
+                    t.second = max(t.second, entity->lastChangeTime());
+                    break;
+
+                default:;
+                    // Intentionally ignoring the case of other Entity subclasses
+                }
+            }
+            return t;
+        },
+        [](const LightAndVisibleTime& a, const LightAndVisibleTime& b) {
+            return LightAndVisibleTime(max(a.first, b.first), max(a.second, b.second));
+        });
+
+    m_lastLightChangeTime = changeTime.first;
+    m_lastVisibleChangeTime = changeTime.second;
 
     if (m_editing) {
         m_lastEditingTime = System::time();
@@ -69,6 +111,23 @@ void Scene::onSimulation(SimTime deltaTime) {
 }
 
 
+void Scene::applyDeferredEntityEdits() {
+    debugAssert(! m_simulatingEntities);
+    Array<std::pair<shared_ptr<Entity>, bool>> editArray;
+    Array<std::pair<shared_ptr<Entity>, bool>>::swap(editArray, m_deferredEntityEditArray);
+
+    for (const std::pair<shared_ptr<Entity>, bool>& edit : editArray) {
+        const shared_ptr<Entity>& entity = edit.first;
+        if (edit.second) {
+            insert(entity);
+        } else if (m_entityArray.contains(entity)) {
+            // An entity may have been removed more than once in the same step
+            remove(entity);
+        }
+    }
+}
+
+
 void Scene::registerEntitySubclass(const String& name, EntityFactory factory, bool errorIfAlreadyRegistered) {
     alwaysAssertM(! m_entityFactory.containsKey(name) || ! errorIfAlreadyRegistered, name + " has already been registered as an entity subclass.");
     m_entityFactory.set(name, factory);
@@ -94,6 +153,13 @@ const shared_ptr<TriTree>& Scene::tritree(TriTreeGPUAPI gpuApi) {
         if (isNull(m_triTree)) {
             // Will attempt to create a GPU tritree by default.
             m_triTree = TriTree::create(true, gpuApi == TriTreeGPUAPI::VULKAN);
+
+            // The CPU trees rebuild everything on every change, so give them a cached
+            // bottom level per model and only update the instances when entities move.
+            // The GPU trees already do this internally.
+            if (notNull(dynamic_pointer_cast<NativeTriTree>(m_triTree)) || notNull(dynamic_pointer_cast<EmbreeTriTree>(m_triTree))) {
+                m_triTree = InstancedTriTree::create();
+            }
         }
     const shared_ptr<Scene>& scene = dynamic_pointer_cast<Scene>(shared_from_this());
 	// No-op if no changes (on OptiXTriTree), safe to call repeatedly.
@@ -216,6 +282,8 @@ Array<String> Scene::sceneNames() {
 
 Scene::Scene(const shared_ptr<AmbientOcclusion>& ambientOcclusion) :
     m_needEntitySort(false),
+    m_simulateEntitiesConcurrently(true),
+    m_simulatingEntities(false),
     m_time(0),
     m_lastStructuralChangeTime(0),
     m_lastVisibleChangeTime(0),
@@ -252,6 +320,9 @@ void Scene::clear() {
     m_needEntitySort = false;
     m_entityTable.clear();
     m_entityArray.fastClear();
+    m_entityTypeTag.fastClear();
+    m_entityLevelStart.fastClear();
+    m_deferredEntityEditArray.fastClear();
     m_cameraArray.fastClear();
     m_localLightingEnvironment = LightingEnvironment();
     m_localLightingEnvironment.ambientOcclusion = old;
@@ -346,6 +417,7 @@ Any Scene::load(const String& scene, const LoadOptions& loadOptions) {
     const String entitySectionName[] = {"entities", "entities2"};
 
     m_modelsAny = Any(Any::TABLE);
+    Table<String, Any> modelAnys;
     // Load the models
     for (int i = 0; i < 2; ++i) {
         if (any.containsKey(modelSectionName[i])) {
@@ -355,11 +427,16 @@ Any Scene::load(const String& scene, const LoadOptions& loadOptions) {
                     const String name = it->key;
                     const Any& v = it->value;
                     createModel(v, name);
+                    modelAnys.set(name, v);
                 }
             }
         }
     }
 
+    if (loadOptions.concurrentModelLoading) {
+        loadModelsConcurrently(modelAnys, loadOptions);
+    }
+
     // Instantiate the entities
     // Try for both the current and extended format entity group names...intended to support using #include to merge
     // different files with entitys in them
@@ -460,6 +537,64 @@ Any Scene::load(const String& scene, const LoadOptions& loadOptions) {
 }
 
 
+void Scene::loadModelsConcurrently(const Table<String, Any>& modelAnys, const LoadOptions& options) {
+    // Find the unresolved ArticulatedModels whose importers do not require OpenGL
+    Array<lazy_ptr<Model>> modelArray;
+    for (const Table<String, Any>::Entry& entry : modelAnys) {
+        const Any& v = entry.value;
+        const lazy_ptr<Model>* m = m_modelTable.getPointer(entry.key);
+        if (isNull(m) || m->resolved() || ((v.type() != Any::STRING) && ! beginsWith(v.name(), "ArticulatedModel"))) {
+            continue;
+        }
+
+        try {
+            if (ArticulatedModel::canLoadConcurrently(ArticulatedModel::Specification(v))) {
+                modelArray.append(*m);
+            }
+        } catch (...) {
+            // Leave malformed specifications to report their errors when the entities load them
+        }
+    }
+
+    if (modelArray.size() == 0) {
+        return;
+    }
+
+    // Create the shared textures here, since their lazy initialization is not threadsafe
+    // and the workers' materials may reference them
+    Texture::white();
+    Texture::whiteCube();
+    Texture::opaqueBlack(Texture::DIM_2D);
+    Texture::zero(Texture::DIM_2D);
+
+    std::atomic_int numLoaded(0);
+    const auto& loadAll = [&]() {
+        runConcurrently(0, modelArray.size(), [&](int i) {
+            try {
+                modelArray[i].resolve();
+            } catch (...) {
+                // The model remains unresolved, so the entity that uses it will
+                // load it again on this thread and report the error there
+            }
+            ++numLoaded;
+        });
+    };
+
+    if (options.progressCallback) {
+        // Keep this thread free for the callback, which may render
+        std::thread loader(loadAll);
+        while (numLoaded < modelArray.size()) {
+            options.progressCallback(format("Loading models (%d/%d)", int(numLoaded), modelArray.size()), float(numLoaded) / float(modelArray.size()));
+            System::sleep(0.05);
+        }
+        loader.join();
+        options.progressCallback("Loading models", 1.0f);
+    } else {
+        loadAll();
+    }
+}
+
+
 void Scene::getVisibleBounds(AABox& box) const {
     box = AABox();
     for (int e = 0; e < m_entityArray.size(); ++e) {
@@ -557,6 +692,12 @@ void Scene::removeEntity(const String& entityName) {
 void Scene::remove(const shared_ptr<Entity>& entity) {
     debugAssert(notNull(entity));
 
+    if (m_simulatingEntities) {
+        std::lock_guard<std::mutex> lock(m_deferredEntityEditMutex);
+        m_deferredEntityEditArray.append(std::pair<shared_ptr<Entity>, bool>(entity, false));
+        return;
+    }
+
     const String& name = entity->name();
 
     // Remove from dependency tables
@@ -586,6 +727,7 @@ void Scene::remove(const shared_ptr<Entity>& entity) {
     
     m_entityTable.remove(name);
     m_entityArray.remove(m_entityArray.findIndex(entity));
+    m_needEntitySort = true;
 
     const shared_ptr<VisibleEntity>& visible = dynamic_pointer_cast<VisibleEntity>(entity);
     if (notNull(visible)) {
@@ -609,9 +751,16 @@ void Scene::remove(const shared_ptr<Entity>& entity) {
 shared_ptr<Entity> Scene::insert(const shared_ptr<Entity>& entity) {
     debugAssert(notNull(entity));
 
+    if (m_simulatingEntities) {
+        std::lock_guard<std::mutex> lock(m_deferredEntityEditMutex);
+        m_deferredEntityEditArray.append(std::pair<shared_ptr<Entity>, bool>(entity, true));
+        return entity;
+    }
+
     debugAssertM(! m_entityTable.containsKey(entity->name()), "Two Entitys with the same name, \"" + entity->name() + "\"");
     m_entityTable.set(entity->name(), entity);
     m_entityArray.append(entity);
+    m_needEntitySort = true;
     m_lastStructuralChangeTime = System::time();
     
     const shared_ptr<VisibleEntity>& visible = dynamic_pointer_cast<VisibleEntity>(entity);
@@ -871,10 +1020,81 @@ void Scene::sortEntitiesByDependency() {
     }
     */
 
+    computeEntityLevels();
     m_needEntitySort = false;
 }
 
 
+void Scene::computeEntityLevels() {
+    const int numEntities = m_entityArray.size();
+    m_entityTypeTag.resize(numEntities);
+    m_entityLevelStart.fastClear();
+
+    // Level of each entity, in the current (dependency) order
+    Array<int> level;
+    level.resize(numEntities);
+    int numLevels = (numEntities > 0) ? 1 : 0;
+
+    if (m_ancestorTable.size() > 0) {
+        Table<Entity*, int> levelTable;
+        for (int e = 0; e < numEntities; ++e) {
+            const shared_ptr<Entity>& entity = m_entityArray[e];
+            int L = 0;
+
+            const DependencyList* dependencies = m_ancestorTable.getPointer(entity->name());
+            if (notNull(dependencies)) {
+                for (int d = 0; d < dependencies->size(); ++d) {
+                    const shared_ptr<Entity>& parent = this->entity((*dependencies)[d]);
+                    // Parents precede children in the sorted array, so their level is already known
+                    const int* parentLevel = notNull(parent) ? levelTable.getPointer(parent.get()) : nullptr;
+                    if (notNull(parentLevel)) {
+                        L = max(L, *parentLevel + 1);
+                    }
+                }
+            }
+
+            levelTable.set(entity.get(), L);
+            level[e] = L;
+            numLevels = max(numLevels, L + 1);
+        }
+    } else {
+        level.setAll(0);
+    }
+
+    // Stable counting sort by level, which preserves the dependency order within each level
+    m_entityLevelStart.resize(numLevels + 1);
+    m_entityLevelStart.setAll(0);
+    for (int e = 0; e < numEntities; ++e) {
+        ++m_entityLevelStart[level[e] + 1];
+    }
+    for (int L = 0; L < numLevels; ++L) {
+        m_entityLevelStart[L + 1] += m_entityLevelStart[L];
+    }
+
+    if (numLevels > 1) {
+        Array<int> next;
+        next.copyFrom(m_entityLevelStart);
+        Array<shared_ptr<Entity>> sorted;
+        sorted.resize(numEntities);
+        for (int e = 0; e < numEntities; ++e) {
+            sorted[next[level[e]]++] = m_entityArray[e];
+        }
+        Array<shared_ptr<Entity>>::swap(sorted, m_entityArray);
+    }
+
+    for (int e = 0; e < numEntities; ++e) {
+        const shared_ptr<Entity>& entity = m_entityArray[e];
+        if (notNull(dynamic_pointer_cast<Light>(entity))) {
+            m_entityTypeTag[e] = LIGHT_ENTITY_TAG;
+        } else if (notNull(dynamic_pointer_cast<VisibleEntity>(entity))) {
+            m_entityTypeTag[e] = VISIBLE_ENTITY_TAG;
+        } else {
+            m_entityTypeTag[e] = OTHER_ENTITY_TAG;
+        }
+    }
+}
+
+
 void Scene::setOrder(const String& entity1Name, const String& entity2Name) {
     debugAssert(entity1Name != entity2Name);
     bool ignore;
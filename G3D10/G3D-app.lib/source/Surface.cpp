@@ -16,6 +16,7 @@
 #include "G3D-base/AABox.h"
 #include "G3D-base/Sphere.h"
 #include "G3D-base/typeutils.h"
+#include "G3D-base/FrameArenaMemoryManager.h"
 #include "G3D-app/Surface.h"
 #include "G3D-gfx/RenderDevice.h"
 #include "G3D-app/UniversalSurface.h"
@@ -386,7 +387,13 @@ void Surface::sortFrontToBack
 (Array<shared_ptr<Surface> >& surface, 
  const Vector3&       wsLook) {
 
-    static Array<ModelSorter> sorter;
+    // Scratch space from the frame arena when there is one; a static
+    // array here would not be safe to use from multiple threads
+    Array<ModelSorter> sorter;
+    if (notNull(FrameArenaMemoryManager::current())) {
+        sorter.clearAndSetMemoryManager(FrameArenaMemoryManager::current());
+    }
+    sorter.reserve(surface.size());
     
     for (int m = 0; m < surface.size(); ++m) {
         sorter.append(ModelSorter(surface[m], wsLook));
@@ -397,8 +404,6 @@ void Surface::sortFrontToBack
     for (int m = 0; m < sorter.size(); ++m) {
         surface[m] = sorter[m].model;
     }
-
-    sorter.fastClear();
 }
 
 
@@ -62,6 +62,28 @@ void TriTree::sample(const Hit& hit, shared_ptr<Surfel>& surfel) const {
 }
 
 
+void TriTree::sample(const HitBuffer& hits, SurfelPool& pool, Array<const Surfel*>& surfel) const {
+    const int N = hits.size();
+    surfel.resize(N, false);
+    if (pool.m_surfel.size() < N) {
+        pool.m_surfel.resize(N, false);
+    }
+
+    const Tri* tri = m_triArray.getCArray();
+    shared_ptr<Surfel>* slot = pool.m_surfel.getCArray();
+    runConcurrently(0, N, [&](int i) {
+        const int t = hits.triIndex[i];
+        if (t != Hit::NONE) {
+            // Material::sample reuses a Surfel of the right type in place
+            tri[t].sample(hits.u[i], hits.v[i], t, m_vertexArray, hits.backface[i], slot[i]);
+            surfel[i] = slot[i].get();
+        } else {
+            surfel[i] = nullptr;
+        }
+    });
+}
+
+
 shared_ptr<TriTree> TriTree::create(bool gpuData, bool preferVulkan) {
 #   if defined(G3D_X86) && (defined(G3D_WINDOWS) || defined(G3D_LINUX) || defined(G3D_MACOS)) 
         if (gpuData) {
@@ -23,9 +23,17 @@ namespace G3D {
 void TriTreeBase::clear() {
     m_triArray.fastClear();
     m_vertexArray.clear();
+
+    std::lock_guard<std::mutex> guard(m_queryTreeMutex);
+    m_queryTree = QueryTree();
+    m_queryTreeBuildTime = -finf();
+    m_queryTreeNumTris = -1;
 }
 
 
+TriTreeBase::TriTreeBase() : m_queryTreeBuildTime(-finf()), m_queryTreeNumTris(-1) {}
+
+
 TriTreeBase::~TriTreeBase() {
     clear();
 }
@@ -84,13 +92,235 @@ void TriTreeBase::setContents
 }
 
 
+/** Spreads the low 5 bits of \a x to every sixth bit of the result */
+static uint32 mortonSpread6(uint32 x) {
+    uint32 result = 0;
+    for (int b = 0; b < 5; ++b) {
+        result |= ((x >> b) & 1) << (6 * b);
+    }
+    return result;
+}
+
+
+void TriTreeBase::sortRays(const Array<Ray>& rays, Array<int>& order) {
+    const int N = rays.size();
+    order.resize(N);
+    if (N == 0) { return; }
+
+    Point3 lo = rays[0].origin(), hi = lo;
+    for (const Ray& ray : rays) {
+        lo = lo.min(ray.origin());
+        hi = hi.max(ray.origin());
+    }
+    const Vector3 extent = hi - lo;
+    const Vector3 scale(
+        (extent.x > 0.0f) ? 32.0f / extent.x : 0.0f,
+        (extent.y > 0.0f) ? 32.0f / extent.y : 0.0f,
+        (extent.z > 0.0f) ? 32.0f / extent.z : 0.0f);
+
+    // Octant in the top 3 bits of the key, then a 6D Morton code of
+    // 5-bit origin and direction magnitude, then the ray index
+    Array<uint64> key;
+    key.resize(N);
+    runConcurrently(0, N, [&](int i) {
+        const Vector3& d = rays[i].direction();
+        const Vector3  o = (rays[i].origin() - lo) * scale;
+        const uint32 octant = uint32(d.x < 0.0f) | (uint32(d.y < 0.0f) << 1) | (uint32(d.z < 0.0f) << 2);
+        const uint32 code =
+            (mortonSpread6(iClamp(int(o.x), 0, 31)) << 5) |
+            (mortonSpread6(iClamp(int(o.y), 0, 31)) << 4) |
+            (mortonSpread6(iClamp(int(o.z), 0, 31)) << 3) |
+            (mortonSpread6(iClamp(int(fabsf(d.x) * 32.0f), 0, 31)) << 2) |
+            (mortonSpread6(iClamp(int(fabsf(d.y) * 32.0f), 0, 31)) << 1) |
+            mortonSpread6(iClamp(int(fabsf(d.z) * 32.0f), 0, 31));
+        key[i] = (uint64((octant << 29) | (code >> 1)) << 32) | uint64(i);
+    });
+
+    tbb::parallel_sort(key.begin(), key.end());
+
+    runConcurrently(0, N, [&](int i) { order[i] = int(key[i] & 0xFFFFFFFF); });
+}
+
+
 void TriTreeBase::intersectRays
    (const Array<Ray>&      rays,
     Array<Hit>&            results,
     IntersectRayOptions    options) const {
 
     results.resize(rays.size());
-    runConcurrently(0, rays.size(), [&](int i) { _intersectRay(rays[i], results[i], options); });
+    if (shouldSortRays(rays.size(), options)) {
+        Array<int> order;
+        sortRays(rays, order);
+        runConcurrently(0, rays.size(), [&](int i) { _intersectRay(rays[order[i]], results[order[i]], options); });
+    } else {
+        runConcurrently(0, rays.size(), [&](int i) { _intersectRay(rays[i], results[i], options); });
+    }
+}
+
+
+void TriTreeBase::intersectRays
+   (const Array<Ray>&      rays,
+    HitBuffer&             results,
+    IntersectRayOptions    options) const {
+
+    // Call the Array<Hit> overload from this thread, since subclasses batch it in their own
+    // way (e.g., rtcIntersect1M or an OptiX launch) and not all of them are safe to invoke
+    // per ray from worker threads. The scratch array is reused across typical batches, but
+    // freed after unusually large ones so that each thread does not keep that allocation.
+    static thread_local Array<Hit> hitArray;
+    intersectRays(rays, hitArray, options);
+
+    results.resize(rays.size());
+    runConcurrently(0, rays.size(), [&](int i) { results.set(i, hitArray[i]); });
+
+    if (hitArray.size() > MAX_RETAINED_HITS) {
+        // clear() keeps the allocation, so swap it into a temporary that frees it
+        Array<Hit> discard;
+        Array<Hit>::swap(hitArray, discard);
+    } else {
+        hitArray.fastClear();
+    }
+}
+
+
+void TriTreeBase::QueryTree::build(const Array<Tri>& triArray, const CPUVertexArray& vertexArray) {
+    m_node.fastClear();
+    m_triIndex.fastClear();
+    m_numTris = triArray.size();
+
+    Array<AABox> triBounds;
+    triBounds.resize(triArray.size());
+    runConcurrently(0, triArray.size(), [&](int t) {
+        const Tri& tri = triArray[t];
+        triBounds[t] = AABox(tri.position(vertexArray, 0));
+        triBounds[t].merge(tri.position(vertexArray, 1));
+        triBounds[t].merge(tri.position(vertexArray, 2));
+    });
+
+    for (int t = 0; t < triArray.size(); ++t) {
+        if (triArray[t].area() > 0.0f) {
+            m_triIndex.append(t);
+        }
+    }
+
+    // Median split on the longest axis of the centroids
+    const std::function<void(int, int)> buildNode = [&](int begin, int end) {
+        const int n = m_node.size();
+        m_node.next();
+
+        AABox bounds = triBounds[m_triIndex[begin]];
+        AABox centroidBounds(triBounds[m_triIndex[begin]].center());
+        for (int i = begin + 1; i < end; ++i) {
+            bounds.merge(triBounds[m_triIndex[i]]);
+            centroidBounds.merge(triBounds[m_triIndex[i]].center());
+        }
+        m_node[n].bounds = bounds;
+
+        if (end - begin <= MAX_TRIS_PER_LEAF) {
+            m_node[n].index = begin;
+            m_node[n].count = end - begin;
+            return;
+        }
+
+        const Vector3::Axis axis = centroidBounds.extent().primaryAxis();
+        const int mid = (begin + end) / 2;
+        std::nth_element(m_triIndex.begin() + begin, m_triIndex.begin() + mid, m_triIndex.begin() + end, [&](int a, int b) {
+            return triBounds[a].center()[axis] < triBounds[b].center()[axis];
+        });
+
+        buildNode(begin, mid);
+        const int second = m_node.size();
+        buildNode(mid, end);
+        m_node[n].index = second;
+    };
+
+    if (m_triIndex.size() > 0) {
+        buildNode(0, m_triIndex.size());
+    }
+}
+
+
+template<class Visit>
+void TriTreeBase::QueryTree::forEachCandidate(const AABox& box, Visit visit) const {
+    if (m_node.size() == 0) {
+        return;
+    }
+
+    // Median splits bound the depth by log2 of the triangle count
+    int stack[64];
+    int top = 0;
+    stack[top++] = 0;
+    while (top > 0) {
+        const int n = stack[--top];
+        const Node& node = m_node[n];
+        if (! node.bounds.intersects(box)) {
+            continue;
+        }
+
+        if (node.count > 0) {
+            for (int i = node.index; i < node.index + node.count; ++i) {
+                visit(m_triIndex[i]);
+            }
+        } else {
+            stack[top++] = node.index;
+            stack[top++] = n + 1;
+        }
+    }
+}
+
+
+void TriTreeBase::QueryTree::intersectBox(const AABox& box, const Array<Tri>& triArray, const CPUVertexArray& vertexArray, Array<int>& triIndex) const {
+    forEachCandidate(box, [&](int t) {
+        const Tri& tri = triArray[t];
+        if (CollisionDetection::fixedSolidBoxIntersectsFixedTriangle(box, Triangle(tri.position(vertexArray, 0), 
+                                                                                   tri.position(vertexArray, 1), 
+                                                                                   tri.position(vertexArray, 2)))) {
+            triIndex.append(t);
+        }
+    });
+}
+
+
+void TriTreeBase::QueryTree::intersectSphere(const Sphere& sphere, const Array<Tri>& triArray, const CPUVertexArray& vertexArray, Array<int>& triIndex) const {
+    AABox box;
+    sphere.getBounds(box);
+    forEachCandidate(box, [&](int t) {
+        const Tri& tri = triArray[t];
+        if (CollisionDetection::fixedSolidSphereIntersectsFixedTriangle(sphere, Triangle(tri.position(vertexArray, 0), 
+                                                                                         tri.position(vertexArray, 1), 
+                                                                                         tri.position(vertexArray, 2)))) {
+            triIndex.append(t);
+        }
+    });
+}
+
+
+const TriTreeBase::QueryTree& TriTreeBase::queryTree() const {
+    // Only the atomics may be read without the lock, because build() writes m_queryTree
+    if ((m_queryTreeBuildTime.load(std::memory_order_acquire) != m_lastBuildTime) ||
+        (m_queryTreeNumTris.load(std::memory_order_acquire) != m_triArray.size())) {
+        std::lock_guard<std::mutex> guard(m_queryTreeMutex);
+        if ((m_queryTreeBuildTime.load(std::memory_order_relaxed) != m_lastBuildTime) || (m_queryTree.m_numTris != m_triArray.size())) {
+            m_queryTree.build(m_triArray, m_vertexArray);
+            m_queryTreeNumTris.store(m_queryTree.m_numTris, std::memory_order_release);
+            m_queryTreeBuildTime.store(m_lastBuildTime, std::memory_order_release);
+        }
+    }
+    return m_queryTree;
+}
+
+
+void TriTreeBase::intersectBox
+   (const AABox&           box,
+    Array<int>&            triIndex) const {
+    queryTree().intersectBox(box, m_triArray, m_vertexArray, triIndex);
+}
+
+
+void TriTreeBase::intersectSphere
+   (const Sphere&          sphere,
+    Array<int>&            triIndex) const {
+    queryTree().intersectSphere(sphere, m_triArray, m_vertexArray, triIndex);
 }
 
 
@@ -98,37 +328,74 @@ void TriTreeBase::intersectBox
    (const AABox&           box,
     Array<Tri>&            results) const {
 
-    results.fastClear();
-    Spinlock resultLock;
-    runConcurrently(0, m_triArray.size(), [&](int t) {
-        const Tri& tri = m_triArray[t];
-        if ((tri.area() > 0.0f) &&
-            CollisionDetection::fixedSolidBoxIntersectsFixedTriangle(box, Triangle(tri.position(m_vertexArray, 0), 
-                                                                                   tri.position(m_vertexArray, 1), 
-                                                                                   tri.position(m_vertexArray, 2)))) {
-            resultLock.lock();
-            results.append(tri);
-            resultLock.unlock();
-        }
-    });
+    Array<int> triIndex;
+    intersectBox(box, triIndex);
+    results.resize(triIndex.size());
+    for (int i = 0; i < triIndex.size(); ++i) {
+        results[i] = m_triArray[triIndex[i]];
+    }
 }
 
 
 void TriTreeBase::intersectSphere
    (const Sphere&                      sphere,
-    Array<Tri>&                        triArray) const {
+    Array<Tri>&                        results) const {
 
-    AABox box;
-    sphere.getBounds(box);
-    intersectBox(box, triArray);
+    Array<int> triIndex;
+    intersectSphere(sphere, triIndex);
+    results.resize(triIndex.size());
+    for (int i = 0; i < triIndex.size(); ++i) {
+        results[i] = m_triArray[triIndex[i]];
+    }
+}
 
-    // Iterate backwards because we're removing
-    for (int i = triArray.size() - 1; i >= 0; --i) {
-        const Tri& tri = triArray[i];
-        if (! CollisionDetection::fixedSolidSphereIntersectsFixedTriangle(sphere, Triangle(tri.position(m_vertexArray, 0), tri.position(m_vertexArray, 1), tri.position(m_vertexArray, 2)))) {
-            triArray.fastRemove(i);
+
+/** Runs \a query(q, triIndex) for each of \a numQueries in parallel blocks, 
+    then packs the per-block results into \a results in query order */
+template<class Query>
+static void batchOverlaps(int numQueries, const Query& query, TriTree::OverlapBuffer& results) {
+    static const int BLOCK_SIZE = 64;
+    const int numBlocks = (numQueries + BLOCK_SIZE - 1) / BLOCK_SIZE;
+
+    results.offset.resize(numQueries + 1, false);
+    Array<Array<int>> blockTriIndex;
+    blockTriIndex.resize(numBlocks);
+    runConcurrently(0, numBlocks, [&](int b) {
+        Array<int>& triIndex = blockTriIndex[b];
+        for (int q = b * BLOCK_SIZE; q < G3D::min(numQueries, (b + 1) * BLOCK_SIZE); ++q) {
+            const int start = triIndex.size();
+            query(q, triIndex);
+            // Temporarily holds the count
+            results.offset[q + 1] = triIndex.size() - start;
         }
+    });
+
+    results.offset[0] = 0;
+    for (int q = 0; q < numQueries; ++q) {
+        results.offset[q + 1] += results.offset[q];
     }
+
+    results.triIndex.resize(results.offset[numQueries], false);
+    runConcurrently(0, numBlocks, [&](int b) {
+        const Array<int>& triIndex = blockTriIndex[b];
+        if (triIndex.size() > 0) {
+            System::memcpy(results.triIndex.getCArray() + results.offset[b * BLOCK_SIZE], triIndex.getCArray(), sizeof(int) * triIndex.size());
+        }
+    });
+}
+
+
+void TriTreeBase::intersectBoxes
+   (const Array<AABox>&                boxArray,
+    OverlapBuffer&                     results) const {
+    batchOverlaps(boxArray.size(), [&](int q, Array<int>& triIndex) { intersectBox(boxArray[q], triIndex); }, results);
+}
+
+
+void TriTreeBase::intersectSpheres
+   (const Array<Sphere>&               sphereArray,
+    OverlapBuffer&                     results) const {
+    batchOverlaps(sphereArray.size(), [&](int q, Array<int>& triIndex) { intersectSphere(sphereArray[q], triIndex); }, results);
 }
 
 
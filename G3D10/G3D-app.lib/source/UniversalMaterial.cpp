@@ -204,6 +204,7 @@ shared_ptr<UniversalMaterial> UniversalMaterial::create(const String& name, cons
         }
 
         value->m_name = name;
+        value->m_specification = std::make_shared<Specification>(specification);
 
         value->m_constantTable = specification.m_constantTable;
 
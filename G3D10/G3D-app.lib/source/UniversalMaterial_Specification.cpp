@@ -157,13 +157,49 @@ UniversalMaterial::Specification::Specification(const Any& any) {
 
 
 Any UniversalMaterial::Specification::toAny() const {
+    debugAssertM(isSerializable(), "Texture objects and light maps cannot be represented by an Any");
     Any a(Any::TABLE, "UniversalMaterial::Specification");
-    // TODO
-    debugAssertM(false, "Unimplemented");
+    a["lambertian"]             = m_lambertian;
+    a["glossy"]                 = m_glossy;
+    a["transmissive"]           = m_transmissive;
+    a["emissive"]               = m_emissive;
+    a["etaTransmit"]            = m_etaTransmit;
+    a["extinctionTransmit"]     = m_extinctionTransmit;
+    a["etaReflect"]             = m_etaReflect;
+    a["extinctionReflect"]      = m_extinctionReflect;
+    a["refractionHint"]         = m_refractionHint;
+    a["mirrorHint"]             = m_mirrorHint;
+    a["alphaFilter"]            = m_alphaFilter;
+    a["sampler"]                = m_sampler;
+    a["flags"]                  = int(m_flags);
+    a["inferAmbientOcclusionAtTransparentPixels"] = m_inferAmbientOcclusionAtTransparentPixels;
+
+    if (! m_customShaderPrefix.empty()) {
+        a["customShaderPrefix"] = m_customShaderPrefix;
+    }
+
+    if (! m_bump.texture.filename.empty()) {
+        a["bump"] = m_bump;
+    }
+
+    if (m_constantTable.size() > 0) {
+        Any constants(Any::TABLE);
+        for (Table<String, double>::Iterator it = m_constantTable.begin(); it.isValid(); ++it) {
+            constants[it->key] = it->value;
+        }
+        a["constantTable"] = constants;
+    }
+
     return a;
 }
 
 
+bool UniversalMaterial::Specification::isSerializable() const {
+    return isNull(m_lambertianTex) && isNull(m_glossyTex) && isNull(m_transmissiveTex) && isNull(m_emissiveTex) &&
+        (m_numLightMapDirections == 0);
+}
+
+
 void UniversalMaterial::Specification::setLambertian(const shared_ptr<Texture>& tex) {
     m_lambertianTex = tex;
 }
@@ -454,8 +454,18 @@ private:
 
     void _parse(const String& src);
 
+    /** Called from serialize(BinaryOutput&). Strings are written as indices into \a stringArray,
+        to which new strings are appended. \a stringTable maps each string to its index. */
+    void serializeBinary(class BinaryOutput& b, Table<String, int>& stringTable, Array<String>& stringArray) const;
+
+    /** Called from deserialize(BinaryInput&) */
+    void deserializeBinary(class BinaryInput& b, const Array<String>& stringArray);
+
 public:
 
+    /** Files whose names end in this (case insensitive) are written in binary by save(). ".Any.bin" */
+    static const char* BINARY_EXTENSION;
+
     /** Thrown by operator[] when a key is not present in a const table. */
     class KeyNotFound : public ParseError {
     public:
@@ -823,23 +833,37 @@ public:
        This must be a TABLE or ARRAY */
     void clear();
 
-    /** Parse from a file.
-     \sa deserialize, parse, fromFile, loadIfExists
+    /** Parse from a file, or read it with deserialize(BinaryInput&) if it was written
+        in binary by save().
+     \sa deserialize, parse, fromFile, loadIfExists, isBinaryFile
      */
     void load(const String& filename);
 
+    /** True if \a filename was written in binary by save(). Files inside
+        zipfiles are recognized by BINARY_EXTENSION, others by their first bytes. */
+    static bool isBinaryFile(const String& filename);
+
     /** Load a new Any from \a filename. \sa load, save, loadIfExists */
     static Any fromFile(const String& filename);
 
     /** Load \a filename file if it exists, otherwise do not modify this */
     void loadIfExists(const String& filename);
 
-    /** Uses the serialize method. If the extension is ".json", uses JSON format with coercion, otherwise uses native Any format. */
+    /** Uses the serialize method. If the extension is ".json", uses JSON format with coercion.
+        If it is BINARY_EXTENSION, uses serialize(BinaryOutput&), which load() reads much faster
+        than text. Otherwise uses native Any format.
+
+        The text format is intended for authoring and the binary one as a build product. */
     void save(const String& filename, bool json = false) const;
 
     /** \param coerce.  If json=true, should features that JSON doesn't support be coerced or produce errors?*/
     void serialize(TextOutput& to, bool json = false, bool coerce = false) const;
 
+    /** Writes a compact binary encoding that preserves everything that the text
+        form does, including names, comments, sources, and #include lines.
+        Every string (table keys, values, names, and source filenames) is stored
+        once in a table and referenced by index, and arrays of plain numbers are
+        packed. The elements of such arrays are read back without sources. */
     void serialize(class BinaryOutput& b) const;
 
     /** Parse from a stream.
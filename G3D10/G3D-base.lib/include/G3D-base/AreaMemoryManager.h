@@ -24,7 +24,8 @@ namespace G3D {
   Useful for ensuring cache coherence and for reducing the time cost of 
   multiple allocations and deallocations.
 
-  <b>Not threadsafe</b>
+  <b>Not threadsafe</b> unless created with \a threadsafe = true, in which
+  case alloc() takes a spin lock.
  */
 class AreaMemoryManager : public MemoryManager {
 private:
@@ -50,7 +51,14 @@ private:
     /** The underlying array is stored in regular MemoryManager heap memory */
     Array<Buffer*>          m_bufferArray;
 
-    AreaMemoryManager(size_t sizeHint);
+    const bool              m_threadsafe;
+
+    /** Only acquired when m_threadsafe is true */
+    tbb::spin_mutex         m_mutex;
+
+    AreaMemoryManager(size_t sizeHint, bool threadsafe);
+
+    void* allocUnlocked(size_t s);
 
 public:
     
@@ -58,8 +66,11 @@ public:
         \param sizeHint Total amount of memory expected to be allocated.
         The allocator will allocate memory from the system in increments
         of this size.
+
+        \param threadsafe If true, alloc() may be invoked concurrently
+        from multiple threads.
     */
-    static shared_ptr<AreaMemoryManager> create(size_t sizeHint = 10 * 1024 * 1024);
+    static shared_ptr<AreaMemoryManager> create(size_t sizeHint = 10 * 1024 * 1024, bool threadsafe = false);
 
     /** Invokes deallocateAll. */
     ~AreaMemoryManager();
@@ -33,6 +33,7 @@
 #include "G3D-base/g3dmath.h"
 #include "G3D-base/debug.h"
 #include "G3D-base/System.h"
+#include "G3D-base/MemoryMappedFile.h"
 
 
 namespace G3D {
@@ -47,7 +48,8 @@ namespace G3D {
  Sequential or random access byte-order independent binary file access.
  Files compressed with zlib and beginning with an unsigned 32-bit int
  size are transparently decompressed when the compressed = true flag is
- specified to the constructor.
+ specified to the constructor. So are BlockCompressor containers written by
+ BinaryOutput::compressBlocks, which are decompressed on all cores.
 
  For every readX method there are also versions that operate on a whole
  Array, std::vector, or C-array.  e.g. readFloat32(Array<float32>& array, n)
@@ -118,10 +120,17 @@ private:
      */
     bool            m_freeBuffer;
 
+    /** When not null, m_buffer is the whole file, mapped read-only. */
+    shared_ptr<MemoryMappedFile> m_mappedFile;
+
     /** Ensures that we are able to read at least minLength from startPosition (relative
-        to start of file). */
+        to start of file). Does nothing for a memory-mapped file, which is always
+        entirely addressable. */
     void loadIntoMemory(int64 startPosition, int64 minLength = 0);
 
+    /** Reads m_filename into m_buffer. Used by the filename constructors. */
+    void loadFile(bool compressed);
+
     /** Verifies that at least this number of bytes can be read.*/
     void prepareToRead(int64 nbytes);
 
@@ -144,13 +153,36 @@ public:
 
        @param compressed Set to true if and only if the file was
        compressed using BinaryOutput's zlib compression.  This has
-       nothing to do with whether the input is in a zipfile.
+       nothing to do with whether the input is in a zipfile. Files
+       written with BinaryOutput::compressBlocks are decompressed from a
+       memory mapping, without reading the compressed data into the heap.
     */
     BinaryInput(
         const String&  filename,
         G3DEndian           fileEndian,
         bool                compressed = false);
 
+    /**
+       Maps \a filename read-only into memory instead of copying it into
+       the heap. getCArray() and the read methods then use the operating
+       system's page cache directly, so opening a large file costs
+       neither a full read nor twice its size in memory, and processes
+       that read the same file share its pages.
+
+       The file must not be modified while this BinaryInput exists.
+       Files inside a zipfile are read in place from the mapped archive when
+       they are stored without compression. Compressed entries, and files
+       that cannot be mapped, are read as by the other constructor.
+
+       @param accessPattern Hint passed to MemoryMappedFile::advise. Use
+       SEQUENTIAL for parsers that make one pass and WILL_NEED to
+       prefetch a file that will be read entirely.
+    */
+    BinaryInput(
+        const String&       filename,
+        G3DEndian           fileEndian,
+        MemoryMappedFile::AccessPattern accessPattern);
+
     /**
      Creates input stream from an in memory source.
      Unless you specify copyMemory = false, the data is copied
@@ -196,6 +228,11 @@ public:
         return m_filename;
     }
 
+    /** True if the file is being read in place from a memory mapping */
+    bool memoryMapped() const {
+        return notNull(m_mappedFile);
+    }
+
     /**
      Performs bounds checks in debug mode.  [] are relative to
      the start of the file, not the current position.
@@ -26,6 +26,7 @@
 #include "G3D-base/debug.h"
 #include "G3D-base/BinaryInput.h"
 #include "G3D-base/System.h"
+#include "G3D-base/BlockCompression.h"
 
 #ifdef _MSC_VER
 #   pragma warning (push)
@@ -37,7 +38,8 @@ namespace G3D {
 /**
  Sequential or random access byte-order independent binary file access.
 
- The compress() call can be used to compress with zlib.
+ The compress() call can be used to compress with zlib. compressBlocks()
+ compresses on all cores instead, and also works for huge files.
 
  Any method call can trigger an out of memory error (thrown as char*) 
  when writing to "<memory>" instead of a file.
@@ -87,8 +89,16 @@ private:
 
     bool            m_ok;
 
+    /** Non-null after compressBlocks() */
+    shared_ptr<BlockCompressor> m_blockCompressor;
+
     void reserveBytesWhenOutOfMemory(size_t bytes);
 
+    /** Writes the first \a bytes of the buffer to the open \a file, compressing
+        them if compressBlocks() was called. If \a final, also writes the index
+        of compressed blocks. Returns false on failure. */
+    bool writeBufferToFile(FILE* file, size_t bytes, bool final);
+
     void reallocBuffer(size_t bytes, size_t oldBufferLen);
 
     /**
@@ -141,6 +151,25 @@ public:
      */
     void compress(int level = 9);
 
+    /** Compresses the file with BlockCompressor, which splits it into
+        independent zlib blocks that are compressed on all cores. Read
+        it with BinaryInput's compressed = true option or with
+        BlockDecompressor, which can also seek to any block.
+
+        Unlike compress(), this only selects the format. The data is
+        compressed when commit() writes it, and when a huge file flushes
+        part of its buffer to disk. Call it before writing a file that
+        may not fit in memory; otherwise it may be called at any time
+        before commit().
+
+        For a "<memory>" output, commit() compresses the buffer in place,
+        after which getCArray() and size() describe the compressed data.
+        commit(uint8*) is not supported.
+
+        \param level Compression level.  0 = fast, low compression; 9 = slow, high compression
+     */
+    void compressBlocks(int level = 6, int blockSize = BlockCompressor::DEFAULT_BLOCK_SIZE);
+
     /** True if no errors have been encountered.*/
     bool ok() const;
 
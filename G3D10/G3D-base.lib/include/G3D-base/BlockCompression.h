@@ -0,0 +1,174 @@
+/**
+  \file G3D-base.lib/include/G3D-base/BlockCompression.h
+
+  G3D Innovation Engine http://casual-effects.com/g3d
+  Copyright 2000-2019, Morgan McGuire
+  All rights reserved
+  Available under the BSD License
+*/
+#pragma once
+#define G3D_base_BlockCompression_h
+
+#include "G3D-base/platform.h"
+#include "G3D-base/g3dmath.h"
+#include "G3D-base/ReferenceCount.h"
+#include "G3D-base/G3DString.h"
+#include "G3D-base/Array.h"
+#include "G3D-base/MemoryMappedFile.h"
+
+namespace G3D {
+
+/** \brief Compresses data into a container of independent zlib blocks.
+
+    Unlike the single zlib stream written by BinaryOutput::compress(),
+    the blocks are compressed on all cores, the data may be compressed
+    incrementally as it is produced, and a reader can decompress any
+    block without the ones before it.
+
+    The container is little-endian regardless of the endianness of its contents:
+
+    <pre>
+      header   "G3DZ", uint32 version, uint32 blockSize, uint32 0
+      block    uint32 compressedSize, uint32 uncompressedSize, zlib stream     (repeated)
+      index    uint64 offset of each block
+      trailer  uint64 uncompressedSize, uint64 indexOffset, uint32 numBlocks, "G3DZ"
+    </pre>
+
+    Every block except the last holds exactly blockSize uncompressed bytes.
+
+    \sa BlockDecompressor, BinaryOutput::compressBlocks */
+class BlockCompressor {
+public:
+
+    enum {DEFAULT_BLOCK_SIZE = 1024 * 1024};
+
+    static const uint32     VERSION = 1;
+
+    static const int        HEADER_SIZE = 16;
+
+    static const int        TRAILER_SIZE = 24;
+
+    static const int        BLOCK_HEADER_SIZE = 8;
+
+protected:
+
+    int                     m_level;
+
+    int                     m_blockSize;
+
+    /** Bytes appended to the output so far */
+    int64                   m_compressedSize;
+
+    int64                   m_uncompressedSize;
+
+    Array<uint64>           m_blockOffsetArray;
+
+    bool                    m_finished;
+
+public:
+
+    /** \param level zlib compression level. 0 = fast, low compression; 9 = slow, high compression */
+    BlockCompressor(int level = 6, int blockSize = DEFAULT_BLOCK_SIZE);
+
+    int blockSize() const {
+        return m_blockSize;
+    }
+
+    /** Compresses \a size bytes of \a src on all cores and appends the blocks,
+        preceded by the header on the first call, to \a out.
+
+        \a size must be a multiple of blockSize() except on the last call before finish(). */
+    void append(const uint8* src, size_t size, Array<uint8>& out);
+
+    /** Appends the index and trailer to \a out. No more data may be appended afterwards. */
+    void finish(Array<uint8>& out);
+
+    /** Compresses all of \a src into a complete container in \a out */
+    static void compress(const uint8* src, size_t size, Array<uint8>& out, int level = 6, int blockSize = DEFAULT_BLOCK_SIZE);
+};
+
+
+/** \brief Reads the container written by BlockCompressor from memory or from a mapped file.
+
+    decompressBlock() and decompress() may be called from several threads
+    at once. read() keeps the most recently decompressed block so that a
+    sequence of small reads through the data decompresses each block only
+    once, and is therefore not threadsafe.
+
+    Throws a String if the data is corrupt. */
+class BlockDecompressor : public ReferenceCountedObject {
+protected:
+
+    /** May be null if the data is in memory */
+    shared_ptr<MemoryMappedFile>    m_mappedFile;
+
+    const uint8*                    m_data;
+
+    size_t                          m_size;
+
+    int64                           m_blockSize;
+
+    int64                           m_uncompressedSize;
+
+    Array<uint64>                   m_blockOffsetArray;
+
+    /** Index of the block in m_cachedBlock, or -1 */
+    int                             m_cachedBlockIndex;
+
+    Array<uint8>                    m_cachedBlock;
+
+    BlockDecompressor(const uint8* data, size_t size, const shared_ptr<MemoryMappedFile>& mappedFile);
+
+public:
+
+    /** True if \a data begins and ends like a BlockCompressor container */
+    static bool isBlockCompressed(const uint8* data, size_t size);
+
+    /** \a data must remain valid for the lifetime of the result.
+        Returns nullptr if it is not a BlockCompressor container. */
+    static shared_ptr<BlockDecompressor> create(const uint8* data, size_t size);
+
+    /** Maps \a filename. Returns nullptr if it cannot be mapped or is not a BlockCompressor container. */
+    static shared_ptr<BlockDecompressor> create(const String& filename);
+
+    /** Uncompressed size in bytes */
+    int64 size() const {
+        return m_uncompressedSize;
+    }
+
+    int numBlocks() const {
+        return m_blockOffsetArray.size();
+    }
+
+    /** Uncompressed size of every block except the last */
+    int64 blockSize() const {
+        return m_blockSize;
+    }
+
+    /** Uncompressed offset of the first byte of \a block */
+    int64 blockStart(int block) const {
+        return int64(block) * m_blockSize;
+    }
+
+    /** Uncompressed size of \a block */
+    int64 blockLength(int block) const {
+        return min(m_blockSize, m_uncompressedSize - blockStart(block));
+    }
+
+    /** The block holding uncompressed offset \a offset */
+    int blockContaining(int64 offset) const {
+        return int(offset / m_blockSize);
+    }
+
+    /** Decompresses \a block into \a dst, which must have room for blockLength(block) bytes */
+    void decompressBlock(int block, uint8* dst) const;
+
+    /** Decompresses everything into \a dst, which must have room for size() bytes, on all cores */
+    void decompress(uint8* dst) const;
+
+    /** Copies \a n uncompressed bytes starting at \a offset into \a dst,
+        decompressing only the blocks that they overlap. */
+    void read(int64 offset, int64 n, uint8* dst);
+};
+
+} // namespace G3D
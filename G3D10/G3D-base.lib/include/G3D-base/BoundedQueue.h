@@ -0,0 +1,264 @@
+/**
+  \file G3D-base.lib/include/G3D-base/BoundedQueue.h
+
+  G3D Innovation Engine http://casual-effects.com/g3d
+  Copyright 2000-2019, Morgan McGuire
+  All rights reserved
+  Available under the BSD License
+*/
+#pragma once
+#define G3D_base_BoundedQueue_h
+
+#include "G3D-base/platform.h"
+#include "G3D-base/g3dmath.h"
+#include <atomic>
+#include <algorithm>
+#include <memory>
+
+namespace G3D {
+
+/** \brief Fixed-capacity, lock-free ring buffer that any number of threads may push to and pop from
+    concurrently.
+
+    Each slot carries a sequence number so that producers and consumers
+    claim slots with a single compare-and-swap and never block each
+    other (Vyukov's bounded MPMC queue). Elements are popped in the
+    order that their pushes completed.
+
+    \a T must be default constructible and move assignable.
+
+    \sa SPSCQueue, ThreadsafeQueue
+ */
+template<class T>
+class MPMCQueue {
+private:
+
+    /** Keeps the producer and consumer cursors from sharing a cache line */
+    enum { CACHE_LINE_SIZE = 64 };
+
+    class Cell {
+    public:
+        std::atomic<size_t>     sequence;
+        T                       value;
+    };
+
+    std::unique_ptr<Cell[]>     m_cell;
+    size_t                      m_mask;
+
+    alignas(CACHE_LINE_SIZE) std::atomic<size_t> m_pushPos;
+    alignas(CACHE_LINE_SIZE) std::atomic<size_t> m_popPos;
+
+    template<class V>
+    bool pushImpl(V&& v) {
+        size_t pos = m_pushPos.load(std::memory_order_relaxed);
+        Cell* cell = nullptr;
+        while (true) {
+            cell = &m_cell[pos & m_mask];
+            const size_t seq = cell->sequence.load(std::memory_order_acquire);
+            const intptr_t diff = intptr_t(seq) - intptr_t(pos);
+            if (diff == 0) {
+                // The slot is free; try to claim it
+                if (m_pushPos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                // The slot still holds an element from the previous lap: full
+                return false;
+            } else {
+                // Another producer claimed this slot first
+                pos = m_pushPos.load(std::memory_order_relaxed);
+            }
+        }
+        cell->value = std::forward<V>(v);
+        cell->sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Not copyable
+    MPMCQueue(const MPMCQueue&) = delete;
+    MPMCQueue& operator=(const MPMCQueue&) = delete;
+
+public:
+
+    /** \param capacity Rounded up to a power of two */
+    explicit MPMCQueue(int capacity = 1024) {
+        const size_t n = size_t(ceilPow2(max(capacity, 2)));
+        m_cell.reset(new Cell[n]);
+        m_mask = n - 1;
+        for (size_t i = 0; i < n; ++i) {
+            m_cell[i].sequence.store(i, std::memory_order_relaxed);
+        }
+        m_pushPos.store(0, std::memory_order_relaxed);
+        m_popPos.store(0, std::memory_order_relaxed);
+    }
+
+    int capacity() const {
+        return int(m_mask + 1);
+    }
+
+    /** Returns false without modifying the queue if it is full */
+    bool tryPushBack(const T& v) {
+        return pushImpl(v);
+    }
+
+    /** Returns false without modifying the queue if it is full */
+    bool tryPushBack(T&& v) {
+        return pushImpl(std::move(v));
+    }
+
+    /** Returns true if v was actually read */
+    bool popFront(T& v) {
+        size_t pos = m_popPos.load(std::memory_order_relaxed);
+        Cell* cell = nullptr;
+        while (true) {
+            cell = &m_cell[pos & m_mask];
+            const size_t seq = cell->sequence.load(std::memory_order_acquire);
+            const intptr_t diff = intptr_t(seq) - intptr_t(pos + 1);
+            if (diff == 0) {
+                if (m_popPos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = m_popPos.load(std::memory_order_relaxed);
+            }
+        }
+        v = std::move(cell->value);
+        // Release the moved-from value's resources before the slot is reused
+        cell->value = T();
+        cell->sequence.store(pos + m_mask + 1, std::memory_order_release);
+        return true;
+    }
+
+    /** Note that by the time the method has returned, the value may be incorrect. */
+    int size() const {
+        const size_t pop  = m_popPos.load(std::memory_order_acquire);
+        const size_t push = m_pushPos.load(std::memory_order_acquire);
+        return (push > pop) ? int(std::min(push - pop, m_mask + 1)) : 0;
+    }
+
+    bool empty() const {
+        return size() == 0;
+    }
+
+    bool full() const {
+        return size() == capacity();
+    }
+
+    /** Pops all elements. Elements pushed concurrently may remain. */
+    void clear() {
+        T ignore;
+        while (popFront(ignore)) {}
+    }
+};
+
+
+/** \brief Fixed-capacity, lock-free ring buffer for exactly one producer thread and one consumer thread.
+
+    Cheaper than MPMCQueue because neither side needs a compare-and-swap,
+    and each side caches the other's cursor so that the shared cache
+    lines are only read when the queue appears full or empty.
+
+    \sa MPMCQueue, ThreadsafeQueue
+ */
+template<class T>
+class SPSCQueue {
+private:
+
+    enum { CACHE_LINE_SIZE = 64 };
+
+    std::unique_ptr<T[]>        m_value;
+    size_t                      m_mask;
+
+    /** Written only by the consumer */
+    alignas(CACHE_LINE_SIZE) std::atomic<size_t> m_popPos;
+    /** Consumer's copy of m_pushPos */
+    size_t                      m_cachedPushPos;
+
+    /** Written only by the producer */
+    alignas(CACHE_LINE_SIZE) std::atomic<size_t> m_pushPos;
+    /** Producer's copy of m_popPos */
+    size_t                      m_cachedPopPos;
+
+    SPSCQueue(const SPSCQueue&) = delete;
+    SPSCQueue& operator=(const SPSCQueue&) = delete;
+
+    template<class V>
+    bool pushImpl(V&& v) {
+        const size_t pos = m_pushPos.load(std::memory_order_relaxed);
+        if (pos - m_cachedPopPos > m_mask) {
+            m_cachedPopPos = m_popPos.load(std::memory_order_acquire);
+            if (pos - m_cachedPopPos > m_mask) {
+                return false;
+            }
+        }
+        m_value[pos & m_mask] = std::forward<V>(v);
+        m_pushPos.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+public:
+
+    /** \param capacity Rounded up to a power of two */
+    explicit SPSCQueue(int capacity = 1024) : m_cachedPushPos(0), m_cachedPopPos(0) {
+        const size_t n = size_t(ceilPow2(max(capacity, 2)));
+        m_value.reset(new T[n]);
+        m_mask = n - 1;
+        m_popPos.store(0, std::memory_order_relaxed);
+        m_pushPos.store(0, std::memory_order_relaxed);
+    }
+
+    int capacity() const {
+        return int(m_mask + 1);
+    }
+
+    /** Call only from the producer thread. Returns false if full. */
+    bool tryPushBack(const T& v) {
+        return pushImpl(v);
+    }
+
+    /** Call only from the producer thread. Returns false if full. */
+    bool tryPushBack(T&& v) {
+        return pushImpl(std::move(v));
+    }
+
+    /** Call only from the consumer thread. Returns true if v was actually read */
+    bool popFront(T& v) {
+        const size_t pos = m_popPos.load(std::memory_order_relaxed);
+        if (pos == m_cachedPushPos) {
+            m_cachedPushPos = m_pushPos.load(std::memory_order_acquire);
+            if (pos == m_cachedPushPos) {
+                return false;
+            }
+        }
+        T& slot = m_value[pos & m_mask];
+        v = std::move(slot);
+        slot = T();
+        m_popPos.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    /** Note that by the time the method has returned, the value may be incorrect. */
+    int size() const {
+        const size_t pop  = m_popPos.load(std::memory_order_acquire);
+        const size_t push = m_pushPos.load(std::memory_order_acquire);
+        return (push > pop) ? int(push - pop) : 0;
+    }
+
+    bool empty() const {
+        return size() == 0;
+    }
+
+    bool full() const {
+        return size() == capacity();
+    }
+
+    /** Call only from the consumer thread. */
+    void clear() {
+        T ignore;
+        while (popFront(ignore)) {}
+    }
+};
+
+} // namespace G3D
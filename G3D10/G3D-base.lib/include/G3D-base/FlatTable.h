@@ -0,0 +1,798 @@
+/**
+  \file G3D-base.lib/include/G3D-base/FlatTable.h
+
+  G3D Innovation Engine http://casual-effects.com/g3d
+  Copyright 2000-2019, Morgan McGuire
+  All rights reserved
+  Available under the BSD License
+*/
+#pragma once
+#define G3D_base_FlatTable_h
+
+#include <cstddef>
+#include <cstring>
+#include "G3D-base/platform.h"
+#include "G3D-base/G3DString.h"
+#include "G3D-base/Array.h"
+#include "G3D-base/debug.h"
+#include "G3D-base/g3dmath.h"
+#include "G3D-base/EqualsTrait.h"
+#include "G3D-base/HashTrait.h"
+#include "G3D-base/MemoryManager.h"
+
+#ifdef G3D_X86
+#   include <emmintrin.h>
+#endif
+#ifdef _MSC_VER
+#   include <intrin.h>
+#endif
+
+namespace G3D {
+
+namespace _internal {
+
+/** Metadata and probing helpers shared by all FlatTable instantiations.
+    Each slot of a FlatTable has one control byte: EMPTY, DELETED, or
+    the low 7 bits of the key's hash when the slot is in use. */
+class FlatTableControl {
+public:
+
+    enum {
+        /** Number of slots whose control bytes are compared at once */
+        GROUP_SIZE = 16
+    };
+
+    static const uint8 EMPTY   = 0x80;
+    static const uint8 DELETED = 0xFE;
+
+    /** Spreads the bits of a HashTrait code, which are often poorly
+        distributed (e.g., pointers and small integers) */
+    static size_t mix(size_t h) {
+        const uint64 x = uint64(h) * 0x9E3779B97F4A7C15ull;
+        return size_t(x ^ (x >> 32));
+    }
+
+    /** Bit i is set if control byte i of the group equals \a b */
+    static uint32 match(const uint8* group, uint8 b) {
+#       ifdef G3D_X86
+            const __m128i ctrl = _mm_loadu_si128(reinterpret_cast<const __m128i*>(group));
+            return uint32(_mm_movemask_epi8(_mm_cmpeq_epi8(ctrl, _mm_set1_epi8(char(b)))));
+#       else
+            uint32 mask = 0;
+            for (int i = 0; i < GROUP_SIZE; ++i) {
+                mask |= uint32(group[i] == b) << i;
+            }
+            return mask;
+#       endif
+    }
+
+    static uint32 matchEmpty(const uint8* group) {
+        return match(group, EMPTY);
+    }
+
+    /** EMPTY and DELETED are the only control values with the high bit set */
+    static uint32 matchEmptyOrDeleted(const uint8* group) {
+#       ifdef G3D_X86
+            return uint32(_mm_movemask_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(group))));
+#       else
+            uint32 mask = 0;
+            for (int i = 0; i < GROUP_SIZE; ++i) {
+                mask |= uint32(group[i] >> 7) << i;
+            }
+            return mask;
+#       endif
+    }
+
+    /** Index of the least significant set bit. \a mask must be nonzero. */
+    static int lowestBit(uint32 mask) {
+        debugAssert(mask != 0);
+#       ifdef _MSC_VER
+            unsigned long i;
+            _BitScanForward(&i, mask);
+            return int(i);
+#       else
+            return __builtin_ctz(mask);
+#       endif
+    }
+};
+
+} // namespace _internal
+
+
+/**
+ \brief An unordered data structure mapping keys to values, with the same
+ interface and key requirements as Table but much better cache behavior.
+
+ FlatTable uses open addressing. The entries are stored contiguously in
+ a dense array, and a separate slot array maps hash positions to entry
+ indices. Each slot also has a one-byte control code holding 7 bits of
+ the key's hash, so a lookup compares 16 slots with a single SSE2
+ instruction and only touches an Entry when those bits match. Inserting
+ does not allocate except when the table grows.
+
+ Iteration walks the dense array, so it visits entries in insertion
+ order and independent of the hash function. remove() moves the last
+ entry into the hole left by the removed one.
+
+ Unlike Table, inserting or removing an element may move other entries,
+ so pointers returned by getPointer(), getKeyPointer(), and
+ getCreateEntry() are invalidated by the next set(), getCreate(), or
+ remove(). Copy values out instead of holding pointers across
+ modifications.
+
+ \sa Table, FastPODTable, SmallTable
+ */
+template<class Key, class Value, class HashFunc = HashTrait<Key>, class EqualsFunc = EqualsTrait<Key> >
+class FlatTable {
+public:
+
+    /**
+     The pairs returned by iterator.
+     */
+    class Entry {
+    public:
+        Key    key;
+        Value  value;
+        Entry() {}
+        Entry(const Key& k) : key(k) {}
+        Entry(const Key& k, const Value& v) : key(k), value(v) {}
+        bool operator==(const Entry &peer) const { return (key == peer.key && value == peer.value); }
+        bool operator!=(const Entry &peer) const { return !operator==(peer); }
+    };
+
+private:
+
+    typedef FlatTable<Key, Value, HashFunc, EqualsFunc> ThisType;
+    typedef _internal::FlatTableControl Control;
+
+    enum { GROUP_SIZE = Control::GROUP_SIZE, NOT_FOUND = -1 };
+
+    /** Entries in insertion order (modulo removals) */
+    Array<Entry>                m_entry;
+
+    /** Mixed hash code of each element of m_entry */
+    Array<size_t>               m_hash;
+
+    /** m_capacity control bytes followed by m_capacity int32 m_slot values,
+        in a single allocation */
+    uint8*                      m_control;
+
+    /** Index into m_entry for each slot whose control byte is full */
+    int32*                      m_slot;
+
+    /** Zero or a power of two that is at least GROUP_SIZE */
+    size_t                      m_capacity;
+
+    size_t                      m_numDeleted;
+
+    shared_ptr<MemoryManager>   m_memoryManager;
+
+    size_t groupMask() const {
+        return (m_capacity / GROUP_SIZE) - 1;
+    }
+
+    static uint8 controlCode(size_t h) {
+        return uint8(h & 0x7F);
+    }
+
+    static size_t firstGroup(size_t h) {
+        return h >> 7;
+    }
+
+    /** Returns the slot holding \a key, or NOT_FOUND. \a h is the mixed hash of key. */
+    ptrdiff_t findSlot(const Key& key, size_t h) const {
+        if (m_capacity == 0) {
+            return NOT_FOUND;
+        }
+        const uint8 code = controlCode(h);
+        const size_t mask = groupMask();
+        size_t g = firstGroup(h) & mask;
+
+        // Triangular probing visits every group exactly once when the
+        // number of groups is a power of two. The load limit guarantees
+        // that some group contains an EMPTY slot, so this terminates.
+        for (size_t probe = 1; ; ++probe) {
+            const uint8* group = m_control + g * GROUP_SIZE;
+            for (uint32 m = Control::match(group, code); m != 0; m &= m - 1) {
+                const size_t s = g * GROUP_SIZE + Control::lowestBit(m);
+                const int32 d = m_slot[s];
+                if ((m_hash[d] == h) && EqualsFunc::equals(m_entry[d].key, key)) {
+                    return ptrdiff_t(s);
+                }
+            }
+            if (Control::matchEmpty(group) != 0) {
+                return NOT_FOUND;
+            }
+            g = (g + probe) & mask;
+        }
+    }
+
+    /** Returns the slot that refers to dense index \a d. That slot must exist. */
+    size_t findSlotOfIndex(int32 d) const {
+        const size_t h = m_hash[d];
+        const uint8 code = controlCode(h);
+        const size_t mask = groupMask();
+        size_t g = firstGroup(h) & mask;
+        for (size_t probe = 1; ; ++probe) {
+            const uint8* group = m_control + g * GROUP_SIZE;
+            for (uint32 m = Control::match(group, code); m != 0; m &= m - 1) {
+                const size_t s = g * GROUP_SIZE + Control::lowestBit(m);
+                if (m_slot[s] == d) {
+                    return s;
+                }
+            }
+            debugAssertM(Control::matchEmpty(group) == 0, "FlatTable index missing from slot array");
+            g = (g + probe) & mask;
+        }
+    }
+
+    /** Returns the first EMPTY or DELETED slot on the probe sequence for \a h */
+    size_t findFreeSlot(size_t h) const {
+        const size_t mask = groupMask();
+        size_t g = firstGroup(h) & mask;
+        for (size_t probe = 1; ; ++probe) {
+            const uint32 m = Control::matchEmptyOrDeleted(m_control + g * GROUP_SIZE);
+            if (m != 0) {
+                return g * GROUP_SIZE + Control::lowestBit(m);
+            }
+            g = (g + probe) & mask;
+        }
+    }
+
+    /** Number of groups examined when looking up dense index \a d */
+    size_t probeLength(int32 d) const {
+        const size_t s = findSlotOfIndex(d);
+        const size_t mask = groupMask();
+        size_t g = firstGroup(m_hash[d]) & mask;
+        size_t n = 1;
+        for (size_t probe = 1; g != s / GROUP_SIZE; ++probe, ++n) {
+            g = (g + probe) & mask;
+        }
+        return n;
+    }
+
+    void freeSlots() {
+        if (m_control != nullptr) {
+            m_memoryManager->free(m_control);
+        }
+        m_control    = nullptr;
+        m_slot       = nullptr;
+        m_capacity   = 0;
+        m_numDeleted = 0;
+    }
+
+    /** Rebuilds the slot array at \a newCapacity, discarding DELETED markers */
+    void rehash(size_t newCapacity) {
+        debugAssert(isPow2(int(newCapacity / GROUP_SIZE)) && (newCapacity >= GROUP_SIZE));
+        debugAssert(newCapacity * 7 / 8 > size_t(m_entry.size()));
+        freeSlots();
+
+        m_control  = static_cast<uint8*>(m_memoryManager->alloc(newCapacity * (sizeof(uint8) + sizeof(int32))));
+        m_slot     = reinterpret_cast<int32*>(m_control + newCapacity);
+        m_capacity = newCapacity;
+        ::memset(m_control, Control::EMPTY, m_capacity);
+
+        for (int32 d = 0; d < m_entry.size(); ++d) {
+            const size_t s = findFreeSlot(m_hash[d]);
+            m_control[s] = controlCode(m_hash[d]);
+            m_slot[s]    = d;
+        }
+    }
+
+    /** Smallest legal capacity that holds \a n elements below the maximum load */
+    static size_t capacityFor(size_t n) {
+        size_t c = GROUP_SIZE;
+        while (c * 7 / 8 <= n) {
+            c *= 2;
+        }
+        return c;
+    }
+
+    /** Ensures that there is room to insert one more element */
+    void reserveOne() {
+        const size_t n = size_t(m_entry.size());
+        if (m_capacity == 0) {
+            rehash(GROUP_SIZE);
+        } else if (n + m_numDeleted + 1 > m_capacity * 7 / 8) {
+            // Reclaim tombstones in place unless the live elements alone are
+            // above half of the maximum load
+            rehash((n * 16 > m_capacity * 7) ? m_capacity * 2 : m_capacity);
+        }
+    }
+
+    /** Marks slot \a s as unused and removes its entry from the dense array */
+    void eraseSlot(size_t s) {
+        const int32 d    = m_slot[s];
+        const int32 last = m_entry.size() - 1;
+
+        // A probe sequence only continues past a group that had no EMPTY
+        // slot. If this group still has one, nothing was ever displaced
+        // past it and the slot can become EMPTY instead of DELETED.
+        uint8* group = m_control + (s & ~size_t(GROUP_SIZE - 1));
+        if (Control::matchEmpty(group) != 0) {
+            m_control[s] = Control::EMPTY;
+        } else {
+            m_control[s] = Control::DELETED;
+            ++m_numDeleted;
+        }
+
+        if (d != last) {
+            m_slot[findSlotOfIndex(last)] = d;
+            m_entry[d] = std::move(m_entry[last]);
+            m_hash[d]  = m_hash[last];
+        }
+        m_entry.popDiscard();
+        m_hash.popDiscard();
+    }
+
+    void copyFrom(const ThisType& h) {
+        m_entry      = h.m_entry;
+        m_hash       = h.m_hash;
+        if (h.m_capacity > 0) {
+            const size_t bytes = h.m_capacity * (sizeof(uint8) + sizeof(int32));
+            m_control  = static_cast<uint8*>(m_memoryManager->alloc(bytes));
+            m_slot     = reinterpret_cast<int32*>(m_control + h.m_capacity);
+            ::memcpy(m_control, h.m_control, bytes);
+        }
+        m_capacity   = h.m_capacity;
+        m_numDeleted = h.m_numDeleted;
+    }
+
+    Entry* getEntryPointer(const Key& key) const {
+        const ptrdiff_t s = findSlot(key, Control::mix(HashFunc::hashCode(key)));
+        if (s == NOT_FOUND) {
+            return nullptr;
+        } else {
+            return const_cast<Entry*>(&m_entry[m_slot[s]]);
+        }
+    }
+
+    /** Helper for remove() and getRemove() */
+    bool remove(const Key& key, Key& removedKey, Value& removedValue, bool updateRemoved) {
+        const ptrdiff_t s = findSlot(key, Control::mix(HashFunc::hashCode(key)));
+        if (s == NOT_FOUND) {
+            return false;
+        }
+        if (updateRemoved) {
+            const Entry& e = m_entry[m_slot[s]];
+            removedKey   = e.key;
+            removedValue = e.value;
+        }
+        eraseSlot(size_t(s));
+        return true;
+    }
+
+public:
+
+    /**
+     Creates an empty hash table using the default MemoryManager.
+     */
+    FlatTable() : m_control(nullptr), m_slot(nullptr), m_capacity(0), m_numDeleted(0) {
+        m_memoryManager = MemoryManager::create();
+    }
+
+    /** Uses the default memory manager */
+    FlatTable(const ThisType& h) : m_control(nullptr), m_slot(nullptr), m_capacity(0), m_numDeleted(0) {
+        m_memoryManager = MemoryManager::create();
+        copyFrom(h);
+    }
+
+    FlatTable& operator=(const ThisType& h) {
+        if (this != &h) {
+            freeSlots();
+            copyFrom(h);
+        }
+        return *this;
+    }
+
+    /**
+       Destroys all of the memory allocated by the table, but does <B>not</B>
+       call delete on keys or values if they are pointers.
+    */
+    virtual ~FlatTable() {
+        freeSlots();
+    }
+
+    /** Changes the internal memory manager to m */
+    void clearAndSetMemoryManager(const shared_ptr<MemoryManager>& m) {
+        clear();
+        m_memoryManager = m;
+        m_entry.clearAndSetMemoryManager(m);
+        m_hash.clearAndSetMemoryManager(m);
+    }
+
+    /**
+        Recommends that the table resize to anticipate at least this number of elements.
+     */
+    void setSizeHint(size_t n) {
+        const size_t c = capacityFor(n);
+        if (c > m_capacity) {
+            rehash(c);
+        }
+        if (int(n) > m_entry.size()) {
+            m_entry.reserve(int(n));
+            m_hash.reserve(int(n));
+        }
+    }
+
+    /**
+     Returns the largest number of 16-slot groups that a lookup of a
+     present key examines. Analogous to Table::debugGetDeepestBucketSize().
+     */
+    size_t debugGetDeepestBucketSize() const {
+        size_t deepest = 0;
+        for (int32 d = 0; d < m_entry.size(); ++d) {
+            deepest = max(deepest, probeLength(d));
+        }
+        return deepest;
+    }
+
+    /**
+       Returns the average number of 16-slot groups that a lookup of a present key examines.
+    */
+    float debugGetAverageBucketSize() const {
+        if (m_entry.size() == 0) {
+            return 0.0f;
+        }
+        uint64 total = 0;
+        for (int32 d = 0; d < m_entry.size(); ++d) {
+            total += probeLength(d);
+        }
+        return (float)((double)total / m_entry.size());
+    }
+
+    /**
+     Fraction of slots in use, including DELETED slots that have not yet
+     been reclaimed. Never exceeds 7/8.
+     */
+    double debugGetLoad() const {
+        return (double)(size() + m_numDeleted) / m_capacity;
+    }
+
+    /**
+     Returns the number of slots.
+     */
+    size_t debugGetNumBuckets() const {
+        return m_capacity;
+    }
+
+    /**
+     C++ STL style iterator variable.  See begin().
+     */
+    class Iterator {
+    private:
+        friend class FlatTable<Key, Value, HashFunc, EqualsFunc>;
+
+        Entry*              m_entry;
+        int                 m_index;
+        int                 m_size;
+
+        /**
+         Creates the end iterator.
+         */
+        Iterator() : m_entry(nullptr), m_index(0), m_size(0) {}
+
+        Iterator(Entry* entry, int size) : m_entry(entry), m_index(0), m_size(size) {}
+
+    public:
+        inline bool operator!=(const Iterator& other) const {
+            return !(*this == other);
+        }
+
+        bool operator==(const Iterator& other) const {
+            if (! isValid() || ! other.isValid()) {
+                return isValid() == other.isValid();
+            } else {
+                return (m_entry + m_index) == (other.m_entry + other.m_index);
+            }
+        }
+
+        /**
+         Pre increment.
+         */
+        Iterator& operator++() {
+            debugAssert(isValid());
+            ++m_index;
+            return *this;
+        }
+
+        /**
+         Post increment (slower than preincrement).
+         */
+        Iterator operator++(int) {
+            Iterator old = *this;
+            ++(*this);
+            return old;
+        }
+
+        const Entry& operator*() const {
+            return m_entry[m_index];
+        }
+
+        const Value& value() const {
+            return m_entry[m_index].value;
+        }
+
+        const Key& key() const {
+            return m_entry[m_index].key;
+        }
+
+        Entry* operator->() const {
+            debugAssert(isValid());
+            return m_entry + m_index;
+        }
+
+        operator Entry*() const {
+            debugAssert(isValid());
+            return m_entry + m_index;
+        }
+
+        bool isValid() const {
+            return m_index < m_size;
+        }
+
+        /** @deprecated  Use isValid */
+        bool hasMore() const {
+            return isValid();
+        }
+    };
+
+    /**
+     C++ STL style iterator method.  Returns the first Entry, which
+     contains a key and value.  Use preincrement (++entry) to get to
+     the next element.  Do not modify the table while iterating.
+     */
+    Iterator begin() const {
+        return Iterator(const_cast<Entry*>(m_entry.getCArray()), m_entry.size());
+    }
+
+    /**
+     C++ STL style iterator method.  Returns one after the last iterator
+     element.
+     */
+    const Iterator end() const {
+        return Iterator();
+    }
+
+    /**
+     Removes all elements. Guaranteed to free all memory associated with
+     the table.
+     */
+    void clear() {
+        freeSlots();
+        m_entry.clear();
+        m_hash.clear();
+    }
+
+    /**
+     Returns the number of keys.
+     */
+    size_t size() const {
+        return size_t(m_entry.size());
+    }
+
+    /**
+     If you insert a pointer into the key or value of a table, you are
+     responsible for deallocating the object eventually.
+     */
+    void set(const Key& key, const Value& value) {
+        getCreateEntry(key).value = value;
+    }
+
+   /** If @a member is present, sets @a removed to the element
+    being removed and returns true.  Otherwise returns false
+    and does not write to @a removed. */
+    bool getRemove(const Key& key, Key& removedKey, Value& removedValue) {
+        return remove(key, removedKey, removedValue, true);
+    }
+
+    /**
+    Removes an element from the table if it is present.
+    @return true if the element was found and removed, otherwise  false
+    */
+    bool remove(const Key& key) {
+        const ptrdiff_t s = findSlot(key, Control::mix(HashFunc::hashCode(key)));
+        if (s == NOT_FOUND) {
+            return false;
+        }
+        eraseSlot(size_t(s));
+        return true;
+    }
+
+    /** If a value that is EqualsFunc to @a member is present, returns a pointer to the
+        version stored in the data structure, otherwise returns nullptr.
+     */
+    const Key* getKeyPointer(const Key& key) const {
+        const Entry* e = getEntryPointer(key);
+        if (e == nullptr) {
+            return nullptr;
+        } else {
+            return &(e->key);
+        }
+    }
+
+   /**
+    Returns the value associated with key.
+    @deprecated Use get(key, val) or getPointer(key)
+    */
+    Value& get(const Key& key) const {
+        Entry* e = getEntryPointer(key);
+        debugAssertM(e != nullptr, "Key not found");
+        return e->value;
+    }
+
+    /** Returns a pointer to the element if it exists, or nullptr if it does not.
+        The pointer is invalidated by the next insertion or removal. */
+    Value* getPointer(const Key& key) const {
+        Entry* e = getEntryPointer(key);
+        if (e == nullptr) {
+            return nullptr;
+        } else {
+            return &(e->value);
+        }
+    }
+
+   /**
+    If the key is present in the table, val is set to the associated value and returns true.
+    If the key is not present, returns false.
+    */
+    bool get(const Key& key, Value& val) const {
+        const Value* v = getPointer(key);
+        if (v != nullptr) {
+            val = *v;
+            return true;
+        } else {
+            return false;
+        }
+    }
+
+    /** Called by getCreate() and set()
+
+        \param created Set to true if the entry was created by this method.
+    */
+    Entry& getCreateEntry(const Key& key, bool& created) {
+        const size_t h = Control::mix(HashFunc::hashCode(key));
+        const ptrdiff_t existing = findSlot(key, h);
+        if (existing != NOT_FOUND) {
+            created = false;
+            return m_entry[m_slot[existing]];
+        }
+
+        reserveOne();
+        const size_t s = findFreeSlot(h);
+        if (m_control[s] == Control::DELETED) {
+            --m_numDeleted;
+        }
+        m_control[s] = controlCode(h);
+        m_slot[s]    = m_entry.size();
+        m_hash.append(h);
+        m_entry.append(Entry(key));
+        created = true;
+        return m_entry.last();
+    }
+
+    Entry& getCreateEntry(const Key& key) {
+        bool ignore;
+        return getCreateEntry(key, ignore);
+    }
+
+    /** Returns the current value that key maps to, creating it if necessary.*/
+    Value& getCreate(const Key& key) {
+        return getCreateEntry(key).value;
+    }
+
+    /** \param created True if the element was created. */
+    Value& getCreate(const Key& key, bool& created) {
+        return getCreateEntry(key, created).value;
+    }
+
+   /**
+    Returns true if any key maps to value using operator==.
+    */
+    bool containsValue(const Value& value) const {
+        for (int i = 0; i < m_entry.size(); ++i) {
+            if (m_entry[i].value == value) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+   /**
+    Returns true if key is in the table.
+    */
+    bool containsKey(const Key& key) const {
+        return findSlot(key, Control::mix(HashFunc::hashCode(key))) != NOT_FOUND;
+    }
+
+   /**
+    Short syntax for get.
+    */
+    inline Value& operator[](const Key &key) const {
+        return get(key);
+    }
+
+   /**
+    Returns an array of all of the keys in the table.
+    You can iterate over the keys to get the values.
+    @deprecated
+    */
+    Array<Key> getKeys() const {
+        Array<Key> keyArray;
+        getKeys(keyArray);
+        return keyArray;
+    }
+
+    void getKeys(Array<Key>& keyArray) const {
+        keyArray.resize(0, DONT_SHRINK_UNDERLYING_ARRAY);
+        keyArray.reserve(m_entry.size());
+        for (int i = 0; i < m_entry.size(); ++i) {
+            keyArray.append(m_entry[i].key);
+        }
+    }
+
+    /** Will contain duplicate values if they exist in the table.  This array is parallel to the one returned by getKeys() if the table has not been modified. */
+    void getValues(Array<Value>& valueArray) const {
+        valueArray.resize(0, DONT_SHRINK_UNDERLYING_ARRAY);
+        valueArray.reserve(m_entry.size());
+        for (int i = 0; i < m_entry.size(); ++i) {
+            valueArray.append(m_entry[i].value);
+        }
+    }
+
+   /**
+    Calls delete on all of the keys and then clears the table.
+    */
+    void deleteKeys() {
+        for (int i = 0; i < m_entry.size(); ++i) {
+            delete m_entry[i].key;
+            m_entry[i].key = nullptr;
+        }
+        clear();
+    }
+
+   /**
+    Calls delete on all of the values.  This is unsafe--
+    do not call unless you know that each value appears
+    at most once.
+
+    Does not clear the table, so you are left with a table
+    of nullptr pointers.
+    */
+    void deleteValues() {
+        for (int i = 0; i < m_entry.size(); ++i) {
+            delete m_entry[i].value;
+            m_entry[i].value = nullptr;
+        }
+    }
+
+    template<class H, class E>
+    bool operator==(const FlatTable<Key, Value, H, E>& other) const {
+        if (size() != other.size()) {
+            return false;
+        }
+
+        for (int i = 0; i < m_entry.size(); ++i) {
+            const Value* v = other.getPointer(m_entry[i].key);
+            if ((v == nullptr) || (*v != m_entry[i].value)) {
+                // Either the key did not exist or the value was not the same
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    template<class H, class E>
+    bool operator!=(const FlatTable<Key, Value, H, E>& other) const {
+        return ! (*this == other);
+    }
+
+    void debugPrintStatus() {
+        debugPrintf("Deepest probe (groups) = %d\n", (int)debugGetDeepestBucketSize());
+        debugPrintf("Average probe (groups) = %g\n", debugGetAverageBucketSize());
+        debugPrintf("Load factor            = %g\n", debugGetLoad());
+    }
+};
+
+} // namespace G3D
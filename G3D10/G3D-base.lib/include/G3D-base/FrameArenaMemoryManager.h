@@ -0,0 +1,172 @@
+/**
+  \file G3D-base.lib/include/G3D-base/FrameArenaMemoryManager.h
+
+  G3D Innovation Engine http://casual-effects.com/g3d
+  Copyright 2000-2019, Morgan McGuire
+  All rights reserved
+  Available under the BSD License
+*/
+#pragma once
+#define G3D_base_FrameArenaMemoryManager_h
+
+#include "G3D-base/platform.h"
+#include "G3D-base/Array.h"
+#include "G3D-base/MemoryManager.h"
+#include "G3D-base/Thread.h"
+
+namespace G3D {
+
+/** 
+  \brief A threadsafe linear allocator for data that only lives for one or two frames.
+
+  alloc() bumps a pointer through a block reserved from the heap;
+  free() is ignored. beginFrame() recycles everything that was allocated
+  \a numFrames frames earlier, so with the default of two frames the
+  data allocated during the previous frame is still valid during the
+  current one.
+
+  When a frame overflows its block, additional blocks are allocated.
+  The next time that frame's memory is recycled they are coalesced
+  into a single block large enough for the whole frame, so in steady
+  state there is no heap traffic at all.
+
+  Pass it to Array::clearAndSetMemoryManager or Table::clearAndSetMemoryManager for
+  per-frame scratch arrays, or to std::allocate_shared through
+  FrameArenaAllocator. Destructors are still invoked normally; only the
+  memory is reclaimed in bulk. Never store a pointer to arena memory in
+  an object that outlives the frame.
+
+  Only use current() from code that is known to run on the thread that
+  invokes beginFrame() and to finish within the frame. Work that may run
+  on another thread or span frames, such as a TriTree rebuild, must use
+  the heap.
+
+  GApp creates one, registers it as current(), and invokes beginFrame() at
+  the top of every frame.
+
+  \sa AreaMemoryManager, MemoryManager
+ */
+class FrameArenaMemoryManager : public MemoryManager {
+private:
+
+    class Block {
+    public:
+        uint8*              data;
+        size_t              size;
+        Block() : data(nullptr), size(0) {}
+        Block(uint8* d, size_t s) : data(d), size(s) {}
+    };
+
+    class Frame {
+    public:
+        /** The last block receives new allocations */
+        Array<Block>        block;
+
+        /** Bytes used in the last block */
+        size_t              used;
+
+        /** Bytes allocated during this frame in all blocks */
+        size_t              bytesAllocated;
+
+        Frame() : used(0), bytesAllocated(0) {}
+    };
+
+    enum {ALIGNMENT = 16};
+
+    size_t                  m_sizeHint;
+    Array<Frame>            m_frame;
+    int                     m_currentFrame;
+
+    /** Number of times that a block was obtained from the heap */
+    int                     m_numHeapAllocations;
+
+    mutable Spinlock        m_lock;
+
+    static shared_ptr<FrameArenaMemoryManager> s_current;
+
+    FrameArenaMemoryManager(size_t sizeHint, int numFrames);
+
+    /** Requires the lock */
+    void addBlock(Frame& frame, size_t minSize);
+
+public:
+
+    /** 
+        \param sizeHint Initial size of each frame's block in bytes
+        \param numFrames Number of frames that an allocation remains valid. Must be at least 1.
+    */
+    static shared_ptr<FrameArenaMemoryManager> create(size_t sizeHint = 4 * 1024 * 1024, int numFrames = 2);
+
+    ~FrameArenaMemoryManager();
+
+    /** Returns 16-byte aligned memory that remains valid until beginFrame() has been invoked numFrames() times */
+    virtual void* alloc(size_t s) override;
+
+    /** Ignored. Memory is reclaimed by beginFrame(). */
+    virtual void free(void* x) override;
+
+    virtual bool isThreadsafe() const override;
+
+    /** Recycles the memory of the oldest frame and directs subsequent allocations to it.
+        Must not be invoked concurrently with alloc(). */
+    void beginFrame();
+
+    int numFrames() const {
+        return m_frame.size();
+    }
+
+    /** Bytes allocated since the last beginFrame() */
+    size_t bytesAllocatedThisFrame() const;
+
+    /** Total bytes reserved from the heap for all frames */
+    size_t bytesReserved() const;
+
+    /** Number of blocks obtained from the heap since creation. Stops increasing in steady state. */
+    int numHeapAllocations() const {
+        return m_numHeapAllocations;
+    }
+
+    /** The arena for the running application, or nullptr if none has been registered.
+        Library code uses this for per-frame scratch data when it is available. */
+    static const shared_ptr<FrameArenaMemoryManager>& current() {
+        return s_current;
+    }
+
+    static void setCurrent(const shared_ptr<FrameArenaMemoryManager>& arena) {
+        s_current = arena;
+    }
+};
+
+
+/** \brief Standard library allocator adapter for FrameArenaMemoryManager, e.g., for std::allocate_shared.
+
+    \code
+    shared_ptr<Foo> f = std::allocate_shared<Foo>(FrameArenaAllocator<Foo>(arena), args...);
+    \endcode
+ */
+template<class T>
+class FrameArenaAllocator {
+public:
+    typedef T value_type;
+
+    FrameArenaMemoryManager* arena;
+
+    explicit FrameArenaAllocator(const shared_ptr<FrameArenaMemoryManager>& a) : arena(a.get()) {}
+    template<class S> FrameArenaAllocator(const FrameArenaAllocator<S>& other) : arena(other.arena) {}
+
+    T* allocate(size_t n) {
+        return static_cast<T*>(arena->alloc(n * sizeof(T)));
+    }
+
+    void deallocate(T*, size_t) {}
+
+    template<class S> bool operator==(const FrameArenaAllocator<S>& other) const {
+        return arena == other.arena;
+    }
+
+    template<class S> bool operator!=(const FrameArenaAllocator<S>& other) const {
+        return arena != other.arena;
+    }
+};
+
+} // namespace G3D
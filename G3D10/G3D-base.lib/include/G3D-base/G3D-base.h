@@ -73,13 +73,17 @@
 #include "G3D-base/stringutils.h"
 #include "G3D-base/prompt.h"
 #include "G3D-base/Table.h"
+#include "G3D-base/FlatTable.h"
 #include "G3D-base/FileSystem.h"
 #include "G3D-base/Set.h"
 #include "G3D-base/GUniqueID.h"
 #include "G3D-base/RayGridIterator.h"
 #include "G3D-base/BinaryFormat.h"
 #include "G3D-base/BinaryInput.h"
+#include "G3D-base/BlockCompression.h"
 #include "G3D-base/BinaryOutput.h"
+#include "G3D-base/MemoryMappedFile.h"
+#include "G3D-base/ZipArchive.h"
 #include "G3D-base/debug.h"
 #include "G3D-base/g3dfnmatch.h"
 #include "G3D-base/G3DGameUnits.h"
@@ -96,9 +100,11 @@
 #include "G3D-base/MemoryManager.h"
 #include "G3D-base/BlockPoolMemoryManager.h"
 #include "G3D-base/AreaMemoryManager.h"
+#include "G3D-base/FrameArenaMemoryManager.h"
 #include "G3D-base/BumpMapPreprocess.h"
 #include "G3D-base/CubeFace.h"
 #include "G3D-base/Line2D.h"
+#include "G3D-base/BoundedQueue.h"
 #include "G3D-base/ThreadsafeQueue.h"
 #include "G3D-base/network.h"
 #include "G3D-base/FrameName.h"
@@ -139,6 +145,7 @@
 #include "G3D-base/MeshBuilder.h"
 #include "G3D-base/Stopwatch.h"
 #include "G3D-base/Thread.h"
+#include "G3D-base/TaskGraph.h"
 #include "G3D-base/RegistryUtil.h"
 #include "G3D-base/Any.h"
 #include "G3D-base/XML.h"
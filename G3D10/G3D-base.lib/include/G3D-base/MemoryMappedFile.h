@@ -0,0 +1,86 @@
+/**
+  \file G3D-base.lib/include/G3D-base/MemoryMappedFile.h
+
+  G3D Innovation Engine http://casual-effects.com/g3d
+  Copyright 2000-2019, Morgan McGuire
+  All rights reserved
+  Available under the BSD License
+*/
+#pragma once
+#define G3D_base_MemoryMappedFile_h
+
+#include "G3D-base/platform.h"
+#include "G3D-base/g3dmath.h"
+#include "G3D-base/ReferenceCount.h"
+#include "G3D-base/G3DString.h"
+
+namespace G3D {
+
+/** \brief Read-only view of the contents of a file on disk, mapped into the address space.
+
+    The operating system reads pages on demand and shares them among all
+    processes that map the same file, so large data can be used in place
+    without being copied into the heap. The file must not be modified
+    while it is mapped.
+
+    \sa BinaryInput */
+class MemoryMappedFile : public ReferenceCountedObject {
+public:
+
+    /** Hints to the virtual memory system about how the contents will be read */
+    enum AccessPattern {
+        /** Read ahead moderately */
+        NORMAL,
+
+        /** Read ahead aggressively and release pages soon after they are read */
+        SEQUENTIAL,
+
+        /** Do not read ahead */
+        RANDOM,
+
+        /** Start reading the whole file into the page cache now */
+        WILL_NEED};
+
+protected:
+
+    String              m_filename;
+
+    const uint8*        m_data;
+
+    size_t              m_size;
+
+#   ifdef G3D_WINDOWS
+        HANDLE          m_file;
+        HANDLE          m_mapping;
+#   else
+        int             m_file;
+#   endif
+
+    MemoryMappedFile();
+
+public:
+
+    /** Returns nullptr if \a filename does not exist or cannot be mapped. Zero-length files map successfully to a null data(). */
+    static shared_ptr<MemoryMappedFile> create(const String& filename);
+
+    ~MemoryMappedFile();
+
+    const String& filename() const {
+        return m_filename;
+    }
+
+    /** The contents of the file, aligned to at least the system page size */
+    const uint8* data() const {
+        return m_data;
+    }
+
+    size_t size() const {
+        return m_size;
+    }
+
+    /** Advises the operating system about the access pattern for [offset, offset + length).
+        Has no effect on platforms that do not support the hint. */
+    void advise(AccessPattern pattern, size_t offset = 0, size_t length = size_t(-1)) const;
+};
+
+} // namespace G3D
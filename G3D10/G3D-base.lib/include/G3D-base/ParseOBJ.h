@@ -102,6 +102,12 @@ public:
 
         ParseMTL::Options materialOptions;
 
+        /** If true, inputs larger than a few megabytes are split at line
+            boundaries and the chunks are parsed on multiple threads. The
+            result is identical to parsing on a single thread, so this is
+            not compared by operator==. */
+        bool           parallel = true;
+
         /** The sampler to use with Materials created for this model */
 //        Sampler        sampler;
 
@@ -238,6 +244,19 @@ private:
     void processFace(TextInput& ti);
 
     shared_ptr<ParseMTL::Material> getMaterial(const String& materialName);
+
+    /** Executes the "g" command */
+    void changeGroup(const String& groupName);
+
+    /** Executes the "usemtl" command */
+    void changeMaterial(const String& materialName);
+
+    /** Executes the "mtllib" command */
+    void loadMaterialLibrary(const String& mtlFilename);
+
+    /** The mesh that faces are currently added to, creating the default group,
+        material, and mesh if they have not been specified yet. */
+    const shared_ptr<Mesh>& currentMesh();
     
     /** Consume one character */
     inline void consumeCharacter() {
@@ -265,6 +284,39 @@ private:
 
     enum Command {MTLLIB, GROUP, USEMTL, VERTEX, TEXCOORD, NORMAL, FACE, UNKNOWN};
 
+    /** In parallel mode, a "g", "usemtl", or "mtllib" command from a chunk
+        and the faces that follow it, which are applied in file order after
+        all chunks have been parsed. */
+    class Run {
+    public:
+        /** UNKNOWN for the faces at the start of a chunk, before any command */
+        Command         command = UNKNOWN;
+        String          name;
+        Array<Face>     faceArray;
+    };
+
+    /** When parsing a chunk in parallel mode, commands that depend on the
+        state left by earlier chunks are recorded here instead of executed.
+        nullptr when parsing serially. */
+    Array<Run>*         m_runArray = nullptr;
+
+    /** In parallel mode, relative face indices are resolved against the
+        arrays of the chunk and then offset by this value, so that they can
+        be distinguished and corrected once the sizes of the arrays before
+        the chunk are known. */
+    static const int    CHUNK_RELATIVE_INDEX = -(1 << 30);
+
+    /** True if a face in this chunk used a relative index */
+    bool                m_hasRelativeIndices = false;
+
+    /** Parses commands until the end of the current text */
+    void parseCommands();
+
+    /** Called from parse() for large inputs when Options::parallel is true.
+        Returns false without changing anything if the input cannot be
+        divided into chunks. */
+    bool parseParallel(const char* ptr, size_t len);
+
     /** Returns true for space and tab, but not newline */
     static inline bool isSpace(const char c) {
         return (c == ' ') || (c == '\t');
@@ -335,9 +387,68 @@ private:
     }
     */
 
+    /** Returns the number of leading decimal digits (at most 8) in the 8
+        characters at \a p and stores their values in the corresponding
+        bytes of \a digits, first digit in the lowest byte. The bytes after
+        the digits are undefined.
+
+        Examines all 8 characters at once with arithmetic on a single
+        64-bit word, so the caller must ensure that they are readable. */
+    static int readDigits8(const char* p, uint64& digits) {
+        // Assemble a little-endian word regardless of the machine, which
+        // compilers reduce to a single load on little-endian machines
+        uint64 word = 0;
+        for (int b = 7; b >= 0; --b) {
+            word = (word << 8) | uint64(uint8(p[b]));
+        }
+        digits = word - 0x3030303030303030ULL;
+
+        // The high bit of a byte is set if it is below '0' or above '9'. Borrows and
+        // carries only corrupt the bytes after the first non-digit, which are ignored.
+        const uint64 nonDigit = (digits | (digits + 0x7676767676767676ULL)) & 0x8080808080808080ULL;
+        if (nonDigit == 0) {
+            return 8;
+        }
+#       ifdef _MSC_VER
+            unsigned long bit;
+            _BitScanForward64(&bit, nonDigit);
+            return int(bit) >> 3;
+#       else
+            return __builtin_ctzll(nonDigit) >> 3;
+#       endif
+    }
+
+    /** The integer value of the first \a n digits from readDigits8(), for 0 < n <= 8 */
+    static int digitsValue8(uint64 digits, int n) {
+        debugAssert((n > 0) && (n <= 8));
+        // Shift out the unused bytes, which makes the low bytes leading zeros
+        digits <<= 8 * (8 - n);
+
+        // Combine adjacent pairs of digits, then pairs of pairs, then the two halves
+        digits = (digits * 10) + (digits >> 8);
+        digits = (((digits & 0x000000FF000000FFULL) * (100 + (1000000ULL << 32))) +
+                  (((digits >> 16) & 0x000000FF000000FFULL) * (1 + (10000ULL << 32)))) >> 32;
+        return int(uint32(digits));
+    }
+
     inline int readUnsignedInt() {
         int i = 0;
         debugAssertM(isDigitFast(*nextCharacter), format("Expected a digit and found '%c'", *nextCharacter));
+
+        // Convert up to eight digits without a loop when there is room to read them
+        if (remainingCharacters >= 8) {
+            uint64 digits;
+            const int n = readDigits8(nextCharacter, digits);
+            if (n > 0) {
+                i = digitsValue8(digits, n);
+                nextCharacter       += n;
+                remainingCharacters -= n;
+            }
+            if (n < 8) {
+                return i;
+            }
+        }
+
         while ((remainingCharacters > 0) && isDigitFast(*nextCharacter)) {
             i = i * 10 + (*nextCharacter) - '0';
             --remainingCharacters;
@@ -382,6 +493,21 @@ private:
 
             // Avoid overflowing the integer
             const int MAX_MAGNITUDE = 10000000;
+
+            if (remainingCharacters >= 8) {
+                // Convert the digits that the loop below would, all at once
+                uint64 digits;
+                const int n = min(readDigits8(nextCharacter, digits), 7);
+                if (n > 0) {
+                    i = digitsValue8(digits, n);
+                    for (int d = 0; d < n; ++d) {
+                        magnitude *= 10;
+                    }
+                    nextCharacter       += n;
+                    remainingCharacters -= n;
+                }
+            }
+
             while ((remainingCharacters > 0) && isDigitFast(*nextCharacter) && (magnitude < MAX_MAGNITUDE)) {
                 magnitude *= 10;
                 i = i * 10 + (*nextCharacter) - '0';
@@ -164,6 +164,10 @@ public:
        optimizing System::malloc, and describing how well System::malloc is using
         its internal pooled storage.  "heap" memory was slow to
         allocate; the other data sizes are comparatively fast.
+
+        Also reports, for each thread that has allocated, the fraction of
+        its allocations that were served from its thread-local cache
+        without acquiring the shared pool lock.
      */
     static String mallocStatus();
 
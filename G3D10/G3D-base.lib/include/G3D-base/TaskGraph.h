@@ -0,0 +1,121 @@
+/**
+  \file G3D-base.lib/include/G3D-base/TaskGraph.h
+
+  G3D Innovation Engine http://casual-effects.com/g3d
+  Copyright 2000-2019, Morgan McGuire
+  All rights reserved
+  Available under the BSD License
+*/
+#pragma once
+#define G3D_base_TaskGraph_h
+
+#include "G3D-base/platform.h"
+#include "G3D-base/G3DString.h"
+#include "G3D-base/Array.h"
+#include "G3D-base/enumclass.h"
+#include <atomic>
+#include <functional>
+#include <memory>
+
+namespace G3D {
+
+/**
+   \brief A directed acyclic graph of callbacks that is executed on the
+   TBB worker pool, running each task as soon as all of its
+   prerequisites have completed.
+
+   Tasks with Affinity::CALLING_THREAD are always executed by the
+   thread that invoked run(). Use that for anything that touches
+   OpenGL, the GUI, or other state that is not threadsafe. All other
+   tasks may run on any worker thread concurrently with each other.
+
+   The graph may be reused: clear() releases the tasks but retains the
+   underlying storage, so rebuilding the same graph every frame does
+   not allocate in steady state.
+
+   Task callbacks must not throw exceptions.
+
+   \code
+   TaskGraph graph;
+   const TaskGraph::TaskID a = graph.add("load", [&]() { load(); });
+   const TaskGraph::TaskID b = graph.add("parse", [&]() { parse(); }, TaskGraph::Affinity::ANY_THREAD, {a});
+   graph.add("upload", [&]() { upload(); }, TaskGraph::Affinity::CALLING_THREAD, {b});
+   graph.run();
+   \endcode
+
+   \sa runConcurrently, GApp::onBuildFrameTaskGraph
+*/
+class TaskGraph {
+public:
+
+    typedef int TaskID;
+
+    G3D_DECLARE_ENUM_CLASS(Affinity,
+        /** The task may run on any TBB worker thread */
+        ANY_THREAD,
+
+        /** The task runs on the thread that invoked TaskGraph::run() */
+        CALLING_THREAD);
+
+private:
+
+    class Task {
+    public:
+        String                      name;
+        std::function<void ()>      callback;
+        Affinity                    affinity;
+
+        /** Tasks that may not begin until this one has completed */
+        Array<TaskID>               successors;
+
+        /** Number of tasks that must complete before this one begins */
+        int                         numPrerequisites = 0;
+    };
+
+    Array<Task>                     m_task;
+
+    /** Outstanding prerequisite counts during run(), indexed by TaskID */
+    std::unique_ptr<std::atomic<int>[]> m_remaining;
+    int                             m_remainingCapacity = 0;
+
+    /** Returns false if the graph contains a cycle */
+    bool isAcyclic() const;
+
+    void runSerial();
+
+public:
+
+    /** Appends a task and returns its ID. \a prerequisites must be IDs
+        previously returned by add() on this graph. */
+    TaskID add
+       (const String&                   name,
+        const std::function<void ()>&   callback,
+        Affinity                        affinity = Affinity::ANY_THREAD,
+        const Array<TaskID>&            prerequisites = Array<TaskID>());
+
+    /** Requires that \a prerequisite completes before \a dependent begins.
+        Allows tasks to be inserted between tasks that were added earlier. */
+    void addDependency(TaskID prerequisite, TaskID dependent);
+
+    /** Returns the ID of the first task with this name, or -1 if there is none. */
+    TaskID find(const String& name) const;
+
+    const String& name(TaskID id) const {
+        return m_task[id].name;
+    }
+
+    int size() const {
+        return m_task.size();
+    }
+
+    /** Removes all tasks, retaining allocated storage for reuse */
+    void clear();
+
+    /** Executes every task and blocks until all have completed.
+
+        \param singleThread If true, run all tasks on the calling
+        thread in a valid topological order. Helpful when debugging. */
+    void run(bool singleThread = false);
+};
+
+} // namespace G3D
@@ -15,9 +15,14 @@
 #include "G3D-base/SpawnBehavior.h"
 #include "G3D-base/Vector2int32.h"
 #include "G3D-base/Vector3int32.h"
+#include "G3D-base/G3DGameUnits.h"
+#include <algorithm>
 #include <atomic>
+#include <chrono>
+#include <climits>
 #include <functional>
 #include <thread>
+#include <vector>
 
 #ifndef G3D_WINDOWS
 #   include <unistd.h> // For usleep
@@ -64,35 +69,443 @@ public:
 };
 
 
+/** \brief Statistics describing how one runConcurrently call was scheduled.
+    \sa RunConcurrentlyOptions */
+class RunConcurrentlyStats {
+public:
+    /** Number of times that the callback was invoked */
+    int         numElements = 0;
+
+    /** Edge length of the tiles for 2D and 3D domains; elements per tile for 1D domains */
+    int         tileSize = 0;
+
+    /** Number of independent units of work */
+    int         numTiles = 0;
+
+    /** Number of distinct threads that executed at least one tile */
+    int         numThreads = 0;
+
+    /** Largest number of tiles executed by any single thread. Compare to numTiles / numThreads
+        to detect load imbalance. */
+    int         maxTilesPerThread = 0;
+
+    /** Wall-clock duration of the whole call, in seconds */
+    RealTime    elapsedTime = 0;
+};
+
+
+/** \brief Controls how runConcurrently divides its domain between threads.
+    \sa RunConcurrentlyStats */
+class RunConcurrentlyOptions {
+public:
+    /** For 2D and 3D domains, the edge length of the square or cubic
+        tiles that are each processed by a single thread. For 1D domains,
+        the number of consecutive elements per tile.
+
+        If zero, a default is chosen and then reduced for small domains
+        until there are several tiles per worker thread. */
+    int                     tileSize = 0;
+
+    /** If true, 2D and 3D tiles are scheduled in Morton (Z-curve) order.
+        TBB hands each thread runs of consecutive tiles, so this keeps each
+        thread's working set spatially compact instead of spanning whole rows. */
+    bool                    mortonOrder = false;
+
+    /** If true, run every element on the calling thread in row-major order. Helpful when debugging. */
+    bool                    singleThread = false;
+
+    /** If not null, overwritten with scheduling statistics when runConcurrently returns */
+    RunConcurrentlyStats*   stats = nullptr;
+};
+
+
+namespace _internal {
+
+/** Spreads the low 16 bits of \a x to the even bits of the result */
+inline uint32 mortonSpread2(uint32 x) {
+    x &= 0x0000ffff;
+    x = (x | (x << 8)) & 0x00ff00ff;
+    x = (x | (x << 4)) & 0x0f0f0f0f;
+    x = (x | (x << 2)) & 0x33333333;
+    x = (x | (x << 1)) & 0x55555555;
+    return x;
+}
+
+/** Inverse of mortonSpread2 */
+inline uint32 mortonCompact2(uint32 x) {
+    x &= 0x55555555;
+    x = (x | (x >> 1)) & 0x33333333;
+    x = (x | (x >> 2)) & 0x0f0f0f0f;
+    x = (x | (x >> 4)) & 0x00ff00ff;
+    x = (x | (x >> 8)) & 0x0000ffff;
+    return x;
+}
+
+/** Spreads the low 10 bits of \a x to every third bit of the result */
+inline uint32 mortonSpread3(uint32 x) {
+    x &= 0x000003ff;
+    x = (x | (x << 16)) & 0x030000ff;
+    x = (x | (x <<  8)) & 0x0300f00f;
+    x = (x | (x <<  4)) & 0x030c30c3;
+    x = (x | (x <<  2)) & 0x09249249;
+    return x;
+}
+
+/** Inverse of mortonSpread3 */
+inline uint32 mortonCompact3(uint32 x) {
+    x &= 0x09249249;
+    x = (x | (x >>  2)) & 0x030c30c3;
+    x = (x | (x >>  4)) & 0x0300f00f;
+    x = (x | (x >>  8)) & 0x030000ff;
+    x = (x | (x >> 16)) & 0x000003ff;
+    return x;
+}
+
+/** Returns \a preferred, halved until there are at least a few tiles per worker
+    thread or it reaches 1, for a domain that is \a numTiles(tileSize) tiles. */
+template<class NumTilesFn>
+int adaptTileSize(int preferred, const NumTilesFn& numTiles) {
+    const int targetTiles = 4 * tbb::this_task_arena::max_concurrency();
+    int tileSize = preferred;
+    while ((tileSize > 1) && (numTiles(tileSize) < targetTiles)) {
+        tileSize /= 2;
+    }
+    return tileSize;
+}
+
+/** Invokes \a runTile(t) for every 0 <= t < numTiles using the TBB worker pool */
+template<class TileFn>
+void runTilesUntimed(int numTiles, const TileFn& runTile) {
+    if (numTiles == 1) {
+        runTile(0);
+    } else {
+        tbb::parallel_for(tbb::blocked_range<int>(0, numTiles, 1), [&](const tbb::blocked_range<int>& block) {
+            for (int t = block.begin(); t < block.end(); ++t) {
+                runTile(t);
+            }
+        });
+    }
+}
+
+/** Invokes \a runTile(t) for every 0 <= t < numTiles using the TBB worker pool and
+    fills options.stats if it is not null */
+template<class TileFn>
+void runTiles(int numTiles, int tileSize, int numElements, const RunConcurrentlyOptions& options, const TileFn& runTile) {
+    RunConcurrentlyStats* stats = options.stats;
+    if (stats == nullptr) {
+        runTilesUntimed(numTiles, runTile);
+        return;
+    }
+
+    tbb::enumerable_thread_specific<int> tilesPerThread(0);
+    const std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+    runTilesUntimed(numTiles, [&](int t) {
+        ++tilesPerThread.local();
+        runTile(t);
+    });
+    stats->elapsedTime = std::chrono::duration<RealTime>(std::chrono::steady_clock::now() - startTime).count();
+
+    stats->numElements = numElements;
+    stats->tileSize = tileSize;
+    stats->numTiles = numTiles;
+    stats->numThreads = 0;
+    stats->maxTilesPerThread = 0;
+    for (const int n : tilesPerThread) {
+        ++stats->numThreads;
+        stats->maxTilesPerThread = (n > stats->maxTilesPerThread) ? n : stats->maxTilesPerThread;
+    }
+}
+
+/** Runs \a body on the calling thread and fills options.stats if it is not null */
+template<class Body>
+void runSingleThread(int numElements, const RunConcurrentlyOptions& options, const Body& body) {
+    RunConcurrentlyStats* stats = options.stats;
+    const std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+    body();
+    if (stats != nullptr) {
+        stats->elapsedTime = std::chrono::duration<RealTime>(std::chrono::steady_clock::now() - startTime).count();
+        stats->numElements = numElements;
+        stats->tileSize = numElements;
+        stats->numTiles = (numElements > 0) ? 1 : 0;
+        stats->numThreads = stats->numTiles;
+        stats->maxTilesPerThread = stats->numTiles;
+    }
+}
+
+} // namespace _internal
+
+
 /** 
     \brief Iterates over a 3D region using multiple threads and
-    blocks until all threads have completed. Has highest coherence
-    per thread in x, and then in blocks of y.
+    blocks until all threads have completed.
         
-    <p> Evaluates \a
-    object->\a method(\a x, \a y) for every <code>start.x <= x <
-    upTo.x</code> and <code>start.y <= y < upTo.y</code>.
-    Iteration is row major, so each thread can expect to see
-    successive x values.  </p> 
+    Evaluates \a callback(\a P) for every <code>start <= P < stopBefore</code>.
+    The region is divided into cubic tiles (see RunConcurrentlyOptions::tileSize)
+    and each tile is processed by one thread in row-major order.
 
-    \param singleThread If true, force all computation to run on the
-    calling thread. Helpful when debugging
+    Any callable object may be passed as \a callback. The templated
+    overloads inline it into the loop over each tile, so a lambda does
+    not pay for an indirect call per element the way a std::function does.
 
     Example:
 
     \code
     class RayTracer {
     public:
-        void trace(const Vector2int32& pixel) {
+        void trace(const Point2int32& pixel) {
             ...
         }
 
         void traceAll() {
-            Thread::runConcurrently(Point2int32(0,0), Point2int32(w,h), [this](pixel) { trace(pixel); );
+            runConcurrently(Point2int32(0, 0), Point2int32(w, h), [this](Point2int32 pixel) { trace(pixel); });
         }
     };
     \endcode
+
+    \sa RunConcurrentlyOptions, TaskGraph
 */
+template<class Fn>
+void runConcurrently
+   (const Point3int32&              start, 
+    const Point3int32&              stopBefore, 
+    const Fn&                       callback,
+    const RunConcurrentlyOptions&   options) {
+
+    const Point3int32 extent = stopBefore - start;
+    if ((extent.x <= 0) || (extent.y <= 0) || (extent.z <= 0)) {
+        _internal::runSingleThread(0, options, [] {});
+        return;
+    }
+    const int numElements = extent.x * extent.y * extent.z;
+
+    if (options.singleThread) {
+        _internal::runSingleThread(numElements, options, [&] {
+            for (Point3int32 coord(start); coord.z < stopBefore.z; ++coord.z) {
+                for (coord.y = start.y; coord.y < stopBefore.y; ++coord.y) {
+                    for (coord.x = start.x; coord.x < stopBefore.x; ++coord.x) {
+                        callback(coord);
+                    }
+                }
+            }
+        });
+        return;
+    }
+
+    const auto tileCount = [&](int s) {
+        return Point3int32((extent.x + s - 1) / s, (extent.y + s - 1) / s, (extent.z + s - 1) / s);
+    };
+    const int tileSize = (options.tileSize > 0) ? options.tileSize :
+        _internal::adaptTileSize(8, [&](int s) { const Point3int32 n = tileCount(s); return n.x * n.y * n.z; });
+    const Point3int32 numTiles = tileCount(tileSize);
+    const int totalTiles = numTiles.x * numTiles.y * numTiles.z;
+
+    // Morton codes of the tiles in increasing order. Limited to 1024 tiles per axis.
+    std::vector<uint32> mortonCode;
+    if (options.mortonOrder && (totalTiles > 1) && (numTiles.x <= 1024) && (numTiles.y <= 1024) && (numTiles.z <= 1024)) {
+        mortonCode.reserve(totalTiles);
+        for (int z = 0; z < numTiles.z; ++z) {
+            for (int y = 0; y < numTiles.y; ++y) {
+                for (int x = 0; x < numTiles.x; ++x) {
+                    mortonCode.push_back(_internal::mortonSpread3(x) | (_internal::mortonSpread3(y) << 1) | (_internal::mortonSpread3(z) << 2));
+                }
+            }
+        }
+        std::sort(mortonCode.begin(), mortonCode.end());
+    }
+
+    _internal::runTiles(totalTiles, tileSize, numElements, options, [&](int t) {
+        Point3int32 tile;
+        if (mortonCode.empty()) {
+            tile = Point3int32(t % numTiles.x, (t / numTiles.x) % numTiles.y, t / (numTiles.x * numTiles.y));
+        } else {
+            const uint32 code = mortonCode[t];
+            tile = Point3int32(_internal::mortonCompact3(code), _internal::mortonCompact3(code >> 1), _internal::mortonCompact3(code >> 2));
+        }
+
+        const Point3int32 lo = start + tile * tileSize;
+        const Point3int32 hi(min(lo.x + tileSize, stopBefore.x), min(lo.y + tileSize, stopBefore.y), min(lo.z + tileSize, stopBefore.z));
+        for (Point3int32 coord(lo); coord.z < hi.z; ++coord.z) {
+            for (coord.y = lo.y; coord.y < hi.y; ++coord.y) {
+                for (coord.x = lo.x; coord.x < hi.x; ++coord.x) {
+                    callback(coord);
+                }
+            }
+        }
+    });
+}
+
+
+/** \copydoc runConcurrently(const Point3int32&, const Point3int32&, const Fn&, const RunConcurrentlyOptions&) */
+template<class Fn>
+void runConcurrently
+   (const Point2int32&              start,
+    const Point2int32&              stopBefore, 
+    const Fn&                       callback,
+    const RunConcurrentlyOptions&   options) {
+
+    const Point2int32 extent = stopBefore - start;
+    if ((extent.x <= 0) || (extent.y <= 0)) {
+        _internal::runSingleThread(0, options, [] {});
+        return;
+    }
+    const int numElements = extent.x * extent.y;
+
+    if (options.singleThread) {
+        _internal::runSingleThread(numElements, options, [&] {
+            for (Point2int32 coord(start); coord.y < stopBefore.y; ++coord.y) {
+                for (coord.x = start.x; coord.x < stopBefore.x; ++coord.x) {
+                    callback(coord);
+                }
+            }
+        });
+        return;
+    }
+
+    const auto tileCount = [&](int s) {
+        return Point2int32((extent.x + s - 1) / s, (extent.y + s - 1) / s);
+    };
+    const int tileSize = (options.tileSize > 0) ? options.tileSize :
+        _internal::adaptTileSize(16, [&](int s) { const Point2int32 n = tileCount(s); return n.x * n.y; });
+    const Point2int32 numTiles = tileCount(tileSize);
+    const int totalTiles = numTiles.x * numTiles.y;
+
+    // Morton codes of the tiles in increasing order
+    std::vector<uint32> mortonCode;
+    if (options.mortonOrder && (totalTiles > 1) && (numTiles.x <= 0x10000) && (numTiles.y <= 0x10000)) {
+        mortonCode.reserve(totalTiles);
+        for (int y = 0; y < numTiles.y; ++y) {
+            for (int x = 0; x < numTiles.x; ++x) {
+                mortonCode.push_back(_internal::mortonSpread2(x) | (_internal::mortonSpread2(y) << 1));
+            }
+        }
+        std::sort(mortonCode.begin(), mortonCode.end());
+    }
+
+    _internal::runTiles(totalTiles, tileSize, numElements, options, [&](int t) {
+        Point2int32 tile;
+        if (mortonCode.empty()) {
+            tile = Point2int32(t % numTiles.x, t / numTiles.x);
+        } else {
+            const uint32 code = mortonCode[t];
+            tile = Point2int32(_internal::mortonCompact2(code), _internal::mortonCompact2(code >> 1));
+        }
+
+        const Point2int32 lo = start + tile * tileSize;
+        const Point2int32 hi(min(lo.x + tileSize, stopBefore.x), min(lo.y + tileSize, stopBefore.y));
+        for (Point2int32 coord(lo); coord.y < hi.y; ++coord.y) {
+            for (coord.x = lo.x; coord.x < hi.x; ++coord.x) {
+                callback(coord);
+            }
+        }
+    });
+}
+
+
+/** Evaluates \a callback(i) for every <code>start <= i < stopBefore</code>,
+    in tiles of consecutive elements.
+    \sa runConcurrently(const Point3int32&, const Point3int32&, const Fn&, const RunConcurrentlyOptions&) */
+template<class Fn>
+void runConcurrently
+   (const size_t&                   start, 
+    const size_t&                   stopBefore, 
+    const Fn&                       callback,
+    const RunConcurrentlyOptions&   options) {
+
+    const size_t extent = (stopBefore > start) ? (stopBefore - start) : 0;
+    const int numElements = int(std::min(extent, size_t(INT_MAX)));
+
+    if (options.singleThread || (extent == 0)) {
+        _internal::runSingleThread(numElements, options, [&] {
+            for (size_t i = start; i < stopBefore; ++i) {
+                callback(i);
+            }
+        });
+        return;
+    }
+
+    // Below this size, each element is its own tile
+    const size_t ELEMENTS_PER_TILE = 32;
+    size_t tileSize = (options.tileSize > 0) ? size_t(options.tileSize) : ((extent > ELEMENTS_PER_TILE) ? ELEMENTS_PER_TILE : 1);
+    // Keep the tile count representable
+    tileSize = std::max(tileSize, (extent + INT_MAX - 1) / size_t(INT_MAX));
+    const int numTiles = int((extent + tileSize - 1) / tileSize);
+
+    _internal::runTiles(numTiles, int(std::min(tileSize, size_t(INT_MAX))), numElements, options, [&](int t) {
+        const size_t lo = start + size_t(t) * tileSize;
+        const size_t hi = std::min(lo + tileSize, stopBefore);
+        for (size_t i = lo; i < hi; ++i) {
+            callback(i);
+        }
+    });
+}
+
+
+/** \copydoc runConcurrently(const size_t&, const size_t&, const Fn&, const RunConcurrentlyOptions&) */
+template<class Fn>
+void runConcurrently
+   (const int&                      start, 
+    const int&                      stopBefore, 
+    const Fn&                       callback,
+    const RunConcurrentlyOptions&   options) {
+
+    if (stopBefore <= start) {
+        _internal::runSingleThread(0, options, [] {});
+        return;
+    }
+    runConcurrently(size_t(0), size_t(stopBefore - start), [&](size_t i) { callback(int(i) + start); }, options);
+}
+
+
+/** \copydoc runConcurrently(const Point3int32&, const Point3int32&, const Fn&, const RunConcurrentlyOptions&)
+    \param singleThread If true, force all computation to run on the
+    calling thread. Helpful when debugging */
+template<class Fn>
+void runConcurrently
+   (const Point3int32&  start, 
+    const Point3int32&  stopBefore, 
+    const Fn&           callback,
+    bool                singleThread = false) {
+    RunConcurrentlyOptions options;
+    options.singleThread = singleThread;
+    runConcurrently(start, stopBefore, callback, options);
+}
+
+template<class Fn>
+void runConcurrently
+   (const Point2int32&  start,
+    const Point2int32&  stopBefore, 
+    const Fn&           callback,
+    bool                singleThread = false) {
+    RunConcurrentlyOptions options;
+    options.singleThread = singleThread;
+    runConcurrently(start, stopBefore, callback, options);
+}
+
+template<class Fn>
+void runConcurrently
+   (const int&          start, 
+    const int&          stopBefore, 
+    const Fn&           callback,
+    bool                singleThread = false) {
+    RunConcurrentlyOptions options;
+    options.singleThread = singleThread;
+    runConcurrently(start, stopBefore, callback, options);
+}
+
+template<class Fn>
+void runConcurrently
+   (const size_t&       start, 
+    const size_t&       stopBefore, 
+    const Fn&           callback,
+    bool                singleThread = false) {
+    RunConcurrentlyOptions options;
+    options.singleThread = singleThread;
+    runConcurrently(start, stopBefore, callback, options);
+}
+
+
+/** Non-template overloads for callers that already hold a std::function.
+    They use the same tiled scheduling as the templates. */
 void runConcurrently
    (const Point3int32& start, 
     const Point3int32& stopBefore, 
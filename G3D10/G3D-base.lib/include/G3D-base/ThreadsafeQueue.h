@@ -12,67 +12,196 @@
 #include "G3D-base/platform.h"
 #include "G3D-base/Thread.h"
 #include "G3D-base/Queue.h"
+#include "G3D-base/BoundedQueue.h"
+#include "G3D-base/G3DGameUnits.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
 
 namespace G3D {
 
-/** A queue whose methods are synchronized with respect to each other.
-    \sa Queue, Spinlock */
-template<class T>
+/** \brief A FIFO queue whose methods may be invoked concurrently from multiple threads.
+
+    pushBack() and popFront() are lock-free as long as the lock-free
+    ring holding the first capacity() elements has room. pushBack()
+    never blocks: when the ring is full it appends to a mutex-protected
+    overflow Queue, which consumers drain once the ring is empty.
+    waitPopFront() sleeps until a producer pushes. Neither busy-waits.
+
+    Use pushBackBlocking() instead for back-pressure, i.e., to sleep
+    while size() >= capacity() until a consumer makes room. A thread
+    that calls it on a full queue that only it drains will deadlock.
+
+    Values pushed by one thread are popped in the order that they were
+    pushed.
+
+    \param Ring The underlying lock-free storage. Use SPSCQueue<T> when
+    there is exactly one producer thread and one consumer thread.
+
+    \sa Queue, MPMCQueue, SPSCQueue */
+template<class T, class Ring = MPMCQueue<T>>
 class ThreadsafeQueue {
 private:
-    mutable Spinlock    m_mutex;
-    Queue<T>            m_data;
+    Ring                        m_data;
+
+    /** Elements pushed by pushBack() while m_data was full. Whenever this is
+        non-empty, pushes append here so that they stay behind older elements. */
+    Queue<T>                    m_overflow;
+    std::mutex                  m_overflowMutex;
+    std::atomic<int>            m_overflowSize;
+
+    /** Only acquired by threads that are about to sleep and by threads that wake them */
+    std::mutex                  m_waitMutex;
+    std::condition_variable     m_notEmpty;
+    std::condition_variable     m_notFull;
+    std::atomic<int>            m_numWaitingConsumers;
+    std::atomic<int>            m_numWaitingProducers;
+
+    void notify(const std::atomic<int>& numWaiting, std::condition_variable& condition) {
+        // Pairs with the increment of numWaiting in the sleeping thread, so that
+        // either it sees our change to m_data or we see that it is waiting
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (numWaiting.load(std::memory_order_relaxed) > 0) {
+            std::lock_guard<std::mutex> lock(m_waitMutex);
+            condition.notify_all();
+        }
+    }
+
+    /** The Ring only moves from \a v when the push succeeds, so it is safe to retry */
+    template<class V>
+    bool tryPushImpl(V&& v) {
+        return (m_overflowSize.load(std::memory_order_acquire) == 0) && m_data.tryPushBack(std::forward<V>(v));
+    }
+
+    template<class V>
+    void pushImpl(V&& v) {
+        if (! tryPushImpl(std::forward<V>(v))) {
+            std::lock_guard<std::mutex> lock(m_overflowMutex);
+            m_overflow.pushBack(v);
+            m_overflowSize.store(m_overflow.size(), std::memory_order_release);
+        }
+        notify(m_numWaitingConsumers, m_notEmpty);
+    }
+
+    template<class V>
+    void pushBlockingImpl(V&& v) {
+        if (! tryPushImpl(std::forward<V>(v))) {
+            std::unique_lock<std::mutex> lock(m_waitMutex);
+            ++m_numWaitingProducers;
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            m_notFull.wait(lock, [&] { return tryPushImpl(std::forward<V>(v)); });
+            --m_numWaitingProducers;
+        }
+        notify(m_numWaitingConsumers, m_notEmpty);
+    }
+
+    /** Nothing enters the ring while the overflow is non-empty, so the ring's
+        elements are older and are popped first */
+    bool tryPopImpl(T& v) {
+        if (m_data.popFront(v)) {
+            return true;
+        } else if (m_overflowSize.load(std::memory_order_acquire) > 0) {
+            std::lock_guard<std::mutex> lock(m_overflowMutex);
+            if (m_overflow.size() > 0) {
+                v = m_overflow.popFront();
+                m_overflowSize.store(m_overflow.size(), std::memory_order_release);
+                return true;
+            }
+        }
+        return false;
+    }
 
 public:
 
+    explicit ThreadsafeQueue(int capacity = 1024) : m_data(capacity), m_overflowSize(0), m_numWaitingConsumers(0), m_numWaitingProducers(0) {}
+
+    /** The number of elements that fit before pushBack() falls back to locking
+        and pushBackBlocking() blocks */
+    int capacity() const {
+        return m_data.capacity();
+    }
+
+    /** Removes all elements. Elements pushed concurrently may remain. */
     void clear() {
-        m_mutex.lock();
+        {
+            std::lock_guard<std::mutex> lock(m_overflowMutex);
+            m_overflow.clear();
+            m_overflowSize.store(0, std::memory_order_release);
+        }
         m_data.clear();
-        m_mutex.unlock();
+        notify(m_numWaitingProducers, m_notFull);
     }
 
+    /** Never blocks. Acquires a lock if the queue is already at capacity(). */
     void pushBack(const T& v) {
-        m_mutex.lock();
-        m_data.pushBack(v);
-        m_mutex.unlock();
+        pushImpl(v);
+    }
+
+    /** Never blocks. Acquires a lock if the queue is already at capacity(). */
+    void pushBack(T&& v) {
+        pushImpl(std::move(v));
+    }
+
+    /** Sleeps while the queue is at capacity() */
+    void pushBackBlocking(const T& v) {
+        pushBlockingImpl(v);
     }
 
-    void pushFront(const T& v) {
-        m_mutex.lock();
-        m_data.pushFront(v);
-        m_mutex.unlock();
+    /** Sleeps while the queue is at capacity() */
+    void pushBackBlocking(T&& v) {
+        pushBlockingImpl(std::move(v));
     }
 
-    /** Returns true if v was actually read */
+    /** Returns false without blocking if the queue is at capacity() */
+    bool tryPushBack(const T& v) {
+        if (tryPushImpl(v)) {
+            notify(m_numWaitingConsumers, m_notEmpty);
+            return true;
+        } else {
+            return false;
+        }
+    }
+
+    /** Returns true if v was actually read. Never blocks. */
     bool popFront(T& v) {
-        bool read = false;
-        m_mutex.lock();
-        if (m_data.size() > 0) {
-            v = m_data.popFront();
-            read = true;
+        if (tryPopImpl(v)) {
+            notify(m_numWaitingProducers, m_notFull);
+            return true;
+        } else {
+            return false;
         }
-        m_mutex.unlock();
-        return read;
     }
 
-    /** Returns true if v was actually read */
-    bool popBack(T& v) {
+    /** Sleeps until an element is available or \a timeout seconds elapse.
+        Returns true if v was actually read. */
+    bool waitPopFront(T& v, RealTime timeout = finf()) {
+        if (popFront(v)) { return true; }
+
         bool read = false;
-        m_mutex.lock();
-        if (m_data.size() > 0) {
-            v = m_data.popBack();
-            read = true;
+        {
+            std::unique_lock<std::mutex> lock(m_waitMutex);
+            ++m_numWaitingConsumers;
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            const auto predicate = [&] { return tryPopImpl(v); };
+            if (timeout >= finf()) {
+                m_notEmpty.wait(lock, predicate);
+                read = true;
+            } else {
+                read = m_notEmpty.wait_for(lock, std::chrono::duration<double>(timeout), predicate);
+            }
+            --m_numWaitingConsumers;
+        }
+
+        if (read) {
+            notify(m_numWaitingProducers, m_notFull);
         }
-        m_mutex.unlock();
         return read;
     }
 
     /** Note that by the time the method has returned, the value may be incorrect. */
     int size() const {
-        m_mutex.lock();
-        int i = m_data.size();
-        m_mutex.unlock();
-        return i;
+        return m_data.size() + m_overflowSize.load(std::memory_order_acquire);
     }
 
     bool empty() const {
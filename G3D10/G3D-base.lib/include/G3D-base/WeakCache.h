@@ -11,6 +11,7 @@
 
 #include "G3D-base/ReferenceCount.h"
 #include "G3D-base/Table.h"
+#include <mutex>
 
 namespace G3D {
 
@@ -26,6 +27,9 @@ namespace G3D {
    There are no "contains" or "iterate" methods because elements can be
    flushed from the cache at any time if they are garbage collected.
 
+   All methods are threadsafe. Two threads that miss on the same key at the
+   same time will both compute the value, and the later set() wins.
+
    Example:
    <pre>
       WeakCache<String, shared_ptr<Texture>> textureCache;
@@ -52,30 +56,40 @@ private:
 
     Table<Key, ValueWeakRef> table;
 
+    /** Protects table */
+    std::mutex               m_mutex;
+
+    /** Assumes that m_mutex is held */
+    ValueRef lookup(const Key& k) {
+        ValueWeakRef* w = table.getPointer(k);
+        if (isNull(w)) {
+            return nullptr;
+        }
+
+        const ValueRef& s = w->lock();
+        if (! s) {
+            // This object has been collected; clean out its key
+            table.remove(k);
+        }
+        return s;
+    }
+
 public:
     /**
        Returns nullptr if the object is not in the cache
     */
     ValueRef operator[](const Key& k) {
-        if (table.containsKey(k)) {
-            ValueWeakRef w = table[k];
-            const ValueRef& s = w.lock();
-            if (! s) {
-                // This object has been collected; clean out its key
-                table.remove(k);
-            }
-            return s;
-        } else {
-            return nullptr;
-        }
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return lookup(k);
     }
 
     
     void getValues(Array<ValueRef>& values) {
+        std::lock_guard<std::mutex> lock(m_mutex);
         Array<Key> keys;
         table.getKeys(keys);
         for (int i = 0; i < keys.size(); ++i) {
-            const ValueRef& value = (*this)[keys[i]];
+            const ValueRef& value = lookup(keys[i]);
             if (notNull(value)) {
                 values.append(value);
             }
@@ -83,18 +97,19 @@ public:
     }
 
     void clear() {
+        std::lock_guard<std::mutex> lock(m_mutex);
         table.clear();
     }
 
     void set(const Key& k, const ValueRef& v) {
+        std::lock_guard<std::mutex> lock(m_mutex);
         table.set(k, v);
     }
 
     /** Removes k from the cache or does nothing if it is not currently in the cache.*/
     void remove(const Key& k) {
-        if (table.containsKey(k)) {
-            table.remove(k);
-        }
+        std::lock_guard<std::mutex> lock(m_mutex);
+        table.remove(k);
     }
 };
 
@@ -0,0 +1,138 @@
+/**
+  \file G3D-base.lib/include/G3D-base/ZipArchive.h
+
+  G3D Innovation Engine http://casual-effects.com/g3d
+  Copyright 2000-2019, Morgan McGuire
+  All rights reserved
+  Available under the BSD License
+*/
+#pragma once
+#define G3D_base_ZipArchive_h
+
+#include "G3D-base/platform.h"
+#include "G3D-base/ReferenceCount.h"
+#include "G3D-base/G3DString.h"
+#include "G3D-base/Array.h"
+#include "G3D-base/Table.h"
+#include "G3D-base/MemoryMappedFile.h"
+#include <mutex>
+
+struct zip;
+
+namespace G3D {
+
+/** \brief An open zipfile with an index of its central directory.
+
+    FileSystem, BinaryInput, and readWholeFile share one ZipArchive per
+    zipfile through open(), so the archive is validated and indexed once
+    instead of on every query or read. An archive that changes on disk is
+    reopened by the next open().
+
+    All methods are threadsafe. Reads of entries by different threads use
+    separate libzip handles and decompress concurrently.
+
+    Entries that are stored without compression or encryption are also
+    readable in place from a memory mapping of the archive.
+
+    \sa FileSystem, BinaryInput */
+class ZipArchive : public ReferenceCountedObject {
+public:
+
+    class Entry {
+    public:
+        /** Full path inside the archive */
+        String          name;
+
+        /** Index in the archive's central directory */
+        int64           index = 0;
+
+        /** Uncompressed size in bytes */
+        int64           size = 0;
+
+        bool            encrypted = false;
+
+        /** Offset of the contents from the start of the archive if the entry is
+            stored without compression or encryption and the archive is mapped, otherwise -1 */
+        int64           storedOffset = -1;
+    };
+
+protected:
+
+    String                          m_filename;
+
+    /** Size and modification time of the file when it was opened, used to detect changes */
+    int64                           m_fileSize;
+    int64                           m_fileTime;
+
+    Array<Entry>                    m_entryArray;
+
+    /** Lower-case name to index in m_entryArray. Matches libzip's ZIP_FL_NOCASE lookup. */
+    Table<String, int>              m_entryTable;
+
+    /** May be null if the archive could not be mapped */
+    shared_ptr<MemoryMappedFile>    m_mappedFile;
+
+    /** Protects m_handlePool */
+    mutable std::mutex              m_handleMutex;
+
+    /** Open libzip handles that no thread is currently using. A libzip handle
+        cannot be shared between threads, so the pool grows to the number of
+        concurrent readers. */
+    mutable Array<struct zip*>      m_handlePool;
+
+    ZipArchive();
+
+    /** Fills m_entryArray and m_entryTable from \a z */
+    void buildIndex(struct zip* z);
+
+    /** Sets Entry::storedOffset by parsing the central directory from the mapping.
+        \param rawNameArray The undecoded name of each entry, for matching records to entries */
+    void findStoredEntries(const Array<String>& rawNameArray);
+
+    struct zip* acquireHandle() const;
+
+    void releaseHandle(struct zip* z) const;
+
+    /** Reads the size and modification time of \a filename. Returns false if it does not exist. */
+    static bool statFile(const String& filename, int64& size, int64& time);
+
+public:
+
+    /** Returns the shared ZipArchive for \a filename, opening and indexing it on first use.
+        Returns nullptr if \a filename is not a readable zipfile. */
+    static shared_ptr<ZipArchive> open(const String& filename);
+
+    /** Releases the shared archives. Callers that still hold one may continue to use it. */
+    static void clearCache();
+
+    ~ZipArchive();
+
+    const String& filename() const {
+        return m_filename;
+    }
+
+    const Array<Entry>& entryArray() const {
+        return m_entryArray;
+    }
+
+    /** Case-insensitive lookup of \a name. Returns nullptr if there is no such entry. */
+    const Entry* find(const String& name) const;
+
+    /** Decompresses \a entry into \a dst, which must have room for entry.size bytes.
+        Uses the password registered with FileSystem::registerPasswordProtectedZip, if any.
+        Throws a String if the entry cannot be read. */
+    void read(const Entry& entry, void* dst) const;
+
+    /** The contents of \a entry inside mappedFile() if it is stored without
+        compression or encryption, otherwise nullptr. */
+    const uint8* storedData(const Entry& entry) const {
+        return (entry.storedOffset >= 0) ? m_mappedFile->data() + entry.storedOffset : nullptr;
+    }
+
+    /** The whole archive, mapped read-only. May be null. */
+    const shared_ptr<MemoryMappedFile>& mappedFile() const {
+        return m_mappedFile;
+    }
+};
+
+} // namespace G3D
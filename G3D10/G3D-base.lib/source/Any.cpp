@@ -15,6 +15,7 @@
 #include "G3D-base/stringutils.h"
 #include "G3D-base/fileutils.h"
 #include "G3D-base/FileSystem.h"
+#include <climits>
 #include <deque>
 #include <iostream>
 
@@ -32,18 +33,300 @@ static bool isContainerType(Any::Type& t) {
     return (t == Any::ARRAY) || (t == Any::TABLE) || (t == Any::EMPTY_CONTAINER);
 }
 
+const char* Any::BINARY_EXTENSION = ".Any.bin";
+
+/** Begins files written by Any::save() in binary */
+static const char BINARY_MAGIC[8] = {'G', '3', 'D', 'A', 'n', 'y', 'B', '\0'};
+
+/** Type code in serializeBinary() for an ARRAY whose elements are all plain numbers */
+static const uint8 BINARY_NUMBER_ARRAY = 7;
+
+/** Flag on the type code in serializeBinary() when the value has a Data record */
+static const uint8 BINARY_HAS_DATA = 0x80;
+
+/** Version 1 was the unparsed text */
+static const int BINARY_VERSION = 2;
+
+
+static void writeVarUInt(BinaryOutput& b, uint32 x) {
+    while (x >= 0x80) {
+        b.writeUInt8(uint8(x | 0x80));
+        x >>= 7;
+    }
+    b.writeUInt8(uint8(x));
+}
+
+
+static uint32 readVarUInt(BinaryInput& b) {
+    uint32 x = 0;
+    for (int shift = 0; shift < 35; shift += 7) {
+        const uint8 c = b.readUInt8();
+        x |= uint32(c & 0x7F) << shift;
+        if ((c & 0x80) == 0) {
+            return x;
+        }
+    }
+    throw ParseError(b.getFilename(), b.getPosition(), "Corrupt binary Any");
+}
+
+
+/** Reads the number of elements in a container and rejects counts that could not fit in the
+    rest of the input, so that corrupt files cannot trigger huge or negative allocations */
+static int readCount(BinaryInput& b, int minBytesPerElement, const char* errorMessage) {
+    const uint32 n = readVarUInt(b);
+    if ((n > uint32(INT_MAX)) || (int64(n) * minBytesPerElement > b.getLength() - b.getPosition())) {
+        throw ParseError(b.getFilename(), b.getPosition(), errorMessage);
+    }
+    return int(n);
+}
+
+
+static int internString(const String& s, Table<String, int>& stringTable, Array<String>& stringArray) {
+    bool created = false;
+    int& index = stringTable.getCreate(s, created);
+    if (created) {
+        index = stringArray.size();
+        stringArray.append(s);
+    }
+    return index;
+}
+
+
+static const String& lookupString(BinaryInput& b, const Array<String>& stringArray) {
+    const uint32 index = readVarUInt(b);
+    if (index >= uint32(stringArray.size())) {
+        throw ParseError(b.getFilename(), b.getPosition(), "Corrupt binary Any string index");
+    }
+    return stringArray[int(index)];
+}
+
+
 void Any::serialize(BinaryOutput& b) const {
-    TextOutput::Settings s;
-    s.wordWrap = TextOutput::Settings::WRAP_NONE;
-    b.writeInt32(1);
-    b.writeString32(unparse(s));
+    beforeRead();
+
+    // The tree is written first so that the table of the strings in it can precede it
+    Table<String, int> stringTable;
+    Array<String> stringArray;
+    internString("", stringTable, stringArray);
+
+    BinaryOutput tree("<memory>", b.endian());
+    serializeBinary(tree, stringTable, stringArray);
+    tree.commit();
+
+    b.writeInt32(BINARY_VERSION);
+    writeVarUInt(b, uint32(stringArray.size()));
+    for (const String& s : stringArray) {
+        writeVarUInt(b, uint32(s.size()));
+        if (! s.empty()) {
+            b.writeBytes(s.c_str(), s.size());
+        }
+    }
+    b.writeBytes(tree.getCArray(), tree.size());
+}
+
+
+void Any::serializeBinary(BinaryOutput& b, Table<String, int>& stringTable, Array<String>& stringArray) const {
+    bool numberArray = (m_type == ARRAY) && (size() > 0);
+    if (numberArray) {
+        for (const Any& a : *(m_data->value.a)) {
+            if ((a.m_type != NUMBER) || (notNull(a.m_data) && (a.m_data->hexInteger || ! a.m_data->comment.empty() || ! a.m_data->includeLine.empty()))) {
+                numberArray = false;
+                break;
+            }
+        }
+    }
+
+    b.writeUInt8((numberArray ? BINARY_NUMBER_ARRAY : uint8(m_type)) | (notNull(m_data) ? BINARY_HAS_DATA : 0));
+
+    if (notNull(m_data)) {
+        const auto& writeString = [&](const String& s) {
+            writeVarUInt(b, uint32(internString(s, stringTable, stringArray)));
+        };
+
+        writeString(m_data->source.filename);
+        writeVarUInt(b, uint32(m_data->source.line));
+        writeVarUInt(b, uint32(m_data->source.character));
+        writeString(m_data->comment);
+        writeString(m_data->name);
+        writeString(m_data->includeLine);
+
+        // Index of the bracket in "{[(", or 0 for none
+        const char* bracketCode = " {[(";
+        const char* bracket = isNull(m_data->bracket) ? nullptr : strchr(bracketCode + 1, m_data->bracket[0]);
+        b.writeUInt8(isNull(bracket) ? 0 : uint8(bracket - bracketCode));
+        b.writeUInt8(uint8(m_data->separator));
+        b.writeBool8(m_data->hexInteger);
+    }
+
+    switch (m_type) {
+    case NIL:
+    case EMPTY_CONTAINER:
+        break;
+
+    case BOOLEAN:
+        b.writeBool8(m_simpleValue.b);
+        break;
+
+    case NUMBER:
+        b.writeFloat64(m_simpleValue.n);
+        break;
+
+    case STRING:
+        writeVarUInt(b, uint32(internString(*(m_data->value.s), stringTable, stringArray)));
+        break;
+
+    case ARRAY: {
+        const AnyArray& array = *(m_data->value.a);
+        writeVarUInt(b, uint32(array.size()));
+        if (numberArray) {
+            for (const Any& a : array) {
+                b.writeFloat64(a.m_simpleValue.n);
+            }
+        } else {
+            for (const Any& a : array) {
+                a.serializeBinary(b, stringTable, stringArray);
+            }
+        }
+        break;
+    }
+
+    case TABLE: {
+        // Sort the keys so that equal tables have identical serializations, as for text
+        const AnyTable& table = *(m_data->value.t);
+        Array<String> keys;
+        table.getKeys(keys);
+        keys.sort();
+
+        writeVarUInt(b, uint32(keys.size()));
+        for (const String& key : keys) {
+            writeVarUInt(b, uint32(internString(key, stringTable, stringArray)));
+            table[key].serializeBinary(b, stringTable, stringArray);
+        }
+        break;
+    }
+    }
 }
 
 
 void Any::deserialize(BinaryInput& b) {
+    beforeRead();
     const int version = b.readInt32();
-    alwaysAssertM(version == 1, "Wrong Any serialization version");
-    _parse(b.readString32());
+    if (version == 1) {
+        _parse(b.readString32());
+        return;
+    }
+    alwaysAssertM(version == BINARY_VERSION, "Wrong Any serialization version");
+
+    Array<String> stringArray;
+    // Each string has at least a one-byte length
+    stringArray.resize(readCount(b, 1, "Corrupt binary Any string table"));
+    for (String& s : stringArray) {
+        const uint32 length = readVarUInt(b);
+        if (int64(length) > b.getLength() - b.getPosition()) {
+            throw ParseError(b.getFilename(), b.getPosition(), "Corrupt binary Any string table");
+        }
+        if (length > 0) {
+            s.resize(length);
+            b.readBytes(&s[0], length);
+        }
+    }
+
+    deserializeBinary(b, stringArray);
+}
+
+
+void Any::deserializeBinary(BinaryInput& b, const Array<String>& stringArray) {
+    dropReference();
+    m_placeholderName = "";
+    m_simpleValue.b = false;
+
+    const uint8 code = b.readUInt8();
+    const uint8 type = code & ~BINARY_HAS_DATA;
+    if (type > BINARY_NUMBER_ARRAY) {
+        throw ParseError(b.getFilename(), b.getPosition(), "Corrupt binary Any type");
+    }
+    m_type = (type == BINARY_NUMBER_ARRAY) ? ARRAY : Type(type);
+
+    if ((code & BINARY_HAS_DATA) != 0) {
+        const String& filename    = lookupString(b, stringArray);
+        const int     line        = int(readVarUInt(b));
+        const int     character   = int(readVarUInt(b));
+        const String& comment     = lookupString(b, stringArray);
+        const String& name        = lookupString(b, stringArray);
+        const String& includeLine = lookupString(b, stringArray);
+
+        const uint8 bracketCode = b.readUInt8();
+        const char* bracket[]   = {nullptr, BRACE, BRACKET, PAREN};
+        const char  separator   = char(b.readUInt8());
+        const bool  hexInteger  = b.readBool8();
+        if (bracketCode > 3) {
+            throw ParseError(b.getFilename(), b.getPosition(), "Corrupt binary Any bracket");
+        }
+
+        m_data = Data::create(m_type, bracket[bracketCode], separator, hexInteger);
+        m_data->source.filename  = filename;
+        m_data->source.line      = line;
+        m_data->source.character = character;
+        m_data->comment          = comment;
+        m_data->name             = name;
+        m_data->includeLine      = includeLine;
+    } else if ((m_type == STRING) || (m_type == ARRAY) || (m_type == TABLE) || (m_type == EMPTY_CONTAINER)) {
+        ensureData();
+    }
+
+    switch (type) {
+    case NIL:
+    case EMPTY_CONTAINER:
+        break;
+
+    case BOOLEAN:
+        m_simpleValue.b = b.readBool8();
+        break;
+
+    case NUMBER:
+        m_simpleValue.n = b.readFloat64();
+        break;
+
+    case STRING:
+        *(m_data->value.s) = lookupString(b, stringArray);
+        break;
+
+    case ARRAY: {
+        AnyArray& array = *(m_data->value.a);
+        // Each element has at least a one-byte type code
+        array.resize(readCount(b, 1, "Corrupt binary Any array"));
+        for (Any& a : array) {
+            a.deserializeBinary(b, stringArray);
+        }
+        break;
+    }
+
+    case BINARY_NUMBER_ARRAY: {
+        const int n = readCount(b, 8, "Corrupt binary Any array");
+        Array<float64> number;
+        number.resize(n);
+        b.readFloat64(number.getCArray(), n);
+
+        AnyArray& array = *(m_data->value.a);
+        array.resize(n);
+        for (int i = 0; i < n; ++i) {
+            array[i].m_type = NUMBER;
+            array[i].m_simpleValue.n = number[i];
+        }
+        break;
+    }
+
+    case TABLE: {
+        AnyTable& table = *(m_data->value.t);
+        // Each entry has at least a one-byte key index and a one-byte type code
+        const int n = readCount(b, 2, "Corrupt binary Any table");
+        for (int i = 0; i < n; ++i) {
+            const String& key = lookupString(b, stringArray);
+            table.getCreate(key).deserializeBinary(b, stringArray);
+        }
+        break;
+    }
+    }
 }
 
 
@@ -925,18 +1208,54 @@ void Any::_parse(const String& src) {
 }
 
 
+bool Any::isBinaryFile(const String& filename) {
+    String zipfile, internalFile;
+    if (FileSystem::inZipfile(filename, zipfile, internalFile)) {
+        return endsWith(toLower(filename), toLower(BINARY_EXTENSION));
+    }
+
+    char magic[sizeof(BINARY_MAGIC)];
+    FILE* file = FileSystem::fopen(filename.c_str(), "rb");
+    if (isNull(file)) {
+        return false;
+    }
+    const size_t count = fread(magic, 1, sizeof(magic), file);
+    FileSystem::fclose(file);
+
+    return (count == sizeof(magic)) && (memcmp(magic, BINARY_MAGIC, sizeof(magic)) == 0);
+}
+
+
 void Any::load(const String& filename) {
     beforeRead();
+    const String& resolved = FileSystem::resolve(filename);
+
+    if (isBinaryFile(resolved)) {
+        BinaryInput b(resolved, G3D_LITTLE_ENDIAN, MemoryMappedFile::SEQUENTIAL);
+        b.skip(sizeof(BINARY_MAGIC));
+        deserialize(b);
+        return;
+    }
+
     TextInput::Settings settings;
     getDeserializeSettings(settings);
 
-    TextInput ti(FileSystem::resolve(filename), settings);
+    TextInput ti(resolved, settings);
     deserialize(ti);
 }
 
 
 void Any::save(const String& filename, bool json) const {
     beforeRead();
+
+    if (! json && endsWith(toLower(filename), toLower(BINARY_EXTENSION))) {
+        BinaryOutput b(filename, G3D_LITTLE_ENDIAN);
+        b.writeBytes(BINARY_MAGIC, sizeof(BINARY_MAGIC));
+        serialize(b);
+        b.commit();
+        return;
+    }
+
     TextOutput::Settings settings;
     settings.wordWrap = TextOutput::Settings::WRAP_NONE;
 
@@ -35,16 +35,16 @@ void* AreaMemoryManager::Buffer::alloc(size_t s) {
 
 
 bool AreaMemoryManager::isThreadsafe() const {
-    return false;
+    return m_threadsafe;
 }
 
 
-shared_ptr<AreaMemoryManager> AreaMemoryManager::create(size_t sizeHint) {
-    return shared_ptr<AreaMemoryManager>(new AreaMemoryManager(sizeHint));
+shared_ptr<AreaMemoryManager> AreaMemoryManager::create(size_t sizeHint, bool threadsafe) {
+    return shared_ptr<AreaMemoryManager>(new AreaMemoryManager(sizeHint, threadsafe));
 }
 
 
-AreaMemoryManager::AreaMemoryManager(size_t sizeHint) : m_sizeHint(sizeHint) {
+AreaMemoryManager::AreaMemoryManager(size_t sizeHint, bool threadsafe) : m_sizeHint(sizeHint), m_threadsafe(threadsafe) {
     debugAssert(sizeHint > 0);
 }
 
@@ -60,6 +60,16 @@ size_t AreaMemoryManager::bytesAllocated() const {
 
 
 void* AreaMemoryManager::alloc(size_t s) {
+    if (m_threadsafe) {
+        tbb::spin_mutex::scoped_lock lock(m_mutex);
+        return allocUnlocked(s);
+    } else {
+        return allocUnlocked(s);
+    }
+}
+
+
+void* AreaMemoryManager::allocUnlocked(size_t s) {
     void* n = (m_bufferArray.size() > 0) ? m_bufferArray.last()->alloc(s) : nullptr;
     if (n == nullptr) {
         // This buffer is full
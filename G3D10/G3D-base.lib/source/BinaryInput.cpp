@@ -14,7 +14,8 @@
 #include "G3D-base/Log.h"
 #include "G3D-base/FileSystem.h"
 #include "../../external/zlib.lib/include/zlib.h"
-#include "../../external/zip.lib/include/zip.h"
+#include "G3D-base/ZipArchive.h"
+#include "G3D-base/BlockCompression.h"
 #include <cstring>
 
 namespace G3D {
@@ -37,6 +38,18 @@ static uint32 readUInt32FromBuffer(const uint8* data, bool swapBytes) {
 }
 
 
+/** Helper used by the constructors for BlockCompressor containers. Decompresses on all cores. */
+static uint8* decompressBlocks(const BlockDecompressor& decompressor, int64& length) {
+    length = decompressor.size();
+    uint8* buffer = (uint8*)System::alignedMalloc(size_t(length), 16);
+    if (isNull(buffer)) {
+        throw "Not enough memory to load compressed file.";
+    }
+    decompressor.decompress(buffer);
+    return buffer;
+}
+
+
 BinaryInput::BinaryInput(
     const uint8*        data,
     int64               dataLen,
@@ -55,7 +68,14 @@ BinaryInput::BinaryInput(
 
     setEndian(dataEndian);
 
-    if (compressed) {
+    const shared_ptr<BlockDecompressor>& blocks = compressed ? BlockDecompressor::create(data, size_t(dataLen)) : nullptr;
+
+    if (notNull(blocks)) {
+        debugAssert(m_freeBuffer);
+        m_buffer       = decompressBlocks(*blocks, m_length);
+        m_bufferLength = m_length;
+
+    } else if (compressed) {
         // Read the decompressed size from the first 4 bytes
         m_length = readUInt32FromBuffer(data, m_swapBytes);
 
@@ -99,41 +119,81 @@ BinaryInput::BinaryInput
 	m_freeBuffer(true) {
 
 	setEndian(fileEndian);
+	loadFile(compressed);
+}
 
+
+BinaryInput::BinaryInput
+   (const String&                   filename,
+    G3DEndian                       fileEndian,
+    MemoryMappedFile::AccessPattern accessPattern) :
+    m_filename(filename),
+    m_bitPos(0),
+    m_bitString(0),
+    m_beginEndBits(0),
+    m_alreadyRead(0),
+    m_length(0),
+    m_bufferLength(0),
+    m_buffer(nullptr),
+    m_pos(0),
+    m_freeBuffer(true) {
+
+    setEndian(fileEndian);
+
+    String zipfile, internalFile;
+    if (FileSystem::inZipfile(m_filename, zipfile, internalFile)) {
+        // Entries stored without compression are read in place from the mapped archive
+        const shared_ptr<ZipArchive>& archive = ZipArchive::open(zipfile);
+        const ZipArchive::Entry* entry = notNull(archive) ? archive->find(internalFile) : nullptr;
+        if (notNull(entry) && notNull(archive->storedData(*entry))) {
+            FileSystem::markFileUsed(m_filename);
+            FileSystem::markFileUsed(zipfile);
+            m_mappedFile = archive->mappedFile();
+            m_mappedFile->advise(accessPattern, size_t(entry->storedOffset), size_t(entry->size));
+
+            m_buffer       = const_cast<uint8*>(archive->storedData(*entry));
+            m_length       = entry->size;
+            m_bufferLength = m_length;
+            m_freeBuffer   = false;
+            return;
+        }
+    } else {
+        // Interpret the name as FileSystem::fopen does
+        m_mappedFile = MemoryMappedFile::create(FilePath::canonicalize(FilePath::expandEnvironmentVariables(m_filename)));
+        if (notNull(m_mappedFile)) {
+            FileSystem::markFileUsed(m_filename);
+            m_mappedFile->advise(accessPattern);
+
+            // The mapping is read-only; BinaryInput never writes to its buffer
+            m_buffer       = const_cast<uint8*>(m_mappedFile->data());
+            m_length       = int64(m_mappedFile->size());
+            m_bufferLength = m_length;
+            m_freeBuffer   = false;
+            return;
+        }
+    }
+
+    loadFile(false);
+}
+
+
+void BinaryInput::loadFile(bool compressed) {
 	String zipfile, internalFile;
 	if (FileSystem::inZipfile(m_filename, zipfile, internalFile)) {
 		// Load from zipfile
 		FileSystem::markFileUsed(m_filename);
 		FileSystem::markFileUsed(zipfile);
 
-		String password;
-		bool isPasswordProtected = FileSystem::isPasswordProtected(zipfile, password);
-
-		struct zip* z = zip_open(zipfile.c_str(), ZIP_CHECKCONS, nullptr); {
-			struct zip_stat info;
-			zip_stat_init(&info);
-			zip_stat(z, internalFile.c_str(), ZIP_FL_NOCASE, &info);
-			m_bufferLength = m_length = info.size;
-			// sets machines up to use MMX, if they want
-			m_buffer = reinterpret_cast<uint8*>(System::alignedMalloc(m_length, 16));
-			    struct zip_file* zf = !isPasswordProtected ?
-				zip_fopen(z, internalFile.c_str(), ZIP_FL_NOCASE) :
-				zip_fopen_encrypted(z, internalFile.c_str(), ZIP_FL_NOCASE, password.c_str());
-			if (isNull(zf)) {
-				String msg = String("\"") + internalFile + "\" inside \"" + zipfile + "\" could not be opened.";
-                if (!isPasswordProtected) {
-                    msg += String(" If the archive is password protected, register it with FileSystem::registerPasswordProtectedZip()");
-                }
-				throw msg;
-			}
-			else {
-				const int64 bytesRead = zip_fread(zf, m_buffer, m_length);
-				debugAssertM(bytesRead == m_length,
-					internalFile + " was corrupt because it unzipped to the wrong size.");
-				(void)bytesRead;
-				zip_fclose(zf);
-			}
-		} zip_close(z); z = nullptr;
+		const shared_ptr<ZipArchive>& archive = ZipArchive::open(zipfile);
+		const ZipArchive::Entry* entry = notNull(archive) ? archive->find(internalFile) : nullptr;
+		if (isNull(entry)) {
+			throw String("\"") + internalFile + "\" inside \"" + zipfile + "\" could not be opened.";
+		}
+
+		m_bufferLength = m_length = entry->size;
+		// sets machines up to use MMX, if they want
+		m_buffer = reinterpret_cast<uint8*>(System::alignedMalloc(m_length, 16));
+		archive->read(*entry, m_buffer);
 
 		if (compressed) {
 			decompress();
@@ -143,6 +203,18 @@ BinaryInput::BinaryInput
 		return;
 	}
 
+	if (compressed) {
+		// Decompress block compressed files straight from a mapping, without first reading them into memory
+		const shared_ptr<BlockDecompressor>& blocks = BlockDecompressor::create(FilePath::canonicalize(FilePath::expandEnvironmentVariables(m_filename)));
+		if (notNull(blocks)) {
+			FileSystem::markFileUsed(m_filename);
+			m_buffer       = decompressBlocks(*blocks, m_length);
+			m_bufferLength = m_length;
+			m_freeBuffer   = true;
+			return;
+		}
+	}
+
 	// Figure out how big the file is and verify that it exists.
 	std::FILE* file = FileSystem::fopen(m_filename.c_str(), "rb");
 	if (!file) {
@@ -228,6 +300,15 @@ void BinaryInput::decompress() {
     // Use the existing buffer as the source, allocate
     // a new buffer to use as the destination.
     
+    const shared_ptr<BlockDecompressor>& blocks = BlockDecompressor::create(m_buffer, size_t(m_length));
+    if (notNull(blocks)) {
+        uint8* tempBuffer = m_buffer;
+        m_buffer = decompressBlocks(*blocks, m_length);
+        m_bufferLength = m_length;
+        System::alignedFree(tempBuffer);
+        return;
+    }
+
     int64 tempLength = m_length;
     m_length = readUInt32FromBuffer(m_buffer, m_swapBytes);
     
@@ -260,6 +341,12 @@ void BinaryInput::setEndian(G3DEndian e) {
 
 
 void BinaryInput::loadIntoMemory(int64 startPosition, int64 minLength) {
+    if (notNull(m_mappedFile)) {
+        // The whole file is already addressable
+        debugAssertM(startPosition + minLength <= m_length, "Read past end of file.");
+        return;
+    }
+
     // Load the next section of the file
     debugAssertM(m_filename != "<memory>", "Read past end of file.");
 
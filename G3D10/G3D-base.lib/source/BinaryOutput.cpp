@@ -157,6 +157,14 @@ void BinaryOutput::reserveBytesWhenOutOfMemory(size_t bytes) {
             // give up and just write the whole thing.
             writeBytes = m_bufferLen;
         }
+
+        if (notNull(m_blockCompressor)) {
+            // Only the final write may end in a partial block
+            writeBytes -= writeBytes % m_blockCompressor->blockSize();
+            if (writeBytes == 0) {
+                throw "Out of memory while writing to disk in BinaryOutput (could not buffer a whole compressed block).";
+            }
+        }
         debugAssert(writeBytes > 0);
 
         //debugPrintf("Writing %d bytes to disk\n", writeBytes);
@@ -166,8 +174,8 @@ void BinaryOutput::reserveBytesWhenOutOfMemory(size_t bytes) {
         FILE* file = FileSystem::fopen(m_filename.c_str(), mode);
         debugAssert(file);
 
-        size_t count = fwrite(m_buffer, 1, writeBytes, file);
-        debugAssert(count == writeBytes); (void)count;
+        const bool success = writeBufferToFile(file, writeBytes, false);
+        debugAssert(success); (void)success;
 
         fclose(file);
         file = nullptr;
@@ -249,6 +257,7 @@ void BinaryOutput::reset() {
     m_bitString = 0;
     m_bitPos = 0;
     m_committed = false;
+    m_blockCompressor = nullptr;
 }
 
 
@@ -318,12 +327,49 @@ void BinaryOutput::compress(int level) {
 }
 
 
+void BinaryOutput::compressBlocks(int level, int blockSize) {
+    if (m_alreadyWritten > 0) {
+        throw "Cannot compress huge files (part of this file has already been written to disk). Call compressBlocks() before writing.";
+    }
+    debugAssertM(! m_committed, "Cannot compress after committing.");
+    m_blockCompressor = std::make_shared<BlockCompressor>(level, blockSize);
+}
+
+
+bool BinaryOutput::writeBufferToFile(FILE* file, size_t bytes, bool final) {
+    if (isNull(m_blockCompressor)) {
+        return (bytes == 0) || (fwrite(m_buffer, bytes, 1, file) == 1);
+    }
+
+    Array<uint8> compressed;
+    m_blockCompressor->append(m_buffer, bytes, compressed);
+    if (final) {
+        m_blockCompressor->finish(compressed);
+    }
+    return (compressed.size() == 0) || (fwrite(compressed.getCArray(), compressed.size(), 1, file) == 1);
+}
+
+
 void BinaryOutput::commit(bool flush) {
     debugAssertM(! m_committed, "Cannot commit twice");
     m_committed = true;
     debugAssertM(m_beginEndBits == 0, "Missing endBits before commit");
 
     if (m_filename == "<memory>") {
+        if (notNull(m_blockCompressor)) {
+            // Compress in place
+            Array<uint8> compressed;
+            m_blockCompressor->append(m_buffer, m_bufferLen, compressed);
+            m_blockCompressor->finish(compressed);
+
+            if (size_t(compressed.size()) > m_maxBufferLen) {
+                m_maxBufferLen = compressed.size();
+                m_buffer = (uint8*)System::realloc(m_buffer, m_maxBufferLen);
+            }
+            System::memcpy(m_buffer, compressed.getCArray(), compressed.size());
+            m_bufferLen = compressed.size();
+            m_pos = m_bufferLen;
+        }
         return;
     }
 
@@ -350,12 +396,10 @@ void BinaryOutput::commit(bool flush) {
     if (m_ok) {
         debugAssertM(file, String("Could not open '") + m_filename + "'");
 
-        if (m_buffer != nullptr) {
+        if ((m_buffer != nullptr) || notNull(m_blockCompressor)) {
             m_alreadyWritten += m_bufferLen;
 
-            size_t success = fwrite(m_buffer, m_bufferLen, 1, file);
-            (void)success;
-            if (success != 1) {
+            if (! writeBufferToFile(file, m_bufferLen, true)) {
                 debugAssertM(false, String("Could not write to '") + m_filename + "'");
                 throw String("BinaryOutput::commit could not write to '") + m_filename + "'";
             }
@@ -372,6 +416,7 @@ void BinaryOutput::commit(bool flush) {
 void BinaryOutput::commit(
     uint8*                  out) {
     debugAssertM(! m_committed, "Cannot commit twice");
+    alwaysAssertM(isNull(m_blockCompressor), "Cannot commit a block compressed BinaryOutput to a pointer; call commit() and then getCArray()");
     m_committed = true;
 
     System::memcpy(out, m_buffer, m_bufferLen);
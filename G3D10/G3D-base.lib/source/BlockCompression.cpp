@@ -0,0 +1,268 @@
+/**
+  \file G3D-base.lib/source/BlockCompression.cpp
+
+  G3D Innovation Engine http://casual-effects.com/g3d
+  Copyright 2000-2019, Morgan McGuire
+  All rights reserved
+  Available under the BSD License
+*/
+#include "G3D-base/BlockCompression.h"
+#include "G3D-base/Thread.h"
+#include "G3D-base/System.h"
+#include "../../external/zlib.lib/include/zlib.h"
+#include <cstring>
+
+namespace G3D {
+
+static const uint8 BLOCK_MAGIC[4] = {'G', '3', 'D', 'Z'};
+
+static void writeLE32(uint8* p, uint32 x) {
+    p[0] = uint8(x);
+    p[1] = uint8(x >> 8);
+    p[2] = uint8(x >> 16);
+    p[3] = uint8(x >> 24);
+}
+
+
+static void writeLE64(uint8* p, uint64 x) {
+    writeLE32(p, uint32(x));
+    writeLE32(p + 4, uint32(x >> 32));
+}
+
+
+static uint32 readLE32(const uint8* p) {
+    return uint32(p[0]) | (uint32(p[1]) << 8) | (uint32(p[2]) << 16) | (uint32(p[3]) << 24);
+}
+
+
+static uint64 readLE64(const uint8* p) {
+    return uint64(readLE32(p)) | (uint64(readLE32(p + 4)) << 32);
+}
+
+
+/** Blocks are large, so give each its own task */
+static RunConcurrentlyOptions oneBlockPerTask() {
+    RunConcurrentlyOptions options;
+    options.tileSize = 1;
+    return options;
+}
+
+
+BlockCompressor::BlockCompressor(int level, int blockSize) :
+    m_level(iClamp(level, 0, 9)),
+    m_blockSize(max(blockSize, 1)),
+    m_compressedSize(0),
+    m_uncompressedSize(0),
+    m_finished(false) {}
+
+
+void BlockCompressor::append(const uint8* src, size_t size, Array<uint8>& out) {
+    alwaysAssertM(! m_finished, "Cannot append after finish()");
+    alwaysAssertM(m_uncompressedSize % m_blockSize == 0, "Only the last call to BlockCompressor::append may end in a partial block");
+
+    if (m_compressedSize == 0) {
+        const int start = out.size();
+        out.resize(start + HEADER_SIZE, DONT_SHRINK_UNDERLYING_ARRAY);
+        uint8* header = out.getCArray() + start;
+        System::memcpy(header, BLOCK_MAGIC, 4);
+        writeLE32(header + 4, VERSION);
+        writeLE32(header + 8, uint32(m_blockSize));
+        writeLE32(header + 12, 0);
+        m_compressedSize = HEADER_SIZE;
+    }
+
+    const int numBlocks = int((size + m_blockSize - 1) / m_blockSize);
+    if (numBlocks == 0) {
+        return;
+    }
+
+    // Compress each block into its own worst-case sized buffer, then concatenate
+    Array<Array<uint8>> compressed;
+    compressed.resize(numBlocks);
+    runConcurrently(0, numBlocks, [&](int b) {
+        const uint8* blockSrc  = src + size_t(b) * m_blockSize;
+        const uLong  blockSize = uLong(min(size_t(m_blockSize), size - size_t(b) * m_blockSize));
+        uLongf       length    = compressBound(blockSize);
+
+        Array<uint8>& dst = compressed[b];
+        dst.resize(int(length) + BLOCK_HEADER_SIZE);
+        const int result = compress2(dst.getCArray() + BLOCK_HEADER_SIZE, &length, blockSrc, blockSize, m_level);
+        alwaysAssertM(result == Z_OK, "zlib failed to compress a block");
+        (void)result;
+
+        writeLE32(dst.getCArray(), uint32(length));
+        writeLE32(dst.getCArray() + 4, uint32(blockSize));
+        dst.resize(int(length) + BLOCK_HEADER_SIZE);
+    }, oneBlockPerTask());
+
+    for (const Array<uint8>& block : compressed) {
+        m_blockOffsetArray.append(uint64(m_compressedSize));
+        out.append(block);
+        m_compressedSize += block.size();
+    }
+    m_uncompressedSize += int64(size);
+}
+
+
+void BlockCompressor::finish(Array<uint8>& out) {
+    alwaysAssertM(! m_finished, "Cannot finish twice");
+    if (m_compressedSize == 0) {
+        // Write the header of an empty container
+        append(nullptr, 0, out);
+    }
+    m_finished = true;
+
+    const int64 indexOffset = m_compressedSize;
+    const int start = out.size();
+    out.resize(start + 8 * m_blockOffsetArray.size() + TRAILER_SIZE, DONT_SHRINK_UNDERLYING_ARRAY);
+
+    uint8* p = out.getCArray() + start;
+    for (const uint64 offset : m_blockOffsetArray) {
+        writeLE64(p, offset);
+        p += 8;
+    }
+
+    writeLE64(p, uint64(m_uncompressedSize));
+    writeLE64(p + 8, uint64(indexOffset));
+    writeLE32(p + 16, uint32(m_blockOffsetArray.size()));
+    System::memcpy(p + 20, BLOCK_MAGIC, 4);
+
+    m_compressedSize += 8 * m_blockOffsetArray.size() + TRAILER_SIZE;
+}
+
+
+void BlockCompressor::compress(const uint8* src, size_t size, Array<uint8>& out, int level, int blockSize) {
+    BlockCompressor compressor(level, blockSize);
+    compressor.append(src, size, out);
+    compressor.finish(out);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+bool BlockDecompressor::isBlockCompressed(const uint8* data, size_t size) {
+    return (size >= size_t(BlockCompressor::HEADER_SIZE + BlockCompressor::TRAILER_SIZE)) &&
+        (memcmp(data, BLOCK_MAGIC, 4) == 0) &&
+        (memcmp(data + size - 4, BLOCK_MAGIC, 4) == 0) &&
+        (readLE32(data + 4) == BlockCompressor::VERSION);
+}
+
+
+BlockDecompressor::BlockDecompressor(const uint8* data, size_t size, const shared_ptr<MemoryMappedFile>& mappedFile) :
+    m_mappedFile(mappedFile),
+    m_data(data),
+    m_size(size),
+    m_blockSize(readLE32(data + 8)),
+    m_uncompressedSize(0),
+    m_cachedBlockIndex(-1) {
+
+    const uint8* trailer     = data + size - BlockCompressor::TRAILER_SIZE;
+    m_uncompressedSize       = int64(readLE64(trailer));
+    const uint64 indexOffset = readLE64(trailer + 8);
+    const uint32 numBlocks   = readLE32(trailer + 16);
+
+    // Compare without summing untrusted values, which could wrap around. isBlockCompressed()
+    // guarantees that the trailer fits.
+    const uint64 indexEnd    = uint64(size) - BlockCompressor::TRAILER_SIZE;
+    if ((m_blockSize <= 0) || (m_uncompressedSize < 0) ||
+        (uint64(numBlocks) > indexEnd / 8) ||
+        (indexOffset != indexEnd - 8 * uint64(numBlocks)) ||
+        (uint64(numBlocks) != (uint64(m_uncompressedSize) + m_blockSize - 1) / uint64(m_blockSize))) {
+        throw String("Corrupt block compressed index");
+    }
+
+    m_blockOffsetArray.resize(int(numBlocks));
+    for (int b = 0; b < m_blockOffsetArray.size(); ++b) {
+        m_blockOffsetArray[b] = readLE64(data + indexOffset + 8 * b);
+        if (m_blockOffsetArray[b] + BlockCompressor::BLOCK_HEADER_SIZE > indexOffset) {
+            throw String("Corrupt block compressed index");
+        }
+    }
+}
+
+
+shared_ptr<BlockDecompressor> BlockDecompressor::create(const uint8* data, size_t size) {
+    if (! isBlockCompressed(data, size)) {
+        return nullptr;
+    }
+    return createShared<BlockDecompressor>(data, size, nullptr);
+}
+
+
+shared_ptr<BlockDecompressor> BlockDecompressor::create(const String& filename) {
+    const shared_ptr<MemoryMappedFile>& file = MemoryMappedFile::create(filename);
+    if (isNull(file) || ! isBlockCompressed(file->data(), file->size())) {
+        return nullptr;
+    }
+    file->advise(MemoryMappedFile::SEQUENTIAL);
+    return createShared<BlockDecompressor>(file->data(), file->size(), file);
+}
+
+
+void BlockDecompressor::decompressBlock(int block, uint8* dst) const {
+    debugAssert((block >= 0) && (block < numBlocks()));
+    const uint64 offset             = m_blockOffsetArray[block];
+    const uint8* header             = m_data + offset;
+    const uint32 compressedLength   = readLE32(header);
+    const uint32 uncompressedLength = readLE32(header + 4);
+
+    if ((int64(uncompressedLength) != blockLength(block)) ||
+        (offset + BlockCompressor::BLOCK_HEADER_SIZE + compressedLength > m_size)) {
+        throw format("Corrupt header on compressed block %d", block);
+    }
+
+    uLongf length = uncompressedLength;
+    const int result = uncompress(dst, &length, header + BlockCompressor::BLOCK_HEADER_SIZE, compressedLength);
+    if ((result != Z_OK) || (length != uncompressedLength)) {
+        throw format("zlib detected corruption in compressed block %d", block);
+    }
+}
+
+
+void BlockDecompressor::decompress(uint8* dst) const {
+    runConcurrently(0, numBlocks(), [&](int b) {
+        decompressBlock(b, dst + blockStart(b));
+    }, oneBlockPerTask());
+}
+
+
+void BlockDecompressor::read(int64 offset, int64 n, uint8* dst) {
+    debugAssert((offset >= 0) && (offset + n <= m_uncompressedSize));
+    if (n <= 0) {
+        return;
+    }
+
+    const int first = blockContaining(offset);
+    const int last  = blockContaining(offset + n - 1);
+
+    // Whole blocks go straight to the destination
+    const int firstWhole = (blockStart(first) == offset) ? first : first + 1;
+    const int lastWhole  = (blockStart(last) + blockLength(last) == offset + n) ? last : last - 1;
+    if (firstWhole <= lastWhole) {
+        runConcurrently(firstWhole, lastWhole + 1, [&](int b) {
+            decompressBlock(b, dst + (blockStart(b) - offset));
+        }, oneBlockPerTask());
+    }
+
+    // Partial blocks at either end go through the cache
+    const auto& copyPartial = [&](int b) {
+        if (m_cachedBlockIndex != b) {
+            m_cachedBlockIndex = -1;
+            m_cachedBlock.resize(int(blockLength(b)));
+            decompressBlock(b, m_cachedBlock.getCArray());
+            m_cachedBlockIndex = b;
+        }
+
+        const int64 start = max(offset, blockStart(b));
+        const int64 end   = min(offset + n, blockStart(b) + blockLength(b));
+        System::memcpy(dst + (start - offset), m_cachedBlock.getCArray() + (start - blockStart(b)), size_t(end - start));
+    };
+
+    if (first < firstWhole) {
+        copyPartial(first);
+    }
+    if ((last > lastWhole) && ((last != first) || (first >= firstWhole))) {
+        copyPartial(last);
+    }
+}
+
+} // namespace G3D
@@ -12,12 +12,12 @@
 #include "G3D-base/fileutils.h"
 #include <sys/stat.h>
 #include <sys/types.h>
-#include "zip.h"
 #include <regex>
 #include <cstring>
 #include "G3D-base/g3dfnmatch.h"
 #include "G3D-base/BinaryInput.h"
 #include "G3D-base/BinaryOutput.h"
+#include "G3D-base/ZipArchive.h"
 
 #ifdef G3D_WINDOWS
     // Needed for _getcwd
@@ -112,18 +112,16 @@ bool FileSystem::Dir::contains(const String& f, bool caseSensitive) const {
 void FileSystem::Dir::computeZipListing(const String& zipfile, const String& _pathInsideZipfile) {
     const String& pathInsideZipfile = FilePath::canonicalize(_pathInsideZipfile);
     const String& filename = FilePath::canonicalize(FilePath::removeTrailingSlash(zipfile));
-    struct zip* z = zip_open(filename.c_str(), ZIP_CHECKCONS, nullptr);
-    debugAssertM(z, format("Could not open zipfile '%s'", filename.c_str()));
+    const shared_ptr<ZipArchive>& archive = ZipArchive::open(filename);
+    debugAssertM(archive, format("Could not open zipfile '%s'", filename.c_str()));
+    if (isNull(archive)) {
+        return;
+    }
 
-    int count = zip_get_num_files( z );
     Set<String> alreadyAdded;
-    for (int i = 0; i < count; ++i) {
-        struct zip_stat info;
-        zip_stat_init( &info );    // TODO: Docs unclear if zip_stat_init is required.
-        zip_stat_index( z, i, ZIP_FL_NOCASE, &info );
-        
+    for (const ZipArchive::Entry& entry : archive->entryArray()) {
         // Fully-qualified name of a file inside zipfile
-        String name = FilePath::canonicalize(info.name);
+        String name = FilePath::canonicalize(entry.name);
 
         if (beginsWith(name, pathInsideZipfile)) {
             // We found something inside the directory we were looking for,
@@ -158,9 +156,6 @@ void FileSystem::Dir::computeZipListing(const String& zipfile, const String& _pa
             }
         }
     }
-    
-    zip_close(z);
-    z = nullptr;
 }
 
 
@@ -379,6 +374,7 @@ void FileSystem::_clearCache(const String& _path) {
 
     if ((path == "") || FilePath::isRoot(path)) {
         m_cache.clear();
+        ZipArchive::clearCache();
     } else {
         Array<String> keys;
         m_cache.getKeys(keys);
@@ -724,20 +720,11 @@ int64 FileSystem::_size(const String& _filename) {
     if (result == -1) {
         String zip, contents;
         if (zipfileExists(filename, zip, contents)) {
-            int64 requiredMem;
-            
-            struct zip *z = zip_open( zip.c_str(), ZIP_CHECKCONS, nullptr );
-            debugAssertM(z != nullptr, zip + ": zip open failed.");
-            {
-                struct zip_stat info;
-                zip_stat_init( &info );    // Docs unclear if zip_stat_init is required.
-                int success = zip_stat( z, contents.c_str(), ZIP_FL_NOCASE, &info );
-                (void) success;
-                debugAssertM(success == 0, zip + ": " + contents + ": zip stat failed.");
-                requiredMem = info.size;
-            }
-            zip_close(z);
-            return requiredMem;
+            const shared_ptr<ZipArchive>& archive = ZipArchive::open(zip);
+            debugAssertM(archive, zip + ": zip open failed.");
+            const ZipArchive::Entry* entry = notNull(archive) ? archive->find(contents) : nullptr;
+            debugAssertM(entry, zip + ": " + contents + ": zip stat failed.");
+            return notNull(entry) ? entry->size : -1;
         } else {
             return -1;
         }
@@ -0,0 +1,130 @@
+/**
+  \file G3D-base.lib/source/FrameArenaMemoryManager.cpp
+
+  G3D Innovation Engine http://casual-effects.com/g3d
+  Copyright 2000-2019, Morgan McGuire
+  All rights reserved
+  Available under the BSD License
+*/
+
+#include "G3D-base/FrameArenaMemoryManager.h"
+#include "G3D-base/System.h"
+
+namespace G3D {
+
+shared_ptr<FrameArenaMemoryManager> FrameArenaMemoryManager::s_current;
+
+shared_ptr<FrameArenaMemoryManager> FrameArenaMemoryManager::create(size_t sizeHint, int numFrames) {
+    return shared_ptr<FrameArenaMemoryManager>(new FrameArenaMemoryManager(sizeHint, numFrames));
+}
+
+
+FrameArenaMemoryManager::FrameArenaMemoryManager(size_t sizeHint, int numFrames) :
+    m_sizeHint(max(sizeHint, size_t(ALIGNMENT))),
+    m_currentFrame(0),
+    m_numHeapAllocations(0) {
+
+    debugAssertM(numFrames >= 1, "FrameArenaMemoryManager requires at least one frame");
+    m_frame.resize(max(numFrames, 1));
+    for (Frame& frame : m_frame) {
+        addBlock(frame, m_sizeHint);
+    }
+}
+
+
+FrameArenaMemoryManager::~FrameArenaMemoryManager() {
+    for (Frame& frame : m_frame) {
+        for (const Block& block : frame.block) {
+            System::alignedFree(block.data);
+        }
+    }
+}
+
+
+void FrameArenaMemoryManager::addBlock(Frame& frame, size_t minSize) {
+    // Grow geometrically so that a frame that overflows badly needs few blocks
+    const size_t size = max(minSize, (frame.block.size() > 0) ? frame.block.last().size * 2 : m_sizeHint);
+    uint8* data = (uint8*)System::alignedMalloc(size, ALIGNMENT);
+    alwaysAssertM(notNull(data), "Out of memory in FrameArenaMemoryManager");
+    frame.block.append(Block(data, size));
+    frame.used = 0;
+    ++m_numHeapAllocations;
+}
+
+
+void* FrameArenaMemoryManager::alloc(size_t s) {
+    // Round up so that the next allocation is also aligned
+    s = (s + ALIGNMENT - 1) & ~size_t(ALIGNMENT - 1);
+
+    m_lock.lock();
+    Frame& frame = m_frame[m_currentFrame];
+    if (frame.used + s > frame.block.last().size) {
+        addBlock(frame, s);
+    }
+    void* ptr = frame.block.last().data + frame.used;
+    frame.used += s;
+    frame.bytesAllocated += s;
+    m_lock.unlock();
+
+    return ptr;
+}
+
+
+void FrameArenaMemoryManager::free(void* x) {
+    // Intentionally empty; memory is recycled by beginFrame()
+}
+
+
+bool FrameArenaMemoryManager::isThreadsafe() const {
+    return true;
+}
+
+
+void FrameArenaMemoryManager::beginFrame() {
+    m_lock.lock();
+    m_currentFrame = (m_currentFrame + 1) % m_frame.size();
+    Frame& frame = m_frame[m_currentFrame];
+
+    if (frame.block.size() > 1) {
+        // Replace the overflow blocks with one that holds the whole frame
+        size_t total = 0;
+        for (const Block& block : frame.block) {
+            total += block.size;
+            System::alignedFree(block.data);
+        }
+        frame.block.fastClear();
+        addBlock(frame, total);
+    }
+
+#   ifdef G3D_DEBUG
+        // Make use of memory from an expired frame easier to detect
+        System::memset(frame.block.last().data, 0xCD, frame.used);
+#   endif
+
+    frame.used = 0;
+    frame.bytesAllocated = 0;
+    m_lock.unlock();
+}
+
+
+size_t FrameArenaMemoryManager::bytesAllocatedThisFrame() const {
+    m_lock.lock();
+    const size_t b = m_frame[m_currentFrame].bytesAllocated;
+    m_lock.unlock();
+    return b;
+}
+
+
+size_t FrameArenaMemoryManager::bytesReserved() const {
+    m_lock.lock();
+    size_t total = 0;
+    for (const Frame& frame : m_frame) {
+        for (const Block& block : frame.block) {
+            total += block.size;
+        }
+    }
+    m_lock.unlock();
+    return total;
+}
+
+} // namespace G3D
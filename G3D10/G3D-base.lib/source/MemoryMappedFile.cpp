@@ -0,0 +1,128 @@
+/**
+  \file G3D-base.lib/source/MemoryMappedFile.cpp
+
+  G3D Innovation Engine http://casual-effects.com/g3d
+  Copyright 2000-2019, Morgan McGuire
+  All rights reserved
+  Available under the BSD License
+*/
+#include "G3D-base/MemoryMappedFile.h"
+#include "G3D-base/g3dmath.h"
+
+#ifndef G3D_WINDOWS
+#   include <fcntl.h>
+#   include <unistd.h>
+#   include <sys/mman.h>
+#   include <sys/stat.h>
+#endif
+
+namespace G3D {
+
+MemoryMappedFile::MemoryMappedFile() : m_data(nullptr), m_size(0) {
+#   ifdef G3D_WINDOWS
+        m_file    = INVALID_HANDLE_VALUE;
+        m_mapping = nullptr;
+#   else
+        m_file    = -1;
+#   endif
+}
+
+
+shared_ptr<MemoryMappedFile> MemoryMappedFile::create(const String& filename) {
+    const shared_ptr<MemoryMappedFile> m = createShared<MemoryMappedFile>();
+    m->m_filename = filename;
+
+#   ifdef G3D_WINDOWS
+        m->m_file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (m->m_file == INVALID_HANDLE_VALUE) {
+            return nullptr;
+        }
+
+        LARGE_INTEGER size;
+        if (! GetFileSizeEx(m->m_file, &size)) {
+            return nullptr;
+        }
+        m->m_size = size_t(size.QuadPart);
+
+        if (m->m_size > 0) {
+            m->m_mapping = CreateFileMappingA(m->m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+            if (isNull(m->m_mapping)) {
+                return nullptr;
+            }
+
+            m->m_data = static_cast<const uint8*>(MapViewOfFile(m->m_mapping, FILE_MAP_READ, 0, 0, 0));
+            if (isNull(m->m_data)) {
+                return nullptr;
+            }
+        }
+#   else
+        m->m_file = ::open(filename.c_str(), O_RDONLY);
+        if (m->m_file < 0) {
+            return nullptr;
+        }
+
+        struct stat info;
+        if (fstat(m->m_file, &info) != 0) {
+            return nullptr;
+        }
+        m->m_size = size_t(info.st_size);
+
+        if (m->m_size > 0) {
+            // MAP_SHARED so that every process mapping the file uses the same physical pages
+            void* data = mmap(nullptr, m->m_size, PROT_READ, MAP_SHARED, m->m_file, 0);
+            if (data == MAP_FAILED) {
+                return nullptr;
+            }
+            m->m_data = static_cast<const uint8*>(data);
+        }
+#   endif
+
+    return m;
+}
+
+
+MemoryMappedFile::~MemoryMappedFile() {
+#   ifdef G3D_WINDOWS
+        if (notNull(m_data)) {
+            UnmapViewOfFile(m_data);
+        }
+        if (notNull(m_mapping)) {
+            CloseHandle(m_mapping);
+        }
+        if (m_file != INVALID_HANDLE_VALUE) {
+            CloseHandle(m_file);
+        }
+#   else
+        if (notNull(m_data)) {
+            munmap(const_cast<uint8*>(m_data), m_size);
+        }
+        if (m_file >= 0) {
+            ::close(m_file);
+        }
+#   endif
+}
+
+
+void MemoryMappedFile::advise(AccessPattern pattern, size_t offset, size_t length) const {
+    if ((m_size == 0) || (offset >= m_size)) {
+        return;
+    }
+    length = min(length, m_size - offset);
+
+#   ifdef G3D_WINDOWS
+        if (pattern == WILL_NEED) {
+            WIN32_MEMORY_RANGE_ENTRY range;
+            range.VirtualAddress = const_cast<uint8*>(m_data + offset);
+            range.NumberOfBytes  = length;
+            PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+        }
+#   else
+        // madvise requires a page-aligned start
+        const size_t pageSize = size_t(sysconf(_SC_PAGESIZE));
+        const size_t start    = offset - (offset % pageSize);
+        const int    advice[] = {MADV_NORMAL, MADV_SEQUENTIAL, MADV_RANDOM, MADV_WILLNEED};
+        madvise(const_cast<uint8*>(m_data + start), length + (offset - start), advice[pattern]);
+#   endif
+}
+
+} // namespace G3D
@@ -11,6 +11,8 @@
 #include "G3D-base/FileSystem.h"
 #include "G3D-base/stringutils.h"
 #include "G3D-base/TextInput.h"
+#include "G3D-base/Thread.h"
+#include <thread>
 
 namespace G3D {
 
@@ -29,6 +31,7 @@ ParseOBJ::Options::Options(const Any& a) {
     r.getIfPresent("stripRefraction", stripRefraction);
     r.getIfPresent("forceMaterialsWhite", forceMaterialsWhite);
     r.getIfPresent("materialOptions", materialOptions);
+    r.getIfPresent("parallel", parallel);
 //    r.getIfPresent("sampler", sampler);
 
     r.verifyDone();
@@ -46,6 +49,7 @@ Any ParseOBJ::Options::toAny() const {
     a["forceMaterialsWhite"] = forceMaterialsWhite;
     a["stripRefraction"] = stripRefraction;
     a["materialOptions"] = materialOptions;
+    a["parallel"] = parallel;
 //    a["sampler"] = sampler;
 
     return a;
@@ -67,6 +71,10 @@ void ParseOBJ::parse(const char* ptr, size_t len, const String& basePath, const
     m_basePath = basePath;
     m_objOptions = options;
 
+    if (m_objOptions.parallel && parseParallel(ptr, len)) {
+        return;
+    }
+
     // Guess the vertex count based on number of characters; intentionally underestimate to avoid overallocation on low RAM machines
     // Assume 50 char/line, 2/3 of lines for v, vt, and vc
     int numVertexEstimate = (((int)(len)/50) * 2) / 3;
@@ -81,10 +89,28 @@ void ParseOBJ::parse(const char* ptr, size_t len, const String& basePath, const
 
 
     nextCharacter = ptr;
-    alwaysAssertM(len < 0xFFFFFFFF, "Cannot handle more than 4GB of input text.");
+    alwaysAssertM(len < 0x7FFFFFFF, "Cannot handle more than 2GB of input text on a single thread.");
     remainingCharacters = (int)len;
     m_line = 1;
 
+    parseCommands();
+}
+
+
+void ParseOBJ::parse(BinaryInput& bi, const ParseOBJ::Options& options, const String& basePath) {
+    m_filename = bi.getFilename();
+
+    String bp = basePath;
+    if (bp == "<AUTO>") {
+        bp = FilePath::parent(FileSystem::resolve(m_filename));
+    }    
+
+    parse((const char*)bi.getCArray() + bi.getPosition(),
+          size_t(bi.getLength() - bi.getPosition()), bp, options);
+}
+
+
+void ParseOBJ::parseCommands() {
     while (remainingCharacters > 0) {
         // Process leading whitespace
         maybeReadWhitespace();
@@ -92,23 +118,165 @@ void ParseOBJ::parse(const char* ptr, size_t len, const String& basePath, const
         const Command command = readCommand();
         processCommand(command);
 
-        if (m_line % 500000 == 0) {
+        if ((m_line % 500000 == 0) && isNull(m_runArray)) {
             debugPrintf("  ParseOBJ at line %d\n", m_line);
         }
     }        
 }
 
 
-void ParseOBJ::parse(BinaryInput& bi, const ParseOBJ::Options& options, const String& basePath) {
-    m_filename = bi.getFilename();
+bool ParseOBJ::parseParallel(const char* ptr, size_t len) {
+    // Smaller chunks do not amortize the cost of merging
+    const size_t MIN_CHUNK_SIZE = 1024 * 1024;
+    const int numChunks = int(G3D::min(len / MIN_CHUNK_SIZE, size_t(4 * G3D::max(1u, std::thread::hardware_concurrency()))));
+    if (numChunks < 2) {
+        return false;
+    }
 
-    String bp = basePath;
-    if (bp == "<AUTO>") {
-        bp = FilePath::parent(FileSystem::resolve(m_filename));
-    }    
+    // Divide at line boundaries. Every chunk after the first starts
+    // immediately after a '\n' character.
+    Array<const char*> splitArray;
+    const char* end = ptr + len;
+    splitArray.append(ptr);
+    for (int c = 1; c <= numChunks; ++c) {
+        const char* split = end;
+        if (c < numChunks) {
+            const char* target = G3D::max(ptr + (len / numChunks) * c, splitArray.last());
+            split = static_cast<const char*>(memchr(target, '\n', end - target));
+            split = isNull(split) ? end : split + 1;
+        }
+        
+        if (split > splitArray.last()) {
+            alwaysAssertM(split - splitArray.last() < 0x7FFFFFFF, "Cannot handle more than 2GB of input text without line breaks.");
+            splitArray.append(split);
+        }
+    }
 
-    parse((const char*)bi.getCArray() + bi.getPosition(),
-          size_t(bi.getLength() - bi.getPosition()), bp, options);
+    const int numParsers = splitArray.size() - 1;
+    if (numParsers < 2) {
+        return false;
+    }
+
+    // Parse each chunk with its own parser, which records commands that
+    // change state and the faces that follow them in its m_runArray
+    Array<ParseOBJ> parserArray;
+    parserArray.resize(numParsers);
+    Array<Array<Run>> runArray;
+    runArray.resize(numParsers);
+    Array<bool> failed;
+    failed.resize(numParsers);
+
+    runConcurrently(0, numParsers, [&](int c) {
+        ParseOBJ& parser = parserArray[c];
+        parser.m_filename           = m_filename;
+        parser.m_basePath           = m_basePath;
+        parser.m_objOptions         = m_objOptions;
+        parser.m_runArray           = &runArray[c];
+        parser.nextCharacter        = splitArray[c];
+        parser.remainingCharacters  = int(splitArray[c + 1] - splitArray[c]);
+        parser.m_line               = 1;
+        runArray[c].next();
+
+        try {
+            parser.parseCommands();
+            failed[c] = false;
+        } catch (const ParseError&) {
+            failed[c] = true;
+        }
+    });
+
+    for (int c = 0; c < numParsers; ++c) {
+        if (failed[c]) {
+            // Report errors with the correct line number
+            return false;
+        }
+    }
+
+    // Offsets of each chunk's vertex attributes in the arrays for the whole file
+    Array<int> vertexBase, texCoordBase, normalBase;
+    vertexBase.resize(numParsers + 1);
+    texCoordBase.resize(numParsers + 1);
+    normalBase.resize(numParsers + 1);
+    vertexBase[0] = texCoordBase[0] = normalBase[0] = 0;
+    for (int c = 0; c < numParsers; ++c) {
+        vertexBase[c + 1]   = vertexBase[c] + parserArray[c].vertexArray.size();
+        texCoordBase[c + 1] = texCoordBase[c] + parserArray[c].texCoord0Array.size();
+        normalBase[c + 1]   = normalBase[c] + parserArray[c].normalArray.size();
+    }
+
+    const bool hasTexCoord1 = (m_objOptions.texCoord1Mode != Options::NONE);
+    vertexArray.resize(vertexBase.last());
+    texCoord0Array.resize(texCoordBase.last());
+    normalArray.resize(normalBase.last());
+    if (hasTexCoord1) {
+        texCoord1Array.resize(texCoordBase.last());
+    }
+
+    runConcurrently(0, numParsers, [&](int c) {
+        const ParseOBJ& parser = parserArray[c];
+        std::copy(parser.vertexArray.begin(), parser.vertexArray.end(), vertexArray.getCArray() + vertexBase[c]);
+        std::copy(parser.texCoord0Array.begin(), parser.texCoord0Array.end(), texCoord0Array.getCArray() + texCoordBase[c]);
+        std::copy(parser.normalArray.begin(), parser.normalArray.end(), normalArray.getCArray() + normalBase[c]);
+        if (hasTexCoord1) {
+            std::copy(parser.texCoord1Array.begin(), parser.texCoord1Array.end(), texCoord1Array.getCArray() + texCoordBase[c]);
+        }
+    });
+
+    // Apply the state changes in file order to find the mesh and the
+    // position within it of each run of faces
+    class Destination {
+    public:
+        const Run*      run;
+        int             chunk;
+        Mesh*           mesh;
+        int             offset;
+    };
+    Array<Destination> destinationArray;
+    for (int c = 0; c < numParsers; ++c) {
+        for (const Run& run : runArray[c]) {
+            switch (run.command) {
+            case GROUP:  changeGroup(run.name); break;
+            case USEMTL: changeMaterial(run.name); break;
+            case MTLLIB: loadMaterialLibrary(run.name); break;
+            default:;
+            }
+
+            if (run.faceArray.size() > 0) {
+                Mesh* mesh = currentMesh().get();
+                Destination& destination = destinationArray.next();
+                destination.run    = &run;
+                destination.chunk  = c;
+                destination.mesh   = mesh;
+                destination.offset = mesh->faceArray.size();
+
+                // Reserve the space for the copy below
+                mesh->faceArray.resize(destination.offset + run.faceArray.size(), false);
+            }
+        }
+    }
+
+    runConcurrently(0, destinationArray.size(), [&](int d) {
+        const Destination& destination = destinationArray[d];
+        Face* face = destination.mesh->faceArray.getCArray() + destination.offset;
+        std::copy(destination.run->faceArray.begin(), destination.run->faceArray.end(), face);
+
+        if (parserArray[destination.chunk].m_hasRelativeIndices) {
+            // Resolve relative indices against the arrays for the whole file
+            const int vertexOffset   = vertexBase[destination.chunk] - CHUNK_RELATIVE_INDEX;
+            const int texCoordOffset = texCoordBase[destination.chunk] - CHUNK_RELATIVE_INDEX;
+            const int normalOffset   = normalBase[destination.chunk] - CHUNK_RELATIVE_INDEX;
+            for (int f = 0; f < destination.run->faceArray.size(); ++f) {
+                for (int i = 0; i < face[f].size(); ++i) {
+                    Index& index = face[f][i];
+                    if (index.vertex < CHUNK_RELATIVE_INDEX / 2)   { index.vertex   += vertexOffset; }
+                    if (index.texCoord < CHUNK_RELATIVE_INDEX / 2) { index.texCoord += texCoordOffset; }
+                    if (index.normal < CHUNK_RELATIVE_INDEX / 2)   { index.normal   += normalOffset; }
+                }
+            }
+        }
+    });
+
+    return true;
 }
 
 
@@ -125,6 +293,36 @@ shared_ptr<ParseMTL::Material> ParseOBJ::getMaterial(const String& materialName)
 }
 
 
+void ParseOBJ::changeGroup(const String& groupName) {
+    shared_ptr<Group>& g = groupTable.getCreate(groupName);
+
+    if (isNull(g)) {
+        // Newly created
+        g = Group::create();
+        g->name = groupName;
+    }
+
+    m_currentGroup = g;
+}
+
+
+void ParseOBJ::changeMaterial(const String& materialName) {
+    // Change the mesh within the group
+    m_currentMaterial = getMaterial(materialName);
+
+    // Force re-obtaining or creating of the appropriate mesh
+    m_currentMesh.reset();
+}
+
+
+void ParseOBJ::loadMaterialLibrary(const String& mtlFilename) {
+    mtlArray.append(mtlFilename);
+
+    TextInput ti2(FilePath::concat(m_basePath, mtlFilename));
+    m_currentMaterialLibrary.parse(ti2, "<AUTO>", m_objOptions.materialOptions);
+}
+
+
 bool ParseOBJ::maybeReadWhitespace() {
     bool changedLines = false;
 
@@ -255,7 +453,7 @@ ParseOBJ::Command ParseOBJ::readCommand() {
 }
 
 
-void ParseOBJ::readFace() {
+const shared_ptr<ParseOBJ::Mesh>& ParseOBJ::currentMesh() {
     // Ensure that we have a material
     if (isNull(m_currentMaterial)) {
         m_currentMaterial = m_currentMaterialLibrary.materialTable["default"];
@@ -284,11 +482,19 @@ void ParseOBJ::readFace() {
         m_currentMesh = m;
     }
 
-    Face& face = m_currentMesh->faceArray.next();
+    return m_currentMesh;
+}
 
-    const int vertexArraySize   = vertexArray.size();
-    const int texCoordArraySize = texCoord0Array.size();
-    const int normalArraySize   = normalArray.size();
+
+void ParseOBJ::readFace() {
+    // In parallel mode, the mesh is not known until the preceding chunks are merged
+    Face& face = notNull(m_runArray) ? m_runArray->last().faceArray.next() : currentMesh()->faceArray.next();
+
+    // In parallel mode, relative indices are offset to be corrected after all chunks are parsed
+    const int bias              = notNull(m_runArray) ? CHUNK_RELATIVE_INDEX : 0;
+    const int vertexArraySize   = vertexArray.size() + bias;
+    const int texCoordArraySize = texCoord0Array.size() + bias;
+    const int normalArraySize   = normalArray.size() + bias;
 
     // Consume leading whitespace
     bool done = maybeReadWhitespace();
@@ -304,6 +510,7 @@ void ParseOBJ::readFace() {
             // Negative; make relative to the current end of the array.
             // -1 will be the last element, so just add the size of the array.
             index.vertex += vertexArraySize;
+            m_hasRelativeIndices = true;
         }
 
         if ((remainingCharacters > 0) && (*nextCharacter == '/')) {
@@ -322,6 +529,7 @@ void ParseOBJ::readFace() {
                         // of the array.  -1 will be the last element,
                         // so just add the size of the array.
                         index.texCoord += texCoordArraySize;
+                        m_hasRelativeIndices = true;
                     }
                 }
 
@@ -340,6 +548,7 @@ void ParseOBJ::readFace() {
                         // element, so just add the size of the
                         // array.
                         index.normal += normalArraySize;
+                        m_hasRelativeIndices = true;
                     }       
                 }
             }
@@ -390,46 +599,22 @@ void ParseOBJ::processCommand(const Command command) {
         break;
 
     case GROUP:
-        {
-            // Change group
-            const String& groupName = readName();
-
-            shared_ptr<Group>& g = groupTable.getCreate(groupName);
-
-            if (isNull(g)) {
-                // Newly created
-                g = Group::create();
-                g->name = groupName;
-            }
-
-            m_currentGroup = g;
-        }
-        // Consume anything else on this line
-        readUntilNewline();
-        break;
-
     case USEMTL:
-        {
-            // Change the mesh within the group
-            const String& materialName = readName();
-            m_currentMaterial = getMaterial(materialName);
-
-            // Force re-obtaining or creating of the appropriate mesh
-            m_currentMesh.reset();
-        }
-        // Consume anything else on this line
-        readUntilNewline();
-        break;
-
     case MTLLIB:
         {
-            // Specify material library 
-            String mtlFilename = readName();
-            mtlArray.append(mtlFilename);
-            mtlFilename = FilePath::concat(m_basePath, mtlFilename);
-
-            TextInput ti2(mtlFilename);
-            m_currentMaterialLibrary.parse(ti2, "<AUTO>", m_objOptions.materialOptions);
+            const String& name = readName();
+            if (notNull(m_runArray)) {
+                // Defer until the state left by the preceding chunks is known
+                Run& run = m_runArray->next();
+                run.command = command;
+                run.name    = name;
+            } else if (command == GROUP) {
+                changeGroup(name);
+            } else if (command == USEMTL) {
+                changeMaterial(name);
+            } else {
+                loadMaterialLibrary(name);
+            }
         }
         // Consume anything else on this line
         readUntilNewline();
@@ -716,6 +716,232 @@ private:
         m_lock.unlock();
     }
 
+public:
+
+    /** 
+      Per-thread magazines of free buffers for each pool, so that most
+      mallocs and frees never acquire m_lock. An empty magazine is
+      refilled with a batch of buffers from the shared pool and a full
+      one returns half of its buffers in one batch.
+
+      The statistics are only written by the owning thread and are
+      read by status().
+     */
+    class ThreadCache {
+    public:
+        enum {tinyCapacity = 128, smallCapacity = 32, medCapacity = 8};
+
+        UserPtr             tiny[tinyCapacity];
+        int                 tinySize;
+
+        MemBlock            small[smallCapacity];
+        int                 smallSize;
+
+        MemBlock            med[medCapacity];
+        int                 medSize;
+
+        /** All mallocs on this thread of at most medBufferSize bytes */
+        std::atomic<int>    numMallocs;
+
+        /** Mallocs served from a magazine without acquiring the lock */
+        std::atomic<int>    numHits;
+
+        /** Mallocs served from the shared pools under the lock, which also refills the magazine */
+        std::atomic<int>    numShared;
+
+        std::atomic<int>    mallocsFromTinyPool;
+        std::atomic<int>    mallocsFromSmallPool;
+        std::atomic<int>    mallocsFromMedPool;
+
+        /** Sequential ID for status() */
+        int                 index;
+
+        /** Doubly-linked list of live caches, protected by BufferPool::m_lock */
+        ThreadCache*        prev;
+        ThreadCache*        next;
+
+        ThreadCache() : tinySize(0), smallSize(0), medSize(0), numMallocs(0), numHits(0), numShared(0),
+            mallocsFromTinyPool(0), mallocsFromSmallPool(0), mallocsFromMedPool(0), index(0), prev(nullptr), next(nullptr) {}
+
+        /** Increment a counter that only this thread writes */
+        static void increment(std::atomic<int>& counter) {
+            counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        }
+    };
+
+private:
+
+    ThreadCache*        m_firstCache;
+    int                 m_numCachesCreated;
+
+    /** Returns the calling thread's cache, creating it on first use. Returns
+        nullptr while the thread is exiting. */
+    static ThreadCache* threadCache();
+
+    /** Removes and returns a block of at least \a bytes from a magazine, or nullptr */
+    static UserPtr magazineTake(MemBlock* magazine, int& size, size_t bytes) {
+        // Search backwards since usually we'll re-use the last one
+        for (int i = size - 1; i >= 0; --i) {
+            if (magazine[i].bytes >= bytes) {
+                UserPtr ptr = magazine[i].ptr;
+                --size;
+                magazine[i] = magazine[size];
+                return ptr;
+            }
+        }
+        return nullptr;
+    }
+
+    /** Moves up to \a count blocks from the end of the shared pool into a magazine. Requires the lock. */
+    static void refillLocked(MemBlock* pool, int& poolSize, MemBlock* magazine, int& magazineSize, int count) {
+        for (; (count > 0) && (poolSize > 0); --count) {
+            --poolSize;
+            magazine[magazineSize] = pool[poolSize];
+            ++magazineSize;
+            pool[poolSize] = MemBlock();
+        }
+    }
+
+    /** Returns a block to the shared pool, or to the heap if the pool is full. Requires the lock. */
+    void releaseLocked(MemBlock* pool, int& poolSize, const int maxPoolSize, const MemBlock& block) {
+        if (poolSize < maxPoolSize) {
+            pool[poolSize] = block;
+            ++poolSize;
+        } else {
+            bytesAllocated.fetch_sub(USERSIZE_TO_REALSIZE(block.bytes));
+            ::free(USERPTR_TO_REALPTR(block.ptr));
+        }
+    }
+
+    /** Moves the oldest \a count blocks of a magazine to the shared pool. Requires the lock. */
+    void drainLocked(MemBlock* magazine, int& magazineSize, int count, MemBlock* pool, int& poolSize, const int maxPoolSize) {
+        count = min(count, magazineSize);
+        for (int i = 0; i < count; ++i) {
+            releaseLocked(pool, poolSize, maxPoolSize, magazine[i]);
+        }
+        // Keep the most recently freed (and most likely cached) blocks
+        for (int i = count; i < magazineSize; ++i) {
+            magazine[i - count] = magazine[i];
+        }
+        magazineSize -= count;
+    }
+
+    void drainTinyLocked(ThreadCache& cache, int count) {
+        count = min(count, cache.tinySize);
+        for (int i = 0; i < count; ++i) {
+            tinyFree(cache.tiny[i]);
+        }
+        for (int i = count; i < cache.tinySize; ++i) {
+            cache.tiny[i - count] = cache.tiny[i];
+        }
+        cache.tinySize -= count;
+    }
+
+    /** Serves a malloc of at most medBufferSize bytes, preferring the magazine, then the shared pool, then the heap */
+    UserPtr cachedMalloc(ThreadCache& cache, size_t bytes) {
+        ThreadCache::increment(cache.numMallocs);
+
+        if (bytes <= tinyBufferSize) {
+            bool refilled = false;
+            if (cache.tinySize == 0) {
+                lock();
+                for (; (cache.tinySize < ThreadCache::tinyCapacity / 2) && (tinyPoolSize > 0); ++cache.tinySize) {
+                    cache.tiny[cache.tinySize] = tinyMalloc(tinyBufferSize);
+                }
+                unlock();
+                refilled = true;
+            }
+
+            if (cache.tinySize > 0) {
+                --cache.tinySize;
+                ThreadCache::increment(refilled ? cache.numShared : cache.numHits);
+                ThreadCache::increment(cache.mallocsFromTinyPool);
+                return cache.tiny[cache.tinySize];
+            }
+            // Failure to allocate a tiny buffer is allowed to flow
+            // through to a small buffer
+        }
+
+        MemBlock*           magazine = nullptr;
+        int*                magazineSize = nullptr;
+        int                 capacity = 0;
+        MemBlock*           pool = nullptr;
+        int*                poolSize = nullptr;
+        int                 maxPoolSize = 0;
+        std::atomic<int>*   counter = nullptr;
+        if (bytes <= smallBufferSize) {
+            magazine = cache.small;     magazineSize = &cache.smallSize;    capacity    = ThreadCache::smallCapacity;
+            pool     = smallPool;       poolSize     = &smallPoolSize;      maxPoolSize = maxSmallBuffers;
+            counter  = &cache.mallocsFromSmallPool;
+        } else {
+            magazine = cache.med;       magazineSize = &cache.medSize;      capacity    = ThreadCache::medCapacity;
+            pool     = medPool;         poolSize     = &medPoolSize;        maxPoolSize = maxMedBuffers;
+            counter  = &cache.mallocsFromMedPool;
+        }
+
+        UserPtr ptr = magazineTake(magazine, *magazineSize, bytes);
+        if (ptr) {
+            ThreadCache::increment(cache.numHits);
+            ThreadCache::increment(*counter);
+            return ptr;
+        }
+
+        lock();
+        ptr = poolMalloc(pool, *poolSize, maxPoolSize, bytes);
+        if (ptr) {
+            // Take a batch for subsequent requests while holding the lock
+            refillLocked(pool, *poolSize, magazine, *magazineSize, min(capacity / 2, capacity - *magazineSize));
+        } else {
+            ++totalMallocs;
+        }
+        unlock();
+
+        if (ptr) {
+            ThreadCache::increment(cache.numShared);
+            ThreadCache::increment(*counter);
+            return ptr;
+        } else {
+            return heapMalloc(bytes);
+        }
+    }
+
+    /** Returns false if this buffer does not belong in a magazine */
+    bool cachedFree(ThreadCache& cache, UserPtr ptr) {
+        if (inTinyHeap(ptr)) {
+            if (cache.tinySize == ThreadCache::tinyCapacity) {
+                lock();
+                drainTinyLocked(cache, ThreadCache::tinyCapacity / 2);
+                unlock();
+            }
+            cache.tiny[cache.tinySize] = ptr;
+            ++cache.tinySize;
+            return true;
+        }
+
+        const size_t bytes = USERSIZE_FROM_USERPTR(ptr);
+        if (bytes <= smallBufferSize) {
+            if (cache.smallSize == ThreadCache::smallCapacity) {
+                lock();
+                drainLocked(cache.small, cache.smallSize, ThreadCache::smallCapacity / 2, smallPool, smallPoolSize, maxSmallBuffers);
+                unlock();
+            }
+            cache.small[cache.smallSize] = MemBlock(ptr, bytes);
+            ++cache.smallSize;
+            return true;
+        } else if (bytes <= medBufferSize) {
+            if (cache.medSize == ThreadCache::medCapacity) {
+                lock();
+                drainLocked(cache.med, cache.medSize, ThreadCache::medCapacity / 2, medPool, medPoolSize, maxMedBuffers);
+                unlock();
+            }
+            cache.med[cache.medSize] = MemBlock(ptr, bytes);
+            ++cache.medSize;
+            return true;
+        }
+
+        return false;
+    }
+
     /** 
      Malloc out of the tiny heap. Returns nullptr if allocation failed.
      */
@@ -874,6 +1100,8 @@ public:
         smallPoolPurgeCount = 0;
         medPoolPurgeCount   = 0;
 
+        m_firstCache        = nullptr;
+        m_numCachesCreated  = 0;
 
         // Initialize the tiny heap as a bunch of pointers into one
         // pre-allocated buffer.
@@ -891,6 +1119,60 @@ public:
         flushPool(medPool, medPoolSize);
     }
 
+
+    void registerCache(ThreadCache& cache) {
+        lock();
+        cache.index = m_numCachesCreated;
+        ++m_numCachesCreated;
+        cache.next = m_firstCache;
+        if (m_firstCache) {
+            m_firstCache->prev = &cache;
+        }
+        m_firstCache = &cache;
+        unlock();
+    }
+
+    /** Returns all of the cache's buffers to the shared pools and folds its statistics into the totals */
+    void unregisterCache(ThreadCache& cache) {
+        lock();
+        drainTinyLocked(cache, cache.tinySize);
+        drainLocked(cache.small, cache.smallSize, cache.smallSize, smallPool, smallPoolSize, maxSmallBuffers);
+        drainLocked(cache.med, cache.medSize, cache.medSize, medPool, medPoolSize, maxMedBuffers);
+
+        totalMallocs         += cache.numHits + cache.numShared;
+        mallocsFromTinyPool  += cache.mallocsFromTinyPool;
+        mallocsFromSmallPool += cache.mallocsFromSmallPool;
+        mallocsFromMedPool   += cache.mallocsFromMedPool;
+
+        if (cache.prev) {
+            cache.prev->next = cache.next;
+        } else {
+            m_firstCache = cache.next;
+        }
+        if (cache.next) {
+            cache.next->prev = cache.prev;
+        }
+        cache.prev = cache.next = nullptr;
+        unlock();
+    }
+
+    void resetCounters() {
+        lock();
+        totalMallocs         = 0;
+        mallocsFromMedPool   = 0;
+        mallocsFromSmallPool = 0;
+        mallocsFromTinyPool  = 0;
+        for (ThreadCache* cache = m_firstCache; cache; cache = cache->next) {
+            cache->numMallocs           = 0;
+            cache->numHits              = 0;
+            cache->numShared           = 0;
+            cache->mallocsFromTinyPool  = 0;
+            cache->mallocsFromSmallPool = 0;
+            cache->mallocsFromMedPool   = 0;
+        }
+        unlock();
+    }
+
     
     UserPtr realloc(UserPtr ptr, size_t bytes) {
         if (ptr == nullptr) {
@@ -906,9 +1188,7 @@ public:
                 
                 UserPtr newPtr = malloc(bytes);
                 System::memcpy(newPtr, ptr, tinyBufferSize);
-                lock();
-                tinyFree(ptr);
-                unlock();
+                free(ptr);
                 return newPtr;
 
             }
@@ -932,6 +1212,36 @@ public:
 
 
     UserPtr malloc(size_t bytes) {
+        if (bytes <= medBufferSize) {
+            ThreadCache* cache = threadCache();
+            if (cache) {
+                UserPtr ptr = cachedMalloc(*cache, bytes);
+                debugAssertM((intptr_t)ptr % 16 == 0, "BufferPool::cachedMalloc returned non-16 byte aligned memory");
+                return ptr;
+            }
+        }
+        return sharedMalloc(bytes);
+    }
+
+
+    void free(UserPtr ptr) {
+        if (ptr == nullptr) {
+            // Free does nothing on null pointers
+            return;
+        }
+
+        assert(isValidPointer(ptr));
+
+        ThreadCache* cache = threadCache();
+        if (cache && cachedFree(*cache, ptr)) {
+            return;
+        }
+        sharedFree(ptr);
+    }
+
+
+    /** Allocates from the shared pools or the heap, bypassing the thread cache */
+    UserPtr sharedMalloc(size_t bytes) {
         lock();
         ++totalMallocs;
 
@@ -977,8 +1287,14 @@ public:
             }
         }
 
-        bytesAllocated.fetch_add(USERSIZE_TO_REALSIZE(bytes));
         unlock();
+        return heapMalloc(bytes);
+    }
+
+
+    /** Allocates directly from the heap. The caller must already have counted the malloc. */
+    UserPtr heapMalloc(size_t bytes) {
+        bytesAllocated.fetch_add(USERSIZE_TO_REALSIZE(bytes));
 
         // Heap allocate
 
@@ -1027,14 +1343,8 @@ public:
     }
 
 
-    void free(UserPtr ptr) {
-        if (ptr == nullptr) {
-            // Free does nothing on null pointers
-            return;
-        }
-
-        assert(isValidPointer(ptr));
-
+    /** Returns a buffer to the shared pools or the heap, bypassing the thread cache */
+    void sharedFree(UserPtr ptr) {
         if (inTinyHeap(ptr)) {
             lock();
             tinyFree(ptr);
@@ -1067,21 +1377,47 @@ public:
         ::free(USERPTR_TO_REALPTR(ptr));
     }
 
-    String mallocRatioString() const {
-        if (totalMallocs > 0) {
-            int pooled = mallocsFromTinyPool +
-                         mallocsFromSmallPool + 
-                         mallocsFromMedPool;
+    /** Describes the hit rate of each live thread cache. Buffers held in thread caches are not counted
+        as free in the pool sizes. */
+    String threadCacheString() {
+        lock();
+        String s = "Thread Caches (hit = no lock, shared = refilled from shared pool under the lock):";
+        for (const ThreadCache* cache = m_firstCache; cache; cache = cache->next) {
+            const int n = max(1, int(cache->numMallocs));
+            s += format("\n  Thread %3d: %9d mallocs, %5.1f%% hit, %5.1f%% shared; holding %d/%d/%d buffers",
+                        cache->index, int(cache->numMallocs),
+                        100.0 * cache->numHits / n, 100.0 * cache->numShared / n,
+                        cache->tinySize, cache->smallSize, cache->medSize);
+        }
+        unlock();
+        return s;
+    }
+
+    String mallocRatioString() {
+        // Include the mallocs served by live thread caches
+        int total = totalMallocs;
+        int fromTiny = mallocsFromTinyPool;
+        int fromSmall = mallocsFromSmallPool;
+        int fromMed = mallocsFromMedPool;
+        lock();
+        for (const ThreadCache* cache = m_firstCache; cache; cache = cache->next) {
+            total     += cache->numHits + cache->numShared;
+            fromTiny  += cache->mallocsFromTinyPool;
+            fromSmall += cache->mallocsFromSmallPool;
+            fromMed   += cache->mallocsFromMedPool;
+        }
+        unlock();
 
-            int total = totalMallocs;
+        if (total > 0) {
+            int pooled = fromTiny + fromSmall + fromMed;
 
             return format("Percent of Mallocs: %5.1f%% <= %db, %5.1f%% <= %db, "
                           "%5.1f%% <= %db, %5.1f%% > %db",
-                          100.0 * mallocsFromTinyPool  / total,
+                          100.0 * fromTiny  / total,
                           BufferPool::tinyBufferSize,
-                          100.0 * mallocsFromSmallPool / total,
+                          100.0 * fromSmall / total,
                           BufferPool::smallBufferSize,
-                          100.0 * mallocsFromMedPool   / total,
+                          100.0 * fromMed   / total,
                           BufferPool::medBufferSize,
                           100.0 * (1.0 - (double)pooled / total),
                           BufferPool::medBufferSize);
@@ -1090,7 +1426,7 @@ public:
         }
     }
 
-    String status() const {
+    String status() {
         String tinyPoolString = format("Tiny Pool: %5.1f%% of %d x %db Free", 100.0 * tinyPoolSize / maxTinyBuffers, 
                                        maxTinyBuffers, tinyBufferSize);
         String poolSizeString = format("Pool Sizes: %5d/%d x %db, %5d/%d x %db, %5d/%d x %db",
@@ -1104,7 +1440,7 @@ public:
         int outOfPoolsMallocs = totalMallocs - pooled;
         String outOfBufferMemoryString = format("Total out of pools mallocs: %d; Bytes allocated: %d", outOfPoolsMallocs, int(bytesAllocated));
         String purgeString = format("Small Pool Purges: %d; Med Pool Purges: %d", smallPoolPurgeCount, medPoolPurgeCount);
-        return mallocRatioString() + "\n" + poolSizeString + "\n" + outOfBufferMemoryString + "\n" + purgeString;
+        return mallocRatioString() + "\n" + poolSizeString + "\n" + outOfBufferMemoryString + "\n" + purgeString + "\n" + threadCacheString();
 
     }
 };
@@ -1114,6 +1450,40 @@ public:
 // is deallocated.
 static BufferPool* bufferpool = nullptr;
 
+namespace {
+
+/** Null until the thread first allocates, and again once its cache has been destroyed */
+thread_local BufferPool::ThreadCache* t_threadCache = nullptr;
+thread_local bool t_threadCacheDestroyed = false;
+
+/** Returns the cache's buffers to the shared pools when the thread exits */
+class ThreadCacheOwner {
+public:
+    BufferPool::ThreadCache cache;
+
+    ThreadCacheOwner() {
+        bufferpool->registerCache(cache);
+    }
+
+    ~ThreadCacheOwner() {
+        t_threadCache = nullptr;
+        t_threadCacheDestroyed = true;
+        bufferpool->unregisterCache(cache);
+    }
+};
+
+} // namespace
+
+
+BufferPool::ThreadCache* BufferPool::threadCache() {
+    if ((t_threadCache == nullptr) && ! t_threadCacheDestroyed) {
+        // Globals destroyed after this thread's thread_locals fall back to the shared pools
+        static thread_local ThreadCacheOwner owner;
+        t_threadCache = &owner.cache;
+    }
+    return t_threadCache;
+}
+
 String System::mallocStatus() {    
 #ifndef NO_BUFFERPOOL
     return bufferpool->status();
@@ -1125,10 +1495,7 @@ String System::mallocStatus() {
 
 void System::resetMallocPerformanceCounters() {
 #ifndef NO_BUFFERPOOL
-    bufferpool->totalMallocs         = 0;
-    bufferpool->mallocsFromMedPool   = 0;
-    bufferpool->mallocsFromSmallPool = 0;
-    bufferpool->mallocsFromTinyPool  = 0;
+    bufferpool->resetCounters();
 #endif
 }
 
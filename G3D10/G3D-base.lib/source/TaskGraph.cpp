@@ -0,0 +1,209 @@
+/**
+  \file G3D-base.lib/source/TaskGraph.cpp
+
+  G3D Innovation Engine http://casual-effects.com/g3d
+  Copyright 2000-2019, Morgan McGuire
+  All rights reserved
+  Available under the BSD License
+*/
+
+#include "G3D-base/TaskGraph.h"
+#include "G3D-base/debugAssert.h"
+#include "G3D-base/Queue.h"
+#include <condition_variable>
+#include <mutex>
+
+namespace G3D {
+
+TaskGraph::TaskID TaskGraph::add
+   (const String&                   name,
+    const std::function<void ()>&   callback,
+    Affinity                        affinity,
+    const Array<TaskID>&            prerequisites) {
+
+    const TaskID id = m_task.size();
+    Task& task = m_task.next();
+    task.name = name;
+    task.callback = callback;
+    task.affinity = affinity;
+    task.successors.fastClear();
+    task.numPrerequisites = 0;
+
+    for (const TaskID p : prerequisites) {
+        addDependency(p, id);
+    }
+
+    return id;
+}
+
+
+void TaskGraph::addDependency(TaskID prerequisite, TaskID dependent) {
+    debugAssertM((prerequisite >= 0) && (prerequisite < m_task.size()), "Invalid prerequisite TaskID");
+    debugAssertM((dependent >= 0) && (dependent < m_task.size()), "Invalid dependent TaskID");
+    debugAssertM(prerequisite != dependent, "A task cannot depend on itself");
+
+    m_task[prerequisite].successors.append(dependent);
+    ++m_task[dependent].numPrerequisites;
+}
+
+
+TaskGraph::TaskID TaskGraph::find(const String& name) const {
+    for (int t = 0; t < m_task.size(); ++t) {
+        if (m_task[t].name == name) {
+            return t;
+        }
+    }
+    return -1;
+}
+
+
+void TaskGraph::clear() {
+    // Release the callbacks' captured state, but keep the arrays
+    for (Task& task : m_task) {
+        task.callback = nullptr;
+    }
+    m_task.fastClear();
+}
+
+
+bool TaskGraph::isAcyclic() const {
+    // Kahn's algorithm: every task is eventually ready iff there is no cycle
+    Array<int> remaining;
+    remaining.resize(m_task.size());
+    Array<TaskID> ready;
+    for (int t = 0; t < m_task.size(); ++t) {
+        remaining[t] = m_task[t].numPrerequisites;
+        if (remaining[t] == 0) {
+            ready.append(t);
+        }
+    }
+
+    int numVisited = 0;
+    while (ready.size() > 0) {
+        const TaskID t = ready.pop();
+        ++numVisited;
+        for (const TaskID s : m_task[t].successors) {
+            if (--remaining[s] == 0) {
+                ready.append(s);
+            }
+        }
+    }
+
+    return numVisited == m_task.size();
+}
+
+
+void TaskGraph::runSerial() {
+    Array<int> remaining;
+    remaining.resize(m_task.size());
+    Array<TaskID> ready;
+    for (int t = m_task.size() - 1; t >= 0; --t) {
+        remaining[t] = m_task[t].numPrerequisites;
+        if (remaining[t] == 0) {
+            ready.append(t);
+        }
+    }
+
+    // Pops in insertion order when there are no edges, which matches the
+    // order in which the tasks were added
+    while (ready.size() > 0) {
+        const TaskID t = ready.pop();
+        m_task[t].callback();
+        for (int i = m_task[t].successors.size() - 1; i >= 0; --i) {
+            const TaskID s = m_task[t].successors[i];
+            if (--remaining[s] == 0) {
+                ready.append(s);
+            }
+        }
+    }
+}
+
+
+void TaskGraph::run(bool singleThread) {
+    const int numTasks = m_task.size();
+    if (numTasks == 0) { return; }
+
+    debugAssertM(isAcyclic(), "TaskGraph contains a cycle");
+
+    // The calling thread blocks while waiting for its own tasks, so
+    // without at least one worker the pool tasks would never run
+    if (singleThread || (numTasks == 1) || (tbb::this_task_arena::max_concurrency() < 2)) {
+        runSerial();
+        return;
+    }
+
+    if (m_remainingCapacity < numTasks) {
+        m_remaining.reset(new std::atomic<int>[numTasks]);
+        m_remainingCapacity = numTasks;
+    }
+    for (int t = 0; t < numTasks; ++t) {
+        m_remaining[t].store(m_task[t].numPrerequisites, std::memory_order_relaxed);
+    }
+
+    tbb::task_group             group;
+
+    // Tasks that must execute on this thread, guarded by mutex
+    std::mutex                  mutex;
+    std::condition_variable     wake;
+    Queue<TaskID>               callingThreadReady;
+    int                         numComplete = 0;
+
+    std::function<void (TaskID)> execute;
+
+    const auto schedule = [&](TaskID t) {
+        if (m_task[t].affinity == Affinity::CALLING_THREAD) {
+            {
+                std::lock_guard<std::mutex> guard(mutex);
+                callingThreadReady.pushBack(t);
+            }
+            wake.notify_one();
+        } else {
+            group.run([&execute, t]() { execute(t); });
+        }
+    };
+
+    execute = [&](TaskID t) {
+        const Task& task = m_task[t];
+        task.callback();
+
+        for (const TaskID s : task.successors) {
+            if (m_remaining[s].fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                schedule(s);
+            }
+        }
+
+        bool done = false;
+        {
+            std::lock_guard<std::mutex> guard(mutex);
+            done = (++numComplete == numTasks);
+        }
+        if (done) {
+            wake.notify_one();
+        }
+    };
+
+    for (int t = 0; t < numTasks; ++t) {
+        if (m_task[t].numPrerequisites == 0) {
+            schedule(t);
+        }
+    }
+
+    // Service calling-thread tasks until every task has completed
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (numComplete < numTasks) {
+            if (callingThreadReady.size() > 0) {
+                const TaskID t = callingThreadReady.popFront();
+                lock.unlock();
+                execute(t);
+                lock.lock();
+            } else {
+                wake.wait(lock);
+            }
+        }
+    }
+
+    group.wait();
+}
+
+} // namespace G3D
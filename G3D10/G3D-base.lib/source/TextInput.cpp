@@ -15,12 +15,215 @@
 #include "G3D-base/FileSystem.h"
 #include "G3D-base/stringutils.h"
 
+#ifdef G3D_X86
+#   include <emmintrin.h>
+#endif
+#ifdef _MSC_VER
+#   include <intrin.h>
+#endif
+
 #ifdef _MSC_VER
 #   pragma warning (push)
 #endif
 
 namespace G3D {
 
+/* Character classes for scanning runs of input. Each class tests one
+   character, and on x86 also tests 16 at once, setting every byte of the
+   result whose character is in the class. Runs that contain newlines are
+   never scanned because eatInputChar() must count lines. */
+namespace {
+
+/** Spaces and tabs */
+class BlankClass {
+public:
+    bool contains(unsigned char c) const {
+        return (c == ' ') || (c == '\t');
+    }
+
+#   ifdef G3D_X86
+    __m128i contains(__m128i v) const {
+        return _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')), _mm_cmpeq_epi8(v, _mm_set1_epi8('\t')));
+    }
+#   endif
+};
+
+
+/** [0-9] */
+class DigitClass {
+public:
+    bool contains(unsigned char c) const {
+        return (c >= '0') && (c <= '9');
+    }
+
+#   ifdef G3D_X86
+    __m128i contains(__m128i v) const {
+        // Bytes >= 128 are negative as signed chars, so they fail the first test
+        return _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('0' - 1)), _mm_cmplt_epi8(v, _mm_set1_epi8('9' + 1)));
+    }
+#   endif
+};
+
+
+/** [A-Za-z0-9_] */
+class IdentifierClass {
+public:
+    bool contains(unsigned char c) const {
+        const unsigned char lower = c | 0x20;
+        return ((lower >= 'a') && (lower <= 'z')) || ((c >= '0') && (c <= '9')) || (c == '_');
+    }
+
+#   ifdef G3D_X86
+    __m128i contains(__m128i v) const {
+        // Setting bit 5 maps upper case onto lower case without moving any other character into [a-z]
+        const __m128i lower  = _mm_or_si128(v, _mm_set1_epi8(0x20));
+        const __m128i letter = _mm_and_si128(_mm_cmpgt_epi8(lower, _mm_set1_epi8('a' - 1)), _mm_cmplt_epi8(lower, _mm_set1_epi8('z' + 1)));
+        const __m128i digit  = DigitClass().contains(v);
+        return _mm_or_si128(_mm_or_si128(letter, digit), _mm_cmpeq_epi8(v, _mm_set1_epi8('_')));
+    }
+#   endif
+};
+
+
+/** Every character except newlines and up to two other stop characters */
+class ExceptClass {
+private:
+    const unsigned char m_stop1;
+    const unsigned char m_stop2;
+
+public:
+    ExceptClass(unsigned char stop1 = '\n', unsigned char stop2 = '\n') : m_stop1(stop1), m_stop2(stop2) {}
+
+    bool contains(unsigned char c) const {
+        return (c != '\n') && (c != '\r') && (c != m_stop1) && (c != m_stop2);
+    }
+
+#   ifdef G3D_X86
+    __m128i contains(__m128i v) const {
+        const __m128i stop = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\n')), _mm_cmpeq_epi8(v, _mm_set1_epi8('\r'))),
+            _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(char(m_stop1))), _mm_cmpeq_epi8(v, _mm_set1_epi8(char(m_stop2)))));
+        return _mm_cmpeq_epi8(stop, _mm_setzero_si128());
+    }
+#   endif
+};
+
+} // namespace
+
+
+/** Number of characters at the start of the \a n characters at \a p that are in \a cls */
+template<class Class>
+static int spanOf(const Class& cls, const char* p, int n) {
+    int i = 0;
+#   ifdef G3D_X86
+        for (; i + 16 <= n; i += 16) {
+            const uint32 mask = uint32(_mm_movemask_epi8(cls.contains(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i)))));
+            if (mask != 0xFFFF) {
+                // Index of the first character not in the class
+#               ifdef _MSC_VER
+                    unsigned long j;
+                    _BitScanForward(&j, ~mask);
+                    return i + int(j);
+#               else
+                    return i + __builtin_ctz(~mask);
+#               endif
+            }
+        }
+#   endif
+    while ((i < n) && cls.contains((unsigned char)p[i])) {
+        ++i;
+    }
+    return i;
+}
+
+
+template<class Class>
+int TextInput::eatRun(const Class& cls, String* s) {
+    const char* start = buffer.getCArray() + currentCharOffset;
+    const int   n     = spanOf(cls, start, buffer.size() - currentCharOffset);
+    if (notNull(s) && (n > 0)) {
+        s->append(start, n);
+    }
+
+    // The run has no newlines, so it only advances the character number
+    currentCharOffset += n;
+    charNumber        += n;
+    return peekInputChar();
+}
+
+
+/** Parses \a s if it is a decimal number of the form [-]digits[.digits][e[+-]digits][f] whose
+    value can be computed exactly from its digits with one rounding (Clinger's fast path).
+    Returns false otherwise, including for numbers that are valid but need more precision. */
+static bool parseSimpleDecimal(const char* s, double& n) {
+    static const double powersOfTen[] = {
+        1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+    // Doubles represent every integer up to this exactly
+    const uint64 maxMantissa = uint64(1) << 53;
+
+    const bool negative = (*s == '-');
+    if (negative) {
+        ++s;
+    }
+
+    uint64 mantissa = 0;
+    int exponent = 0;
+    int numDigits = 0;
+    for (; isDigitFast(*s); ++s, ++numDigits) {
+        if (mantissa >= maxMantissa) {
+            return false;
+        }
+        mantissa = mantissa * 10 + uint64(*s - '0');
+    }
+
+    if (*s == '.') {
+        ++s;
+        for (; isDigitFast(*s); ++s, ++numDigits, --exponent) {
+            if (mantissa >= maxMantissa) {
+                return false;
+            }
+            mantissa = mantissa * 10 + uint64(*s - '0');
+        }
+    }
+
+    if ((numDigits == 0) || (mantissa > maxMantissa)) {
+        return false;
+    }
+
+    if (((*s == 'e') || (*s == 'E')) && (isDigitFast(s[1]) || (((s[1] == '-') || (s[1] == '+')) && isDigitFast(s[2])))) {
+        ++s;
+        const bool negativeExponent = (*s == '-');
+        if ((*s == '-') || (*s == '+')) {
+            ++s;
+        }
+        int e = 0;
+        for (; isDigitFast(*s); ++s) {
+            if (e > 1000) {
+                return false;
+            }
+            e = e * 10 + (*s - '0');
+        }
+        exponent += negativeExponent ? -e : e;
+    }
+
+    if ((*s == 'f') || (*s == 'F')) {
+        ++s;
+    }
+
+    if ((*s != '\0') || (exponent < -22) || (exponent > 22)) {
+        return false;
+    }
+
+    // Both operands are exact, so IEEE arithmetic rounds the quotient or product correctly
+    n = (exponent < 0) ? double(mantissa) / powersOfTen[-exponent] : double(mantissa) * powersOfTen[exponent];
+    if (negative) {
+        n = -n;
+    }
+    return true;
+}
+
+
 Token TextInput::readSignificant() {
     Token t;
     do { 
@@ -45,6 +248,12 @@ bool TextInput::parseBoolean(const String& _string) {
 
 
 double TextInput::parseNumber(const String& s) {
+    double n;
+    if (parseSimpleDecimal(s.c_str(), n)) {
+        // Common case
+        return n;
+    }
+
     if (s == "-1.#IND00" || s == "-1.#IND" || s == "nan" || s == "NaN" || s == "1.#QNAN") {
         return nan();
     }
@@ -57,7 +266,6 @@ double TextInput::parseNumber(const String& s) {
         return -inf();
     }
     
-    double n;
     if ((s.length() > 2) &&
         (s[0] == '0') &&
         ((s[1] == 'x') || (s[1] == 'X'))) {
@@ -297,6 +505,9 @@ void TextInput::nextToken(Token& t) {
 
                 eatInputChar();
                 return;
+            } else if ((c == ' ') || (c == '\t')) {
+                // Consume the whole run of blanks
+                c = eatRun(BlankClass());
             } else {
                 // Consume the single whitespace
                 c = eatAndPeekInputChar();
@@ -350,14 +561,8 @@ void TextInput::nextToken(Token& t) {
 
         if (isLineComment) {
 
-            // consume line comment to newline or EOF
-            c = peekInputChar();
-            while (! isNewline(c) && c != EOF) {
-                // build comment string for token
-                commentString += c;
-
-                c = eatAndPeekInputChar();
-            }
+            // consume line comment to newline or EOF, building the comment string for the token
+            c = eatRun(ExceptClass(), &commentString);
 
             if (options.generateCommentTokens) {
                 t._type         = Token::COMMENT;
@@ -383,10 +588,15 @@ void TextInput::nextToken(Token& t) {
             c = peekInputChar();
             c2 = peekInputChar(1);
             while (! ((c == '*') && (c2 == '/')) && (c != EOF)) {
-                commentString += c;
+                if ((c == '*') || isNewline(c)) {
+                    commentString += c;
 
-                // Eat input char may consume more than one character if there is a newline
-                eatInputChar();
+                    // Eat input char may consume more than one character if there is a newline
+                    eatInputChar();
+                } else {
+                    // A run without '*' cannot contain the end of the comment
+                    eatRun(ExceptClass('*'), &commentString);
+                }
 
                 c = peekInputChar();
                 c2 = peekInputChar(1);
@@ -691,10 +901,7 @@ numLabel:
             // Non-hex number
 
             // Read the part before the decimal.
-            while (isDigit(c)) {
-                t._string += c;
-                c = eatAndPeekInputChar();
-            }
+            c = eatRun(DigitClass(), &t._string);
     
             // True if we are reading a floating-point special type
             bool isSpecial = false;
@@ -798,10 +1005,7 @@ numLabel:
                 } else {
 
                     // Read the part after the decimal
-                    while (isDigit((char)c)) {
-                        t._string += (char)c;
-                        c = eatAndPeekInputChar();
-                    }
+                    c = eatRun(DigitClass(), &t._string);
                 }
             }
 
@@ -816,10 +1020,7 @@ numLabel:
                     c = eatAndPeekInputChar();                    
                 }
 
-                while (isDigit(c)) {
-                    t._string += c;
-                    c = eatAndPeekInputChar();
-                }
+                c = eatRun(DigitClass(), &t._string);
             }
 
             if (! isSpecial && (t._extendedType == Token::FLOATING_POINT_TYPE) && (c == 'f')) {
@@ -837,10 +1038,14 @@ numLabel:
         t._type = Token::SYMBOL;
         t._extendedType = Token::SYMBOL_TYPE;
         t._string = "";
-        do {
+        c = eatRun(IdentifierClass(), &t._string);
+
+        // Letters outside of ASCII in the current locale, if any
+        while (isLetter(c) || isDigit(c) || (c == '_')) {
             t._string += c;
-            c = eatAndPeekInputChar();
-        } while (isLetter(c) || isDigit(c) || (c == '_'));
+            eatInputChar();
+            c = eatRun(IdentifierClass(), &t._string);
+        }
 
         // See if this symbol is actually a boolean
         if ((options.trueSymbols.size() > 0) || (options.falseSymbols.size() > 0)) {
@@ -915,6 +1120,9 @@ void TextInput::parseQuotedString(unsigned char delimiter, Token& t) {
     }
 
     while (true) {
+        // Copy the run of characters that need no special handling
+        eatRun(ExceptClass(delimiter, '\\'), &t._string);
+
         // We're definitely going to consume the next input char, so we get
         // it right now.  This makes the condition handling below a bit easier.
         int c = eatInputChar();
@@ -7,143 +7,218 @@
   Available under the BSD License
 */
 
+#include <atomic>
 #include "G3D-base/platform.h"
 #include "G3D-base/Vector2.h"
 #include "G3D-base/Vector3.h"
-#include "G3D-base/Sphere.h"
-#include "G3D-base/PointHashGrid.h"
+#include "G3D-base/Vector3int32.h"
 #include "G3D-base/Welder.h"
-#include "G3D-base/Stopwatch.h" // for profiling
-#include "G3D-base/AreaMemoryManager.h"
+#include "G3D-base/Thread.h"
 #include "G3D-base/Any.h"
 #include "G3D-base/stringutils.h"
 #include "G3D-base/BinaryInput.h"
 #include "G3D-base/BinaryOutput.h"
 
-namespace G3D { namespace _internal{
+namespace G3D { namespace _internal {
 
 // Uncomment to print information that can help with performance
 // profiling.
 //#define VERBOSE
 
-/** Used by WeldHelper2::smoothNormals. */
-class VN {
-public:
-    Vector3         vertex;
-    Vector3         normal;
+/** Points sorted by the grid cell that contains them, with a hash table
+    locating each occupied cell. This replaces a PointHashGrid so that both
+    construction and queries run on multiple threads. Points within a cell are in index order, so
+    queries visit neighbors in an order that does not depend on
+    scheduling. */
+class SortedPointGrid {
+private:
 
-    VN() {}
-    VN(const Vector3& v, const Vector3& n) : vertex(v), normal(n) {}
-};
+    class Entry {
+    public:
+        uint64          cell;
+        int             index;
+        Point3          position;
 
-/** Used by WeldHelper::getIndex to maintain a list of vertices by location. */
-class VNTi {
-public:
-    Vector3         vertex;
-    Vector3         normal;
-    Vector2         texCoord;
-    int             index;
+        bool operator<(const Entry& other) const {
+            return (cell < other.cell) || ((cell == other.cell) && (index < other.index));
+        }
+    };
 
-    VNTi() : index(0) {}
+    const float             m_radius;
 
-    VNTi(const Vector3& v, const Vector3& n, const Vector2& t, int i) : 
-        vertex(v), normal(n), texCoord(t), index(i) {}
-};
+    /** Cells are twice the radius, so that a query overlaps at most two cells along each axis */
+    const float             m_invCellSize;
+    Array<Entry>            m_entryArray;
 
+    Vector3int32 cellCoordinate(const Point3& p) const {
+        return Vector3int32(iFloor(p.x * m_invCellSize), iFloor(p.y * m_invCellSize), iFloor(p.z * m_invCellSize));
+    }
 
-}} // G3D
+    /** Keeps 21 bits per axis. Distant cells may share a key, which
+        only costs extra distance tests. */
+    static uint64 cellKey(const Vector3int32& c) {
+        const uint64 MASK = (uint64(1) << 21) - 1;
+        return ((uint64(c.x) & MASK) << 42) | ((uint64(c.y) & MASK) << 21) | (uint64(c.z) & MASK);
+    }
 
-template <> struct HashTrait <G3D::_internal::VN> {
-    static size_t hashCode(const G3D::_internal::VN& k) { return static_cast<size_t>(k.vertex.hashCode()); }
-};
-template <> struct HashTrait <G3D::_internal::VNTi> {
-    static size_t hashCode(const G3D::_internal::VNTi& k) { return static_cast<size_t>(k.vertex.hashCode()); }
-};
+    /** With a zero radius only identical points match, so the key is a
+        hash of the position itself */
+    static uint64 exactKey(const Point3& p) {
+        uint32 bits[3];
+        for (int a = 0; a < 3; ++a) {
+            // Adding zero maps -0 to +0, which compares equal to it
+            const float f = p[a] + 0.0f;
+            memcpy(&bits[a], &f, sizeof(float));
+        }
+        return (uint64(bits[0]) * 0x9E3779B97F4A7C15ULL) ^ (uint64(bits[1]) * 0xC2B2AE3D27D4EB4FULL) ^ (uint64(bits[2]) * 0x165667B19E3779F9ULL);
+    }
 
+    uint64 key(const Point3& p) const {
+        return (m_radius > 0) ? cellKey(cellCoordinate(p)) : exactKey(p);
+    }
 
-template<> struct EqualsTrait <G3D::_internal::VN> {
-    static bool equals(const G3D::_internal::VN& a, const G3D::_internal::VN& b) { return a.vertex == b.vertex; }
-};
-template<> struct EqualsTrait <G3D::_internal::VNTi> {
-    static bool equals(const G3D::_internal::VNTi& a, const G3D::_internal::VNTi& b) { return a.vertex == b.vertex; }
-};
+    /** The first entry of each distinct cell, plus one past the end */
+    Array<int>              m_cellStart;
 
-template<> struct PositionTrait<G3D::_internal::VN> {
-    static void getPosition(const G3D::_internal::VN& v, G3D::Vector3& p) { p = v.vertex; }
-};
-template<> struct PositionTrait<G3D::_internal::VNTi> {
-    static void getPosition(const G3D::_internal::VNTi& v, G3D::Vector3& p) { p = v.vertex; }
-};
+    /** Open-addressed table of indices into m_cellStart, or -1 for empty slots */
+    std::unique_ptr<std::atomic<int>[]> m_directory;
+    uint64                  m_directoryMask;
 
-namespace G3D { namespace _internal {
+    /** Mixes all bits of the key into the low bits */
+    static uint64 directoryHash(uint64 cell) {
+        cell ^= cell >> 33;
+        cell *= 0xFF51AFD7ED558CCDULL;
+        cell ^= cell >> 33;
+        return cell;
+    }
 
-class WeldHelper {
-private:
-    /** Used by getIndex and updateTriLists. Deallocating this is slow. */
-    PointHashGrid<VNTi>     weldGrid;
+    void buildDirectory() {
+        const int n = m_entryArray.size();
+
+        // Find the distinct cells
+        Array<bool> isStart;
+        isStart.resize(n);
+        runConcurrently(0, n, [&](int i) {
+            isStart[i] = (i == 0) || (m_entryArray[i].cell != m_entryArray[i - 1].cell);
+        });
+        for (int i = 0; i < n; ++i) {
+            if (isStart[i]) {
+                m_cellStart.append(i);
+            }
+        }
+        const int numCells = m_cellStart.size();
+        m_cellStart.append(n);
+
+        // At most half full
+        size_t directorySize = 16;
+        while (directorySize < size_t(numCells) * 2) {
+            directorySize *= 2;
+        }
+        m_directoryMask = directorySize - 1;
+        m_directory.reset(new std::atomic<int>[directorySize]);
+        runConcurrently(0, int(directorySize), [&](int i) {
+            m_directory[i].store(-1, std::memory_order_relaxed);
+        });
+
+        runConcurrently(0, numCells, [&](int c) {
+            for (uint64 slot = directoryHash(m_entryArray[m_cellStart[c]].cell) & m_directoryMask; ; slot = (slot + 1) & m_directoryMask) {
+                int empty = -1;
+                if (m_directory[slot].compare_exchange_strong(empty, c, std::memory_order_relaxed)) {
+                    break;
+                }
+            }
+        });
+    }
 
-    Array<Vector3>*         outputVertexArray;
-    Array<Vector3>*         outputNormalArray;
-    Array<Vector2>*         outputTexCoordArray;
+    template<class Fn>
+    void forEachInCell(uint64 cell, const Fn& fn) const {
+        for (uint64 slot = directoryHash(cell) & m_directoryMask; ; slot = (slot + 1) & m_directoryMask) {
+            const int c = m_directory[slot].load(std::memory_order_relaxed);
+            if (c == -1) {
+                // Empty cell
+                return;
+            }
 
-    float                   vertexWeldRadius;
-    /** Squared radius allowed for welding similar normals. */
-    float                   normalWeldRadius2;
-    float                   texCoordWeldRadius2;
+            const int start = m_cellStart[c];
+            if (m_entryArray[start].cell == cell) {
+                for (int i = start; i < m_cellStart[c + 1]; ++i) {
+                    fn(m_entryArray[i]);
+                }
+                return;
+            }
+        }
+    }
 
-    float                   normalSmoothingAngle;
+public:
 
-    /**
-     Returns the index of the vertex in 
-     outputVertexArray/outputNormalArray/outputTexCoordArray
-     that is within the global tolerances of v,n,t. If there 
-     is no such vertex, adds it to the arrays and returns that index.
+    /** \param radius Points within this distance are neighbors. May be zero. */
+    SortedPointGrid(const Array<Point3>& point, float radius) :
+        m_radius(radius),
+        m_invCellSize((radius > 0) ? 0.5f / radius : 0.0f) {
+
+        m_entryArray.resize(point.size());
+        runConcurrently(0, point.size(), [&](int i) {
+            m_entryArray[i].cell     = key(point[i]);
+            m_entryArray[i].index    = i;
+            m_entryArray[i].position = point[i];
+        });
+        tbb::parallel_sort(m_entryArray.begin(), m_entryArray.end());
+        buildDirectory();
+    }
 
-     Called from updateTriLists().
-     */
-    int getIndex(const Vector3& v, const Vector3& n, const Vector2& t) {
-        PointHashGrid<VNTi>::SphereIterator it = 
-                weldGrid.begin(Sphere(v, vertexWeldRadius));
-
-        if (n.isZero()) {
-            // Don't bother trying to match the surface normal, since this vertex has no surface normal.
-            while (it.isValid()) {
-                if ((t - it->texCoord).squaredLength() <= texCoordWeldRadius2) {
-                    // This is the vertex
-                    return it->index;
+    /** Invokes \a fn(j) for every point j within the radius of \a p. Safe to call concurrently. */
+    template<class Fn>
+    void forEachNeighbor(const Point3& p, const Fn& fn) const {
+        if (m_radius > 0) {
+            const float r2 = square(m_radius);
+            const Vector3int32& lo = cellCoordinate(p - Vector3::one() * m_radius);
+            const Vector3int32& hi = cellCoordinate(p + Vector3::one() * m_radius);
+            for (int z = lo.z; z <= hi.z; ++z) {
+                for (int y = lo.y; y <= hi.y; ++y) {
+                    for (int x = lo.x; x <= hi.x; ++x) {
+                        forEachInCell(cellKey(Vector3int32(x, y, z)), [&](const Entry& e) {
+                            if ((e.position - p).squaredLength() <= r2) {
+                                fn(e.index);
+                            }
+                        });
+                    }
                 }
-                ++it;
             }
         } else {
-            while (it.isValid()) {
-                if (((n - it->normal).squaredLength() <= normalWeldRadius2) &&
-                    ((t - it->texCoord).squaredLength() <= texCoordWeldRadius2)) {
-                    // This is the vertex
-                    return it->index;
+            forEachInCell(exactKey(p), [&](const Entry& e) {
+                if (e.position == p) {
+                    fn(e.index);
                 }
-                ++it;
-            }
+            });
         }
+    }
+};
 
-        // Note that a sliver triangle processed before its neighbors may reach here
-        // with a zero length normal.
 
-        // The vertex does not exist. Create it.
-        const int i = outputVertexArray->size();
-        outputVertexArray->append(v);
-        outputNormalArray->append(n);
-        outputTexCoordArray->append(t);
+class WeldHelper {
+private:
 
-        // Store in the grid so that it will be remembered.
-        weldGrid.insert(VNTi(v, n, t, i));
+    float                   vertexWeldRadius;
 
-        return i;
-    }
+    /** Squared radius allowed for welding similar normals. */
+    float                   normalWeldRadius2;
+    float                   texCoordWeldRadius2;
 
+    float                   normalSmoothingAngle;
+
+    /** Can vertex \a j be welded to vertex \a i, within the global tolerances? 
+        Vertices with zero normals match any normal. */
+    bool canWeld(int i, int j, const Array<Vector3>& normalArray, const Array<Vector2>& texCoordArray) const {
+        const Vector3& n = normalArray[i];
+        return (n.isZero() || ((n - normalArray[j]).squaredLength() <= normalWeldRadius2)) &&
+            ((texCoordArray[i] - texCoordArray[j]).squaredLength() <= texCoordWeldRadius2);
+    }
 
     /**
      Updates each indexArray to refer to vertices in the
-     outputVertexArray.
+     outputVertexArray. Each input vertex is welded to the first
+     earlier vertex within the global tolerances that was not itself
+     welded, or else becomes a new output vertex.
 
      Called from process()
      */
@@ -151,41 +226,89 @@ private:
     (Array<Array<int>*>&         indexArrayArray, 
      const Array<Vector3>&       vertexArray,
      const Array<Vector3>&       normalArray,
-     const Array<Vector2>&       texCoordArray) {
+     const Array<Vector2>&       texCoordArray,
+     Array<Vector3>&             outputVertexArray,
+     Array<Vector3>&             outputNormalArray,
+     Array<Vector2>&             outputTexCoordArray) {
      
 #       ifdef VERBOSE
             debugPrintf("WeldHelper::updateTriLists\n");
 #       endif
-          
-        // Compute a hash grid so that we can find neighbors quickly.
-        // It begins empty and is extended as the tri lists are iterated
-        // through.
-        weldGrid.clear();
-
-        // Process all triLists
-        int numTriLists = indexArrayArray.size();
-        int u = 0;
-        for (int t = 0; t < numTriLists; ++t) {
-            if (indexArrayArray[t] != nullptr) {
-                Array<int>& triList = *(indexArrayArray[t]);
-
-                // For all vertices in this list
-                for (int v = 0; v < triList.size(); ++v) {
-                    // This vertex mapped to u in the flatVertexArray
-                    triList[v] = getIndex(vertexArray[u], normalArray[u], texCoordArray[u]);
-
-                    /*
-    #           ifdef G3D_DEBUG
-                {
-                    int i = triList[v];
-                    Vector3 N = normalArray[i];
-                    debugAssertM(N.length() > 0.9f, "Produced non-unit normal");
+
+        const int n = vertexArray.size();
+        const SortedPointGrid grid(vertexArray, vertexWeldRadius);
+
+        // Find the earlier vertices that each vertex could be welded to, in two passes 
+        // that count and then store them, so that they can be resolved in order below
+        Array<int> candidateStart;
+        candidateStart.resize(n + 1);
+        runConcurrently(0, n, [&](int i) {
+            int count = 0;
+            grid.forEachNeighbor(vertexArray[i], [&](int j) {
+                count += ((j < i) && canWeld(i, j, normalArray, texCoordArray)) ? 1 : 0;
+            });
+            candidateStart[i + 1] = count;
+        });
+
+        candidateStart[0] = 0;
+        for (int i = 0; i < n; ++i) {
+            candidateStart[i + 1] += candidateStart[i];
+        }
+
+        Array<int> candidate;
+        candidate.resize(candidateStart[n]);
+        runConcurrently(0, n, [&](int i) {
+            int* next = candidate.getCArray() + candidateStart[i];
+            grid.forEachNeighbor(vertexArray[i], [&](int j) {
+                if ((j < i) && canWeld(i, j, normalArray, texCoordArray)) {
+                    *next = j;
+                    ++next;
                 }
-    #           endif
-                */
-                    ++u;
+            });
+            std::sort(candidate.getCArray() + candidateStart[i], next);
+        });
+
+        // Choose the output vertex for each input vertex. This serial pass only reads
+        // the candidate lists, so it is fast compared to finding them.
+        Array<int> outputIndex;
+        outputIndex.resize(n);
+        Array<int> leaderArray;
+        for (int i = 0; i < n; ++i) {
+            int index = -1;
+            for (int c = candidateStart[i]; (c < candidateStart[i + 1]) && (index == -1); ++c) {
+                const int j = candidate[c];
+                if (leaderArray[outputIndex[j]] == j) {
+                    index = outputIndex[j];
                 }
             }
+
+            if (index == -1) {
+                // The vertex does not exist. Create it.
+                index = leaderArray.size();
+                leaderArray.append(i);
+            }
+            outputIndex[i] = index;
+        }
+
+        outputVertexArray.resize(leaderArray.size());
+        outputNormalArray.resize(leaderArray.size());
+        outputTexCoordArray.resize(leaderArray.size());
+        runConcurrently(0, leaderArray.size(), [&](int i) {
+            const int j = leaderArray[i];
+            outputVertexArray[i]    = vertexArray[j];
+            outputNormalArray[i]    = normalArray[j];
+            outputTexCoordArray[i]  = texCoordArray[j];
+        });
+
+        int u = 0;
+        for (Array<int>* triList : indexArrayArray) {
+            if (notNull(triList)) {
+                runConcurrently(0, triList->size(), [&](int v) {
+                    // This vertex mapped to u + v in the flatVertexArray
+                    (*triList)[v] = outputIndex[u + v];
+                });
+                u += triList->size();
+            }
         }
     }
 
@@ -203,15 +326,24 @@ private:
             debugPrintf("WeldHelper::unroll\n");
 #       endif
        
-        int numTriLists = indexArrayArray.size();
-        for (int t = 0; t < numTriLists; ++t) {
-            if (indexArrayArray[t] != nullptr) {
-                const Array<int>& triList = *(indexArrayArray[t]);
-                for (int v = 0; v < triList.size(); ++v) {
-                    int i = triList[v];
-                    unrolledVertexArray.append(vertexArray[i]);
-                    unrolledTexCoordArray.append(texCoordArray[i]);
-                }
+        int n = 0;
+        for (const Array<int>* triList : indexArrayArray) {
+            if (notNull(triList)) {
+                n += triList->size();
+            }
+        }
+        unrolledVertexArray.resize(n);
+        unrolledTexCoordArray.resize(n);
+
+        int u = 0;
+        for (const Array<int>* triList : indexArrayArray) {
+            if (notNull(triList)) {
+                runConcurrently(0, triList->size(), [&](int v) {
+                    const int i = (*triList)[v];
+                    unrolledVertexArray[u + v]   = vertexArray[i];
+                    unrolledTexCoordArray[u + v] = texCoordArray[i];
+                });
+                u += triList->size();
             }
         }
     }
@@ -229,7 +361,9 @@ private:
         debugAssertM(vertexArray.size() % 3 == 0, "Input is not a triangle soup");
         debugAssertM(faceNormalArray.size() == 0, "Output must start empty.");
 
-        for (int v = 0; v < vertexArray.size(); v += 3) {
+        faceNormalArray.resize(vertexArray.size());
+        runConcurrently(0, vertexArray.size() / 3, [&](int t) {
+            const int v = 3 * t;
             const Vector3& e0 = vertexArray[v + 1] - vertexArray[v];
             const Vector3& e1 = vertexArray[v + 2] - vertexArray[v];
 
@@ -238,9 +372,9 @@ private:
             // multiplying very small edges
             const Vector3& n  = (e0.cross(e1 * 256.0f)).directionOrZero();
 
-            // Append the normal once per vertex.
-            faceNormalArray.append(n, n, n);
-        }
+            // Store the normal once per vertex.
+            faceNormalArray[v] = faceNormalArray[v + 1] = faceNormalArray[v + 2] = n;
+        });
     }
 
     /**
@@ -260,114 +394,46 @@ private:
             debugPrintf("WeldHelper::smoothNormals\n");
 #       endif
 
-        // Create an area memory manager for fast deallocation
-        shared_ptr<MemoryManager> mm = AreaMemoryManager::create(iRound(sizeof(VN) * normalArray.size() * 1.5));
-
         const float cosThresholdAngle = (float)cos(normalSmoothingAngle);
 
         debugAssert(vertexArray.size() == normalArray.size());
+        alwaysAssertM(vertexWeldRadius >= 0, "Cannot smooth with a negative vertex weld radius");
         smoothNormalArray.resize(normalArray.size());
 
-        if (vertexWeldRadius == 0) {
-            // Look for vertices with the exactly identical normal only
-#           ifdef VERBOSE
-                debugPrintf("Taking fast path\n");
-#           endif
-
-            // Maximum expected faces that meet at a vertex
-            static const int k = 8;
-
-            // Maps vertices to the indices of normals at that vertex
-            Table<Point3, SmallArray<Vector3, k> > normalTable;
-            for (int v = 0; v < vertexArray.size(); ++v) {
-                bool ignore = false;
-                SmallArray<Vector3, k>& list = normalTable.getCreate(vertexArray[v], ignore);
-                list.append(normalArray[v]);
-            }
-
-            for (int v = 0; v < vertexArray.size(); ++v) {
-                Vector3 sum;
-
-                const Vector3& original = normalArray[v];
+        // Search within the vertexWeldRadius, since those are the vertices
+        // that will collapse to the same point. When the radius is zero, 
+        // only vertices with exactly identical positions are considered.
+        const SortedPointGrid grid(vertexArray, vertexWeldRadius);
 
-                const SmallArray<Vector3, k>& list = normalTable[vertexArray[v]];
-
-                for (int i = 0; i < list.size(); ++i) {
-                    const Vector3& N = list[i];
-                    const float cosAngle = N.dot(original);
-
-                    if (cosAngle > cosThresholdAngle) {
-                        // This normal is close enough to consider.  Avoid underflow by scaling up
-                        sum += (N * 256.0f);
-                    }
-                }
-
-                const Vector3& average = sum.directionOrZero();
-
-                const bool indeterminate = average.isZero();
-                // Never "smooth" a normal so far that it points backwards
-                const bool backFacing    = original.dot(average) < 0;
-                
-                if (indeterminate || backFacing) {
-                    // Revert to the face normal
-                    smoothNormalArray[v] = original;
-                } else {
-                    // Average available normals
-                    smoothNormalArray[v] = average;
-                }
-            }
-
-        } else {
-            // Non-zero vertex normal welding
-#           ifdef VERBOSE
-                debugPrintf("Taking slower weld path because vertexWeldRadius = %f\n",
-                            vertexWeldRadius);
-#           endif
-
-            // Compute a hash grid so that we can find neighbors quickly.
-            alwaysAssertM(vertexWeldRadius > 0, "Cannot smooth with zero vertex weld radius");
-            PointHashGrid<VN> grid(vertexWeldRadius, mm);
-            for (int v = 0; v < normalArray.size(); ++v) {
-                grid.insert(VN(vertexArray[v], normalArray[v]));
-            }
+        runConcurrently(0, normalArray.size(), [&](int v) {
+            // Compute the sum of all nearby normals within the cutoff angle.
+            Vector3 sum;
             
-            // OPT: this step could be done on multiple threads
-            for (int v = 0; v < normalArray.size(); ++v) {            
-                // Compute the sum of all nearby normals within the cutoff angle.
-                // Search within the vertexWeldRadius, since those are the vertices
-                // that will collapse to the same point.
-                PointHashGrid<VN>::SphereIterator it = 
-                    grid.begin(Sphere(vertexArray[v], vertexWeldRadius));
-                
-                Vector3 sum;
+            const Vector3& original = normalArray[v];
+            grid.forEachNeighbor(vertexArray[v], [&](int j) {
+                const Vector3& N = normalArray[j];
+                const float cosAngle = N.dot(original);
                 
-                const Vector3& original = normalArray[v];
-                while (it.isValid()) {
-                    const Vector3& N = it->normal;
-                    const float cosAngle = N.dot(original);
-                    
-                    if (cosAngle > cosThresholdAngle) {
-                        // This normal is close enough to consider.  Avoid underflow by scaling up
-                        sum += (N * 256.0f);
-                    }
-                    ++it;
-                }
-                
-                const Vector3& average = sum.directionOrZero();
-                
-                const bool indeterminate = average.isZero();
-                // Never "smooth" a normal so far that it points backwards
-                const bool backFacing    = original.dot(average) < 0;
-                
-                if (indeterminate || backFacing) {
-                    // Revert to the face normal
-                    smoothNormalArray[v] = original;
-                } else {
-                    // Average available normals
-                    smoothNormalArray[v] = average;
+                if (cosAngle > cosThresholdAngle) {
+                    // This normal is close enough to consider.  Avoid underflow by scaling up
+                    sum += (N * 256.0f);
                 }
+            });
+            
+            const Vector3& average = sum.directionOrZero();
+            
+            const bool indeterminate = average.isZero();
+            // Never "smooth" a normal so far that it points backwards
+            const bool backFacing    = original.dot(average) < 0;
+            
+            if (indeterminate || backFacing) {
+                // Revert to the face normal
+                smoothNormalArray[v] = original;
+            } else {
+                // Average available normals
+                smoothNormalArray[v] = average;
             }
-        }
+        });
     }
 
 public:
@@ -385,6 +451,9 @@ public:
 
     4. Generate output indexArrayArray.  While doing so, merge all vertices where 
        the distance between position, texCoord, and normal is within the thresholds.
+
+    Every step runs on multiple threads, and the output does not depend on
+    how the work was scheduled.
      */
     void process
     ( Array<Vector3>&     vertexArray,
@@ -409,17 +478,11 @@ public:
                 "Input arrays are not parallel.");
         }
 
-        // Create an area memory manager for fast deallocation
         Array<Vector3> unrolledVertexArray;
         Array<Vector3> unrolledFaceNormalArray;
         Array<Vector3> unrolledSmoothNormalArray;
         Array<Vector2> unrolledTexCoordArray;
 
-        unrolledVertexArray.reserve(vertexArray.size());
-        unrolledFaceNormalArray.reserve(vertexArray.size());
-        unrolledSmoothNormalArray.reserve(vertexArray.size());
-        unrolledTexCoordArray.reserve(vertexArray.size());
-
         if (! hasTexCoords) {
             // Generate all zero texture coordinates
             texCoordArray.resize(vertexArray.size());
@@ -429,14 +492,6 @@ public:
         unroll(indexArrayArray, vertexArray, texCoordArray, 
             unrolledVertexArray, unrolledTexCoordArray);
 
-        // Put the output back into the input slots. 
-        outputVertexArray   = &vertexArray;
-        outputNormalArray   = &normalArray;
-        outputTexCoordArray = &texCoordArray;
-        outputVertexArray->fastClear();
-        outputNormalArray->fastClear();
-        outputTexCoordArray->fastClear();
-
         // For every three vertices, generate their face normal and store it at 
         // each vertex. The output array has the same length as the input.
         computeFaceNormals(unrolledVertexArray, unrolledFaceNormalArray);
@@ -447,8 +502,9 @@ public:
             unrolledFaceNormalArray.clear();
         }
 
-        // Regenerate the triangle lists
-        updateTriLists(indexArrayArray, unrolledVertexArray, unrolledSmoothNormalArray, unrolledTexCoordArray);
+        // Regenerate the triangle lists, putting the output back into the input slots
+        updateTriLists(indexArrayArray, unrolledVertexArray, unrolledSmoothNormalArray, unrolledTexCoordArray,
+            vertexArray, normalArray, texCoordArray);
 
         if (! hasTexCoords) {
             // Throw away the generated texCoords
@@ -456,10 +512,7 @@ public:
         }
     }
 
-    WeldHelper(float vertRadius) :
-        weldGrid(max(vertRadius, 0.1f), AreaMemoryManager::create()),
-        vertexWeldRadius(vertRadius) {
-    }
+    WeldHelper(float vertRadius) : vertexWeldRadius(vertRadius) {}
 
 };
 } // Internal
@@ -0,0 +1,269 @@
+/**
+  \file G3D-base.lib/source/ZipArchive.cpp
+
+  G3D Innovation Engine http://casual-effects.com/g3d
+  Copyright 2000-2019, Morgan McGuire
+  All rights reserved
+  Available under the BSD License
+*/
+#include "G3D-base/ZipArchive.h"
+#include "G3D-base/FileSystem.h"
+#include "G3D-base/stringutils.h"
+#include "G3D-base/System.h"
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <cstring>
+#include "zip.h"
+
+#ifndef G3D_WINDOWS
+#   define _stat stat
+#endif
+
+namespace G3D {
+
+/** Shared archives, keyed by canonical filename */
+static Table<String, shared_ptr<ZipArchive> > s_archiveTable;
+
+/** Protects s_archiveTable */
+static std::mutex s_archiveMutex;
+
+
+ZipArchive::ZipArchive() : m_fileSize(0), m_fileTime(0) {}
+
+
+ZipArchive::~ZipArchive() {
+    for (struct zip* z : m_handlePool) {
+        zip_discard(z);
+    }
+    m_handlePool.clear();
+}
+
+
+bool ZipArchive::statFile(const String& filename, int64& size, int64& time) {
+    struct _stat st;
+    if (_stat(filename.c_str(), &st) != 0) {
+        return false;
+    }
+    size = int64(st.st_size);
+    time = int64(st.st_mtime);
+    return true;
+}
+
+
+shared_ptr<ZipArchive> ZipArchive::open(const String& _filename) {
+    const String& filename = FilePath::canonicalize(FilePath::removeTrailingSlash(_filename));
+
+    int64 size = 0, time = 0;
+    if (! statFile(filename, size, time)) {
+        return nullptr;
+    }
+
+    std::lock_guard<std::mutex> lock(s_archiveMutex);
+    shared_ptr<ZipArchive>& archive = s_archiveTable.getCreate(filename);
+    if (notNull(archive) && (archive->m_fileSize == size) && (archive->m_fileTime == time)) {
+        return archive;
+    }
+
+    // Validate the archive once when first opening it. Subsequent handles skip the check.
+    struct zip* z = zip_open(filename.c_str(), ZIP_CHECKCONS | ZIP_RDONLY, nullptr);
+    if (isNull(z)) {
+        s_archiveTable.remove(filename);
+        return nullptr;
+    }
+
+    const shared_ptr<ZipArchive>& a = createShared<ZipArchive>();
+    a->m_filename   = filename;
+    a->m_fileSize   = size;
+    a->m_fileTime   = time;
+    a->m_mappedFile = MemoryMappedFile::create(filename);
+    a->buildIndex(z);
+    a->m_handlePool.append(z);
+
+    archive = a;
+    return a;
+}
+
+
+void ZipArchive::clearCache() {
+    std::lock_guard<std::mutex> lock(s_archiveMutex);
+    s_archiveTable.clear();
+}
+
+
+void ZipArchive::buildIndex(struct zip* z) {
+    const int64 count = zip_get_num_entries(z, 0);
+    m_entryArray.resize(int(max(count, int64(0))));
+
+    Array<String> rawNameArray;
+    rawNameArray.resize(m_entryArray.size());
+
+    for (int i = 0; i < m_entryArray.size(); ++i) {
+        struct zip_stat info;
+        zip_stat_init(&info);
+        zip_stat_index(z, i, 0, &info);
+
+        Entry& entry    = m_entryArray[i];
+        entry.name      = notNull(info.name) ? info.name : "";
+        entry.index     = i;
+        entry.size      = int64(info.size);
+        entry.encrypted = ((info.valid & ZIP_STAT_ENCRYPTION_METHOD) != 0) && (info.encryption_method != ZIP_EM_NONE);
+
+        const char* raw = zip_get_name(z, i, ZIP_FL_ENC_RAW);
+        rawNameArray[i] = notNull(raw) ? raw : "";
+
+        // The first of several names that differ only in case wins, as for zip_name_locate
+        bool created = false;
+        int& e = m_entryTable.getCreate(toLower(entry.name), created);
+        if (created) {
+            e = i;
+        }
+    }
+
+    findStoredEntries(rawNameArray);
+}
+
+
+static uint16 readLE16(const uint8* p) {
+    return uint16(p[0]) | (uint16(p[1]) << 8);
+}
+
+
+static uint32 readLE32(const uint8* p) {
+    return uint32(p[0]) | (uint32(p[1]) << 8) | (uint32(p[2]) << 16) | (uint32(p[3]) << 24);
+}
+
+
+void ZipArchive::findStoredEntries(const Array<String>& rawNameArray) {
+    if (isNull(m_mappedFile)) {
+        return;
+    }
+
+    const uint8* data = m_mappedFile->data();
+    const size_t size = m_mappedFile->size();
+
+    // Find the end of central directory record, which is followed by a comment of up to 64 kB
+    const size_t EOCD_SIZE = 22;
+    if (size < EOCD_SIZE) {
+        return;
+    }
+    const uint8* eocd = nullptr;
+    for (size_t p = size - EOCD_SIZE; ; --p) {
+        if (readLE32(data + p) == 0x06054b50) {
+            eocd = data + p;
+            break;
+        }
+        if ((p == 0) || (size - p > EOCD_SIZE + 0xFFFF)) {
+            return;
+        }
+    }
+
+    const uint32 numRecords = readLE16(eocd + 10);
+    const uint32 offset     = readLE32(eocd + 16);
+    if ((numRecords == 0xFFFF) || (offset == 0xFFFFFFFF) || (int(numRecords) != m_entryArray.size())) {
+        // Zip64 archives keep working through libzip, but are not read in place
+        return;
+    }
+
+    const size_t CD_RECORD_SIZE    = 46;
+    const size_t LOCAL_HEADER_SIZE = 30;
+    size_t p = offset;
+    for (int i = 0; i < m_entryArray.size(); ++i) {
+        if ((p + CD_RECORD_SIZE > size) || (readLE32(data + p) != 0x02014b50)) {
+            return;
+        }
+        const uint8* record         = data + p;
+        const uint16 flags          = readLE16(record + 8);
+        const uint16 method         = readLE16(record + 10);
+        const uint32 compressedSize = readLE32(record + 20);
+        const uint32 rawSize        = readLE32(record + 24);
+        const uint16 nameLength     = readLE16(record + 28);
+        const uint16 extraLength    = readLE16(record + 30);
+        const uint16 commentLength  = readLE16(record + 32);
+        const uint32 localOffset    = readLE32(record + 42);
+
+        if (p + CD_RECORD_SIZE + nameLength > size) {
+            return;
+        }
+
+        Entry& entry = m_entryArray[i];
+        const bool sameName = (rawNameArray[i].size() == nameLength) && (memcmp(rawNameArray[i].c_str(), record + CD_RECORD_SIZE, nameLength) == 0);
+        // Bit 0 of the flags is encryption
+        if (sameName && (method == ZIP_CM_STORE) && ((flags & 1) == 0) && ! entry.encrypted &&
+            (compressedSize == rawSize) && (int64(rawSize) == entry.size) && (localOffset != 0xFFFFFFFF) &&
+            (size_t(localOffset) + LOCAL_HEADER_SIZE <= size) && (readLE32(data + localOffset) == 0x04034b50)) {
+
+            const uint8* local = data + localOffset;
+            const size_t start = size_t(localOffset) + LOCAL_HEADER_SIZE + readLE16(local + 26) + readLE16(local + 28);
+            if (start + size_t(entry.size) <= size) {
+                entry.storedOffset = int64(start);
+            }
+        }
+
+        p += CD_RECORD_SIZE + nameLength + extraLength + commentLength;
+    }
+}
+
+
+const ZipArchive::Entry* ZipArchive::find(const String& name) const {
+    const int* i = m_entryTable.getPointer(toLower(name));
+    return isNull(i) ? nullptr : &m_entryArray[*i];
+}
+
+
+struct zip* ZipArchive::acquireHandle() const {
+    {
+        std::lock_guard<std::mutex> lock(m_handleMutex);
+        if (m_handlePool.size() > 0) {
+            return m_handlePool.pop();
+        }
+    }
+
+    // Every handle is in use by another thread
+    struct zip* z = zip_open(m_filename.c_str(), ZIP_RDONLY, nullptr);
+    if (isNull(z)) {
+        throw String("\"") + m_filename + "\" could not be opened.";
+    }
+    return z;
+}
+
+
+void ZipArchive::releaseHandle(struct zip* z) const {
+    std::lock_guard<std::mutex> lock(m_handleMutex);
+    m_handlePool.append(z);
+}
+
+
+void ZipArchive::read(const Entry& entry, void* dst) const {
+    const uint8* stored = storedData(entry);
+    if (notNull(stored)) {
+        System::memcpy(dst, stored, size_t(entry.size));
+        return;
+    }
+
+    String password;
+    const bool isPasswordProtected = FileSystem::isPasswordProtected(m_filename, password);
+
+    struct zip* z = acquireHandle();
+    struct zip_file* zf = isPasswordProtected ?
+        zip_fopen_index_encrypted(z, entry.index, 0, password.c_str()) :
+        zip_fopen_index(z, entry.index, 0);
+
+    if (isNull(zf)) {
+        releaseHandle(z);
+        String msg = String("\"") + entry.name + "\" inside \"" + m_filename + "\" could not be opened.";
+        if (! isPasswordProtected) {
+            msg += String(" If the archive is password protected, register it with FileSystem::registerPasswordProtectedZip()");
+        }
+        throw msg;
+    }
+
+    const int64 bytesRead = zip_fread(zf, dst, entry.size);
+    zip_fclose(zf);
+    releaseHandle(z);
+
+    if (bytesRead != entry.size) {
+        throw entry.name + " inside \"" + m_filename + "\" was corrupt because it unzipped to the wrong size.";
+    }
+}
+
+} // namespace G3D
@@ -18,10 +18,10 @@
 #include "G3D-base/Set.h"
 #include "G3D-base/g3dfnmatch.h"
 #include "G3D-base/FileSystem.h"
+#include "G3D-base/ZipArchive.h"
 
 #include <sys/stat.h>
 #include <sys/types.h>
-#include "zip.h"
 
 #ifdef G3D_WINDOWS
    // Needed for _getcwd
@@ -133,40 +133,25 @@ String readWholeFile(const String& filename) {
         // In zipfile
         FileSystem::markFileUsed(zipfile);
 
-        struct zip* z = zip_open(zipfile.c_str(), ZIP_CHECKCONS, nullptr);
-        {
-            struct zip_stat info;
-            zip_stat_init( &info );    // TODO: Docs unclear if zip_stat_init is required.
-            zip_stat(z, internalFile.c_str(), ZIP_FL_NOCASE, &info);
-
-            // Add nullptr termination
-            char* buffer = reinterpret_cast<char*>(System::alignedMalloc(info.size + 1, 16));
-            buffer[info.size] = '\0';
-
-            String password;
-            bool isPasswordProtected = FileSystem::isPasswordProtected(zipfile, password);
-
-            struct zip_file* zf = isPasswordProtected ?
-                                  zip_fopen_encrypted(z, internalFile.c_str(), ZIP_FL_NOCASE, password.c_str()) :
-                                  zip_fopen( z, internalFile.c_str(), ZIP_FL_NOCASE );
-            if (isNull(zf)) {
-                String msg = String("\"") + internalFile + "\" inside \"" + zipfile + "\" could not be opened.";
-                if (!isPasswordProtected) {
-                    msg += String(" If the archive is password protected, register it with FileSystem::registerPasswordProtectedZip()");
-                }
-                throw msg;
-            } else {
-                const int64 bytesRead = zip_fread( zf, buffer, (info.size));
-                debugAssertM((int64)bytesRead == (int64)info.size,
-                             internalFile + " was corrupt because it unzipped to the wrong size.");
-                (void)bytesRead;
-                zip_fclose(zf);
-            }
-            // Copy the string
-            s = buffer;
+        const shared_ptr<ZipArchive>& archive = ZipArchive::open(zipfile);
+        const ZipArchive::Entry* entry = notNull(archive) ? archive->find(internalFile) : nullptr;
+        if (isNull(entry)) {
+            throw String("\"") + internalFile + "\" inside \"" + zipfile + "\" could not be opened.";
+        }
+
+        // Add nullptr termination
+        char* buffer = reinterpret_cast<char*>(System::alignedMalloc(entry->size + 1, 16));
+        buffer[entry->size] = '\0';
+        try {
+            archive->read(*entry, buffer);
+        } catch (...) {
             System::alignedFree(buffer);
+            throw;
         }
-        zip_close(z);
+
+        // Copy the string
+        s = buffer;
+        System::alignedFree(buffer);
     }
 
     return s;
@@ -180,20 +165,11 @@ int64 fileLength(const String& filename) {
     if (result == -1) {
         String zip, contents;
         if(zipfileExists(filename, zip, contents)){
-            int64 requiredMem;
-
-                        struct zip *z = zip_open( zip.c_str(), ZIP_CHECKCONS, nullptr );
-                        debugAssertM(z != nullptr, zip + ": zip open failed.");
-            {
-                                struct zip_stat info;
-                                zip_stat_init( &info );    // TODO: Docs unclear if zip_stat_init is required.
-                                int success = zip_stat( z, contents.c_str(), ZIP_FL_NOCASE, &info );
-                (void)success;
-                                debugAssertM(success == 0, zip + ": " + contents + ": zip stat failed.");
-                                requiredMem = info.size;
-            }
-                        zip_close( z );
-            return requiredMem;
+            const shared_ptr<ZipArchive>& archive = ZipArchive::open(zip);
+            debugAssertM(archive, zip + ": zip open failed.");
+            const ZipArchive::Entry* entry = notNull(archive) ? archive->find(contents) : nullptr;
+            debugAssertM(entry, zip + ": " + contents + ": zip stat failed.");
+            return notNull(entry) ? entry->size : -1;
         } else {
         return -1;
         }
@@ -316,15 +292,9 @@ static void _zip_resolveDirectory(String& completeDir, const String& drive, cons
 
 /** assumes that zipDir references a .zip file */
 static bool _zip_zipContains(const String& zipDir, const String& desiredFile){
-    struct zip *z = zip_open( zipDir.c_str(), ZIP_CHECKCONS, nullptr );
-    //the last parameter, an int, determines case sensitivity:
-    //1 is sensitive, 2 is not, 0 is default
-    zip_int64_t test = zip_name_locate( z, desiredFile.c_str(), ZIP_FL_NOCASE );
-    zip_close( z );
-    if(test == -1){
-        return false;
-    }
-    return true;
+    // Case-insensitive, as the lookups in the zipfile have always been
+    const shared_ptr<ZipArchive>& archive = ZipArchive::open(zipDir);
+    return notNull(archive) && notNull(archive->find(desiredFile));
 }
 
 
@@ -764,20 +734,15 @@ static void getFileOrDirListZip(const String& path,
                                 Array<String>& files,
                                 bool wantFiles,
                                 bool includePath){
-    struct zip *z = zip_open( path.c_str(), ZIP_CHECKCONS, nullptr );
-
     Set<String> fileSet;
 
-    int count = zip_get_num_files( z );
-    for( int i = 0; i < count; ++i ) {
-        struct zip_stat info;
-        zip_stat_init( &info );    // TODO: Docs unclear if zip_stat_init is required.
-        zip_stat_index( z, i, ZIP_FL_NOCASE, &info );
-        _zip_addEntry(path, prefix, info.name, fileSet, wantFiles, includePath);
+    const shared_ptr<ZipArchive>& archive = ZipArchive::open(path);
+    if (notNull(archive)) {
+        for (const ZipArchive::Entry& entry : archive->entryArray()) {
+            _zip_addEntry(path, prefix, entry.name, fileSet, wantFiles, includePath);
+        }
     }
 
-    zip_close( z );
-
     fileSet.getMembers(files);
 }
 
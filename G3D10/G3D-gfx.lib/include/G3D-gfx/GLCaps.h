@@ -16,6 +16,7 @@
 #include "G3D-base/G3DString.h"
 #include "G3D-gfx/glheaders.h"
 #include "G3D-gfx/OSWindow.h"
+#include <thread>
 
 // MacOS defines INTEL and it conflicts with GLCaps::INTEL
 #ifdef INTEL
@@ -180,6 +181,9 @@ private:
 
     static OSWindow::Settings::API s_api;
 
+    /** The thread that called init() */
+    static std::thread::id     s_glThread;
+
     /** Runs all of the checkBug_ methods. Called from loadExtensions(). */
     static void checkAllBugs();
 
@@ -201,6 +205,13 @@ public:
         return s_api;
     }
 
+    /** True if the caller is on the thread that owns the OpenGL context, or if init()
+        has not been called yet. Loaders that may run on worker threads use this to
+        defer OpenGL work to the main thread. */
+    static bool onGLThread() {
+        return (s_glThread == std::thread::id()) || (s_glThread == std::this_thread::get_id());
+    }
+
     static bool supports(const String& extName);
 
     /** Returns true if the given texture format is supported on this
@@ -15,6 +15,7 @@
 #include "G3D-base/G3DString.h"
 #include "G3D-base/Table.h"
 #include <mutex>
+#include <thread>
 
 typedef int GLint;
 typedef unsigned int GLuint;
@@ -171,6 +172,13 @@ private:
         /** Full tree of events for the previous frame */
         Array<Event>                        previousEventTree;
 
+        /** False for threads other than the one that owns the GL context, such
+            as TBB workers running TaskGraph tasks, and for all threads before the
+            first nextFrame() identifies that one. Their events record CPU time only. */
+        bool                                issuesGfxQueries;
+
+        ThreadInfo() : nextQueryObjectIndex(0), issuesGfxQueries(false) {}
+
         void beginEvent(const String& name, const String& file, int line, const String& hint = "");
 
         void endEvent();
@@ -197,6 +205,9 @@ private:
 
     static std::mutex                       s_profilerMutex;
 
+    /** The thread that invoked nextFrame(), which must own the GL context */
+    static std::thread::id                  s_gfxThreadId;
+
     /** Whether to make profile events in every LAUNCH_SHADER call. Default is true. */
     static bool                             s_timeShaderLaunches;
 
@@ -244,7 +255,8 @@ public:
     static void setEnabled(bool e);
 
     /** Calls to beginEvent may be nested on a single thread. Events on different
-        threads are tracked independently.*/
+        threads are tracked independently. Events on threads other than the one
+        that calls nextFrame() measure only CPU time; their gfxDuration() is zero.*/
     static void beginEvent(const String& name, const String& file, int line, const String& hint = "");
     
     /** Ends the most recent pending event on the current thread. */
@@ -855,8 +855,11 @@ protected:
     /** If the underlying texture has not yet been uploaded to the GPU, then this method immediately 
         blocks on the loading thread and does not return until the upload is completed. Otherwise it 
         does nothing. This should be called on the OpenGL thread. 
+
+        When invoked on any other thread, it only waits for the CPU loading steps, so that
+        min(), max(), mean(), and opaque() are valid, and leaves the upload to the OpenGL thread.
         
-        \sa m_loadingThread, m_loadingGLCallback, m_loadingMutex, m_needsForce */
+        \sa m_loadingThread, m_loadingGLCallback, m_loadingMutex, m_needsForce, GLCaps::onGLThread */
     void force() const;
 
     friend class BufferTexture;
@@ -879,6 +882,14 @@ protected:
     */
     void completeGPULoading();
 
+    /** Invokes completeGPULoading() on the OpenGL thread. On any other thread,
+        sets m_needsForce so that the upload occurs during force(). */
+    void completeGPULoadingOrDefer();
+
+    /** Fills in unknown alpha statistics from the format and computes m_opaque.
+        Requires the CPU loading steps to be complete. */
+    void updateAlphaStats();
+
 public:
 
     /** Used to display this Texture in a GuiTextureBox  */
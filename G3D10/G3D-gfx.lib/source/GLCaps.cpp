@@ -46,6 +46,8 @@ float GLCaps::m_glslVersion = 0.0f;
 
 OSWindow::Settings::API GLCaps::s_api = OSWindow::Settings::API_OPENGL;
 
+std::thread::id GLCaps::s_glThread;
+
 /**
  Dummy function to which unloaded extensions can be set.
  */
@@ -255,6 +257,7 @@ String GLCaps::getDriverVersion() {
 
 void GLCaps::init(OSWindow::Settings::API api) {
     s_api = api;
+    s_glThread = std::this_thread::get_id();
 
     debugAssertGLOk();
     const char* v = (const char*)glGetString(GL_SHADING_LANGUAGE_VERSION);
@@ -21,6 +21,7 @@ thread_local int                                Profiler::s_level = 0;
 
 Array< shared_ptr<Profiler::ThreadInfo> >       Profiler::s_threadInfoArray;
 std::mutex                                      Profiler::s_profilerMutex;
+std::thread::id                                 Profiler::s_gfxThreadId;
 uint64                                          Profiler::s_frameNum = 0;
 bool                                            Profiler::s_enabled = false;
 bool                                            Profiler::s_timeShaderLaunches = true;
@@ -56,8 +57,10 @@ GLuint Profiler::ThreadInfo::getQueryLocationObject(int eventIndex, QueryLocatio
 
 
 Profiler::ThreadInfo::~ThreadInfo() {
-    glDeleteQueries(queryObjects.size(), queryObjects.getCArray());
-    debugAssertGLOk();
+    if (queryObjects.size() > 0) {
+        glDeleteQueries(queryObjects.size(), queryObjects.getCArray());
+        debugAssertGLOk();
+    }
     queryObjects.clear();
 }
 
@@ -82,9 +85,11 @@ void Profiler::ThreadInfo::beginEvent(const String& name, const String& file, in
             dummy.m_numChildren = -1; // indicates dummy event
             dummy.m_parentIndex = ancestorStack.last();
 
-            // push dummy query objects
-            getQueryLocationObject(eventTree.length(), QUERY_LOCATION_START);
-            getQueryLocationObject(eventTree.length(), QUERY_LOCATION_END);
+            if (issuesGfxQueries) {
+                // push dummy query objects
+                getQueryLocationObject(eventTree.length(), QUERY_LOCATION_START);
+                getQueryLocationObject(eventTree.length(), QUERY_LOCATION_END);
+            }
 
             eventTree.append(dummy);
         }
@@ -97,7 +102,7 @@ void Profiler::ThreadInfo::beginEvent(const String& name, const String& file, in
     }
     ancestorStack.push(eventTree.length());
 
-    if (RenderDevice::current) {
+    if (RenderDevice::current && issuesGfxQueries) {
         // Set start location marker query object 
         glQueryCounter(getQueryLocationObject(eventTree.length(), QUERY_LOCATION_START), GL_TIMESTAMP);
         debugAssertGLOk();
@@ -120,7 +125,7 @@ void Profiler::ThreadInfo::endEvent() {
 
     Event& event(eventTree[eventIndex]);
 
-    if (RenderDevice::current) {
+    if (RenderDevice::current && issuesGfxQueries) {
         // Set end location marker query object
         glQueryCounter(getQueryLocationObject(eventIndex, QUERY_LOCATION_END), GL_TIMESTAMP);
         debugAssertGLOk();
@@ -184,6 +189,8 @@ void Profiler::beginEvent(const String& name, const String& file, int line, cons
         // First time that this thread invoked beginEvent--intialize it
         s_threadInfo = new shared_ptr<ThreadInfo>(new ThreadInfo());
         std::lock_guard<std::mutex> guard(s_profilerMutex);
+        // Worker threads have no GL context, so they may only take CPU samples
+        (*s_threadInfo)->issuesGfxQueries = (s_gfxThreadId == std::this_thread::get_id());
         s_threadInfoArray.append(*s_threadInfo);
     }
 
@@ -208,6 +215,7 @@ void Profiler::nextFrame() {
     std::lock_guard<std::mutex> guard(s_profilerMutex);
     debugAssertGLOk();
     debugAssertM(s_level == 0, "More BEGIN_PROFILER_EVENT than END_PROFILER_EVENT calls!");
+    s_gfxThreadId = std::this_thread::get_id();
 
     // For each thread
     for (int t = 0; t < s_threadInfoArray.length(); ++t) {
@@ -215,6 +223,10 @@ void Profiler::nextFrame() {
 
         for (int e = 0; e < info->eventTree.length(); ++e) {
             Event& event = info->eventTree[e];
+            if (! info->issuesGfxQueries) {
+                event.m_gfxStart = event.m_gfxEnd = 0;
+                continue;
+            }
             GLuint startQueryObject = info->getQueryLocationObject(e, ThreadInfo::QUERY_LOCATION_START);
             GLuint endQueryObject = info->getQueryLocationObject(e, ThreadInfo::QUERY_LOCATION_END);
             if (! event.isDummy()) {
@@ -262,6 +274,12 @@ void Profiler::nextFrame() {
         info->eventTree.fastClear();
     } // t
 
+    // A thread that began events before the first nextFrame() starts issuing queries with
+    // the now-empty event tree, so that no event is missing its query objects
+    if (notNull(s_threadInfo)) {
+        (*s_threadInfo)->issuesGfxQueries = true;
+    }
+
     ++s_frameNum;
 }
 
@@ -487,14 +487,7 @@ void Texture::completeGPULoading() {
 
         debugAssertGLOk();
 
-        if (isNaN(m_min.a)) {
-            if (m_encoding.format->opaque) {
-                m_min.a = m_max.a = m_mean.a = 1.0f;
-            } else {
-                m_min.a = 0.0f;
-            }
-        }
-        m_opaque = (m_encoding.readMultiplyFirst.a * m_min.a) >= 1.0f;
+        updateAlphaStats();
         m_hasMipMaps = false;
         m_appearsInTextureBrowserWindow = true;
         m_destroyGLTextureInDestructor = true;
@@ -542,6 +535,30 @@ void Texture::completeGPULoading() {
 }
 
 
+void Texture::updateAlphaStats() {
+    if (isNaN(m_min.a)) {
+        if (m_encoding.format->opaque) {
+            m_min.a = m_max.a = m_mean.a = 1.0f;
+        } else {
+            m_min.a = 0.0f;
+        }
+    }
+    m_opaque = (m_encoding.readMultiplyFirst.a * m_min.a) >= 1.0f;
+}
+
+
+void Texture::completeGPULoadingOrDefer() {
+    if (GLCaps::onGLThread()) {
+        completeGPULoading();
+    } else {
+        // Created by a worker thread (e.g., a concurrent Scene::load). The
+        // upload happens during the first force() on the GL thread.
+        updateAlphaStats();
+        m_needsForce = true;
+    }
+}
+
+
 void Texture::force() const {
     // Quick, mutex-less conservative out for the common run-time case
     if (! m_needsForce) { return; }
@@ -551,18 +568,27 @@ void Texture::force() const {
         if (! m_needsForce) { m_loadingMutex.unlock(); return; }
 
         debugAssert(notNull(m_loadingInfo));
-        debugAssert(notNull(m_loadingThread));
 
-        // Block on the actual loading operation
-        m_loadingThread->join();
-        // Free the callback code
-        delete m_loadingThread;
-        m_loadingThread = nullptr;       
-        // Upload to GL
-        const_cast<Texture*>(this)->completeGPULoading();
+        // Block on the actual loading operation. There is no thread if
+        // the CPU steps already ran or the upload was deferred.
+        if (notNull(m_loadingThread)) {
+            m_loadingThread->join();
+            // Free the callback code
+            delete m_loadingThread;
+            m_loadingThread = nullptr;
+        }
+
+        if (GLCaps::onGLThread()) {
+            // Upload to GL
+            const_cast<Texture*>(this)->completeGPULoading();
 
-        debugAssert(isNull(m_loadingInfo));
-        m_needsForce = false;
+            debugAssert(isNull(m_loadingInfo));
+            m_needsForce = false;
+        } else {
+            // The CPU statistics are now available to the worker. The
+            // GL thread's next force() performs the upload.
+            const_cast<Texture*>(this)->updateAlphaStats();
+        }
     } m_loadingMutex.unlock();
 }
 
@@ -1328,7 +1354,7 @@ shared_ptr<Texture> Texture::fromFile
 
         // Launch loader
         instance->completeCPULoading();
-        instance->completeGPULoading();
+        instance->completeGPULoadingOrDefer();
         instance->m_min = instance->m_mean = instance->m_max = Color4::one();
 
         if (instance->m_encoding.readMultiplyFirst.a + instance->m_encoding.readAddSecond.a >= 1.0f) {
@@ -1620,7 +1646,8 @@ shared_ptr<Texture> Texture::fromPixelTransferBuffer
     info.preprocess        = preprocess;
 
     t->completeCPULoading();
-    t->completeGPULoading();
+    // The PixelTransferBuffer is retained by m_loadingInfo, so the upload can be deferred
+    t->completeGPULoadingOrDefer();
 
     return t;
 }
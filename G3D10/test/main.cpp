@@ -58,6 +58,13 @@ void testuint128();
 void testCollisionDetection();
 void perfCollisionDetection();
 
+void testNativeTriTree();
+void perfNativeTriTree();
+
+void testInstancedTriTree();
+void testScene();
+void testPathTracer();
+
 void testWeakCache();
 void testCallback();
 
@@ -72,6 +79,8 @@ void testQuat();
 void perfKDTree();
 void testKDTree();
 
+void testArticulatedModel();
+
 void testSphere();
 
 void testAABox();
@@ -97,12 +106,21 @@ void testMeshAlgTangentSpace();
 void perfQueue();
 void testQueue();
 
+void testFrameArenaMemoryManager();
+
 void testBinaryIO();
 void testHugeBinaryIO();
 void perfBinaryIO();
 
 void testTextInput();
 void testTextInput2();
+void perfTextInput();
+
+void testParseOBJ();
+void perfParseOBJ();
+
+void testWelder();
+void perfWelder();
 
 void testTable();
 void testAdjacency();
@@ -116,6 +134,7 @@ void testThread();
 void testfilter();
 
 void testAny();
+void perfAny();
 
 void testFastPODTable() {
     typedef FastPODTable<int, int, HashTrait<int>, EqualsTrait<int>, true> TestTable;
@@ -738,12 +757,22 @@ int main(int argc, char* argv[]) {
 
         perfBinaryIO();
 
+        perfParseOBJ();
+
+        perfWelder();
+
         perfTable();
 
+        perfAny();
+
+        perfTextInput();
+
         perfHashTrait();
 
         perfCollisionDetection();
 
+        perfNativeTriTree();
+
         perfQueue();
 
         perfMatrix3();
@@ -815,8 +844,13 @@ int main(int argc, char* argv[]) {
 
     testCollisionDetection();  
 
+    testNativeTriTree();
+    testInstancedTriTree();
+    testScene();
+
     testTextInput();
     testTextInput2();
+    testParseOBJ();
     printf("  passed\n");
 
     testSphere();
@@ -832,6 +866,8 @@ int main(int argc, char* argv[]) {
 
     if (renderDevice) {
         testKDTree();
+        testArticulatedModel();
+        testPathTracer();
         testGLight();
     }
 
@@ -878,8 +914,12 @@ int main(int argc, char* argv[]) {
 
     testQueue();
 
+    testFrameArenaMemoryManager();
+
     testMeshAlgTangentSpace();
 
+    testWelder();
+
     testConvexPolygon2D();
 
     testPlane();
@@ -9,6 +9,7 @@
 
 #include "G3D/G3D.h"
 #include "testassert.h"
+#include "printhelpers.h"
 #include <sstream>
 
 static void testRefCount1() {
@@ -302,6 +303,95 @@ static void testTableReader() {
     testAssert(b == false);
 }
 
+static Any binaryRoundTrip(const Any& a) {
+    BinaryOutput bo("<memory>", G3D_LITTLE_ENDIAN);
+    a.serialize(bo);
+    bo.commit();
+
+    BinaryInput bi(bo.getCArray(), bo.size(), G3D_LITTLE_ENDIAN);
+    Any b;
+    b.deserialize(bi);
+    testAssert(! bi.hasMore());
+    return b;
+}
+
+
+static void testBinary() {
+    // Everything in the text form survives, including names and comments
+    const Any& text = Any::fromFile("Any-load.txt");
+    const Any& binary = binaryRoundTrip(text);
+    testAssert(binary == text);
+    testAssert(binary.unparse() == text.unparse());
+    testAssert(binary.source().filename == text.source().filename);
+
+    // Arrays of numbers are packed
+    const Any& v = binaryRoundTrip(Any::parse("Vector3(1, -2, 3.5)"));
+    testAssert(v.name() == "Vector3");
+    testAssert((v.size() == 3) && (v[0].type() == Any::NUMBER) && (float(v[2]) == 3.5f));
+    testAssert(Vector3(v) == Vector3(1, -2, 3.5f));
+
+    const Any& mixed = binaryRoundTrip(Any::parse("{ a = [1, \"two\", true, nil]; b = {}; c = 0x10; \"d e\" = \"\"; }"));
+    testAssert(String(mixed["a"][1]) == "two");
+    testAssert(bool(mixed["a"][2]) && mixed["a"][3].isNil());
+    testAssert(mixed["b"].size() == 0);
+    testAssert(int(mixed["c"]) == 16);
+    testAssert(mixed.unparse() == Any::parse("{ a = [1, \"two\", true, nil]; b = {}; c = 0x10; \"d e\" = \"\"; }").unparse());
+
+    // The text encoding of earlier versions is still read
+    {
+        BinaryOutput bo("<memory>", G3D_LITTLE_ENDIAN);
+        bo.writeInt32(1);
+        bo.writeString32("{ x = 3; }");
+        bo.commit();
+        BinaryInput bi(bo.getCArray(), bo.size(), G3D_LITTLE_ENDIAN);
+        Any a;
+        a.deserialize(bi);
+        testAssert(int(a["x"]) == 3);
+    }
+
+    // Counts that cannot fit in the remaining input are rejected before allocating
+    {
+        const auto isRejected = [](const Array<uint8>& bytes) {
+            BinaryOutput bo("<memory>", G3D_LITTLE_ENDIAN);
+            bo.writeInt32(2);
+            bo.writeBytes(bytes.getCArray(), bytes.size());
+            bo.commit();
+            BinaryInput bi(bo.getCArray(), bo.size(), G3D_LITTLE_ENDIAN);
+            Any a;
+            try {
+                a.deserialize(bi);
+            } catch (const ParseError&) {
+                return true;
+            }
+            return false;
+        };
+
+        const uint8 ARRAY = uint8(Any::ARRAY), TABLE = uint8(Any::TABLE), NUMBER_ARRAY = 7;
+        // 0xFFFFFFFF, which is negative as an int
+        testAssert(isRejected(Array<uint8>(0xFF, 0xFF, 0xFF, 0xFF, 0x0F)));
+        // A string table of 1000 strings in two bytes
+        testAssert(isRejected(Array<uint8>(0xE8, 0x07, 0, 0)));
+        testAssert(isRejected(Array<uint8>(0, ARRAY, 0xFF, 0xFF, 0xFF, 0xFF, 0x0F)));
+        testAssert(isRejected(Array<uint8>(0, ARRAY, 3, 0)));
+        testAssert(isRejected(Array<uint8>(0, TABLE, 0xFF, 0xFF, 0xFF, 0xFF, 0x07)));
+        testAssert(isRejected(Array<uint8>(0, TABLE, 2, 0)));
+        testAssert(isRejected(Array<uint8>(0, NUMBER_ARRAY, 0xFF, 0xFF, 0xFF, 0xFF, 0x0F)));
+        testAssert(isRejected(Array<uint8>(0, NUMBER_ARRAY, 1, 0)));
+
+        // ...while counts that fit are accepted
+        testAssert(! isRejected(Array<uint8>(0, ARRAY, 2, uint8(Any::NIL), uint8(Any::NIL))));
+    }
+
+    // save() and load() select binary files automatically
+    const String& filename = FileSystem::tempFilename() + Any::BINARY_EXTENSION;
+    text.save(filename);
+    testAssert(Any::isBinaryFile(filename));
+    testAssert(! Any::isBinaryFile("Any-load.txt"));
+    testAssert(Any::fromFile(filename) == text);
+    FileSystem::removeFile(filename);
+}
+
+
 void testAny() {
 
     printf("G3D::Any ");
@@ -313,6 +403,7 @@ void testAny() {
     testConstruct();
     testCast();
     testPlaceholder();
+    testBinary();
 
     std::stringstream errss;
 
@@ -359,3 +450,40 @@ void testAny() {
     printf("passed\n");
 
 };    // void testAny()
+
+
+void perfAny() {
+    PRINT_SECTION("Any", "Time to load a generated scene-like file");
+
+    // Many small tables with repeated keys, as in a scene
+    Any root(Any::TABLE, "Scene");
+    Any entities(Any::TABLE);
+    for (int i = 0; i < 20000; ++i) {
+        Any e(Any::TABLE, "VisibleEntity");
+        e["model"] = format("model%d", i % 50);
+        e["frame"] = CFrame::fromXYZYPRDegrees(float(i), 1.0f, 2.0f, 30.0f, 0.0f, 0.0f);
+        e["castsShadows"] = (i % 2) == 0;
+        entities[format("entity%d", i)] = e;
+    }
+    root["entities"] = entities;
+
+    const String& textFilename   = FileSystem::tempFilename() + ".Scene.Any";
+    const String& binaryFilename = textFilename + ".bin";
+    root.save(textFilename);
+    root.save(binaryFilename);
+
+    PRINT_HEADER(format("%d kB text, %d kB binary", int(FileSystem::size(textFilename) / 1024), int(FileSystem::size(binaryFilename) / 1024)).c_str());
+    PRINT_TEXT("", "load");
+    // Binary first: freeing the many small allocations of a text load leaves the heap slower for the next load
+    for (const String& filename : {binaryFilename, textFilename}) {
+        Stopwatch stopwatch;
+        stopwatch.tick();
+        const Any& a = Any::fromFile(filename);
+        stopwatch.tock();
+        testAssert(a["entities"].size() == 20000);
+        PRINT_MILLI((filename == binaryFilename) ? "binary" : "text", "(ms)", stopwatch.elapsedDuration());
+    }
+
+    FileSystem::removeFile(textFilename);
+    FileSystem::removeFile(binaryFilename);
+}
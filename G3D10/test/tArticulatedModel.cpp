@@ -0,0 +1,166 @@
+/**
+  \file test/tArticulatedModel.cpp
+
+  G3D Innovation Engine http://casual-effects.com/g3d
+  Copyright 2000-2019, Morgan McGuire
+  All rights reserved
+  Available under the BSD License
+*/
+#include "G3D/G3D.h"
+#include "testassert.h"
+#include "printhelpers.h"
+
+template<class Component>
+static void testComponentsMatch(const Component& x, const Component& y) {
+    testAssert(x.max() == y.max());
+    testAssert(x.mean() == y.mean());
+    testAssert(isNull(x.texture()) == isNull(y.texture()));
+    if (notNull(x.texture())) {
+        testAssert(x.texture()->name() == y.texture()->name());
+        testAssert(x.texture()->width() == y.texture()->width());
+        testAssert(x.texture()->height() == y.texture()->height());
+        testAssert(x.texture()->format() == y.texture()->format());
+    }
+}
+
+
+static void testMaterialsMatch(const shared_ptr<UniversalMaterial>& x, const shared_ptr<UniversalMaterial>& y) {
+    testAssert(isNull(x) == isNull(y));
+    if (isNull(x)) {
+        return;
+    }
+    testAssert(x->name() == y->name());
+    testAssert(notNull(x->specification()) && notNull(y->specification()));
+    testAssert(x->specification()->toAny() == y->specification()->toAny());
+    testAssert(x->alphaFilter() == y->alphaFilter());
+    testComponentsMatch(x->bsdf()->lambertian(), y->bsdf()->lambertian());
+    testComponentsMatch(x->bsdf()->glossy(), y->bsdf()->glossy());
+    testComponentsMatch(x->bsdf()->transmissive(), y->bsdf()->transmissive());
+    testComponentsMatch(x->emissive(), y->emissive());
+}
+
+
+static void testModelsMatch(const shared_ptr<ArticulatedModel>& a, const shared_ptr<ArticulatedModel>& b) {
+    testAssert(a->rootArray().size() == b->rootArray().size());
+    testAssert(a->geometryArray().size() == b->geometryArray().size());
+    testAssert(a->meshArray().size() == b->meshArray().size());
+
+    for (int g = 0; g < a->geometryArray().size(); ++g) {
+        const CPUVertexArray& x = a->geometryArray()[g]->cpuVertexArray;
+        const CPUVertexArray& y = b->geometryArray()[g]->cpuVertexArray;
+        testAssert(x.size() == y.size());
+        testAssert(x.hasTangent == y.hasTangent);
+        for (int v = 0; v < x.size(); ++v) {
+            testAssert(x.vertex[v].position == y.vertex[v].position);
+            testAssert(x.vertex[v].normal == y.vertex[v].normal);
+        }
+    }
+
+    for (int m = 0; m < a->meshArray().size(); ++m) {
+        const ArticulatedModel::Mesh* x = a->meshArray()[m];
+        const ArticulatedModel::Mesh* y = b->meshArray()[m];
+        testAssert(x->name == y->name);
+        testAssert(x->primitive == y->primitive);
+        testAssert(x->uniqueID == y->uniqueID);
+        testAssert(x->cpuIndexArray.size() == y->cpuIndexArray.size());
+        for (int i = 0; i < x->cpuIndexArray.size(); ++i) {
+            testAssert(x->cpuIndexArray[i] == y->cpuIndexArray[i]);
+        }
+        testMaterialsMatch(x->material, y->material);
+        testAssert(x->logicalPart->name == y->logicalPart->name);
+    }
+}
+
+
+static void testPersistentCache() {
+    const String& directory = FileSystem::tempFilename();
+    ArticulatedModel::setPersistentCacheDirectory(directory);
+
+    ArticulatedModel::Specification specification;
+    specification.filename = System::findDataFile("cow.ifs");
+    specification.scale    = 2.0f;
+
+    // The first load writes the entry
+    const shared_ptr<ArticulatedModel>& first = ArticulatedModel::create(specification);
+    Array<String> files;
+    FileSystem::getFiles(FilePath::concat(directory, "*.ArticulatedModel.cache"), files, true);
+    testAssert(files.size() == 1);
+
+    // The second load reads it, because the in-memory cache was cleared
+    ArticulatedModel::clearCache();
+    const shared_ptr<ArticulatedModel>& second = ArticulatedModel::create(specification);
+    testAssert(first != second);
+    testModelsMatch(first, second);
+
+    // Uncachable specifications neither read nor write entries
+    specification.cachable = false;
+    const shared_ptr<ArticulatedModel>& third = ArticulatedModel::create(specification);
+    testModelsMatch(first, third);
+    files.fastClear();
+    FileSystem::getFiles(FilePath::concat(directory, "*.ArticulatedModel.cache"), files, true);
+    testAssert(files.size() == 1);
+
+    // A corrupt entry is ignored and rewritten
+    {
+        BinaryOutput b(files[0], G3D_LITTLE_ENDIAN);
+        b.writeString32("not a cache entry");
+        b.commit();
+    }
+    ArticulatedModel::clearCache();
+    specification.cachable = true;
+    const shared_ptr<ArticulatedModel>& fourth = ArticulatedModel::create(specification);
+    testModelsMatch(first, fourth);
+
+    ArticulatedModel::setPersistentCacheDirectory("");
+    ArticulatedModel::clearCache();
+    FileSystem::removeFile(files[0]);
+    // FileSystem::removeFile only removes files
+    ::remove(directory.c_str());
+}
+
+
+/** An OBJ whose MTL library references textures, including a separate alpha map */
+static void testPersistentCacheMaterials() {
+    const String& directory = FileSystem::tempFilename();
+    ArticulatedModel::setPersistentCacheDirectory(directory);
+
+    ArticulatedModel::Specification specification;
+    specification.filename = "transparency/texturedQuads.obj";
+
+    const shared_ptr<ArticulatedModel>& first = ArticulatedModel::create(specification);
+    testAssert(first->meshArray().size() == 3);
+    for (const ArticulatedModel::Mesh* mesh : first->meshArray()) {
+        testAssert(notNull(mesh->material));
+        testAssert(notNull(mesh->material->bsdf()->lambertian().texture()));
+    }
+
+    Array<String> files;
+    FileSystem::getFiles(FilePath::concat(directory, "*.ArticulatedModel.cache"), files, true);
+    testAssert(files.size() == 1);
+
+    ArticulatedModel::clearCache();
+    const shared_ptr<ArticulatedModel>& second = ArticulatedModel::create(specification);
+    testAssert(first != second);
+    testModelsMatch(first, second);
+
+    // Meshes that shared a material before caching still share one
+    for (int i = 0; i < first->meshArray().size(); ++i) {
+        for (int j = 0; j < i; ++j) {
+            testAssert((first->meshArray()[i]->material == first->meshArray()[j]->material) ==
+                       (second->meshArray()[i]->material == second->meshArray()[j]->material));
+        }
+    }
+
+    ArticulatedModel::setPersistentCacheDirectory("");
+    ArticulatedModel::clearCache();
+    FileSystem::removeFile(files[0]);
+    ::remove(directory.c_str());
+}
+
+
+void testArticulatedModel() {
+    printf("ArticulatedModel ");
+    testPersistentCache();
+    testPersistentCacheMaterials();
+    printf("passed\n");
+}
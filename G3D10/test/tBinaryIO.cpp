@@ -258,10 +258,45 @@ static void measureOverhead() {
 }
 
 
+static void measureCompression() {
+    // Mostly small integers, which compress moderately well
+    const int N = 4 * 1024 * 1024;
+    Array<int32> data;
+    data.resize(N);
+    Random rnd(1234, false);
+    for (int i = 0; i < N; ++i) {
+        data[i] = rnd.integer(0, 255) * (i % 3);
+    }
+
+    PRINT_HEADER(format("Compress %d MB", int(N * sizeof(int32) / (1024 * 1024))).c_str());
+    Stopwatch stopwatch;
+    for (const bool blocks : {false, true}) {
+        BinaryOutput bo("<memory>", G3D_LITTLE_ENDIAN);
+        bo.writeInt32(data.getCArray(), N);
+
+        stopwatch.tick();
+        if (blocks) {
+            bo.compressBlocks();
+        } else {
+            bo.compress(6);
+        }
+        bo.commit();
+        stopwatch.tock();
+        PRINT_MILLI(blocks ? "compressBlocks" : "compress", "(ms)", stopwatch.elapsedDuration());
+
+        stopwatch.tick();
+        BinaryInput bi(bo.getCArray(), bo.size(), G3D_LITTLE_ENDIAN, true);
+        stopwatch.tock();
+        PRINT_MILLI("  decompress", "(ms)", stopwatch.elapsedDuration());
+    }
+}
+
+
 void perfBinaryIO() {
     PRINT_SECTION("Performance: BinaryOutput", "Measures performance of read/write operations");
     measureOverhead();
     measureSerializerPerformance();
+    measureCompression();
 }
 
 
@@ -424,9 +459,197 @@ static void testStringSerialization() {
 
 }
 
+static void testMemoryMapped() {
+    printf("BinaryInput memory mapped\n");
+    const String& filename = FileSystem::tempFilename();
+    {
+        BinaryOutput bo(filename, G3D_BIG_ENDIAN);
+        for (int i = 0; i < 10000; ++i) {
+            bo.writeInt32(i);
+        }
+        bo.writeString("end");
+        bo.commit();
+    }
+
+    {
+        BinaryInput copied(filename, G3D_BIG_ENDIAN);
+        BinaryInput mapped(filename, G3D_BIG_ENDIAN, MemoryMappedFile::SEQUENTIAL);
+        testAssert(! copied.memoryMapped());
+        testAssert(mapped.memoryMapped());
+        testAssert(mapped.size() == copied.size());
+        testAssert(memcmp(mapped.getCArray(), copied.getCArray(), size_t(copied.size())) == 0);
+
+        for (int i = 0; i < 10000; ++i) {
+            testAssert(mapped.readInt32() == i);
+        }
+        testAssert(mapped.readString() == "end");
+        testAssert(! mapped.hasMore());
+
+        // Seeking backwards needs no reload
+        mapped.setPosition(4 * 9999);
+        testAssert(mapped.readInt32() == 9999);
+    }
+
+    FileSystem::removeFile(filename);
+}
+
+
+/** Writes \a n int32s that compress moderately well */
+static void writeBlockTestData(BinaryOutput& b, int n) {
+    Random rnd(1234, false);
+    for (int i = 0; i < n; ++i) {
+        b.writeInt32((i % 7 == 0) ? rnd.integer(0, 1000) : i);
+    }
+}
+
+
+static void testBlockCompression() {
+    printf("BinaryOutput block compression\n");
+    const int N = 100000;
+    const int BLOCK_SIZE = 4096;
+
+    BinaryOutput uncompressed("<memory>", G3D_LITTLE_ENDIAN);
+    writeBlockTestData(uncompressed, N);
+    uncompressed.commit();
+    const uint8* expected = uncompressed.getCArray();
+
+    // File
+    const String& filename = FileSystem::tempFilename();
+    {
+        BinaryOutput bo(filename, G3D_LITTLE_ENDIAN);
+        bo.compressBlocks(6, BLOCK_SIZE);
+        writeBlockTestData(bo, N);
+        bo.commit();
+    }
+    testAssert(FileSystem::size(filename) < uncompressed.size());
+    {
+        BinaryInput bi(filename, G3D_LITTLE_ENDIAN, true);
+        testAssert(bi.size() == uncompressed.size());
+        testAssert(memcmp(bi.getCArray(), expected, size_t(bi.size())) == 0);
+    }
+
+    // Random access and incremental reads
+    {
+        const shared_ptr<BlockDecompressor>& decompressor = BlockDecompressor::create(filename);
+        testAssert(notNull(decompressor));
+        testAssert(decompressor->size() == uncompressed.size());
+        testAssert(decompressor->numBlocks() == int((uncompressed.size() + BLOCK_SIZE - 1) / BLOCK_SIZE));
+
+        Array<uint8> buffer;
+        buffer.resize(3 * BLOCK_SIZE);
+        for (const int64 offset : {int64(0), int64(BLOCK_SIZE), int64(100), int64(5 * BLOCK_SIZE - 7), uncompressed.size() - 3 * BLOCK_SIZE}) {
+            for (const int n : {1, 9, BLOCK_SIZE, BLOCK_SIZE + 10, 3 * BLOCK_SIZE}) {
+                decompressor->read(offset, n, buffer.getCArray());
+                testAssert(memcmp(buffer.getCArray(), expected + offset, n) == 0);
+            }
+        }
+
+        for (int64 offset = 0; offset < uncompressed.size(); offset += 1000) {
+            const int n = int(min(int64(1000), uncompressed.size() - offset));
+            decompressor->read(offset, n, buffer.getCArray());
+            testAssert(memcmp(buffer.getCArray(), expected + offset, n) == 0);
+        }
+    }
+    FileSystem::removeFile(filename);
+
+    // Memory
+    {
+        BinaryOutput bo("<memory>", G3D_LITTLE_ENDIAN);
+        writeBlockTestData(bo, N);
+        bo.compressBlocks(6, BLOCK_SIZE);
+        bo.commit();
+        testAssert(BlockDecompressor::isBlockCompressed(bo.getCArray(), size_t(bo.size())));
+
+        BinaryInput bi(bo.getCArray(), bo.size(), G3D_LITTLE_ENDIAN, true);
+        testAssert(bi.size() == uncompressed.size());
+        testAssert(memcmp(bi.getCArray(), expected, size_t(bi.size())) == 0);
+    }
+
+    // Empty
+    {
+        BinaryOutput bo("<memory>", G3D_LITTLE_ENDIAN);
+        bo.compressBlocks();
+        bo.commit();
+        BinaryInput bi(bo.getCArray(), bo.size(), G3D_LITTLE_ENDIAN, true);
+        testAssert(bi.size() == 0);
+    }
+
+    // Truncated and corrupt trailers are rejected before the index is read
+    {
+        BinaryOutput bo("<memory>", G3D_LITTLE_ENDIAN);
+        writeBlockTestData(bo, N);
+        bo.compressBlocks(6, BLOCK_SIZE);
+        bo.commit();
+        const size_t size = size_t(bo.size());
+        const uint64 numBlocks = uint64((uncompressed.size() + BLOCK_SIZE - 1) / BLOCK_SIZE);
+
+        const auto isRejected = [](const Array<uint8>& data) {
+            try {
+                BlockDecompressor::create(data.getCArray(), size_t(data.size()));
+            } catch (const String&) {
+                return true;
+            }
+            return false;
+        };
+
+        const auto corrupt = [&](uint64 uncompressedSize, uint64 indexOffset, uint32 count) {
+            Array<uint8> data;
+            data.resize(int(size));
+            System::memcpy(data.getCArray(), bo.getCArray(), size);
+            uint8* trailer = data.getCArray() + size - BlockCompressor::TRAILER_SIZE;
+            for (int i = 0; i < 8; ++i) {
+                trailer[i]     = uint8(uncompressedSize >> (8 * i));
+                trailer[8 + i] = uint8(indexOffset >> (8 * i));
+            }
+            for (int i = 0; i < 4; ++i) {
+                trailer[16 + i] = uint8(count >> (8 * i));
+            }
+            return data;
+        };
+
+        const uint64 indexOffset = uint64(size) - BlockCompressor::TRAILER_SIZE - 8 * numBlocks;
+        {
+            const Array<uint8>& data = corrupt(uint64(uncompressed.size()), indexOffset, uint32(numBlocks));
+            testAssert(! isRejected(data));
+        }
+
+        // Index offset and block count whose sum wraps around to the file size
+        const uint32 hugeCount = 0xFFFFFFFF;
+        testAssert(isRejected(corrupt(uint64(hugeCount) * BLOCK_SIZE, uint64(size) - BlockCompressor::TRAILER_SIZE - 8 * uint64(hugeCount), hugeCount)));
+        testAssert(isRejected(corrupt(uint64(uncompressed.size()), indexOffset + 8, uint32(numBlocks))));
+        testAssert(isRejected(corrupt(uint64(uncompressed.size()), ~uint64(0), uint32(numBlocks))));
+        testAssert(isRejected(corrupt(~uint64(0), indexOffset, uint32(numBlocks))));
+
+        // Dropping part of the index while keeping the trailer
+        {
+            Array<uint8> data;
+            data.resize(int(size) - 16);
+            const size_t head = size - BlockCompressor::TRAILER_SIZE - 16;
+            System::memcpy(data.getCArray(), bo.getCArray(), head);
+            System::memcpy(data.getCArray() + head, bo.getCArray() + size - BlockCompressor::TRAILER_SIZE, BlockCompressor::TRAILER_SIZE);
+            testAssert(isRejected(data));
+        }
+
+        // Truncation that loses the trailer is not recognized as block compressed
+        testAssert(! BlockDecompressor::isBlockCompressed(bo.getCArray(), size - 1));
+        testAssert(isNull(BlockDecompressor::create(bo.getCArray(), BlockCompressor::HEADER_SIZE)));
+    }
+
+    // The single-stream format is not mistaken for blocks
+    {
+        BinaryOutput bo("<memory>", G3D_LITTLE_ENDIAN);
+        writeBlockTestData(bo, N);
+        bo.compress();
+        testAssert(! BlockDecompressor::isBlockCompressed(bo.getCArray(), size_t(bo.size())));
+    }
+}
+
+
 void testBinaryIO() {
     testStringSerialization();
     testBasicSerialization();
     testBitSerialization();
     testCompression();
+    testMemoryMapped();
+    testBlockCompression();
 }
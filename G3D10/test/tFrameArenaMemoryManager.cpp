@@ -0,0 +1,80 @@
+/**
+  \file test/tFrameArenaMemoryManager.cpp
+
+  G3D Innovation Engine http://casual-effects.com/g3d
+  Copyright 2000-2019, Morgan McGuire
+  All rights reserved
+  Available under the BSD License
+*/
+#include "G3D/G3D.h"
+#include "testassert.h"
+
+void testFrameArenaMemoryManager() {
+    printf("FrameArenaMemoryManager ");
+
+    const shared_ptr<FrameArenaMemoryManager> arena = FrameArenaMemoryManager::create(1024, 2);
+
+    // Alignment
+    for (int i = 1; i < 40; ++i) {
+        testAssert((intptr_t(arena->alloc(i)) & 15) == 0);
+    }
+
+    // Data from the previous frame survives one beginFrame()
+    Array<int> previous;
+    previous.clearAndSetMemoryManager(arena);
+    for (int i = 0; i < 100; ++i) {
+        previous.append(i);
+    }
+    arena->beginFrame();
+    Array<int> current;
+    current.clearAndSetMemoryManager(arena);
+    for (int i = 0; i < 100; ++i) {
+        current.append(-i);
+    }
+    for (int i = 0; i < 100; ++i) {
+        testAssert(previous[i] == i);
+    }
+    previous.clear();
+    current.clear();
+
+    // Overflowing frames coalesce, after which steady state does not touch the heap
+    for (int frame = 0; frame < 4; ++frame) {
+        arena->beginFrame();
+        for (int i = 0; i < 100; ++i) {
+            arena->alloc(100);
+        }
+    }
+    const int numHeapAllocations = arena->numHeapAllocations();
+    for (int frame = 0; frame < 10; ++frame) {
+        arena->beginFrame();
+        for (int i = 0; i < 100; ++i) {
+            arena->alloc(100);
+        }
+        testAssert(arena->bytesAllocatedThisFrame() == 100 * 112);
+    }
+    testAssert(arena->numHeapAllocations() == numHeapAllocations);
+
+    // Concurrent allocation must not hand out overlapping memory
+    arena->beginFrame();
+    Array<int*> ptr;
+    ptr.resize(1000);
+    runConcurrently(0, ptr.size(), [&](int i) {
+        ptr[i] = (int*)arena->alloc(sizeof(int) * 4);
+        for (int j = 0; j < 4; ++j) {
+            ptr[i][j] = i;
+        }
+    });
+    for (int i = 0; i < ptr.size(); ++i) {
+        for (int j = 0; j < 4; ++j) {
+            testAssert(ptr[i][j] == i);
+        }
+    }
+
+    // shared_ptr control block and object in the arena
+    {
+        shared_ptr<Vector3> v = std::allocate_shared<Vector3>(FrameArenaAllocator<Vector3>(arena), 1.0f, 2.0f, 3.0f);
+        testAssert(v->y == 2.0f);
+    }
+
+    printf("passed\n");
+}
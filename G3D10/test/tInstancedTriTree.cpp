@@ -0,0 +1,193 @@
+/**
+  \file test/tInstancedTriTree.cpp
+
+  G3D Innovation Engine http://casual-effects.com/g3d
+  Copyright 2000-2019, Morgan McGuire
+  All rights reserved
+  Available under the BSD License
+*/
+#include "G3D/G3D.h"
+#include "testassert.h"
+
+/** A UniversalSurface with no material, so that the test does not need to create textures */
+class InstanceTestSurface : public UniversalSurface {
+protected:
+
+    InstanceTestSurface(const CFrame& frame, const shared_ptr<GPUGeom>& gpuGeom, const CPUGeom& cpuGeom) :
+        UniversalSurface("InstanceTestSurface", frame, frame, nullptr, gpuGeom, cpuGeom, nullptr,
+                         ExpressiveLightScatteringProperties(), nullptr, nullptr, nullptr, 1) {}
+
+public:
+
+    static shared_ptr<InstanceTestSurface> create(const CFrame& frame, const shared_ptr<GPUGeom>& gpuGeom, const CPUGeom& cpuGeom) {
+        return createShared<InstanceTestSurface>(frame, gpuGeom, cpuGeom);
+    }
+
+    virtual void setStorage(ImageStorage newStorage) override {}
+};
+
+
+/** Two meshes that share one vertex array, as ArticulatedModel parts do */
+class InstanceTestModel {
+public:
+    CPUVertexArray                          vertexArray;
+    Array<int>                              index[2];
+    shared_ptr<UniversalSurface::GPUGeom>   gpuGeom[2];
+
+    InstanceTestModel() {
+        Random rnd(4321, false);
+        for (int t = 0; t < 400; ++t) {
+            const Point3 c(rnd.uniform(-1, 1), rnd.uniform(-1, 1), rnd.uniform(-1, 1));
+            for (int k = 0; k < 3; ++k) {
+                CPUVertexArray::Vertex& v = vertexArray.vertex.next();
+                v.position  = c + Vector3(rnd.uniform(-0.2f, 0.2f), rnd.uniform(-0.2f, 0.2f), rnd.uniform(-0.2f, 0.2f));
+                v.normal    = Vector3::unitY();
+                v.tangent   = Vector4::zero();
+                v.texCoord0 = Point2::zero();
+                index[t % 2].append(vertexArray.size() - 1);
+            }
+        }
+        for (int m = 0; m < 2; ++m) {
+            gpuGeom[m] = UniversalSurface::GPUGeom::create();
+            gpuGeom[m]->twoSided = (m == 1);
+        }
+    }
+
+    void pose(const CFrame& frame, Array<shared_ptr<Surface>>& surfaceArray) const {
+        for (int m = 0; m < 2; ++m) {
+            UniversalSurface::CPUGeom cpuGeom;
+            cpuGeom.index       = &index[m];
+            cpuGeom.vertexArray = &vertexArray;
+            surfaceArray.append(InstanceTestSurface::create(frame, gpuGeom[m], cpuGeom));
+        }
+    }
+};
+
+
+static void poseScene(const InstanceTestModel& model, const Array<CFrame>& frame, Array<shared_ptr<Surface>>& surfaceArray) {
+    surfaceArray.fastClear();
+    for (const CFrame& f : frame) {
+        model.pose(f, surfaceArray);
+    }
+}
+
+
+/** Checks the instanced tree against a flat NativeTriTree of the same surfaces */
+static void testAgreesWithFlatTree(const shared_ptr<InstancedTriTree>& tree, const Array<shared_ptr<Surface>>& surfaceArray) {
+    // Surface::getTris requires a material, so flatten by hand
+    Array<Tri> triArray;
+    CPUVertexArray vertexArray;
+    for (const shared_ptr<Surface>& surface : surfaceArray) {
+        const shared_ptr<UniversalSurface>& uniS = dynamic_pointer_cast<UniversalSurface>(surface);
+        const int offset = vertexArray.size();
+        vertexArray.transformAndAppend(*uniS->cpuGeom().vertexArray, uniS->frame());
+        const Array<int>& index = *uniS->cpuGeom().index;
+        for (int i = 0; i < index.size(); i += 3) {
+            triArray.append(Tri(index[i] + offset, index[i + 1] + offset, index[i + 2] + offset, vertexArray, surface, uniS->gpuGeom()->twoSided));
+        }
+    }
+    const shared_ptr<NativeTriTree> flat = NativeTriTree::create();
+    flat->setContents(triArray, vertexArray);
+    testAssert(tree->size() == flat->size());
+
+    Random rnd(8765, false);
+    for (int r = 0; r < 2000; ++r) {
+        const Ray ray = Ray::fromOriginAndDirection(Point3(rnd.uniform(-8, 8), rnd.uniform(-3, 3), rnd.uniform(-3, 3)), Vector3::random(rnd), 0.0f, (r % 3 == 0) ? 2.0f : finf());
+        for (const TriTree::IntersectRayOptions options : {TriTree::IntersectRayOptions(0), TriTree::OCCLUSION_TEST_ONLY}) {
+            TriTree::Hit expected, actual;
+            const bool expectedHit = flat->intersectRay(ray, expected, options);
+            const bool actualHit   = tree->intersectRay(ray, actual, options);
+            testAssertM(expectedHit == actualHit, "Instanced and flat trees disagree on whether a ray hit");
+            if (expectedHit && (options == 0)) {
+                testAssertM(fuzzyEq(expected.distance, actual.distance), "Instanced and flat trees disagree on the first hit");
+
+                // The hit must index the flattened world-space triangle
+                const Tri& tri = (*tree)[actual.triIndex];
+                const Point3 P = tri.position(tree->vertexArray(), 0) * (1.0f - actual.u - actual.v) +
+                                 tri.position(tree->vertexArray(), 1) * actual.u +
+                                 tri.position(tree->vertexArray(), 2) * actual.v;
+                testAssert((P - ray.origin() - ray.direction() * actual.distance).length() < 1e-3f);
+                testAssert(notNull(tri.surface()));
+            }
+        }
+    }
+
+    for (int q = 0; q < 50; ++q) {
+        const Point3 c(rnd.uniform(-8, 8), rnd.uniform(-2, 2), rnd.uniform(-2, 2));
+        Array<Tri> expected, actual;
+
+        const AABox box(c - Vector3::one() * 0.5f, c + Vector3::one() * 0.5f);
+        flat->intersectBox(box, expected);
+        tree->intersectBox(box, actual);
+        testAssert(expected.size() == actual.size());
+
+        const Sphere sphere(c, 0.7f);
+        flat->intersectSphere(sphere, expected);
+        tree->intersectSphere(sphere, actual);
+        testAssert(expected.size() == actual.size());
+    }
+}
+
+
+void testInstancedTriTree() {
+    printf("InstancedTriTree ");
+
+    const InstanceTestModel model;
+    Array<CFrame> frame;
+    for (int i = 0; i < 7; ++i) {
+        frame.append(CFrame::fromXYZYPRDegrees(float(i) * 2.5f - 7.5f, 0, 0, float(i) * 40.0f, float(i) * 10.0f));
+    }
+
+    Array<shared_ptr<Surface>> surfaceArray;
+    poseScene(model, frame, surfaceArray);
+
+    const shared_ptr<InstancedTriTree> tree = InstancedTriTree::create([] { return NativeTriTree::create(); });
+    tree->setContents(surfaceArray);
+
+    InstancedTriTree::Stats stats = tree->stats();
+    testAssert(stats.numInstances == surfaceArray.size());
+    testAssertM(stats.numGeometries == 2, "Instances of the same mesh must share a bottom-level tree");
+    testAssert(stats.numBottomLevelBuilds == 2);
+    testAgreesWithFlatTree(tree, surfaceArray);
+
+    // Rigid motion only refits the top level
+    frame[3].translation += Vector3(0.5f, 0.25f, 0);
+    frame[5].rotation = Matrix3::fromAxisAngle(Vector3::unitZ(), 0.5f) * frame[5].rotation;
+    poseScene(model, frame, surfaceArray);
+    tree->setContents(surfaceArray);
+    stats = tree->stats();
+    testAssert(stats.numBottomLevelBuilds == 2);
+    testAssert(stats.numRefits == 1);
+    testAssert(stats.numRebuilds == 1);
+    testAgreesWithFlatTree(tree, surfaceArray);
+
+    // Teleporting an instance far away degrades the top level enough to rebuild it
+    frame[0].translation = Point3(1000, 0, 0);
+    poseScene(model, frame, surfaceArray);
+    tree->setContents(surfaceArray);
+    stats = tree->stats();
+    testAssert(stats.numBottomLevelBuilds == 2);
+    testAssert(stats.numRefits == 1);
+    testAssert(stats.numRebuilds == 2);
+    testAgreesWithFlatTree(tree, surfaceArray);
+
+    // Removing an instance re-flattens without rebuilding any geometry
+    frame.pop();
+    poseScene(model, frame, surfaceArray);
+    tree->setContents(surfaceArray);
+    stats = tree->stats();
+    testAssert(stats.numInstances == surfaceArray.size());
+    testAssert(stats.numBottomLevelBuilds == 2);
+    testAgreesWithFlatTree(tree, surfaceArray);
+
+    // Flat Tri input still works, as a single instance
+    Array<Tri> triArray;
+    triArray.copyFrom(tree->triArray());
+    CPUVertexArray vertexArray;
+    vertexArray.copyFrom(tree->vertexArray());
+    tree->setContents(triArray, vertexArray);
+    testAssert(tree->stats().numInstances == 1);
+    testAgreesWithFlatTree(tree, surfaceArray);
+
+    printf("passed\n");
+}
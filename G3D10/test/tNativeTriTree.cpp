@@ -0,0 +1,703 @@
+/**
+  \file test/tNativeTriTree.cpp
+
+  G3D Innovation Engine http://casual-effects.com/g3d
+  Copyright 2000-2019, Morgan McGuire
+  All rights reserved
+  Available under the BSD License
+*/
+#include "G3D/G3D.h"
+#include "testassert.h"
+#include "printhelpers.h"
+
+using G3D::uint8;
+using G3D::uint32;
+using G3D::uint64;
+
+/** Random small triangles scattered through a unit cube, plus a large
+    ground quad so that many rays hit something */
+static void makeTriangleSoup(int numTris, Array<Tri>& triArray, CPUVertexArray& vertexArray) {
+    Random rnd(1234, false);
+    triArray.fastClear();
+    vertexArray.clear();
+
+    const auto addVertex = [&](const Point3& p) {
+        CPUVertexArray::Vertex& v = vertexArray.vertex.next();
+        v.position  = p;
+        v.normal    = Vector3::unitY();
+        v.tangent   = Vector4::zero();
+        v.texCoord0 = Point2::zero();
+        return vertexArray.size() - 1;
+    };
+
+    for (int t = 0; t < numTris; ++t) {
+        const Point3 c(rnd.uniform(-1, 1), rnd.uniform(-1, 1), rnd.uniform(-1, 1));
+        const int i0 = addVertex(c);
+        const int i1 = addVertex(c + Vector3(rnd.uniform(-0.1f, 0.1f), rnd.uniform(-0.1f, 0.1f), rnd.uniform(-0.1f, 0.1f)));
+        const int i2 = addVertex(c + Vector3(rnd.uniform(-0.1f, 0.1f), rnd.uniform(-0.1f, 0.1f), rnd.uniform(-0.1f, 0.1f)));
+        triArray.append(Tri(i0, i1, i2, vertexArray, nullptr, (t % 2) == 0));
+    }
+
+    const int a = addVertex(Point3(-2, -1.5f, -2));
+    const int b = addVertex(Point3(-2, -1.5f,  2));
+    const int c = addVertex(Point3( 2, -1.5f,  2));
+    const int d = addVertex(Point3( 2, -1.5f, -2));
+    triArray.append(Tri(a, b, c, vertexArray));
+    triArray.append(Tri(a, c, d, vertexArray));
+}
+
+
+static void makeRays(int numRays, Array<Ray>& rays) {
+    Random rnd(5678, false);
+    rays.resize(numRays);
+    for (int r = 0; r < numRays; ++r) {
+        const Point3 origin(rnd.uniform(-1.5f, 1.5f), rnd.uniform(-1.5f, 1.5f), rnd.uniform(-1.5f, 1.5f));
+        rays[r] = Ray::fromOriginAndDirection(origin, Vector3::random(rnd), 0.0f, (r % 3 == 0) ? 1.0f : finf());
+    }
+}
+
+
+/** Primary rays in scanline order from a pinhole camera outside the soup */
+static void makeCoherentRays(int width, int height, Array<Ray>& rays) {
+    const Point3 eye(0.3f, 0.2f, 3.0f);
+    rays.resize(width * height);
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            const Vector3 d((x + 0.5f) / width - 0.5f, 0.5f - (y + 0.5f) / height, -1.0f);
+            rays[x + y * width] = Ray::fromOriginAndDirection(eye, d.direction());
+        }
+    }
+}
+
+
+static shared_ptr<NativeTriTree> makeTree(const NativeTriTree::Settings& settings, const Array<Tri>& triArray, const CPUVertexArray& vertexArray) {
+    const shared_ptr<NativeTriTree> tree = NativeTriTree::create();
+    tree->setSettings(settings);
+    tree->setContents(triArray, vertexArray);
+    return tree;
+}
+
+
+static shared_ptr<NativeTriTree> makeTree(NativeTriTree::Layout layout, const Array<Tri>& triArray, const CPUVertexArray& vertexArray) {
+    NativeTriTree::Settings settings;
+    settings.layout = layout;
+    return makeTree(settings, triArray, vertexArray);
+}
+
+
+static bool sameTri(const Tri& a, const Tri& b) {
+    return (a.index[0] == b.index[0]) && (a.index[1] == b.index[1]) && (a.index[2] == b.index[2]);
+}
+
+
+static void testRaysAgree(const shared_ptr<NativeTriTree>& reference, const shared_ptr<NativeTriTree>& tree, const Array<Ray>& rays) {
+    for (const TriTree::IntersectRayOptions options : {TriTree::IntersectRayOptions(0), TriTree::DO_NOT_CULL_BACKFACES, TriTree::OCCLUSION_TEST_ONLY}) {
+        for (const Ray& ray : rays) {
+            TriTree::Hit expected, actual;
+            const bool expectedHit = reference->intersectRay(ray, expected, options);
+            const bool actualHit   = tree->intersectRay(ray, actual, options);
+            testAssertM(expectedHit == actualHit, "Trees disagree on whether a ray hit");
+            if (expectedHit && ((options & TriTree::OCCLUSION_TEST_ONLY) == 0)) {
+                testAssertM(fuzzyEq(expected.distance, actual.distance), "Trees disagree on the first hit");
+                testAssert(expected.backface == actual.backface);
+            }
+        }
+    }
+}
+
+
+/** The HitBuffer overload must produce exactly the results of the Array<Hit> overload */
+static void testHitBufferAgrees(const shared_ptr<NativeTriTree>& tree, const Array<Ray>& rays, const Array<TriTree::Hit>& expected, TriTree::IntersectRayOptions options) {
+    TriTree::HitBuffer buffer;
+    // Stale results must be overwritten
+    buffer.resize(rays.size() + 7);
+    buffer.triIndex.setAll(0);
+    tree->intersectRays(rays, buffer, options);
+    testAssert(buffer.size() == rays.size());
+    for (int r = 0; r < rays.size(); ++r) {
+        testAssert((expected[r].triIndex == TriTree::Hit::NONE) == (buffer.triIndex[r] == TriTree::Hit::NONE));
+        if ((expected[r].triIndex != TriTree::Hit::NONE) && ((options & TriTree::OCCLUSION_TEST_ONLY) == 0)) {
+            const TriTree::Hit& hit = buffer[r];
+            testAssert(hit.triIndex == expected[r].triIndex);
+            testAssert(hit.distance == expected[r].distance);
+            testAssert((hit.u == expected[r].u) && (hit.v == expected[r].v));
+            testAssert(hit.backface == expected[r].backface);
+        }
+    }
+}
+
+
+static void testLayoutsAgree() {
+    Array<Tri> triArray;
+    CPUVertexArray vertexArray;
+    makeTriangleSoup(3000, triArray, vertexArray);
+
+    Array<Ray> rays;
+    makeRays(2000, rays);
+
+    const shared_ptr<NativeTriTree> bih  = makeTree(NativeTriTree::BIH,  triArray, vertexArray);
+    const NativeTriTree::Layout wideLayout[] = { NativeTriTree::BVH4, NativeTriTree::BVH8, NativeTriTree::COMPRESSED_BVH8 };
+
+    for (const NativeTriTree::Layout layout : wideLayout) {
+        const shared_ptr<NativeTriTree> wide = makeTree(layout, triArray, vertexArray);
+
+        const NativeTriTree::Stats stats = wide->stats(4);
+        testAssertM(stats.numTris == triArray.size(), "Every triangle must be in exactly one BVH leaf");
+
+        testRaysAgree(bih, wide, rays);
+
+        // Box queries must match an exhaustive search
+        Random rnd(91011, false);
+        for (int q = 0; q < 50; ++q) {
+            const Point3 c(rnd.uniform(-1, 1), rnd.uniform(-1, 1), rnd.uniform(-1, 1));
+            const AABox box(c - Vector3::one() * 0.2f, c + Vector3::one() * 0.2f);
+
+            Array<Tri> expected, actual;
+            for (const Tri& tri : triArray) {
+                if (CollisionDetection::fixedSolidBoxIntersectsFixedTriangle(box, Triangle(tri.position(vertexArray, 0), tri.position(vertexArray, 1), tri.position(vertexArray, 2)))) {
+                    expected.append(tri);
+                }
+            }
+            wide->intersectBox(box, actual);
+            testAssert(actual.size() == expected.size());
+            for (const Tri& tri : expected) {
+                bool found = false;
+                for (int i = 0; (i < actual.size()) && ! found; ++i) {
+                    found = sameTri(tri, actual[i]);
+                }
+                testAssert(found);
+            }
+        }
+    }
+}
+
+
+/** The compressed layout must find exactly the hits of BVH8 in much less memory */
+static void testCompressedBVH() {
+    Array<Tri> triArray;
+    CPUVertexArray vertexArray;
+    makeTriangleSoup(3000, triArray, vertexArray);
+
+    Array<Ray> rays;
+    makeRays(2000, rays);
+
+    const shared_ptr<NativeTriTree> bvh8       = makeTree(NativeTriTree::BVH8, triArray, vertexArray);
+    const shared_ptr<NativeTriTree> compressed = makeTree(NativeTriTree::COMPRESSED_BVH8, triArray, vertexArray);
+
+    for (const TriTree::IntersectRayOptions options : {TriTree::IntersectRayOptions(0), TriTree::DO_NOT_CULL_BACKFACES}) {
+        for (const Ray& ray : rays) {
+            TriTree::Hit expected, actual;
+            const bool expectedHit = bvh8->intersectRay(ray, expected, options);
+            testAssert(compressed->intersectRay(ray, actual, options) == expectedHit);
+            if (expectedHit) {
+                testAssert((actual.triIndex == expected.triIndex) && (actual.distance == expected.distance));
+                testAssert((actual.u == expected.u) && (actual.v == expected.v) && (actual.backface == expected.backface));
+            }
+        }
+    }
+
+    const NativeTriTree::Stats wideStats       = bvh8->stats(4);
+    const NativeTriTree::Stats compressedStats = compressed->stats(4);
+    testAssert((compressedStats.numTris == wideStats.numTris) && (compressedStats.depth == wideStats.depth));
+    testAssert(compressedStats.sceneBytes == wideStats.sceneBytes);
+    testAssertM(compressedStats.treeBytes * 3 < wideStats.treeBytes, "Compression must shrink the tree");
+    testAssert(fuzzyEq(compressedStats.bytesPerTri, float(compressedStats.treeBytes + compressedStats.sceneBytes) / triArray.size()));
+
+    // A flat triangle has zero extent along one axis
+    makeTriangleSoup(0, triArray, vertexArray);
+    const shared_ptr<NativeTriTree> flat = makeTree(NativeTriTree::COMPRESSED_BVH8, triArray, vertexArray);
+    TriTree::Hit hit;
+    testAssert(flat->intersectRay(Ray::fromOriginAndDirection(Point3(0.5f, 1, 0.25f), -Vector3::unitY()), hit));
+    testAssert(fuzzyEq(hit.distance, 2.5f));
+}
+
+
+static void testSaveAndLoad() {
+    Array<Tri> triArray;
+    CPUVertexArray vertexArray;
+    makeTriangleSoup(3000, triArray, vertexArray);
+
+    Array<Ray> rays;
+    makeRays(2000, rays);
+
+    const String& filename = FileSystem::tempFilename();
+    for (const NativeTriTree::Layout layout : {NativeTriTree::BVH4, NativeTriTree::BVH8, NativeTriTree::COMPRESSED_BVH8}) {
+        const shared_ptr<NativeTriTree> built = makeTree(layout, triArray, vertexArray);
+        testAssert(built->save(filename));
+
+        // Built from a different layout, so that nothing can be left over from the first build
+        const shared_ptr<NativeTriTree> loaded = makeTree((layout == NativeTriTree::BVH8) ? NativeTriTree::BVH4 : NativeTriTree::BVH8, triArray, vertexArray);
+        testAssertM(! loaded->load(filename), "Loaded a file with a different layout");
+
+        NativeTriTree::Settings settings;
+        settings.layout = layout;
+        loaded->setSettings(settings);
+        testAssert(loaded->contentHash() == built->contentHash());
+        testAssert(loaded->load(filename));
+
+        const NativeTriTree::Stats builtStats  = built->stats(4);
+        const NativeTriTree::Stats loadedStats = loaded->stats(4);
+        testAssert((loadedStats.numNodes == builtStats.numNodes) && (loadedStats.depth == builtStats.depth));
+        testAssert(loadedStats.treeBytes == builtStats.treeBytes);
+
+        for (const Ray& ray : rays) {
+            TriTree::Hit expected, actual;
+            testAssert(built->intersectRay(ray, expected) == loaded->intersectRay(ray, actual));
+            testAssert((actual.triIndex == expected.triIndex) && (actual.distance == expected.distance));
+        }
+
+        const AABox box(Point3(-0.3f, -0.3f, -0.3f), Point3(0.2f, 0.4f, 0.1f));
+        Array<int> expected, actual;
+        built->intersectBox(box, expected);
+        loaded->intersectBox(box, actual);
+        testAssert(expected.size() == actual.size());
+        for (int i = 0; i < expected.size(); ++i) {
+            testAssert(expected[i] == actual[i]);
+        }
+
+        // Moving a vertex invalidates the file
+        CPUVertexArray moved(vertexArray);
+        moved.vertex[0].position.x += 0.01f;
+        const shared_ptr<NativeTriTree> changed = makeTree(settings, triArray, moved);
+        testAssert(changed->contentHash() != built->contentHash());
+        testAssertM(! changed->load(filename), "Loaded a file for different geometry");
+    }
+
+    testAssertM(! makeTree(NativeTriTree::BIH, triArray, vertexArray)->save(filename), "The BIH cannot be saved");
+    FileSystem::removeFile(filename);
+
+    // The second tree with the same cacheDirectory must load the first one's file
+    const String& directory = FileSystem::tempFilename();
+    NativeTriTree::Settings settings;
+    settings.layout         = NativeTriTree::BVH8;
+    settings.cacheDirectory = directory;
+    const shared_ptr<NativeTriTree> first = makeTree(settings, triArray, vertexArray);
+
+    Array<String> files;
+    FileSystem::getFiles(FilePath::concat(directory, "*.tritree"), files, true);
+    testAssert(files.size() == 1);
+
+    const shared_ptr<NativeTriTree> second = makeTree(settings, triArray, vertexArray);
+    testAssert(second->stats(4).numNodes == first->stats(4).numNodes);
+    testRaysAgree(first, second, rays);
+
+    FileSystem::removeFile(files[0]);
+    // FileSystem::removeFile only removes files
+    ::remove(directory.c_str());
+}
+
+
+/** Answers region queries with the generic TriTreeBase::QueryTree, as Embree and the GPU trees do */
+class QueryTreeOnly : public NativeTriTree {
+public:
+    using NativeTriTree::intersectBox;
+    using NativeTriTree::intersectSphere;
+
+    virtual void intersectBox(const AABox& box, Array<int>& triIndex) const override {
+        TriTreeBase::intersectBox(box, triIndex);
+    }
+
+    virtual void intersectSphere(const Sphere& sphere, Array<int>& triIndex) const override {
+        TriTreeBase::intersectSphere(sphere, triIndex);
+    }
+};
+
+
+/** Checks that the results for query q are exactly the triangles for which \a overlaps is true */
+template<class Overlaps>
+static void testOverlapsMatch(const Array<Tri>& triArray, const TriTree::OverlapBuffer& results, int q, Overlaps overlaps) {
+    Array<int> actual;
+    for (const int* t = results.begin(q); t != results.end(q); ++t) {
+        actual.append(*t);
+    }
+    actual.sort();
+    for (int i = 1; i < actual.size(); ++i) {
+        testAssertM(actual[i - 1] != actual[i], "Overlap queries must not report a triangle twice");
+    }
+
+    int count = 0;
+    for (int t = 0; t < triArray.size(); ++t) {
+        if ((triArray[t].area() > 0.0f) && overlaps(triArray[t])) {
+            testAssert(actual.contains(t));
+            ++count;
+        }
+    }
+    testAssert(count == actual.size());
+}
+
+
+/** Batched box and sphere queries must match an exhaustive search in every layout */
+static void testOverlapQueries() {
+    Array<Tri> triArray;
+    CPUVertexArray vertexArray;
+    makeTriangleSoup(3000, triArray, vertexArray);
+
+    Random rnd(2468, false);
+    Array<AABox> boxArray;
+    Array<Sphere> sphereArray;
+    for (int q = 0; q < 200; ++q) {
+        const Point3 c(rnd.uniform(-1.2f, 1.2f), rnd.uniform(-1.6f, 1.2f), rnd.uniform(-1.2f, 1.2f));
+        const Vector3 extent(rnd.uniform(0, 0.3f), rnd.uniform(0, 0.3f), rnd.uniform(0, 0.3f));
+        boxArray.append(AABox(c - extent, c + extent));
+        sphereArray.append(Sphere(c, rnd.uniform(0, 0.3f)));
+    }
+
+    const shared_ptr<QueryTreeOnly> generic = std::make_shared<QueryTreeOnly>();
+    generic->setContents(triArray, vertexArray);
+
+    const shared_ptr<TriTree> tree[] = {
+        makeTree(NativeTriTree::BIH,  triArray, vertexArray),
+        makeTree(NativeTriTree::BVH4, triArray, vertexArray),
+        makeTree(NativeTriTree::BVH8, triArray, vertexArray),
+        makeTree(NativeTriTree::COMPRESSED_BVH8, triArray, vertexArray),
+        generic};
+
+    for (const shared_ptr<TriTree>& t : tree) {
+        TriTree::OverlapBuffer boxResults, sphereResults;
+        t->intersectBoxes(boxArray, boxResults);
+        t->intersectSpheres(sphereArray, sphereResults);
+        testAssert((boxResults.size() == boxArray.size()) && (sphereResults.size() == sphereArray.size()));
+
+        for (int q = 0; q < boxArray.size(); ++q) {
+            testOverlapsMatch(triArray, boxResults, q, [&](const Tri& tri) {
+                return CollisionDetection::fixedSolidBoxIntersectsFixedTriangle(boxArray[q], Triangle(tri.position(vertexArray, 0), tri.position(vertexArray, 1), tri.position(vertexArray, 2)));
+            });
+            testOverlapsMatch(triArray, sphereResults, q, [&](const Tri& tri) {
+                return CollisionDetection::fixedSolidSphereIntersectsFixedTriangle(sphereArray[q], Triangle(tri.position(vertexArray, 0), tri.position(vertexArray, 1), tri.position(vertexArray, 2)));
+            });
+        }
+
+        // The single-query form replaces its results
+        Array<Tri> single;
+        single.append(triArray[0]);
+        t->intersectBox(boxArray[7], single);
+        testAssert(single.size() == boxResults.count(7));
+    }
+}
+
+
+/** Enough triangles that the top of the tree is built concurrently */
+static void testParallelBuild() {
+    Array<Tri> triArray;
+    CPUVertexArray vertexArray;
+    makeTriangleSoup(40000, triArray, vertexArray);
+
+    Array<Ray> rays;
+    makeRays(2000, rays);
+
+    const shared_ptr<NativeTriTree> reference = makeTree(NativeTriTree::BIH, triArray, vertexArray);
+
+    for (const NativeTriTree::Layout layout : {NativeTriTree::BIH, NativeTriTree::BVH4, NativeTriTree::BVH8}) {
+        NativeTriTree::Settings settings;
+        settings.layout     = layout;
+        settings.algorithm  = NativeTriTree::BINNED_SAH;
+        settings.numThreads = 1;
+        const shared_ptr<NativeTriTree> serial = makeTree(settings, triArray, vertexArray);
+
+        settings.numThreads = 0;
+        const shared_ptr<NativeTriTree> parallel = makeTree(settings, triArray, vertexArray);
+
+        // Concurrency must not change the tree
+        const NativeTriTree::Stats serialStats   = serial->stats(4);
+        const NativeTriTree::Stats parallelStats = parallel->stats(4);
+        testAssert(serialStats.numNodes  == parallelStats.numNodes);
+        testAssert(serialStats.numLeaves == parallelStats.numLeaves);
+        testAssert(serialStats.numTris   == parallelStats.numTris);
+        testAssert(serialStats.depth     == parallelStats.depth);
+
+        testRaysAgree(reference, parallel, rays);
+    }
+}
+
+
+/** Packet traversal must find exactly the hits of the scalar traversal */
+static void testPackets() {
+    Array<Tri> triArray;
+    CPUVertexArray vertexArray;
+    makeTriangleSoup(5000, triArray, vertexArray);
+
+    Array<Ray> coherent, incoherent;
+    makeCoherentRays(67, 43, coherent);
+    makeRays(3001, incoherent);
+
+    for (const NativeTriTree::Layout layout : {NativeTriTree::BVH4, NativeTriTree::BVH8}) {
+        const shared_ptr<NativeTriTree> tree = makeTree(layout, triArray, vertexArray);
+
+        for (const Array<Ray>* rays : {&coherent, &incoherent}) {
+            for (const TriTree::IntersectRayOptions options : {TriTree::IntersectRayOptions(0), TriTree::DO_NOT_CULL_BACKFACES, TriTree::OCCLUSION_TEST_ONLY}) {
+                Array<TriTree::Hit> packet;
+                // Stale results must not leak into rays that miss
+                packet.resize(rays->size());
+                for (TriTree::Hit& hit : packet) {
+                    hit.triIndex = 0;
+                }
+                tree->intersectRays(*rays, packet, options | TriTree::COHERENT_RAY_HINT);
+                testAssert(packet.size() == rays->size());
+                testHitBufferAgrees(tree, *rays, packet, options | TriTree::COHERENT_RAY_HINT);
+
+                for (int r = 0; r < rays->size(); ++r) {
+                    TriTree::Hit expected;
+                    const bool expectedHit = tree->intersectRay((*rays)[r], expected, options);
+                    testAssertM(expectedHit == (packet[r].triIndex != TriTree::Hit::NONE), "Packet and scalar traversal disagree on whether a ray hit");
+                    if (expectedHit && ((options & TriTree::OCCLUSION_TEST_ONLY) == 0)) {
+                        testAssert(expected.triIndex == packet[r].triIndex);
+                        testAssert(expected.distance == packet[r].distance);
+                        testAssert(expected.backface == packet[r].backface);
+                    }
+                }
+            }
+        }
+    }
+}
+
+
+/** Sorted incoherent batches must scatter each result back to its own ray */
+static void testSortedRays() {
+    Array<Tri> triArray;
+    CPUVertexArray vertexArray;
+    makeTriangleSoup(5000, triArray, vertexArray);
+
+    Array<Ray> rays;
+    makeRays(9001, rays);
+
+    Array<int> order;
+    TriTreeBase::sortRays(rays, order);
+    testAssert(order.size() == rays.size());
+    Array<bool> seen;
+    seen.resize(rays.size());
+    for (int r = 0; r < seen.size(); ++r) {
+        seen[r] = false;
+    }
+    int previousOctant = 0;
+    for (const int r : order) {
+        testAssert((r >= 0) && (r < rays.size()) && ! seen[r]);
+        seen[r] = true;
+        const Vector3& d = rays[r].direction();
+        const int octant = int(d.x < 0.0f) | (int(d.y < 0.0f) << 1) | (int(d.z < 0.0f) << 2);
+        testAssertM(octant >= previousOctant, "Sorted rays must be binned by octant");
+        previousOctant = octant;
+    }
+
+    for (const NativeTriTree::Layout layout : {NativeTriTree::BIH, NativeTriTree::BVH8}) {
+        const shared_ptr<NativeTriTree> tree = makeTree(layout, triArray, vertexArray);
+        for (const TriTree::IntersectRayOptions options : {TriTree::IntersectRayOptions(0), TriTree::OCCLUSION_TEST_ONLY}) {
+            Array<TriTree::Hit> sorted;
+            tree->intersectRays(rays, sorted, options);
+            testAssert(sorted.size() == rays.size());
+            testHitBufferAgrees(tree, rays, sorted, options);
+            for (int r = 0; r < rays.size(); ++r) {
+                TriTree::Hit expected;
+                const bool expectedHit = tree->intersectRay(rays[r], expected, options);
+                testAssertM(expectedHit == (sorted[r].triIndex != TriTree::Hit::NONE), "Sorted and scalar traversal disagree on whether a ray hit");
+                if (expectedHit && ((options & TriTree::OCCLUSION_TEST_ONLY) == 0)) {
+                    testAssert(expected.triIndex == sorted[r].triIndex);
+                    testAssert(expected.distance == sorted[r].distance);
+                }
+            }
+        }
+    }
+}
+
+
+void testNativeTriTree() {
+    printf("NativeTriTree ");
+    testLayoutsAgree();
+    testParallelBuild();
+    testPackets();
+    testSortedRays();
+    testOverlapQueries();
+    testCompressedBVH();
+    testSaveAndLoad();
+    printf("passed\n");
+}
+
+
+void perfNativeTriTree() {
+    PRINT_SECTION("NativeTriTree", "Compares build time and ray intersection throughput of the node layouts");
+
+    Array<Tri> triArray;
+    CPUVertexArray vertexArray;
+    makeTriangleSoup(200000, triArray, vertexArray);
+
+    Array<Ray> rays;
+    makeRays(200000, rays);
+    Array<PrecomputedRay> prays;
+    prays.resize(rays.size());
+    for (int r = 0; r < rays.size(); ++r) {
+        prays[r] = rays[r];
+    }
+
+    PRINT_HEADER("200k tris, 200k rays");
+    PRINT_TEXT("", "build", "trace");
+
+    class Config {
+    public:
+        const char*                     name;
+        NativeTriTree::Layout           layout;
+        NativeTriTree::SplitAlgorithm   algorithm;
+        int                             numThreads;
+    };
+
+    const Config config[] = {
+        {"BIH",                 NativeTriTree::BIH,  NativeTriTree::MEAN_EXTENT, 1},
+        {"BIH",                 NativeTriTree::BIH,  NativeTriTree::MEAN_EXTENT, 0},
+        {"BIH binned SAH",      NativeTriTree::BIH,  NativeTriTree::BINNED_SAH,  1},
+        {"BIH binned SAH",      NativeTriTree::BIH,  NativeTriTree::BINNED_SAH,  0},
+        {"BVH4",                NativeTriTree::BVH4, NativeTriTree::BINNED_SAH,  1},
+        {"BVH4",                NativeTriTree::BVH4, NativeTriTree::BINNED_SAH,  0},
+        {"BVH8",                NativeTriTree::BVH8, NativeTriTree::BINNED_SAH,  1},
+        {"BVH8",                NativeTriTree::BVH8, NativeTriTree::BINNED_SAH,  0}};
+
+    for (const Config& c : config) {
+        NativeTriTree::Settings settings;
+        settings.layout     = c.layout;
+        settings.algorithm  = c.algorithm;
+        settings.numThreads = c.numThreads;
+
+        Stopwatch stopwatch;
+        stopwatch.tick();
+        const shared_ptr<NativeTriTree> tree = makeTree(settings, triArray, vertexArray);
+        stopwatch.tock();
+        const chrono::nanoseconds build = stopwatch.elapsedDuration();
+
+        Array<TriTree::Hit> results;
+        results.resize(prays.size());
+        stopwatch.tick();
+        for (int r = 0; r < prays.size(); ++r) {
+            tree->intersectRay(prays[r], results[r]);
+        }
+        stopwatch.tock();
+        const chrono::nanoseconds trace = stopwatch.elapsedDuration();
+
+        PRINT_MILLI(c.name, (c.numThreads == 1) ? "(ms, 1 thread)" : "(ms, all threads)", build, trace);
+    }
+
+    PRINT_HEADER("200k tris, memory");
+    PRINT_TEXT("", "tree B/tri", "total B/tri");
+
+    for (const NativeTriTree::Layout layout : {NativeTriTree::BIH, NativeTriTree::BVH4, NativeTriTree::BVH8, NativeTriTree::COMPRESSED_BVH8}) {
+        const NativeTriTree::Stats stats = makeTree(layout, triArray, vertexArray)->stats(4);
+        const char* name[] = {"BIH", "BVH4", "BVH8", "Compressed BVH8"};
+        PRINT_TEXT(name[layout], format("%.1f", stats.treeBytesPerTri).c_str(), format("%.1f", stats.bytesPerTri).c_str());
+    }
+
+    PRINT_HEADER("200k tris, 200k rays");
+    PRINT_TEXT("", "BVH8", "compressed");
+    {
+        const shared_ptr<NativeTriTree> bvh8       = makeTree(NativeTriTree::BVH8, triArray, vertexArray);
+        const shared_ptr<NativeTriTree> compressed = makeTree(NativeTriTree::COMPRESSED_BVH8, triArray, vertexArray);
+        TriTree::Hit hit;
+
+        Stopwatch stopwatch;
+        stopwatch.tick();
+        for (const PrecomputedRay& ray : prays) {
+            bvh8->intersectRay(ray, hit);
+        }
+        stopwatch.tock();
+        const chrono::nanoseconds wide = stopwatch.elapsedDuration();
+
+        stopwatch.tick();
+        for (const PrecomputedRay& ray : prays) {
+            compressed->intersectRay(ray, hit);
+        }
+        stopwatch.tock();
+        PRINT_MILLI("trace", "(ms)", wide, stopwatch.elapsedDuration());
+    }
+
+    PRINT_HEADER("200k tris, BVH8");
+    PRINT_TEXT("", "build", "load");
+    {
+        const shared_ptr<NativeTriTree> tree = makeTree(NativeTriTree::BVH8, triArray, vertexArray);
+        const String& filename = FileSystem::tempFilename();
+        tree->save(filename);
+
+        Stopwatch stopwatch;
+        stopwatch.tick();
+        tree->rebuild();
+        stopwatch.tock();
+        const chrono::nanoseconds build = stopwatch.elapsedDuration();
+
+        stopwatch.tick();
+        tree->load(filename);
+        stopwatch.tock();
+        PRINT_MILLI("", "(ms)", build, stopwatch.elapsedDuration());
+        FileSystem::removeFile(filename);
+    }
+
+    Array<Ray> primary;
+    makeCoherentRays(512, 384, primary);
+
+    PRINT_HEADER("200k tris, 512x384 primary rays");
+    PRINT_TEXT("", "rays", "packets");
+
+    for (const NativeTriTree::Layout layout : {NativeTriTree::BVH4, NativeTriTree::BVH8}) {
+        const shared_ptr<NativeTriTree> tree = makeTree(layout, triArray, vertexArray);
+        Array<TriTree::Hit> results;
+
+        Stopwatch stopwatch;
+        stopwatch.tick();
+        tree->intersectRays(primary, results);
+        stopwatch.tock();
+        const chrono::nanoseconds scalar = stopwatch.elapsedDuration();
+
+        stopwatch.tick();
+        tree->intersectRays(primary, results, TriTree::COHERENT_RAY_HINT);
+        stopwatch.tock();
+        const chrono::nanoseconds packet = stopwatch.elapsedDuration();
+
+        PRINT_MILLI((layout == NativeTriTree::BVH4) ? "BVH4" : "BVH8", "(ms)", scalar, packet);
+    }
+
+    PRINT_HEADER("200k tris, 200k incoherent rays");
+    PRINT_TEXT("", "unsorted", "sorted");
+
+    for (const NativeTriTree::Layout layout : {NativeTriTree::BIH, NativeTriTree::BVH4, NativeTriTree::BVH8}) {
+        const shared_ptr<NativeTriTree> tree = makeTree(layout, triArray, vertexArray);
+        Array<TriTree::Hit> results;
+        results.resize(rays.size());
+
+        Stopwatch stopwatch;
+        stopwatch.tick();
+        runConcurrently(0, rays.size(), [&](int r) { tree->intersectRay(rays[r], results[r]); });
+        stopwatch.tock();
+        const chrono::nanoseconds unsorted = stopwatch.elapsedDuration();
+
+        stopwatch.tick();
+        tree->intersectRays(rays, results);
+        stopwatch.tock();
+        const chrono::nanoseconds sorted = stopwatch.elapsedDuration();
+
+        PRINT_MILLI((layout == NativeTriTree::BIH) ? "BIH" : (layout == NativeTriTree::BVH4) ? "BVH4" : "BVH8", "(ms)", unsorted, sorted);
+    }
+
+    Array<AABox> boxArray;
+    Random rnd(1357, false);
+    for (int q = 0; q < 10000; ++q) {
+        const Point3 c(rnd.uniform(-1, 1), rnd.uniform(-1, 1), rnd.uniform(-1, 1));
+        boxArray.append(AABox(c - Vector3::one() * 0.05f, c + Vector3::one() * 0.05f));
+    }
+
+    PRINT_HEADER("200k tris, 10k box queries");
+    PRINT_TEXT("", "single", "batched");
+
+    for (const NativeTriTree::Layout layout : {NativeTriTree::BIH, NativeTriTree::BVH4, NativeTriTree::BVH8}) {
+        const shared_ptr<NativeTriTree> tree = makeTree(layout, triArray, vertexArray);
+
+        Stopwatch stopwatch;
+        stopwatch.tick();
+        Array<Tri> single;
+        for (const AABox& box : boxArray) {
+            tree->intersectBox(box, single);
+        }
+        stopwatch.tock();
+        const chrono::nanoseconds sequential = stopwatch.elapsedDuration();
+
+        TriTree::OverlapBuffer results;
+        stopwatch.tick();
+        tree->intersectBoxes(boxArray, results);
+        stopwatch.tock();
+        const chrono::nanoseconds batched = stopwatch.elapsedDuration();
+
+        PRINT_MILLI((layout == NativeTriTree::BIH) ? "BIH" : (layout == NativeTriTree::BVH4) ? "BVH4" : "BVH8", "(ms)", sequential, batched);
+    }
+}
@@ -0,0 +1,185 @@
+/**
+  \file test/tParseOBJ.cpp
+
+  G3D Innovation Engine http://casual-effects.com/g3d
+  Copyright 2000-2019, Morgan McGuire
+  All rights reserved
+  Available under the BSD License
+*/
+#include "G3D/G3D.h"
+#include "testassert.h"
+#include "printhelpers.h"
+
+/** Generates an OBJ file with \a numVertices of each attribute, faces that
+    use both absolute and relative indices, several groups and materials,
+    comments, and a mixture of line endings */
+static String makeOBJ(int numVertices, const String& mtlFilename) {
+    Random rnd(1234, false);
+    String s;
+    s += "# Generated by tParseOBJ\n";
+    if (! mtlFilename.empty()) {
+        s += "mtllib " + mtlFilename + "\n";
+    }
+
+    const char* group[]    = {"floor", "walls", "ceiling"};
+    const char* material[] = {"red", "green"};
+    const int   BATCH      = 64;
+    int numWritten = 0;
+    for (int b = 0; numWritten < numVertices; ++b) {
+        const char* newline = (b % 7 == 3) ? "\r\n" : "\n";
+        for (int i = 0; i < BATCH; ++i) {
+            s += format("v %f %f %f%s", rnd.uniform(-100, 100), rnd.uniform(-100, 100), rnd.uniform(-1e-3f, 1e-3f), newline);
+            s += format("vt %.7f %.3f%s", rnd.uniform(), rnd.uniform(), newline);
+            s += format("  vn %g %g %g%s", rnd.uniform(-1, 1), rnd.uniform(-1, 1), rnd.uniform(-1, 1), newline);
+        }
+        numWritten += BATCH;
+
+        if (b % 5 == 0) {
+            s += format("g %s\n", group[(b / 5) % 3]);
+        }
+        if (b % 3 == 0) {
+            s += format("usemtl %s\n", material[(b / 3) % 2]);
+        }
+        s += "\n# faces\n";
+
+        for (int i = 0; i < BATCH - 3; ++i) {
+            if (i % 2 == 0) {
+                // Absolute, 1-based
+                const int v = numWritten - BATCH + i + 1;
+                s += format("f %d/%d/%d %d/%d/%d %d/%d/%d%s", v, v, v, v + 1, v + 1, v + 1, v + 2, v + 2, v + 2, newline);
+            } else {
+                // Relative to the end of the arrays, possibly reaching into an earlier chunk
+                const int r = -(BATCH - i) - 40 * (b % 2);
+                s += format("f %d//%d %d//%d %d//%d %d//%d%s", r, r, r + 1, r + 1, r + 2, r + 2, r + 3, r + 3, newline);
+            }
+        }
+    }
+
+    return s;
+}
+
+
+static void testParsersAgree(const ParseOBJ& a, const ParseOBJ& b) {
+    testAssert(a.vertexArray.size() == b.vertexArray.size());
+    testAssert(a.texCoord0Array.size() == b.texCoord0Array.size());
+    testAssert(a.normalArray.size() == b.normalArray.size());
+    testAssert(memcmp(a.vertexArray.getCArray(), b.vertexArray.getCArray(), sizeof(Point3) * a.vertexArray.size()) == 0);
+    testAssert(memcmp(a.texCoord0Array.getCArray(), b.texCoord0Array.getCArray(), sizeof(Point2) * a.texCoord0Array.size()) == 0);
+    testAssert(memcmp(a.normalArray.getCArray(), b.normalArray.getCArray(), sizeof(Vector3) * a.normalArray.size()) == 0);
+    testAssert(a.mtlArray.size() == b.mtlArray.size());
+
+    testAssert(a.groupTable.size() == b.groupTable.size());
+    for (const ParseOBJ::GroupTable::Entry& groupEntry : a.groupTable) {
+        const shared_ptr<ParseOBJ::Group>& groupA = groupEntry.value;
+        const shared_ptr<ParseOBJ::Group>& groupB = b.groupTable[groupEntry.key];
+        testAssert(groupA->meshTable.size() == groupB->meshTable.size());
+
+        // The parsers have different material objects, so match meshes by material name
+        for (const ParseOBJ::MeshTable::Entry& meshEntryA : groupA->meshTable) {
+            const shared_ptr<ParseOBJ::Mesh>& meshA = meshEntryA.value;
+            shared_ptr<ParseOBJ::Mesh> meshB;
+            for (const ParseOBJ::MeshTable::Entry& meshEntryB : groupB->meshTable) {
+                if (meshEntryB.key->name == meshEntryA.key->name) {
+                    meshB = meshEntryB.value;
+                }
+            }
+            testAssert(notNull(meshB));
+            testAssert(meshA->faceArray.size() == meshB->faceArray.size());
+
+            for (int f = 0; f < meshA->faceArray.size(); ++f) {
+                const ParseOBJ::Face& faceA = meshA->faceArray[f];
+                const ParseOBJ::Face& faceB = meshB->faceArray[f];
+                testAssert(faceA.size() == faceB.size());
+                for (int i = 0; i < faceA.size(); ++i) {
+                    testAssert(faceA[i].vertex == faceB[i].vertex);
+                    testAssert(faceA[i].texCoord == faceB[i].texCoord);
+                    testAssert(faceA[i].normal == faceB[i].normal);
+                }
+            }
+        }
+    }
+}
+
+
+static void testNumbers() {
+    // Lengths on both sides of the eight-character fast path
+    const String& text =
+        "v 1 -2 +3\n"
+        "v 12345678 123456789 0.1234567890123\n"
+        "v -0.5 7.25e2 1.5E-3\n"
+        "v 0.00000001 99999999.5 3.14159265\n";
+
+    ParseOBJ parser;
+    parser.parse(text.c_str(), text.size(), "", ParseOBJ::Options());
+    testAssert(parser.vertexArray.size() == 4);
+
+    const Point3 expected[] = {
+        Point3(1, -2, 3),
+        Point3(12345678, 123456789, 0.1234567f),
+        Point3(-0.5f, 725.0f, 1.5e-3f),
+        Point3(0.0f, 99999999.5f, 3.1415926f)};
+
+    for (int v = 0; v < 4; ++v) {
+        for (int a = 0; a < 3; ++a) {
+            testAssert(fuzzyEq(parser.vertexArray[v][a] / max(1.0f, abs(expected[v][a])), expected[v][a] / max(1.0f, abs(expected[v][a]))));
+        }
+    }
+}
+
+
+static void testParallel() {
+    const String& mtlFilename = FileSystem::tempFilename();
+    {
+        TextOutput mtl(mtlFilename);
+        mtl.printf("newmtl red\nKd 1 0 0\n\nnewmtl green\nKd 0 1 0\n");
+        mtl.commit();
+    }
+
+    // Large enough to be split into several chunks
+    const String& text = makeOBJ(60000, FilePath::baseExt(mtlFilename));
+    testAssert(text.size() > 4 * 1024 * 1024);
+
+    ParseOBJ::Options options;
+    options.parallel = false;
+    ParseOBJ serial;
+    serial.parse(text.c_str(), text.size(), FilePath::parent(mtlFilename), options);
+    testAssert(serial.vertexArray.size() > 60000);
+    testAssert(serial.groupTable.size() == 3);
+
+    options.parallel = true;
+    ParseOBJ parallel;
+    parallel.parse(text.c_str(), text.size(), FilePath::parent(mtlFilename), options);
+    testParsersAgree(serial, parallel);
+
+    FileSystem::removeFile(mtlFilename);
+}
+
+
+void testParseOBJ() {
+    printf("ParseOBJ ");
+    testNumbers();
+    testParallel();
+    printf("passed\n");
+}
+
+
+void perfParseOBJ() {
+    PRINT_SECTION("ParseOBJ", "Time to parse a generated OBJ file from memory");
+
+    const String& text = makeOBJ(300000, "");
+    PRINT_HEADER(format("%d MB", int(text.size() / (1024 * 1024))).c_str());
+    PRINT_TEXT("", "parse");
+
+    for (const bool parallel : {false, true}) {
+        ParseOBJ::Options options;
+        options.parallel = parallel;
+        ParseOBJ parser;
+
+        Stopwatch stopwatch;
+        stopwatch.tick();
+        parser.parse(text.c_str(), text.size(), "", options);
+        stopwatch.tock();
+
+        PRINT_MILLI(parallel ? "parallel" : "single thread", "(ms)", stopwatch.elapsedDuration());
+    }
+}
@@ -0,0 +1,102 @@
+/**
+  \file test/tPathTracer.cpp
+
+  G3D Innovation Engine http://casual-effects.com/g3d
+  Copyright 2000-2019, Morgan McGuire
+  All rights reserved
+  Available under the BSD License
+*/
+#include "G3D/G3D.h"
+#include "testassert.h"
+
+/** Rays toward the three textured quads of transparency/texturedQuads.obj, some of which miss */
+static void makeRays(Array<Ray>& rays) {
+    Random rnd(1234, false);
+    for (int i = 0; i < 500; ++i) {
+        const Point3 origin(rnd.uniform(-1.0f, 6.0f), rnd.uniform(-0.5f, 1.5f), 3.0f);
+        const Vector3 direction = (Vector3(rnd.uniform(-0.2f, 0.2f), rnd.uniform(-0.2f, 0.2f), -1.0f)).direction();
+        rays.append(Ray::fromOriginAndDirection(origin, direction));
+    }
+}
+
+
+/** The HitBuffer overload and SurfelPool on a tree that does not implement the HitBuffer
+    overload itself must agree with the Array<Hit> overload and per-hit sampling */
+static void testSurfelPool(const shared_ptr<TriTree>& tree, const Array<Ray>& rays) {
+    Array<TriTree::Hit> expected;
+    tree->intersectRays(rays, expected);
+
+    TriTree::HitBuffer hits;
+    TriTree::SurfelPool pool;
+    Array<const Surfel*> surfel;
+    tree->intersectRays(rays, hits);
+    tree->sample(hits, pool, surfel);
+    testAssert((hits.size() == rays.size()) && (surfel.size() == rays.size()));
+
+    int numHits = 0;
+    for (int r = 0; r < rays.size(); ++r) {
+        const TriTree::Hit& hit = hits[r];
+        testAssert(hit.triIndex == expected[r].triIndex);
+        testAssert((hit.distance == expected[r].distance) && (hit.u == expected[r].u) && (hit.v == expected[r].v));
+        testAssert(isNull(surfel[r]) == (hit.triIndex == TriTree::Hit::NONE));
+        if (notNull(surfel[r])) {
+            ++numHits;
+            shared_ptr<Surfel> s;
+            tree->sample(expected[r], s);
+            testAssert((s->position - surfel[r]->position).length() < 1e-4f);
+            testAssert(s->shadingNormal == surfel[r]->shadingNormal);
+        }
+    }
+    testAssert((numHits > 0) && (numHits < rays.size()));
+
+    // The pool's Surfels are reused for the same batch
+    const Array<const Surfel*> previous(surfel);
+    tree->sample(hits, pool, surfel);
+    for (int r = 0; r < rays.size(); ++r) {
+        testAssert(surfel[r] == previous[r]);
+    }
+}
+
+
+void testPathTracer() {
+    printf("PathTracer ");
+
+    const shared_ptr<Scene>& scene = Scene::create(nullptr);
+    ArticulatedModel::Specification specification;
+    specification.filename = "transparency/texturedQuads.obj";
+    scene->insert(VisibleEntity::create("quads", scene.get(), ArticulatedModel::create(specification)));
+
+    // InstancedTriTree relies on the TriTreeBase implementation of the HitBuffer overload
+    const shared_ptr<PathTracer>& native    = PathTracer::create(NativeTriTree::create());
+    const shared_ptr<PathTracer>& instanced = PathTracer::create(InstancedTriTree::create([] { return NativeTriTree::create(); }));
+    native->setScene(scene);
+    instanced->setScene(scene);
+
+    // Only primary rays, so that the result is deterministic
+    PathTracer::Options options;
+    options.maxScatteringEvents = 1;
+    options.raysPerPixel        = 1;
+
+    Array<Ray> rays;
+    makeRays(rays);
+
+    Array<Radiance3> radiance[2];
+    Array<float>     distance[2];
+    const shared_ptr<PathTracer> pathTracer[2] = {native, instanced};
+    for (int p = 0; p < 2; ++p) {
+        Array<Ray> rayBuffer(rays);
+        radiance[p].resize(rays.size());
+        distance[p].resize(rays.size());
+        pathTracer[p]->traceBuffer(rayBuffer, radiance[p].getCArray(), options, true, nullptr, distance[p].getCArray());
+    }
+
+    for (int r = 0; r < rays.size(); ++r) {
+        testAssert(isFinite(distance[0][r]) == isFinite(distance[1][r]));
+        testAssert(! isFinite(distance[0][r]) || fuzzyEq(distance[0][r], distance[1][r]));
+        testAssert((radiance[0][r] - radiance[1][r]).length() < 1e-3f);
+    }
+
+    testSurfelPool(instanced->triTree(), rays);
+
+    printf("passed\n");
+}
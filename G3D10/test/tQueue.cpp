@@ -14,6 +14,8 @@ using G3D::uint8;
 using G3D::uint32;
 using G3D::uint64;
 #include <deque>
+#include <mutex>
+#include <thread>
 
 class BigE {
 public:
@@ -46,6 +48,7 @@ public:
     }
 };
 
+static void perfThreadsafeQueue();
 
 void perfQueue() {
     PRINT_SECTION("Performance: Queue", "");
@@ -241,6 +244,234 @@ void perfQueue() {
     PRINT_MICRO("std::deque<int>", "(us/iteration)", stdStreamSmall / iterations);
     PRINT_MICRO("G3D::Queue<BigE>", "(us/iteration)", g3dStreamLarge / iterations);
     PRINT_MICRO("std::deque<BigE>", "(us/iteration)", stdStreamLarge / iterations);
+
+    perfThreadsafeQueue();
+}
+
+
+/** Producers push increasing values so that consumers can detect reordering and loss */
+template<class Q>
+static chrono::nanoseconds streamConcurrently(Q& q, int numProducers, int numConsumers, int numPerProducer, bool checkOrder) {
+    std::atomic<int>  numConsumed(0);
+    std::atomic<bool> ok(true);
+    Array<int>        sum;
+    sum.resize(numConsumers);
+    sum.setAll(0);
+    const int total = numProducers * numPerProducer;
+
+    Stopwatch stopwatch;
+    stopwatch.tick();
+    Array<std::thread*> thread;
+    for (int p = 0; p < numProducers; ++p) {
+        thread.append(new std::thread([&q, p, numPerProducer]() {
+            for (int i = 0; i < numPerProducer; ++i) {
+                q.pushBack(p * numPerProducer + i);
+            }
+        }));
+    }
+    for (int c = 0; c < numConsumers; ++c) {
+        thread.append(new std::thread([&, c]() {
+            Array<int> last;
+            last.resize(numProducers);
+            last.setAll(-1);
+            int v = 0;
+            while (numConsumed.load() < total) {
+                if (q.waitPopFront(v, 0.01)) {
+                    ++numConsumed;
+                    sum[c] += 1;
+                    const int p = v / numPerProducer;
+                    if (checkOrder && (v <= last[p])) {
+                        ok = false;
+                    }
+                    last[p] = v;
+                }
+            }
+        }));
+    }
+    for (std::thread* t : thread) {
+        t->join();
+        delete t;
+    }
+    stopwatch.tock();
+
+    int n = 0;
+    for (int c = 0; c < numConsumers; ++c) {
+        n += sum[c];
+    }
+    testAssertM(ok, "Values from one producer were reordered");
+    testAssertM(n == total, format("Consumed %d of %d values", n, total));
+    testAssert(q.empty());
+    return stopwatch.elapsedDuration();
+}
+
+
+/** The locking queue that ThreadsafeQueue replaced, for comparison */
+class MutexDequeQueue {
+    std::mutex      m_mutex;
+    std::deque<int> m_data;
+public:
+    void pushBack(int v) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_data.push_back(v);
+    }
+
+    bool waitPopFront(int& v, RealTime) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_data.empty()) { return false; }
+        v = m_data.front();
+        m_data.pop_front();
+        return true;
+    }
+
+    bool empty() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_data.empty();
+    }
+};
+
+
+/** Adapts a ThreadsafeQueue so that streamConcurrently() exercises pushBackBlocking() */
+template<class Q>
+class BlockingPush {
+public:
+    Q queue;
+
+    explicit BlockingPush(int capacity) : queue(capacity) {}
+
+    void pushBack(int v) {
+        queue.pushBackBlocking(v);
+    }
+
+    bool waitPopFront(int& v, RealTime timeout) {
+        return queue.waitPopFront(v, timeout);
+    }
+
+    bool empty() const {
+        return queue.empty();
+    }
+};
+
+
+static void perfThreadsafeQueue() {
+    const int n = 200000;
+    PRINT_HEADER("Concurrent streaming (4 producers, 4 consumers)");
+    {
+        MutexDequeQueue q;
+        PRINT_MICRO("std::mutex + std::deque<int>", "(us/elt)", streamConcurrently(q, 4, 4, n / 4, true) / n);
+    }
+    {
+        ThreadsafeQueue<int> q(256);
+        PRINT_MICRO("G3D::ThreadsafeQueue<int>", "(us/elt)", streamConcurrently(q, 4, 4, n / 4, true) / n);
+    }
+    {
+        BlockingPush<ThreadsafeQueue<int>> q(256);
+        PRINT_MICRO("G3D::ThreadsafeQueue<int>::pushBackBlocking", "(us/elt)", streamConcurrently(q, 4, 4, n / 4, true) / n);
+    }
+    PRINT_HEADER("Concurrent streaming (1 producer, 1 consumer)");
+    {
+        MutexDequeQueue q;
+        PRINT_MICRO("std::mutex + std::deque<int>", "(us/elt)", streamConcurrently(q, 1, 1, n, true) / n);
+    }
+    {
+        ThreadsafeQueue<int, SPSCQueue<int>> q(256);
+        PRINT_MICRO("G3D::ThreadsafeQueue<int, SPSCQueue>", "(us/elt)", streamConcurrently(q, 1, 1, n, true) / n);
+    }
+    {
+        BlockingPush<ThreadsafeQueue<int, SPSCQueue<int>>> q(256);
+        PRINT_MICRO("G3D::ThreadsafeQueue<int, SPSCQueue>::pushBackBlocking", "(us/elt)", streamConcurrently(q, 1, 1, n, true) / n);
+    }
+}
+
+
+static void testThreadsafeQueue() {
+    {
+        MPMCQueue<int> q(5);
+        testAssert(q.capacity() == 8);
+        testAssert(q.empty());
+        for (int i = 0; i < 8; ++i) {
+            testAssert(q.tryPushBack(i));
+        }
+        testAssert(q.full());
+        testAssert(! q.tryPushBack(8));
+
+        // Wrap around several times
+        int v = -1;
+        for (int i = 8; i < 100; ++i) {
+            testAssert(q.popFront(v));
+            testAssert(v == i - 8);
+            testAssert(q.tryPushBack(i));
+        }
+        testAssert(q.size() == 8);
+        q.clear();
+        testAssert(q.empty());
+        testAssert(! q.popFront(v));
+    }
+
+    {
+        SPSCQueue<shared_ptr<int>> q(4);
+        shared_ptr<int> p = std::make_shared<int>(3);
+        for (int i = 0; i < 4; ++i) {
+            testAssert(q.tryPushBack(p));
+        }
+        testAssert(! q.tryPushBack(p));
+        testAssert(p.use_count() == 5);
+        shared_ptr<int> out;
+        while (q.popFront(out)) {}
+        out.reset();
+        // Popped slots must not keep the value alive
+        testAssert(p.use_count() == 1);
+    }
+
+    {
+        ThreadsafeQueue<int> q(4);
+        int v = 0;
+        testAssert(! q.waitPopFront(v, 0.001));
+        testAssert(q.tryPushBack(1));
+        testAssert(q.waitPopFront(v, 0.001) && (v == 1));
+    }
+
+    // pushBack past capacity spills without blocking and preserves order
+    {
+        ThreadsafeQueue<int> q(4);
+        for (int i = 0; i < 100; ++i) {
+            q.pushBack(i);
+        }
+        testAssert(q.size() == 100);
+        testAssert(! q.tryPushBack(100));
+        int v = -1;
+        for (int i = 0; i < 50; ++i) {
+            testAssert(q.popFront(v) && (v == i));
+        }
+        q.pushBack(100);
+        for (int i = 50; i <= 100; ++i) {
+            testAssert(q.waitPopFront(v, 0.001) && (v == i));
+        }
+        testAssert(q.empty());
+        testAssert(q.tryPushBack(101));
+        q.pushBack(102);
+        q.clear();
+        testAssert(q.empty() && ! q.popFront(v));
+    }
+
+    // Small capacity forces producers to spill
+    {
+        ThreadsafeQueue<int> q(16);
+        streamConcurrently(q, 4, 3, 20000, true);
+    }
+    {
+        ThreadsafeQueue<int, SPSCQueue<int>> q(16);
+        streamConcurrently(q, 1, 1, 50000, true);
+    }
+
+    // ...or to block
+    {
+        BlockingPush<ThreadsafeQueue<int>> q(16);
+        streamConcurrently(q, 4, 3, 20000, true);
+    }
+    {
+        BlockingPush<ThreadsafeQueue<int, SPSCQueue<int>>> q(16);
+        streamConcurrently(q, 1, 1, 50000, true);
+    }
 }
 
 
@@ -373,6 +604,8 @@ void testQueue() {
         Queue<int> r(q);
         _check(r);
     }
+
+    testThreadsafeQueue();
     
     printf("succeeded\n");
 }
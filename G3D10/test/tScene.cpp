@@ -0,0 +1,95 @@
+/**
+  \file test/tScene.cpp
+
+  G3D Innovation Engine http://casual-effects.com/g3d
+  Copyright 2000-2019, Morgan McGuire
+  All rights reserved
+  Available under the BSD License
+*/
+#include "G3D/G3D.h"
+#include "testassert.h"
+
+/** Removes itself, and optionally inserts a replacement, on its second simulation step,
+    as SoundEntity does when its sound finishes */
+class SelfRemovingEntity : public MarkerEntity {
+protected:
+
+    int                         m_numSimulations = 0;
+
+    bool                        m_insertReplacement = false;
+
+public:
+
+    static shared_ptr<SelfRemovingEntity> create(const String& name, Scene* scene, bool insertReplacement) {
+        const shared_ptr<SelfRemovingEntity>& e = createShared<SelfRemovingEntity>();
+        e->m_name              = name;
+        e->m_scene             = scene;
+        e->m_insertReplacement = insertReplacement;
+        return e;
+    }
+
+    virtual void onSimulation(SimTime absoluteTime, SimTime deltaTime) override {
+        MarkerEntity::onSimulation(absoluteTime, deltaTime);
+
+        // The first call is from Scene::insert
+        if (++m_numSimulations == 2) {
+            m_scene->remove(dynamic_pointer_cast<Entity>(shared_from_this()));
+            if (m_insertReplacement) {
+                m_scene->insert(MarkerEntity::create(m_name + "Replacement"));
+            }
+        }
+    }
+};
+
+
+static int numEntities(const shared_ptr<Scene>& scene) {
+    Array<shared_ptr<Entity>> entityArray;
+    scene->getEntityArray(entityArray);
+    return entityArray.size();
+}
+
+
+static void testSelfRemoval(bool concurrent) {
+    const shared_ptr<Scene>& scene = Scene::create(nullptr);
+    scene->setSimulateEntitiesConcurrently(concurrent);
+
+    // Enough entities that a level is simulated concurrently, interleaved with ones that remove themselves
+    const int N = 300;
+    int numRemoving = 0;
+    int numReplacements = 0;
+    for (int i = 0; i < N; ++i) {
+        if (i % 3 == 0) {
+            scene->insert(SelfRemovingEntity::create(format("remover%d", i), scene.get(), i % 2 == 0));
+            ++numRemoving;
+            numReplacements += (i % 2 == 0) ? 1 : 0;
+        } else {
+            scene->insert(MarkerEntity::create(format("marker%d", i)));
+        }
+    }
+
+    // Dependencies keep one remover in a later level than its parent
+    scene->setOrder("marker1", "remover3");
+
+    scene->onSimulation(1.0 / 60.0);
+
+    testAssert(numEntities(scene) == N - numRemoving + numReplacements);
+    for (int i = 0; i < N; i += 3) {
+        testAssert(isNull(scene->entity(format("remover%d", i))));
+        testAssert(notNull(scene->entity(format("remover%dReplacement", i))) == (i % 2 == 0));
+    }
+
+    // The rebuilt levels and type tags must be consistent with the new entity array
+    for (int step = 0; step < 3; ++step) {
+        scene->onSimulation(1.0 / 60.0);
+    }
+    testAssert(numEntities(scene) == N - numRemoving + numReplacements);
+    testAssert(notNull(scene->entity("marker1")));
+}
+
+
+void testScene() {
+    printf("Scene ");
+    testSelfRemoval(false);
+    testSelfRemoval(true);
+    printf("passed\n");
+}
@@ -56,6 +56,132 @@ bool operator==(const TableKeyWithCustomHashStruct& lhs, const TableKeyWithCusto
 }
 
 
+static void testFlatTable() {
+    printf("G3D::FlatTable  ");
+
+    // Basic get/set/remove
+    {
+        FlatTable<int, int> table;
+
+        table.set(10, 20);
+        table.set(3, 1);
+        table.set(1, 4);
+
+        testAssert(table.size() == 3);
+        testAssert(table[10] == 20);
+        testAssert(table[3] == 1);
+        testAssert(table[1] == 4);
+        testAssert(table.containsKey(10));
+        testAssert(! table.containsKey(0));
+        testAssert(table.containsValue(4));
+
+        table.set(3, 7);
+        testAssert(table.size() == 3);
+        testAssert(table[3] == 7);
+
+        int k = 0, v = 0;
+        testAssert(table.getRemove(10, k, v) && (k == 10) && (v == 20));
+        testAssert(! table.remove(10));
+        testAssert(table.size() == 2);
+        testAssert(table.get(1, v) && (v == 4));
+        testAssert(! table.get(10, v));
+    }
+
+    // Many inserts and removes, checked against Table. Forces growth
+    // and the reuse of DELETED slots.
+    {
+        FlatTable<int, int> flat;
+        Table<int, int>     reference;
+        for (int i = 0; i < 5000; ++i) {
+            const int key = (i * 7919) % 3001;
+            if ((i % 3) == 2) {
+                testAssert(flat.remove(key) == reference.remove(key));
+            } else {
+                flat.set(key, i);
+                reference.set(key, i);
+            }
+            testAssert(flat.size() == reference.size());
+        }
+        for (Table<int, int>::Iterator it = reference.begin(); it.isValid(); ++it) {
+            const int* v = flat.getPointer(it.key());
+            testAssert(notNull(v) && (*v == it.value()));
+        }
+
+        int count = 0;
+        for (FlatTable<int, int>::Iterator it = flat.begin(); it != flat.end(); ++it) {
+            testAssert(reference[it->key] == it->value);
+            ++count;
+        }
+        testAssert(count == int(reference.size()));
+        testAssert(flat.debugGetLoad() <= 7.0 / 8.0);
+    }
+
+    // Every key collides
+    {
+        TableKey                x[40];
+        FlatTable<TableKey*, int> table;
+        for (int i = 0; i < 40; ++i) {
+            x[i].value = i;
+            table.set(x + i, i);
+        }
+        testAssert(table.size() == 40);
+        for (int i = 0; i < 40; i += 2) {
+            testAssert(table.remove(x + i));
+        }
+        for (int i = 0; i < 40; ++i) {
+            testAssert(table.containsKey(x + i) == (i % 2 == 1));
+        }
+        testAssert(table.debugGetDeepestBucketSize() > 1);
+    }
+
+    // Non-POD keys and values, iteration order, and copying
+    {
+        FlatTable<String, String> table;
+        for (int i = 0; i < 100; ++i) {
+            table.set(format("key%d", i), format("value%d", i));
+        }
+
+        // Iteration follows insertion order until something is removed
+        int i = 0;
+        for (const FlatTable<String, String>::Entry& e : table) {
+            testAssert(e.key == format("key%d", i));
+            ++i;
+        }
+
+        table.remove("key0");
+        testAssert(table.begin().key() == "key99");
+
+        FlatTable<String, String> copy(table);
+        testAssert(copy == table);
+        copy.set("key1", "changed");
+        testAssert(copy != table);
+        testAssert(table["key1"] == "value1");
+
+        Array<String> keys;
+        table.getKeys(keys);
+        testAssert(keys.size() == 99);
+
+        table.clear();
+        testAssert(table.size() == 0);
+        testAssert(! table.containsKey("key5"));
+        table.set("key5", "x");
+        testAssert(table["key5"] == "x");
+    }
+
+    // getCreate
+    {
+        FlatTable<String, int> table;
+        bool created = false;
+        table.getCreate("a", created) = 3;
+        testAssert(created);
+        table.getCreate("a", created) += 1;
+        testAssert(! created && (table["a"] == 4));
+    }
+
+    printf("passed\n");
+}
+
+
 void testTable() {
 
     printf("G3D::Table  ");
@@ -191,6 +317,8 @@ void testTable() {
     }
 
     printf("passed\n");
+
+    testFlatTable();
 }
 
 
@@ -198,6 +326,7 @@ template<class K, class V>
 void perfTest(const char* description, const K* keys, const V* vals, int M) {
     Stopwatch stopwatch;
     chrono::nanoseconds tableSet, tableGet, tableRemove;
+    chrono::nanoseconds flatSet, flatGet, flatRemove;
     chrono::nanoseconds mapSet, mapGet, mapRemove;
 
     chrono::nanoseconds overhead;
@@ -242,6 +371,31 @@ void perfTest(const char* description, const K* keys, const V* vals, int M) {
 
         /////////////////////////////////
 
+        {FlatTable<K, V> t;
+        stopwatch.tick();
+        for (int i = 0; i < M; ++i) {
+            t.set(keys[i], vals[i]);
+        }
+        stopwatch.tock();
+        flatSet = stopwatch.elapsedDuration();
+
+        stopwatch.tick();
+        for (int i = 0; i < M; ++i) {
+            v=t[keys[i]];
+        }
+        stopwatch.tock();
+        flatGet = stopwatch.elapsedDuration();
+
+        stopwatch.tick();
+        for (int i = 0; i < M; ++i) {
+            t.remove(keys[i]);
+        }
+        stopwatch.tock();
+        flatRemove = stopwatch.elapsedDuration();
+        }
+
+        /////////////////////////////////
+
         {std::map<K, V> t;
         stopwatch.tick();
         for (int i = 0; i < M; ++i) {
@@ -274,6 +428,14 @@ void perfTest(const char* description, const K* keys, const V* vals, int M) {
     }
     tableRemove -= overhead;
 
+    flatSet -= overhead;
+    if (flatGet < overhead) {
+        flatGet = flatGet.zero();
+    } else {
+        flatGet -= overhead;
+    }
+    flatRemove -= overhead;
+
     mapSet -= overhead;
     mapGet -= overhead;
     mapRemove -= overhead;
@@ -281,13 +443,15 @@ void perfTest(const char* description, const K* keys, const V* vals, int M) {
     PRINT_HEADER(description);
     PRINT_TEXT("", "insert", "fetch", "remove");
     PRINT_MICRO("Table", "(us)", tableSet / M, tableGet / M, tableRemove / M);
+    PRINT_MICRO("FlatTable", "(us)", flatSet / M, flatGet / M, flatRemove / M);
     PRINT_MICRO("std::map", "(us)", mapSet / M, mapGet / M, mapRemove / M);
     PRINT_TEXT("Outcome", tableSet <= mapSet ? "ok" : "FAIL", tableGet <= mapGet ? "ok" : "FAIL", tableRemove < mapRemove ? "ok" : "FAIL");
+    PRINT_TEXT("Flat vs. Table", flatSet <= tableSet ? "ok" : "FAIL", flatGet <= tableGet ? "ok" : "FAIL", flatRemove <= tableRemove ? "ok" : "FAIL");
 }
 
 
 void perfTable() {
-    PRINT_SECTION("Table", "Checks performance of Table against standard library");
+    PRINT_SECTION("Table", "Checks performance of Table and FlatTable against standard library");
 
     const int M = 300;
     {
@@ -8,11 +8,13 @@
 */
 #include "G3D/G3D.h"
 #include "testassert.h"
+#include "printhelpers.h"
 
 static void tfunc1();
 static void tfunc2();
 static void tCommentTokens();
 static void tNewlineTokens();
+static void tRunsAndNumbers();
 
 void testTextInput() {
     printf("TextInput\n");
@@ -329,6 +331,7 @@ void testTextInput() {
     
     tCommentTokens();
     tNewlineTokens();
+    tRunsAndNumbers();
 }
 
     // these defines are duplicated in tTextInput2.cpp
@@ -507,3 +510,82 @@ static void tNewlineTokens() {
         CHECK_END_TOKEN(ti,         6, 1);
     }
 }
+
+
+/** Tokens longer than the 16 characters that TextInput scans at once, at every alignment */
+static void tRunsAndNumbers() {
+    const String identifier(37, 'a');
+    const String digits = "1234567890123456789012345";
+    const String comment(50, 'c');
+    for (int pad = 0; pad < 40; ++pad) {
+        TextInput::Settings settings;
+        settings.generateCommentTokens = true;
+        const String& source = String(pad, ' ') + identifier + "_9 \t  " + digits + "." + digits + "e-5\n" +
+            "// " + comment + "\r\n/* " + comment + " **\n*/ \"" + comment + "\\\"x\r\ny\"";
+        TextInput ti(TextInput::FROM_STRING, source, settings);
+
+        CHECK_SYM_TOKEN(ti, identifier + "_9", 1, pad + 1);
+
+        Token t = ti.read();
+        testAssert(t.type() == Token::NUMBER && t.extendedType() == Token::FLOATING_POINT_TYPE);
+        testAssert(t.string() == digits + "." + digits + "e-5");
+        CHECK_TOKEN_POS(t, 1, pad + int(identifier.size()) + 7);
+        testAssert(t.number() == strtod(t.string().c_str(), nullptr));
+
+        CHECK_LINE_COMMENT_TOKEN(ti, " " + comment, 2, 1);
+        CHECK_BLOCK_COMMENT_TOKEN(ti, " " + comment + " **\n", 3, 1);
+
+        t = ti.read();
+        testAssert(t.type() == Token::STRING);
+        testAssert(t.string() == comment + "\"x\ny");
+        CHECK_TOKEN_POS(t, 4, 4);
+        CHECK_END_TOKEN(ti, 5, 3);
+    }
+
+    // Numbers within and beyond the exact fast path
+    const char* numbers[] = {"0", "-0", "0.1", "-1.5f", "1e22", "1e23", "4.35", "123.456e-7", "9007199254740992",
+        "9007199254740993", "0.30000000000000004", "1.7976931348623157e308", "4.9e-324", "1e-400", "00012.50"};
+    for (const char* s : numbers) {
+        const double expected = strtod(s, nullptr);
+        const double actual   = TextInput::parseNumber(s);
+        testAssert(memcmp(&expected, &actual, sizeof(double)) == 0);
+    }
+
+    Random rnd(10, false);
+    for (int i = 0; i < 2000; ++i) {
+        const double x = rnd.uniform(-1000.0f, 1000.0f) * pow(10.0, rnd.integer(-30, 30));
+        for (const String& s : {format("%.17g", x), format("%.6f", x), format("%.3e", x), format("%.9g", x)}) {
+            testAssert(TextInput::parseNumber(s) == strtod(s.c_str(), nullptr));
+        }
+    }
+}
+
+
+void perfTextInput() {
+    PRINT_SECTION("TextInput", "Time to tokenize a generated scene-like file");
+
+    String source;
+    for (int i = 0; i < 20000; ++i) {
+        source += format("    entity%d = VisibleEntity {\n        model = \"model%d\"; // The model\n"
+            "        frame = CFrame::fromXYZYPRDegrees(%g, %g, %g, %g, 0, 0);\n        castsShadows = %s;\n    };\n\n",
+            i, i % 50, i * 0.25, 1.5, -2.125, i * 0.1, (i % 2 == 0) ? "true" : "false");
+    }
+
+    PRINT_HEADER(format("%d kB", int(source.size() / 1024)).c_str());
+    PRINT_TEXT("", "time");
+
+    Stopwatch stopwatch;
+    stopwatch.tick();
+    TextInput ti(TextInput::FROM_STRING, source);
+    int numTokens = 0;
+    double sum = 0;
+    for (Token t = ti.read(); t.type() != Token::END; t = ti.read()) {
+        sum += t.number();
+        ++numTokens;
+    }
+    stopwatch.tock();
+    testAssert(sum != 0);
+
+    PRINT_MILLI("read + number", "(ms)", stopwatch.elapsedDuration());
+    PRINT_NANO("per token", "(ns)", stopwatch.elapsedDuration() / numTokens);
+}
@@ -51,6 +51,129 @@ void testSpinlock() {
     spinLock.unlock();
 }
 
+static void testTaskGraph(bool singleThread) {
+    TaskGraph graph;
+    const std::thread::id callingThread = std::this_thread::get_id();
+
+    // Each task records the step at which it ran
+    std::atomic<int> step(0);
+    int order[5];
+    bool ranOnCallingThread = false;
+
+    for (int frame = 0; frame < 3; ++frame) {
+        graph.clear();
+        step = 0;
+
+        const TaskGraph::TaskID a = graph.add("a", [&]() { order[0] = step++; });
+        const TaskGraph::TaskID b = graph.add("b", [&]() { order[1] = step++; }, TaskGraph::Affinity::ANY_THREAD, { a });
+        const TaskGraph::TaskID c = graph.add("c", [&]() { order[2] = step++; }, TaskGraph::Affinity::ANY_THREAD, { a });
+        const TaskGraph::TaskID d = graph.add("d", [&]() {
+            order[3] = step++;
+            ranOnCallingThread = (std::this_thread::get_id() == callingThread);
+        }, TaskGraph::Affinity::CALLING_THREAD, { b, c });
+
+        // Inserted between existing tasks after the fact
+        const TaskGraph::TaskID e = graph.add("e", [&]() { order[4] = step++; });
+        graph.addDependency(b, e);
+        graph.addDependency(e, d);
+
+        testAssert(graph.size() == 5);
+        testAssert(graph.find("c") == c);
+        testAssert(graph.find("missing") == -1);
+
+        graph.run(singleThread);
+
+        testAssert(step == 5);
+        testAssert(order[a] < order[b]);
+        testAssert(order[a] < order[c]);
+        testAssert(order[b] < order[e]);
+        testAssert(order[e] < order[d]);
+        testAssert(order[c] < order[d]);
+        testAssert(ranOnCallingThread);
+    }
+}
+
+
+/** Every element of a region must be visited exactly once regardless of how it is tiled */
+static void testRunConcurrently() {
+    for (int morton = 0; morton < 2; ++morton) {
+        for (const int tileSize : {0, 1, 5, 16}) {
+            RunConcurrentlyOptions options;
+            options.mortonOrder = (morton == 1);
+            options.tileSize = tileSize;
+            RunConcurrentlyStats stats;
+            options.stats = &stats;
+
+            const Point2int32 lo2(3, 4), hi2(40, 57);
+            std::vector<std::atomic<int>> count2((hi2.x - lo2.x) * (hi2.y - lo2.y));
+            for (std::atomic<int>& c : count2) { c = 0; }
+            runConcurrently(lo2, hi2, [&](Point2int32 P) {
+                ++count2[(P.y - lo2.y) * (hi2.x - lo2.x) + P.x - lo2.x];
+            }, options);
+            for (const std::atomic<int>& c : count2) { testAssert(c == 1); }
+            testAssert(stats.numElements == int(count2.size()));
+            testAssert((stats.numThreads >= 1) && (stats.maxTilesPerThread <= stats.numTiles));
+
+            const Point3int32 lo3(-1, 0, 2), hi3(6, 9, 13);
+            std::vector<std::atomic<int>> count3((hi3.x - lo3.x) * (hi3.y - lo3.y) * (hi3.z - lo3.z));
+            for (std::atomic<int>& c : count3) { c = 0; }
+            runConcurrently(lo3, hi3, [&](Point3int32 P) {
+                ++count3[((P.z - lo3.z) * (hi3.y - lo3.y) + P.y - lo3.y) * (hi3.x - lo3.x) + P.x - lo3.x];
+            }, options);
+            for (const std::atomic<int>& c : count3) { testAssert(c == 1); }
+
+            std::vector<std::atomic<int>> count1(1000);
+            for (std::atomic<int>& c : count1) { c = 0; }
+            runConcurrently(5, 1005, [&](int i) { ++count1[i - 5]; }, options);
+            for (const std::atomic<int>& c : count1) { testAssert(c == 1); }
+        }
+    }
+
+    // Empty domains
+    int n = 0;
+    runConcurrently(3, 3, [&](int i) { ++n; });
+    runConcurrently(Point2int32(0, 0), Point2int32(0, 5), [&](Point2int32 P) { ++n; });
+    testAssert(n == 0);
+
+    // The std::function overloads share the implementation
+    std::atomic<int> sum(0);
+    const std::function<void (int)> f = [&](int i) { sum += i; };
+    runConcurrently(0, 100, f);
+    testAssert(sum == 4950);
+}
+
+
+/** Exercises the System::malloc thread caches, including buffers freed by a different thread than allocated them */
+static void testConcurrentMalloc() {
+    const int numThreads = 4;
+    const int numBuffers = 2000;
+    Array<uint8*> buffer;
+    buffer.resize(numThreads * numBuffers);
+    Array<size_t> size;
+    size.resize(buffer.size());
+
+    runConcurrently(0, numThreads, [&](int t) {
+        for (int i = t * numBuffers; i < (t + 1) * numBuffers; ++i) {
+            // Cycle through the tiny, small, medium, and heap size classes
+            size[i] = size_t(1) << (4 + (i % 11));
+            buffer[i] = (uint8*)System::malloc(size[i]);
+            System::memset(buffer[i], uint8(i), size[i]);
+        }
+    }, false);
+
+    // Each thread frees buffers that a different thread allocated
+    runConcurrently(0, numThreads, [&](int t) {
+        const int owner = (t + 1) % numThreads;
+        for (int i = owner * numBuffers; i < (owner + 1) * numBuffers; ++i) {
+            for (size_t b = 0; b < size[i]; b += 7) {
+                testAssertM(buffer[i][b] == uint8(i), "System::malloc returned overlapping buffers");
+            }
+            System::free(buffer[i]);
+        }
+    }, false);
+}
+
+
 void testThread() {
 
     printf("G3D::Spinlock ");
@@ -60,5 +183,18 @@ void testThread() {
     }
 
     printf("passed\n");
+
+    printf("G3D::TaskGraph ");
+    testTaskGraph(true);
+    testTaskGraph(false);
+    printf("passed\n");
+
+    printf("G3D::runConcurrently ");
+    testRunConcurrently();
+    printf("passed\n");
+
+    printf("G3D::System::malloc (concurrent) ");
+    testConcurrentMalloc();
+    printf("passed\n");
 }
 
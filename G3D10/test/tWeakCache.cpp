@@ -26,7 +26,44 @@ public:
 int CacheTest::count = 0;
 typedef shared_ptr<CacheTest> CacheTestRef;
 
+/** Many threads inserting, reading, and releasing overlapping keys */
+static void testConcurrent() {
+    WeakCache<int, shared_ptr<int>> cache;
+    const int N = 2000;
+    Array<shared_ptr<int>> keep;
+    keep.resize(N);
+
+    runConcurrently(0, N, [&](int i) {
+        const int key = i % 100;
+        shared_ptr<int> value = cache[key];
+        if (isNull(value)) {
+            value = std::make_shared<int>(key);
+            cache.set(key, value);
+        }
+        testAssert(*value == key);
+
+        // Keep every other value alive so that some entries are collected
+        if (i % 2 == 0) {
+            keep[i] = value;
+        }
+
+        Array<shared_ptr<int>> values;
+        cache.getValues(values);
+        for (const shared_ptr<int>& v : values) {
+            testAssert((*v >= 0) && (*v < 100));
+        }
+    });
+
+    for (int i = 0; i < 100; i += 2) {
+        const shared_ptr<int>& value = cache[i];
+        testAssert(isNull(value) || (*value == i));
+    }
+}
+
+
 void testWeakCache() {
+    testConcurrent();
+
     WeakCache<String, CacheTestRef> cache;
 
     testAssert(CacheTest::count == 0);
@@ -0,0 +1,168 @@
+/**
+  \file test/tWelder.cpp
+
+  G3D Innovation Engine http://casual-effects.com/g3d
+  Copyright 2000-2019, Morgan McGuire
+  All rights reserved
+  Available under the BSD License
+*/
+#include "G3D/G3D.h"
+#include "testassert.h"
+#include "printhelpers.h"
+
+/** Appends an unindexed n x n grid of quads in the XY plane, facing +Z. Each
+    position is offset by up to \a jitter. */
+static void makeGrid(int n, float jitter, Array<Vector3>& vertexArray, Array<int>& indexArray) {
+    Random rnd(1234, false);
+    const auto& corner = [&](int x, int y) {
+        return Vector3(float(x) + rnd.uniform(-jitter, jitter), float(y) + rnd.uniform(-jitter, jitter), 0.0f);
+    };
+
+    for (int y = 0; y < n; ++y) {
+        for (int x = 0; x < n; ++x) {
+            vertexArray.append(corner(x, y), corner(x + 1, y), corner(x + 1, y + 1));
+            vertexArray.append(corner(x, y), corner(x + 1, y + 1), corner(x, y + 1));
+        }
+    }
+
+    for (int i = indexArray.size(); i < vertexArray.size(); ++i) {
+        indexArray.append(i);
+    }
+}
+
+
+static void testGrid(float jitter, float vertexWeldRadius) {
+    const int N = 40;
+    Array<Vector3> vertexArray;
+    Array<Vector2> texCoordArray;
+    Array<Vector3> normalArray;
+    Array<int>     indexArray;
+    makeGrid(N, jitter, vertexArray, indexArray);
+
+    Welder::Settings settings;
+    settings.vertexWeldRadius = vertexWeldRadius;
+    Welder::weld(vertexArray, texCoordArray, normalArray, indexArray, settings);
+
+    testAssert(vertexArray.size() == square(N + 1));
+    testAssert(normalArray.size() == vertexArray.size());
+    testAssert(texCoordArray.size() == 0);
+    testAssert(indexArray.size() == 6 * square(N));
+    for (int i = 0; i < normalArray.size(); ++i) {
+        testAssert(normalArray[i].fuzzyEq(Vector3::unitZ()));
+    }
+
+    // Triangles keep their orientation
+    for (int i = 0; i < indexArray.size(); i += 3) {
+        const Vector3& a = vertexArray[indexArray[i]];
+        const Vector3& b = vertexArray[indexArray[i + 1]];
+        const Vector3& c = vertexArray[indexArray[i + 2]];
+        testAssert((b - a).cross(c - a).z > 0);
+    }
+}
+
+
+/** Two meshes that share an edge at a right angle */
+static void testHardEdge() {
+    for (const bool smooth : {false, true}) {
+        Array<Vector3> vertexArray;
+        Array<Vector2> texCoordArray;
+        Array<Vector3> normalArray;
+        Array<int>     floor;
+        Array<int>     wall;
+
+        // Facing +Y
+        vertexArray.append(Vector3(0, 0, 0), Vector3(1, 0, 0), Vector3(1, 0, -1));
+        vertexArray.append(Vector3(0, 0, 0), Vector3(1, 0, -1), Vector3(0, 0, -1));
+        floor.append(0, 1, 2, 3, 4, 5);
+
+        // Facing +Z
+        vertexArray.append(Vector3(0, 0, 0), Vector3(1, 1, 0), Vector3(0, 1, 0));
+        vertexArray.append(Vector3(0, 0, 0), Vector3(1, 0, 0), Vector3(1, 1, 0));
+        wall.append(6, 7, 8, 9, 10, 11);
+
+        Array<Array<int>*> indexArrayArray;
+        indexArrayArray.append(&floor, &wall);
+        Welder::weld(vertexArray, texCoordArray, normalArray, indexArrayArray, Welder::Settings(toRadians(smooth ? 100.0f : 70.0f)));
+
+        if (smooth) {
+            // The shared edge is welded and its normals averaged
+            testAssert(vertexArray.size() == 6);
+            for (int i = 0; i < vertexArray.size(); ++i) {
+                if (vertexArray[i].y == 0 && vertexArray[i].z == 0) {
+                    testAssert((normalArray[i].y > 0.1f) && (normalArray[i].z > 0.1f));
+                }
+            }
+        } else {
+            // Each quad has its own four vertices
+            testAssert(vertexArray.size() == 8);
+            for (int i = 0; i < floor.size(); ++i) {
+                testAssert(normalArray[floor[i]].fuzzyEq(Vector3::unitY()));
+                testAssert(normalArray[wall[i]].fuzzyEq(Vector3::unitZ()));
+            }
+        }
+    }
+}
+
+
+static void testDeterministic() {
+    Array<Vector3> vertexArray[2];
+    Array<Vector2> texCoordArray[2];
+    Array<Vector3> normalArray[2];
+    Array<int>     indexArray[2];
+
+    for (int trial = 0; trial < 2; ++trial) {
+        makeGrid(60, 0.0002f, vertexArray[trial], indexArray[trial]);
+        texCoordArray[trial].resize(vertexArray[trial].size());
+        for (int i = 0; i < vertexArray[trial].size(); ++i) {
+            texCoordArray[trial][i] = vertexArray[trial][i].xy() * 0.25f;
+        }
+        Welder::weld(vertexArray[trial], texCoordArray[trial], normalArray[trial], indexArray[trial], Welder::Settings());
+    }
+
+    testAssert(vertexArray[0].size() == vertexArray[1].size());
+    testAssert(indexArray[0].size() == indexArray[1].size());
+    testAssert(memcmp(vertexArray[0].getCArray(), vertexArray[1].getCArray(), sizeof(Vector3) * vertexArray[0].size()) == 0);
+    testAssert(memcmp(normalArray[0].getCArray(), normalArray[1].getCArray(), sizeof(Vector3) * normalArray[0].size()) == 0);
+    testAssert(memcmp(texCoordArray[0].getCArray(), texCoordArray[1].getCArray(), sizeof(Vector2) * texCoordArray[0].size()) == 0);
+    testAssert(memcmp(indexArray[0].getCArray(), indexArray[1].getCArray(), sizeof(int) * indexArray[0].size()) == 0);
+}
+
+
+void testWelder() {
+    printf("Welder ");
+    // Exact positions, with and without a radius
+    testGrid(0.0f, 0.0f);
+    testGrid(0.0f, 0.001f);
+    // Positions that only match within the radius
+    testGrid(0.0002f, 0.001f);
+    testHardEdge();
+    testDeterministic();
+    printf("passed\n");
+}
+
+
+void perfWelder() {
+    PRINT_SECTION("Welder", "Time to weld an unindexed grid");
+
+    const int N = 400;
+    PRINT_HEADER(format("%d tris", 2 * square(N)).c_str());
+    PRINT_TEXT("", "weld");
+
+    for (const float radius : {0.0f, 0.001f}) {
+        Array<Vector3> vertexArray;
+        Array<Vector2> texCoordArray;
+        Array<Vector3> normalArray;
+        Array<int>     indexArray;
+        makeGrid(N, 0.0f, vertexArray, indexArray);
+
+        Welder::Settings settings;
+        settings.vertexWeldRadius = radius;
+
+        Stopwatch stopwatch;
+        stopwatch.tick();
+        Welder::weld(vertexArray, texCoordArray, normalArray, indexArray, settings);
+        stopwatch.tock();
+
+        PRINT_MILLI((radius == 0.0f) ? "exact" : "radius", "(ms)", stopwatch.elapsedDuration());
+    }
+}
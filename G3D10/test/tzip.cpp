@@ -24,6 +24,100 @@ static bool zipfileExistsTest(const String& filename) {
 }
 
 
+static void testZipArchive() {
+    const shared_ptr<ZipArchive>& archive = ZipArchive::open("apiTest.zip");
+    testAssert(notNull(archive));
+    testAssert(ZipArchive::open("apiTest.zip") == archive);
+    testAssert(isNull(ZipArchive::open("Grawk.zip")));
+
+    // Lookup is case-insensitive
+    const ZipArchive::Entry* entry = archive->find("test.TXT");
+    testAssert(notNull(entry) && (entry->name == "Test.txt"));
+    testAssert(entry->size == 69);
+    testAssert(isNull(archive->find("Grawk.txt")));
+
+    // The entry is compressed, so it is only readable through libzip
+    testAssert(isNull(archive->storedData(*entry)));
+
+    const String& expected = readWholeFile("TestDir/Test.txt");
+    Array<String> result;
+    result.resize(16);
+    runConcurrently(0, result.size(), [&](int i) {
+        Array<char> buffer;
+        buffer.resize(int(entry->size));
+        archive->read(*entry, buffer.getCArray());
+        result[i] = String(buffer.getCArray(), buffer.size());
+    });
+    for (const String& s : result) {
+        testAssert(s == expected);
+    }
+
+    // inZipfile() requires a directory before the zipfile
+    BinaryInput b(FilePath::concat(FileSystem::currentDirectory(), "apiTest.zip/Test.txt"), G3D_LITTLE_ENDIAN, MemoryMappedFile::SEQUENTIAL);
+    testAssert(b.readString(int(b.size())) == expected);
+}
+
+
+/** ZipTest/storedTest.zip holds Stored.txt and Folder/Pattern.bin without compression
+    and Deflated.txt with it */
+static void testStoredEntries() {
+    const String& zipfile = "ZipTest/storedTest.zip";
+    const shared_ptr<ZipArchive>& archive = ZipArchive::open(zipfile);
+    testAssert(notNull(archive));
+
+    const String& text = readWholeFile("TestDir/Test.txt");
+    Array<uint8> pattern;
+    pattern.resize(3001);
+    for (int i = 0; i < pattern.size(); ++i) {
+        pattern[i] = uint8(i * 7 + 3);
+    }
+
+    const ZipArchive::Entry* storedText = archive->find("Stored.txt");
+    testAssert(notNull(storedText) && (storedText->size == 69));
+    testAssert(storedText->storedOffset >= 0);
+    testAssert(notNull(archive->storedData(*storedText)));
+    testAssert(memcmp(archive->storedData(*storedText), text.c_str(), text.size()) == 0);
+
+    const ZipArchive::Entry* storedPattern = archive->find("Folder/Pattern.bin");
+    testAssert(notNull(storedPattern) && (storedPattern->size == pattern.size()));
+    testAssert(notNull(archive->storedData(*storedPattern)));
+    testAssert(memcmp(archive->storedData(*storedPattern), pattern.getCArray(), pattern.size()) == 0);
+
+    const ZipArchive::Entry* deflated = archive->find("Deflated.txt");
+    testAssert(notNull(deflated) && (deflated->storedOffset == -1));
+    testAssert(isNull(archive->storedData(*deflated)));
+
+    // read() copies stored entries straight from the mapping
+    {
+        Array<uint8> buffer;
+        buffer.resize(int(storedPattern->size));
+        archive->read(*storedPattern, buffer.getCArray());
+        testAssert(memcmp(buffer.getCArray(), pattern.getCArray(), pattern.size()) == 0);
+    }
+
+    // BinaryInput reads stored entries in place and falls back to decompressing the rest
+    {
+        BinaryInput b(FilePath::concat(zipfile, "Stored.txt"), G3D_LITTLE_ENDIAN, MemoryMappedFile::SEQUENTIAL);
+        testAssert(b.memoryMapped());
+        testAssert(b.getCArray() == archive->storedData(*storedText));
+        testAssert(b.readString(int(b.size())) == text);
+    }
+    {
+        BinaryInput b(FilePath::concat(zipfile, "Folder/Pattern.bin"), G3D_LITTLE_ENDIAN, MemoryMappedFile::RANDOM);
+        testAssert(b.memoryMapped());
+        testAssert(b.size() == pattern.size());
+        testAssert(memcmp(b.getCArray(), pattern.getCArray(), pattern.size()) == 0);
+        b.setPosition(1000);
+        testAssert(b.readUInt8() == pattern[1000]);
+    }
+    {
+        BinaryInput b(FilePath::concat(zipfile, "Deflated.txt"), G3D_LITTLE_ENDIAN, MemoryMappedFile::SEQUENTIAL);
+        testAssert(! b.memoryMapped());
+        testAssert(b.readString(int(b.size())) == text);
+    }
+}
+
+
 void testZip() {
 	
 	printf("zip API ");
@@ -123,6 +217,8 @@ void testZip() {
 	}
 	testAssertM(zipLength, "Zip fileLength failed.");
 
+	testZipArchive();
+	testStoredEntries();
 
 	printf("passed\n");
 }